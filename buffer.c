@@ -302,6 +302,71 @@ buf_write_string_file (const struct buffer *buf, const char *filename, int fd)
  * Garbage collection
  */
 
+#ifdef GC_CHUNKED
+
+/* alignment of allocations carved out of a chunk */
+#define GC_CHUNK_ALIGN 8
+#define GC_CHUNK_ROUND(n) (((n) + GC_CHUNK_ALIGN - 1) & ~((size_t)GC_CHUNK_ALIGN - 1))
+
+/* released chunks kept for reuse */
+static struct gc_chunk *gc_chunk_free_list; /* GLOBAL */
+static int gc_chunk_n_free;                 /* GLOBAL */
+
+static struct gc_chunk *
+gc_chunk_new (struct gc_arena *a)
+{
+  struct gc_chunk *c = gc_chunk_free_list;
+  if (c)
+    {
+      gc_chunk_free_list = c->next;
+      --gc_chunk_n_free;
+    }
+  else
+    {
+      c = (struct gc_chunk *) malloc (GC_CHUNK_SIZE);
+      check_malloc_return (c);
+      c->end = (uint8_t *) c + GC_CHUNK_SIZE;
+    }
+  c->ptr = (uint8_t *) c + GC_CHUNK_ROUND (sizeof (struct gc_chunk));
+  c->next = a->chunk;
+  a->chunk = c;
+  return c;
+}
+
+static void
+gc_chunk_release (struct gc_chunk *c)
+{
+  while (c != NULL)
+    {
+      struct gc_chunk *next = c->next;
+      if (gc_chunk_n_free < GC_CHUNK_FREE_MAX)
+	{
+	  c->next = gc_chunk_free_list;
+	  gc_chunk_free_list = c;
+	  ++gc_chunk_n_free;
+	}
+      else
+	free (c);
+      c = next;
+    }
+}
+
+static inline void *
+gc_chunk_alloc (struct gc_arena *a, size_t size)
+{
+  struct gc_chunk *c = a->chunk;
+  void *ret;
+
+  size = GC_CHUNK_ROUND (size);
+  if (!c || (size_t)(c->end - c->ptr) < size)
+    c = gc_chunk_new (a);
+  ret = c->ptr;
+  c->ptr += size;
+  return ret;
+}
+
+#endif
+
 void *
 #ifdef DMALLOC
 gc_malloc_debug (size_t size, bool clear, struct gc_arena *a, const char *file, int line)
@@ -310,6 +375,13 @@ gc_malloc (size_t size, bool clear, struct gc_arena *a)
 #endif
 {
   void *ret;
+#ifdef GC_CHUNKED
+  if (a && a->chunked && size <= GC_CHUNK_MAX_ALLOC)
+    {
+      ret = gc_chunk_alloc (a, size);
+    }
+  else
+#endif
   if (a)
     {
       struct gc_entry *e;
@@ -352,6 +424,11 @@ x_gc_free (struct gc_arena *a)
       free (e);
       e = next;
     }
+
+#ifdef GC_CHUNKED
+  gc_chunk_release (a->chunk);
+#endif
+  a->chunk = NULL;
 }
 
 /*
@@ -371,6 +448,15 @@ gc_transfer (struct gc_arena *dest, struct gc_arena *src)
 	  dest->list = src->list;
 	  src->list = NULL;
 	}
+      if (src->chunk)
+	{
+	  struct gc_chunk *c = src->chunk;
+	  while (c->next != NULL)
+	    c = c->next;
+	  c->next = dest->chunk;
+	  dest->chunk = src->chunk;
+	  src->chunk = NULL;
+	}
     }
 }
 
@@ -898,6 +984,196 @@ valign4 (const struct buffer *buf, const char *file, const int line)
  * struct buffer_list
  */
 
+/*
+ * struct buffer_pool
+ */
+
+void
+buffer_pool_init (struct buffer_pool *pool, int buf_size, int max_free, int limit)
+{
+  CLEAR (*pool);
+  ASSERT (buf_size >= (int) sizeof (uint8_t *));
+  if (!buf_size_valid (buf_size))
+    buf_size_error (buf_size);
+  pool->buf_size = buf_size;
+  pool->max_free = max_free;
+  pool->limit = limit;
+}
+
+/*
+ * Allocate buffer memory aligned to pool->align where the
+ * platform supports it.  Released with free().
+ */
+static uint8_t *
+buffer_pool_alloc (const struct buffer_pool *pool, size_t size)
+{
+  void *p;
+
+#ifdef HAVE_POSIX_MEMALIGN
+  if (pool->align)
+    {
+      if (posix_memalign (&p, pool->align, size))
+	p = NULL;
+      check_malloc_return (p);
+      return (uint8_t *) p;
+    }
+#endif
+  p = malloc (size);
+  check_malloc_return (p);
+  return (uint8_t *) p;
+}
+
+static inline bool
+buffer_pool_in_slab (const struct buffer_pool *pool, const uint8_t *data)
+{
+  return pool->slab && data >= pool->slab && data < pool->slab + pool->slab_size;
+}
+
+void
+buffer_pool_free (struct buffer_pool *pool)
+{
+  while (pool->free_list)
+    {
+      uint8_t *next;
+      memcpy (&next, pool->free_list, sizeof (next));
+      if (!buffer_pool_in_slab (pool, pool->free_list))
+	free (pool->free_list);
+      pool->free_list = next;
+    }
+  pool->n_free = 0;
+
+  if (pool->slab)
+    {
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+      munmap (pool->slab, pool->slab_size);
+#else
+      free (pool->slab);
+#endif
+      pool->slab = NULL;
+      pool->slab_size = 0;
+    }
+}
+
+void
+buffer_pool_resize (struct buffer_pool *pool, int buf_size)
+{
+  ASSERT (!pool->slab);
+  if (pool->buf_size != buf_size)
+    {
+      if (!buf_size_valid (buf_size))
+	buf_size_error (buf_size);
+      buffer_pool_free (pool);
+      pool->buf_size = buf_size;
+    }
+}
+
+int
+buffer_pool_prealloc (struct buffer_pool *pool, int n, bool hugepages)
+{
+  size_t size = (size_t) n * (size_t) pool->buf_size;
+  uint8_t *slab = NULL;
+  int i;
+
+  ASSERT (n > 0 && !pool->slab);
+
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+  if (hugepages)
+    {
+#ifdef MAP_HUGETLB
+      const size_t hsize = (size + BUFFER_POOL_HUGEPAGE_SIZE - 1) & ~((size_t)BUFFER_POOL_HUGEPAGE_SIZE - 1);
+      void *p = mmap (NULL, hsize, PROT_READ|PROT_WRITE,
+		      MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED)
+	{
+	  slab = (uint8_t *) p;
+	  size = hsize;
+	}
+      else
+	msg (M_WARN|M_ERRNO, "Note: cannot map %u bytes of huge pages for buffer pool, using normal pages",
+	     (unsigned int) hsize);
+#else
+      msg (M_WARN, "Note: huge pages are not supported on this platform");
+#endif
+    }
+  if (!slab)
+    {
+      void *p = mmap (NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+	msg (M_ERR, "Cannot map %u bytes for buffer pool", (unsigned int) size);
+      slab = (uint8_t *) p;
+    }
+#else
+  if (hugepages)
+    msg (M_WARN, "Note: huge pages are not supported on this platform");
+  slab = buffer_pool_alloc (pool, size);
+#endif
+
+  pool->slab = slab;
+  pool->slab_size = size;
+  n = (int) (size / pool->buf_size);
+  for (i = n - 1; i >= 0; --i)
+    {
+      uint8_t *data = slab + (size_t) i * (size_t) pool->buf_size;
+      memcpy (data, &pool->free_list, sizeof (pool->free_list));
+      pool->free_list = data;
+      ++pool->n_free;
+    }
+  return n;
+}
+
+struct buffer
+buffer_pool_get (struct buffer_pool *pool)
+{
+  struct buffer buf;
+
+  CLEAR (buf);
+  if (pool->limit && pool->n_out >= pool->limit)
+    {
+      ++pool->n_exhausted;
+      return buf;
+    }
+  if (pool->free_list)
+    {
+      buf.data = pool->free_list;
+      memcpy (&pool->free_list, buf.data, sizeof (pool->free_list));
+      --pool->n_free;
+    }
+  else
+    buf.data = buffer_pool_alloc (pool, pool->buf_size);
+  buf.capacity = pool->buf_size;
+  *buf.data = 0;
+
+  if (++pool->n_out > pool->max_out)
+    pool->max_out = pool->n_out;
+  return buf;
+}
+
+void
+buffer_pool_put (struct buffer_pool *pool, struct buffer *buf)
+{
+  if (buf->data)
+    {
+      ASSERT (pool->n_out > 0);
+      --pool->n_out;
+      if (buf->capacity != pool->buf_size)
+	{
+	  /* handed out before buffer_pool_resize */
+	  ASSERT (!buffer_pool_in_slab (pool, buf->data));
+	  free (buf->data);
+	}
+      else if (!pool->max_free || pool->n_free < pool->max_free
+	       || buffer_pool_in_slab (pool, buf->data))
+	{
+	  memcpy (buf->data, &pool->free_list, sizeof (pool->free_list));
+	  pool->free_list = buf->data;
+	  ++pool->n_free;
+	}
+      else
+	free (buf->data);
+    }
+  CLEAR (*buf);
+}
+
 #ifdef ENABLE_BUFFER_LIST
 
 struct buffer_list *
@@ -91,6 +91,36 @@ struct gc_entry
 };
 
 
+/*
+ * Chunked gc_arena tuning.  Under DMALLOC every allocation stays
+ * individually tracked so that the debug hooks see its origin.
+ */
+#ifndef DMALLOC
+#define GC_CHUNKED
+#endif
+#define GC_CHUNK_SIZE      4096  /* bytes per chunk, including header */
+#define GC_CHUNK_MAX_ALLOC 1024  /* larger requests are malloced individually */
+#define GC_CHUNK_FREE_MAX  64    /* max chunks kept for reuse */
+
+/**
+ * Block of memory from which a chunked \c gc_arena carves out its small
+ * allocations.
+ *
+ * Allocating from a chunk only advances \c ptr, and the whole chunk is
+ * released at once when the arena is freed.  Released chunks are kept on
+ * a free list for reuse by the next arena, so that short-lived arenas
+ * normally don't call \c malloc() or \c free() at all.  The usable
+ * memory follows this header.
+ */
+struct gc_chunk
+{
+  struct gc_chunk *next;        /**< Next chunk owned by the same arena,
+                                 *   or the next free chunk. */
+  uint8_t *ptr;                 /**< Start of the unused memory. */
+  uint8_t *end;                 /**< End of the chunk. */
+};
+
+
 /**
  * Garbage collection arena used to keep track of dynamically allocated
  * memory.
@@ -100,11 +130,24 @@ struct gc_entry
  * allocation is registered in the function's \c gc_arena argument.  All
  * the dynamically allocated memory registered in a \c gc_arena can be
  * freed using the \c gc_free() function.
+ *
+ * Arenas created with \c gc_new() or \c gc_init() are chunked: requests
+ * of up to \c GC_CHUNK_MAX_ALLOC bytes are served from \c gc_chunk
+ * blocks and only larger ones are tracked as \c gc_entry items.  Arenas
+ * which live as long as a client instance should be created with \c
+ * gc_new_unchunked() or \c gc_init_unchunked() instead, so that each of
+ * them does not hold on to a partially used chunk.
  */
 struct gc_arena
 {
   struct gc_entry *list;        /**< First element of the linked list of
                                  *   \c gc_entry structures. */
+  struct gc_chunk *chunk;       /**< Chunk currently used for small
+                                 *   allocations, followed by the chunks
+                                 *   already filled up. */
+  bool chunked;                 /**< Whether small allocations are carved
+                                 *   out of chunks rather than being
+                                 *   allocated individually. */
 };
 
 
@@ -770,33 +813,55 @@ void x_gc_free (struct gc_arena *a);
 static inline bool
 gc_defined (struct gc_arena *a)
 {
-  return a->list != NULL;
+  return a->list != NULL || a->chunk != NULL;
 }
 
 static inline void
 gc_init (struct gc_arena *a)
 {
   a->list = NULL;
+  a->chunk = NULL;
+  a->chunked = true;
 }
 
 static inline void
-gc_detach (struct gc_arena *a)
+gc_init_unchunked (struct gc_arena *a)
 {
   gc_init (a);
+  a->chunked = false;
+}
+
+/*
+ * Forget the allocations of an arena whose contents were copied
+ * elsewhere, keeping its allocation mode.
+ */
+static inline void
+gc_detach (struct gc_arena *a)
+{
+  a->list = NULL;
+  a->chunk = NULL;
 }
 
 static inline struct gc_arena
 gc_new (void)
 {
   struct gc_arena ret;
-  ret.list = NULL;
+  gc_init (&ret);
+  return ret;
+}
+
+static inline struct gc_arena
+gc_new_unchunked (void)
+{
+  struct gc_arena ret;
+  gc_init_unchunked (&ret);
   return ret;
 }
 
 static inline void
 gc_free (struct gc_arena *a)
 {
-  if (a->list)
+  if (a->list || a->chunk)
     x_gc_free (a);
 }
 
@@ -867,6 +932,62 @@ check_malloc_return (void *p)
     out_of_memory ();
 }
 
+/*
+ * A pool of recycled buffers of identical capacity.  Buffers which are
+ * only needed intermittently by a large number of objects can be
+ * borrowed from a pool while in use and returned to it afterwards,
+ * rather than staying allocated for the lifetime of each object.
+ */
+
+struct buffer_pool
+{
+  int buf_size;              /* capacity of pooled buffers */
+  int max_free;              /* maximum length of the free list, 0 for unlimited */
+  int limit;                 /* maximum number of buffers handed out, 0 for unlimited */
+  int n_free;                /* current length of the free list */
+  int n_out;                 /* number of buffers currently handed out */
+  int max_out;               /* high-water mark of n_out */
+  unsigned int n_exhausted;  /* number of requests refused because of limit */
+  int align;                 /* alignment of buffers allocated on demand, 0 for malloc's */
+  uint8_t *free_list;        /* free buffers, linked through their first bytes */
+  uint8_t *slab;             /* preallocated buffers, or NULL */
+  size_t slab_size;          /* size of slab in bytes */
+};
+
+/* assumed huge page size when backing a slab with huge pages */
+#define BUFFER_POOL_HUGEPAGE_SIZE (2*1024*1024)
+
+void buffer_pool_init (struct buffer_pool *pool, int buf_size, int max_free, int limit);
+
+/* all buffers of a preallocated pool must have been returned before this call */
+void buffer_pool_free (struct buffer_pool *pool);
+
+/*
+ * Change the capacity of buffers handed out from now on, for a pool
+ * without preallocated buffers.  Buffers of the old capacity which
+ * are still out are freed as they are returned.
+ */
+void buffer_pool_resize (struct buffer_pool *pool, int buf_size);
+
+/*
+ * Preallocate n buffers in one page-aligned slab, optionally backed by
+ * huge pages, and return the number of buffers it holds.  Buffers from
+ * the slab stay on the free list when returned instead of going back to
+ * the heap.
+ */
+int buffer_pool_prealloc (struct buffer_pool *pool, int n, bool hugepages);
+
+/* returns an undefined buffer if the pool limit has been reached */
+struct buffer buffer_pool_get (struct buffer_pool *pool);
+void buffer_pool_put (struct buffer_pool *pool, struct buffer *buf);
+
+/* total number of bytes of buffer memory owned by the pool */
+static inline size_t
+buffer_pool_size (const struct buffer_pool *pool)
+{
+  return (size_t) (pool->n_free + pool->n_out) * (size_t) pool->buf_size;
+}
+
 /*
  * Manage lists of buffers
  */
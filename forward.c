@@ -737,6 +737,7 @@ process_incoming_link (struct context *c)
   if (c->c2.buf.len > 0)
     {
       c->c2.link_read_bytes += c->c2.buf.len;
+      ++c->c2.link_read_packets;
       link_read_bytes_global += c->c2.buf.len;
       c->c2.original_recv_size = c->c2.buf.len;
 #ifdef ENABLE_MANAGEMENT
@@ -819,6 +820,8 @@ process_incoming_link (struct context *c)
 
       /* authenticate and decrypt the incoming packet */
       decrypt_status = openvpn_decrypt (&c->c2.buf, c->c2.buffers->decrypt_buf, &c->c2.crypto_options, &c->c2.frame);
+      if (!decrypt_status)
+	++c->c2.link_read_drops;
 
       if (!decrypt_status && link_socket_connection_oriented (c->c2.link_socket))
 	{
@@ -1136,6 +1139,7 @@ process_outgoing_link (struct context *c)
 	    {
 	      c->c2.max_send_size_local = max_int (size, c->c2.max_send_size_local);
 	      c->c2.link_write_bytes += size;
+	      ++c->c2.link_write_packets;
 	      link_write_bytes_global += size;
 #ifdef ENABLE_MANAGEMENT
 	      if (management)
@@ -1341,6 +1345,9 @@ io_wait_dowork (struct context *c, const unsigned int flags)
 #ifdef ENABLE_MANAGEMENT
   static int management_shift = 6; /* depends on MANAGEMENT_READ and MANAGEMENT_WRITE */
 #endif
+#ifdef PLUGIN_DEF_AUTH
+  static int plugin_auth_shift = 8; /* depends on PLUGIN_AUTH_READ */
+#endif
 
   /*
    * Decide what kind of events we want to wait for.
@@ -1435,6 +1442,10 @@ io_wait_dowork (struct context *c, const unsigned int flags)
     management_socket_set (management, c->c2.event_set, (void*)&management_shift, NULL);
 #endif
 
+#ifdef PLUGIN_DEF_AUTH
+  plugin_auth_event_set (c->plugins, c->c2.event_set, (void*)&plugin_auth_shift, NULL);
+#endif
+
   /*
    * Possible scenarios:
    *  (1) tcp/udp port has data available to read
@@ -1496,6 +1507,23 @@ io_wait_dowork (struct context *c, const unsigned int flags)
   dmsg (D_EVENT_WAIT, "I/O WAIT status=0x%04x", c->c2.event_set_status);
 }
 
+#ifdef PLUGIN_DEF_AUTH
+/*
+ * Apply deferred auth results which plugins wrote to
+ * the auth completion pipe (point-to-point mode).
+ */
+static void
+process_plugin_auth (struct context *c)
+{
+  struct plugin_auth_completion pac[16];
+  const int n = plugin_auth_read (c->plugins, pac, SIZE (pac));
+  int i;
+
+  for (i = 0; i < n; ++i)
+    tls_authenticate_plugin_key (c->c2.tls_multi, pac[i].handle, pac[i].success);
+}
+#endif
+
 void
 process_io (struct context *c)
 {
@@ -1509,6 +1537,11 @@ process_io (struct context *c)
     }
 #endif
 
+#ifdef PLUGIN_DEF_AUTH
+  if (status & PLUGIN_AUTH_READ)
+    process_plugin_auth (c);
+#endif
+
   /* TCP/UDP port ready to accept write */
   if (status & SOCKET_WRITE)
     {
@@ -33,20 +33,81 @@
 
 #define FRAG_ERR(s) { errmsg = s; goto error; }
 
+/*
+ * Reassembly and outgoing fragment buffers are only needed while
+ * fragmented packets are actually flowing, which most peers never do.
+ * They are taken on demand from this pool, which is shared by all
+ * fragment_master objects of the process and bounded by
+ * --fragment-buffers, and returned once they have been idle for
+ * FRAG_TTL_SEC.
+ */
+static struct buffer_pool fragment_buf_pool; /* GLOBAL */
+static int fragment_master_count;            /* GLOBAL */
+
+/*
+ * May f take one more reassembly buffer?  Each fragment_master gets
+ * an equal share of the pool for reassembly, and reassembly leaves a
+ * reserve of the pool, one outgoing/outgoing_return pair per
+ * fragment_master up to an eighth of the pool, to outgoing packets.
+ */
+static bool
+fragment_reassembly_allowed (const struct fragment_master *f)
+{
+  const int limit = fragment_buf_pool.limit;
+  int quota, reserve;
+
+  if (!limit)
+    return true;
+  quota = max_int (FRAG_MIN_REASSEMBLY_BUFS, limit / max_int (fragment_master_count, 1));
+  reserve = min_int (limit / 8, 2 * fragment_master_count);
+  return f->n_reassembly_bufs < quota
+    && fragment_buf_pool.n_out < limit - reserve;
+}
+
+static bool
+fragment_get_buf (struct fragment_master *f, struct buffer *buf, const bool reassembly)
+{
+  if (!buf->data)
+    {
+      if (reassembly && !fragment_reassembly_allowed (f))
+	return false;
+      *buf = buffer_pool_get (&fragment_buf_pool);
+      if (!buf->data)
+	return false;
+      ++f->n_bufs;
+      if (reassembly)
+	++f->n_reassembly_bufs;
+    }
+  return true;
+}
+
 static void
-fragment_list_buf_init (struct fragment_list *list, const struct frame *frame)
+fragment_put_buf (struct fragment_master *f, struct buffer *buf, const bool reassembly)
 {
-  int i;
-  for (i = 0; i < N_FRAG_BUF; ++i)
-    list->fragments[i].buf = alloc_buf (BUF_SIZE (frame));
+  if (buf->data)
+    {
+      buffer_pool_put (&fragment_buf_pool, buf);
+      --f->n_bufs;
+      if (reassembly)
+	--f->n_reassembly_bufs;
+    }
 }
 
 static void
-fragment_list_buf_free (struct fragment_list *list)
+fragment_release_idle_buffers (struct fragment_master *f)
 {
   int i;
   for (i = 0; i < N_FRAG_BUF; ++i)
-    free_buf (&list->fragments[i].buf);
+    {
+      struct fragment *frag = &f->incoming.fragments[i];
+      if (!frag->defined && frag->timestamp + FRAG_TTL_SEC <= now)
+	fragment_put_buf (f, &frag->buf, true);
+    }
+  if (!fragment_outgoing_defined (f) && f->outgoing_timestamp + FRAG_TTL_SEC <= now)
+    {
+      fragment_put_buf (f, &f->outgoing, false);
+      fragment_put_buf (f, &f->outgoing_return, false);
+    }
 }
 
 /*
@@ -99,24 +160,56 @@ fragment_init (struct frame *frame)
 
   event_timeout_init (&ret->wakeup, FRAG_WAKEUP_INTERVAL, now);
 
+  ++fragment_master_count;
+
   return ret;
 }
 
 void
 fragment_free (struct fragment_master *f)
 {
-  fragment_list_buf_free (&f->incoming);
-  free_buf (&f->outgoing);
-  free_buf (&f->outgoing_return);
+  int i;
+  for (i = 0; i < N_FRAG_BUF; ++i)
+    fragment_put_buf (f, &f->incoming.fragments[i].buf, true);
+  fragment_put_buf (f, &f->outgoing, false);
+  fragment_put_buf (f, &f->outgoing_return, false);
+  ASSERT (!f->n_bufs && !f->n_reassembly_bufs);
   free (f);
+
+  /* release pooled memory along with the last user */
+  if (!--fragment_master_count)
+    buffer_pool_free (&fragment_buf_pool);
 }
 
 void
-fragment_frame_init (struct fragment_master *f, const struct frame *frame)
+fragment_frame_init (struct fragment_master *f, const struct frame *frame, int max_buffers)
+{
+  const int buf_size = BUF_SIZE (frame);
+
+  if (!fragment_buf_pool.buf_size)
+    buffer_pool_init (&fragment_buf_pool, buf_size, max_buffers, max_buffers);
+  else if (fragment_buf_pool.buf_size < buf_size)
+    {
+      /*
+       * Frame grew.  Only grow, so that buffers fit every frame
+       * still in use; smaller ones still out are freed when returned.
+       */
+      buffer_pool_resize (&fragment_buf_pool, buf_size);
+    }
+  fragment_buf_pool.max_free = fragment_buf_pool.limit = max_buffers;
+}
+
+size_t
+fragment_buffer_size (const struct fragment_master *f)
 {
-  fragment_list_buf_init (&f->incoming, frame);
-  f->outgoing = alloc_buf (BUF_SIZE (frame));
-  f->outgoing_return = alloc_buf (BUF_SIZE (frame));
+  return (size_t) f->n_bufs * fragment_buf_pool.buf_size;
+}
+
+void
+fragment_pool_stats (size_t *in_use, counter_type *drops)
+{
+  *in_use = (size_t) fragment_buf_pool.n_out * fragment_buf_pool.buf_size;
+  *drops = fragment_buf_pool.n_exhausted;
 }
 
 /*
@@ -190,6 +283,15 @@ fragment_incoming (struct fragment_master *f, struct buffer *buf,
 	  if (size & FRAG_SIZE_ROUND_MASK)
 	    FRAG_ERR ("bad fragment size");
 
+	  /* take a reassembly buffer from the pool if we don't hold one yet */
+	  if (!fragment_get_buf (f, &frag->buf, true))
+	    {
+	      dmsg (D_FRAG_DEBUG, "FRAG_IN no reassembly buffer available, dropping fragment");
+	      ++f->n_pool_drops;
+	      frag->defined = false;
+	      goto error;
+	    }
+
 	  /* is this the first fragment for our sequence number? */
 	  if (!frag->defined || (frag->defined && frag->max_frag_size != size))
 	    {
@@ -315,6 +417,13 @@ fragment_outgoing (struct fragment_master *f, struct buffer *buf,
 	  f->outgoing_frag_size = optimal_fragment_size (buf->len, PAYLOAD_SIZE_DYNAMIC(frame));
 	  if (buf->len > f->outgoing_frag_size * MAX_FRAGS)
 	    FRAG_ERR ("too many fragments would be required to send datagram");
+	  if (!fragment_get_buf (f, &f->outgoing, false)
+	      || !fragment_get_buf (f, &f->outgoing_return, false))
+	    {
+	      dmsg (D_FRAG_DEBUG, "FRAG_OUT fragment buffer pool exhausted, dropping packet");
+	      ++f->n_pool_drops;
+	      goto error;
+	    }
 	  ASSERT (buf_init (&f->outgoing, FRAME_HEADROOM (frame)));
 	  ASSERT (buf_copy (&f->outgoing, buf));
 	  f->outgoing_seq_id = modulo_add (f->outgoing_seq_id, 1, N_SEQ_ID);
@@ -360,6 +469,8 @@ fragment_ready_to_send (struct fragment_master *f, struct buffer *buf,
 	  last = true;
 	}
 
+      f->outgoing_timestamp = now;
+
       /* initialize return buffer */
       *buf = f->outgoing_return;
       ASSERT (buf_init (buf, FRAME_HEADROOM (frame)));
@@ -401,6 +512,9 @@ fragment_wakeup (struct fragment_master *f, struct frame *frame)
 {
   /* delete fragments with expired TTLs */
   fragment_ttl_reap (f);
+
+  /* give buffers we haven't needed for a while back to the pool */
+  fragment_release_idle_buffers (f);
 }
 
 #else
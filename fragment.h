@@ -59,6 +59,18 @@
                                 /**< Interval in seconds between calls to
                                  *   wakeup code. */
 
+#define FRAG_POOL_DEFAULT_BUFFERS    1024
+                                /**< Default maximum number of packet
+                                 *   buffers shared by all VPN tunnels for
+                                 *   reassembling and sending fragmented
+                                 *   packets, see \c --fragment-buffers. */
+
+#define FRAG_MIN_REASSEMBLY_BUFS     2
+                                /**< Number of reassembly buffers each VPN
+                                 *   tunnel may always borrow from the
+                                 *   shared pool, however many tunnels
+                                 *   share it. */
+
 /**************************************************************************/
 /**
  * Structure for reassembling one incoming fragmented packet.
@@ -176,10 +188,22 @@ struct fragment_master {
                                 /**< Buffer used by \c
                                  *   fragment_ready_to_send() to return a
                                  *   part to send. */
+  time_t outgoing_timestamp;    /**< When a part was last sent, used to
+                                 *   decide when the outgoing buffers can
+                                 *   be returned to the pool. */
 
   struct fragment_list incoming;
                                 /**< List of structures for reassembling
                                  *   incoming packets. */
+
+  int n_bufs;                   /**< Number of packet buffers currently
+                                 *   borrowed from the shared fragment
+                                 *   buffer pool. */
+  int n_reassembly_bufs;        /**< How many of \c n_bufs are held by
+                                 *   \c incoming for reassembly. */
+  counter_type n_pool_drops;    /**< Number of packets dropped because the
+                                 *   shared fragment buffer pool was
+                                 *   exhausted. */
 };
 
 
@@ -275,15 +299,47 @@ struct fragment_master *fragment_init (struct frame *frame);
 
 
 /**
- * Allocate internal packet buffers for a \c fragment_master structure.
+ * Set up the packet buffers of a \c fragment_master structure.
+ * 
+ * Packet buffers are not allocated up front.  They are borrowed from a
+ * pool shared by all \c fragment_master structures when a fragmented
+ * packet is received or sent, and returned to it after \c FRAG_TTL_SEC
+ * seconds without use.  When the pool is exhausted, the packet is
+ * dropped and counted in \c fragment_master.n_pool_drops.
+ *
+ * So that one peer cannot starve the others by leaving many packets
+ * half reassembled, each \c fragment_master may only hold its share of
+ * the pool (but at least \c FRAG_MIN_REASSEMBLY_BUFS) for reassembly,
+ * and reassembly never takes the part of the pool kept back for
+ * outgoing fragmentation.
  * 
  * @param f            - The \c fragment_master structure for which to
- *                       allocate the internal buffers.
+ *                       set up the internal buffers.
  * @param frame        - The packet geometry parameters for this VPN
  *                       tunnel, used to determine how much memory to
  *                       allocate for each packet buffer.
+ * @param max_buffers  - The maximum number of packet buffers which may
+ *                       be borrowed from the pool by all VPN tunnels
+ *                       together.
+ */
+void fragment_frame_init (struct fragment_master *f, const struct frame *frame, int max_buffers);
+
+/**
+ * Return the number of bytes of packet buffer memory currently borrowed
+ * by a \c fragment_master structure.
+ * 
+ * @param f            - The \c fragment_master structure to inspect.
+ */
+size_t fragment_buffer_size (const struct fragment_master *f);
+
+/**
+ * Report the state of the shared fragment buffer pool.
+ * 
+ * @param in_use       - Set to the number of bytes currently lent out.
+ * @param drops        - Set to the number of buffer requests which were
+ *                       refused because the pool was exhausted.
  */
-void fragment_frame_init (struct fragment_master *f, const struct frame *frame);
+void fragment_pool_stats (size_t *in_use, counter_type *drops);
 
 
 /**
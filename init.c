@@ -746,6 +746,10 @@ uninit_static (void)
   close_port_share ();
 #endif
 
+#if defined(ENABLE_EXECVE) && !defined(WIN32)
+  script_helper_stop ();
+#endif
+
 #if defined(MEASURE_TLS_HANDSHAKE_STATS) && defined(USE_CRYPTO) && defined(USE_SSL)
   show_tls_performance_stats ();
 #endif
@@ -946,6 +950,17 @@ do_uid_gid_chroot (struct context *c, bool no_delay)
 	    msg (M_INFO, "NOTE: setcon %s", why_not);
 	}
 #endif
+
+      /* fork the script helper, now that we run with the
+	 privileges scripts should get */
+      if (no_delay && c->options.script_helper)
+	{
+#if defined(ENABLE_EXECVE) && !defined(WIN32)
+	  script_helper_start (c->options.script_helper);
+#else
+	  msg (M_WARN, "NOTE: --script-helper is not supported on this platform");
+#endif
+	}
     }
 }
 
@@ -2104,6 +2119,7 @@ do_init_crypto_tls (struct context *c, const unsigned int flags)
   to.transition_window = options->transition_window;
   to.handshake_window = options->handshake_window;
   to.packet_timeout = options->tls_timeout;
+  to.reliable_window = options->tls_window;
   to.renegotiate_bytes = options->renegotiate_bytes;
   to.renegotiate_packets = options->renegotiate_packets;
   to.renegotiate_seconds = options->renegotiate_seconds;
@@ -2488,7 +2504,8 @@ do_init_fragment (struct context *c)
   ASSERT (c->options.fragment);
   frame_set_mtu_dynamic (&c->c2.frame_fragment,
 			 c->options.fragment, SET_MTU_UPPER_BOUND);
-  fragment_frame_init (c->c2.fragment, &c->c2.frame_fragment);
+  fragment_frame_init (c->c2.fragment, &c->c2.frame_fragment,
+		       c->options.n_fragment_buf);
 }
 #endif
 
@@ -3082,6 +3099,7 @@ open_management (struct context *c)
 			       c->options.management_user_pass,
 			       c->options.management_client_user,
 			       c->options.management_client_group,
+			       c->options.management_max_clients,
 			       c->options.management_log_history_cache,
 			       c->options.management_echo_buffer_size,
 			       c->options.management_state_buffer_size,
@@ -3168,7 +3186,7 @@ init_instance (struct context *c, const struct env_set *env, const unsigned int
   int link_socket_mode = LS_MODE_DEFAULT;
 
   /* init garbage collection level */
-  gc_init (&c->c2.gc);
+  gc_init_unchunked (&c->c2.gc);
 
   /* signals caught here will abort */
   c->sig->signal_received = 0;
@@ -3474,7 +3492,7 @@ inherit_context_child (struct context *dest,
   /* proto_is_dgram will ASSERT(0) if proto is invalid */
   dest->mode = proto_is_dgram(src->options.ce.proto)? CM_CHILD_UDP : CM_CHILD_TCP;
 
-  dest->gc = gc_new ();
+  dest->gc = gc_new_unchunked ();
 
   ALLOC_OBJ_CLEAR_GC (dest->sig, struct signal_info, &dest->gc);
 
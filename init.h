@@ -31,7 +31,7 @@
  * Baseline maximum number of events
  * to wait for.
  */
-#define BASE_N_EVENTS 4
+#define BASE_N_EVENTS 5
 
 void context_clear (struct context *c);
 void context_clear_1 (struct context *c);
@@ -31,6 +31,27 @@
 
 #include "memdbg.h"
 
+/* key of removed elements, so that probe sequences stay intact */
+static const char hash_deleted_key; /* GLOBAL */
+#define HASH_DELETED ((const void *) &hash_deleted_key)
+
+static inline bool
+hash_element_live (const struct hash_element *he)
+{
+  return he->key != NULL && he->key != HASH_DELETED;
+}
+
+/* bucket array replaced while iterators still point into it */
+struct hash_retired
+{
+  struct hash_bucket *buckets;
+  struct hash_retired *next;
+};
+
+/* secret key of hash_func, shared by all tables */
+static uint64_t hash_secret[2]; /* GLOBAL */
+static bool hash_secret_defined; /* GLOBAL */
+
 struct hash *
 hash_init (const int n_buckets,
 	   const uint32_t iv,
@@ -38,42 +59,236 @@ hash_init (const int n_buckets,
 	   bool (*compare_function)(const void *key1, const void *key2))
 {
   struct hash *h;
-  int i;
 
   ASSERT (n_buckets > 0);
+
+  if (!hash_secret_defined)
+    {
+      int i;
+      for (i = 0; i < 2; ++i)
+	hash_secret[i] = ((uint64_t) get_random () << 32) ^ (uint64_t) get_random ();
+      hash_secret_defined = true;
+    }
+
   ALLOC_OBJ_CLEAR (h, struct hash);
-  h->n_buckets = (int) adjust_power_of_2 (n_buckets);
+  h->n_buckets = (int) adjust_power_of_2 (max_int (n_buckets, 4));
   h->mask = h->n_buckets - 1;
   h->hash_function = hash_function;
   h->compare_function = compare_function;
   h->iv = iv;
-  ALLOC_ARRAY (h->buckets, struct hash_bucket, h->n_buckets);
-  for (i = 0; i < h->n_buckets; ++i)
+  ALLOC_ARRAY_CLEAR (h->buckets, struct hash_bucket, h->n_buckets);
+  return h;
+}
+
+static void
+hash_free_retired (struct hash *hash)
+{
+  while (hash->retired)
     {
-      struct hash_bucket *b = &h->buckets[i];
-      b->list = NULL;
+      struct hash_retired *r = hash->retired;
+      hash->retired = r->next;
+      free (r->buckets);
+      free (r);
     }
-  return h;
 }
 
 void
 hash_free (struct hash *hash)
 {
-  int i;
-  for (i = 0; i < hash->n_buckets; ++i)
+  hash_free_retired (hash);
+  free (hash->buckets);
+  free (hash->old_buckets);
+  free (hash);
+}
+
+static struct hash_element *
+hash_find (struct hash *hash,
+	   struct hash_bucket *buckets,
+	   const int mask,
+	   const void *key,
+	   uint32_t hv)
+{
+  int i = hv & mask;
+
+  while (true)
     {
-      struct hash_bucket *b = &hash->buckets[i];
-      struct hash_element *he = b->list;
+      struct hash_element *he = &buckets[i].elem;
+      if (!he->key)
+	return NULL;
+      if (he->hash_value == hv
+	  && he->key != HASH_DELETED
+	  && (*hash->compare_function)(key, he->key))
+	return he;
+      i = (i + 1) & mask;
+    }
+}
 
-      while (he)
+/*
+ * Return the first empty or deleted bucket on the probe
+ * sequence for hv.
+ */
+static struct hash_element *
+hash_find_free (struct hash *hash, uint32_t hv)
+{
+  int i = hv & hash->mask;
+
+  while (hash_element_live (&hash->buckets[i].elem))
+    i = (i + 1) & hash->mask;
+  return &hash->buckets[i].elem;
+}
+
+/*
+ * Move up to n buckets of old_buckets into buckets.
+ */
+static void
+hash_migrate (struct hash *hash, int n)
+{
+  while (hash->old_buckets && n-- > 0)
+    {
+      struct hash_element *he = &hash->old_buckets[hash->migrate_index].elem;
+      if (hash_element_live (he))
+	{
+	  struct hash_element *dest = hash_find_free (hash, he->hash_value);
+	  if (dest->key == HASH_DELETED)
+	    --hash->n_deleted;
+	  *dest = *he;
+	  he->key = HASH_DELETED;
+	}
+      if (++hash->migrate_index >= hash->old_n_buckets)
 	{
-	  struct hash_element *next = he->next;
-	  free (he);
-	  he = next;
+	  free (hash->old_buckets);
+	  hash->old_buckets = NULL;
+	  hash->old_n_buckets = 0;
+	  hash->migrate_index = 0;
 	}
     }
-  free (hash->buckets);
-  free (hash);
+}
+
+static inline void
+hash_migrate_step (struct hash *hash)
+{
+  if (hash->old_buckets && !hash->n_iterators)
+    hash_migrate (hash, HASH_MIGRATE_STEP);
+}
+
+/*
+ * Copy all elements into a fresh array, leaving buckets and
+ * old_buckets untouched for the active iterators until the
+ * last of them is freed.
+ */
+static void
+hash_rebuild (struct hash *hash)
+{
+  struct hash_bucket *arrays[2];
+  int sizes[2];
+  int i, j;
+
+  arrays[0] = hash->buckets;
+  sizes[0] = hash->n_buckets;
+  arrays[1] = hash->old_buckets;
+  sizes[1] = hash->old_n_buckets;
+
+  hash->n_buckets = (int) adjust_power_of_2 (max_int ((hash->n_elements + 1) * 2, 4));
+  hash->mask = hash->n_buckets - 1;
+  hash->n_deleted = 0;
+  hash->old_buckets = NULL;
+  hash->old_n_buckets = 0;
+  hash->migrate_index = 0;
+  ALLOC_ARRAY_CLEAR (hash->buckets, struct hash_bucket, hash->n_buckets);
+
+  for (i = 0; i < 2; ++i)
+    {
+      struct hash_retired *r;
+
+      for (j = 0; j < sizes[i]; ++j)
+	{
+	  const struct hash_element *he = &arrays[i][j].elem;
+	  if (hash_element_live (he))
+	    *hash_find_free (hash, he->hash_value) = *he;
+	}
+      ALLOC_OBJ (r, struct hash_retired);
+      r->buckets = arrays[i];
+      r->next = hash->retired;
+      hash->retired = r;
+    }
+  ++hash->generation;
+  dmsg (D_MULTI_DEBUG, "HASH: table full during %d iteration(s), rebuilt with %d buckets for %d elements",
+	hash->n_iterators, hash->n_buckets, hash->n_elements);
+}
+
+/*
+ * Find the live element which a copy in a replaced array stands
+ * for.  Keys are compared by address, because the element may have
+ * been removed and its key freed since.
+ */
+static struct hash_element *
+hash_find_copy (struct hash *hash, const struct hash_element *copy)
+{
+  struct hash_bucket *buckets = hash->buckets;
+  int mask = hash->mask;
+
+  while (buckets)
+    {
+      int i = copy->hash_value & mask;
+      while (true)
+	{
+	  struct hash_element *he = &buckets[i].elem;
+	  if (!he->key)
+	    break;
+	  if (he->key == copy->key && he->hash_value == copy->hash_value)
+	    return he;
+	  i = (i + 1) & mask;
+	}
+      if (buckets == hash->old_buckets)
+	break;
+      buckets = hash->old_buckets;
+      mask = hash->old_n_buckets - 1;
+    }
+  return NULL;
+}
+
+/*
+ * Make room for one more element in buckets, starting
+ * a resize if the array would become more than 3/4 full
+ * counting deleted markers.
+ */
+static void
+hash_reserve (struct hash *hash)
+{
+  if ((hash->n_elements + hash->n_deleted + 1) * 4 <= hash->n_buckets * 3)
+    return;
+
+  if (hash->old_buckets)
+    {
+      if (hash->n_iterators)
+	{
+	  /*
+	   * Iterators pin both arrays, so run above 3/4 while
+	   * buckets keeps an empty slot to end probe sequences.
+	   */
+	  if (hash->n_elements + hash->n_deleted + 1 < hash->n_buckets)
+	    return;
+	  hash_rebuild (hash);
+	  return;
+	}
+
+      /* previous resize is still in progress, finish it first */
+      hash_migrate (hash, hash->old_n_buckets);
+      if ((hash->n_elements + hash->n_deleted + 1) * 4 <= hash->n_buckets * 3)
+	return;
+    }
+
+  /* rehash into an array of the same size if most of the load is deleted markers */
+  hash->old_buckets = hash->buckets;
+  hash->old_n_buckets = hash->n_buckets;
+  hash->migrate_index = 0;
+  if ((hash->n_elements + 1) * 2 > hash->n_buckets)
+    hash->n_buckets *= 2;
+  hash->mask = hash->n_buckets - 1;
+  hash->n_deleted = 0;
+  ALLOC_ARRAY_CLEAR (hash->buckets, struct hash_bucket, hash->n_buckets);
+  dmsg (D_MULTI_DEBUG, "HASH: resize %d -> %d buckets, %d elements",
+	hash->old_n_buckets, hash->n_buckets, hash->n_elements);
 }
 
 struct hash_element *
@@ -83,28 +298,44 @@ hash_lookup_fast (struct hash *hash,
 		  uint32_t hv)
 {
   struct hash_element *he;
-  struct hash_element *prev = NULL;
 
-  he = bucket->list;
+  he = hash_find (hash, hash->buckets, hash->mask, key, hv);
+  if (!he && hash->old_buckets)
+    he = hash_find (hash, hash->old_buckets, hash->old_n_buckets - 1, key, hv);
+  return he;
+}
 
-  while (he)
-    {
-      if (hv == he->hash_value && (*hash->compare_function)(key, he->key))
-	{
-	  /* move to head of list */
-	  if (prev)
-	    {
-	      prev->next = he->next;
-	      he->next = bucket->list;
-	      bucket->list = he;
-	    }
-	  return he;
-	}
-      prev = he;
-      he = he->next;
-    }
+void
+hash_add_fast (struct hash *hash,
+	       struct hash_bucket *bucket,
+	       const void *key,
+	       uint32_t hv,
+	       void *value)
+{
+  struct hash_element *he;
 
-  return NULL;
+  hash_migrate_step (hash);
+  hash_reserve (hash);
+  he = hash_find_free (hash, hv);
+  if (he->key == HASH_DELETED)
+    --hash->n_deleted;
+  he->value = value;
+  he->key = key;
+  he->hash_value = hv;
+  ++hash->n_elements;
+}
+
+/*
+ * Mark an element removed.
+ */
+static void
+hash_delete_element (struct hash *hash, struct hash_element *he)
+{
+  if (he >= &hash->buckets[0].elem && he <= &hash->buckets[hash->mask].elem)
+    ++hash->n_deleted;
+  he->key = HASH_DELETED;
+  he->value = NULL;
+  --hash->n_elements;
 }
 
 bool
@@ -113,25 +344,13 @@ hash_remove_fast (struct hash *hash,
 		  const void *key,
 		  uint32_t hv)
 {
-  struct hash_element *he;
-  struct hash_element *prev = NULL;
+  struct hash_element *he = hash_lookup_fast (hash, bucket, key, hv);
 
-  he = bucket->list;
-
-  while (he)
+  if (he)
     {
-      if (hv == he->hash_value && (*hash->compare_function)(key, he->key))
-	{
-	  if (prev)
-	    prev->next = he->next;
-	  else
-	    bucket->list = he->next;
-	  free (he);
-	  --hash->n_elements;
-	  return true;
-	}
-      prev = he;
-      he = he->next;
+      hash_delete_element (hash, he);
+      hash_migrate_step (hash);
+      return true;
     }
   return false;
 }
@@ -140,14 +359,12 @@ bool
 hash_add (struct hash *hash, const void *key, void *value, bool replace)
 {
   uint32_t hv;
-  struct hash_bucket *bucket;
   struct hash_element *he;
   bool ret = false;
 
   hv = hash_value (hash, key);
-  bucket = &hash->buckets[hv & hash->mask];
 
-  if ((he = hash_lookup_fast (hash, bucket, key, hv))) /* already exists? */
+  if ((he = hash_lookup_fast (hash, NULL, key, hv))) /* already exists? */
     {
       if (replace)
 	{
@@ -157,7 +374,7 @@ hash_add (struct hash *hash, const void *key, void *value, bool replace)
     }
   else
     {
-      hash_add_fast (hash, bucket, key, hv, value);
+      hash_add_fast (hash, NULL, key, hv, value);
       ret = true;
     }
 
@@ -179,33 +396,6 @@ hash_remove_by_value (struct hash *hash, void *value)
   hash_iterator_free (&hi);
 }
 
-static void
-hash_remove_marked (struct hash *hash, struct hash_bucket *bucket)
-{
-  struct hash_element *prev = NULL;
-  struct hash_element *he = bucket->list;
-
-  while (he)
-    {
-      if (!he->key) /* marked? */
-	{
-	  struct hash_element *newhe;
-	  if (prev)
-	    newhe = prev->next = he->next;
-	  else
-	    newhe = bucket->list = he->next;
-	  free (he);
-	  --hash->n_elements;
-	  he = newhe;
-	}
-      else
-	{
-	  prev = he;
-	  he = he->next;
-	}
-    }
-}
-
 uint32_t
 void_ptr_hash_function (const void *key, uint32_t iv)
 {
@@ -218,25 +408,45 @@ void_ptr_compare_function (const void *key1, const void *key2)
   return key1 == key2;
 }
 
+/*
+ * Iterate over buckets [start_bucket, end_bucket).  A pending
+ * resize is completed first, unless another iterator is active;
+ * in that case a full iteration also visits the elements not yet
+ * moved, while a partial one only sees the current array.
+ */
 void
 hash_iterator_init_range (struct hash *hash,
 		       struct hash_iterator *hi,
 		       int start_bucket,
 		       int end_bucket)
 {
+  if (hash->old_buckets && !hash->n_iterators)
+    hash_migrate (hash, hash->old_n_buckets);
+
+  if (hash->old_buckets && start_bucket == 0 && end_bucket >= hash->n_buckets)
+    {
+      hi->old_buckets = hash->old_buckets;
+      hi->old_n_buckets = hash->old_n_buckets;
+    }
+  else
+    {
+      hi->old_buckets = NULL;
+      hi->old_n_buckets = 0;
+    }
+
   if (end_bucket > hash->n_buckets)
     end_bucket = hash->n_buckets;
 
   ASSERT (start_bucket >= 0 && start_bucket <= end_bucket);
 
   hi->hash = hash;
-  hi->elem = NULL;
-  hi->bucket = NULL;
+  hi->buckets = hash->buckets;
   hi->last = NULL;
-  hi->bucket_marked = false;
   hi->bucket_index_start = start_bucket;
   hi->bucket_index_end = end_bucket;
   hi->bucket_index = hi->bucket_index_start - 1;
+  hi->generation = hash->generation;
+  ++hash->n_iterators;
 }
 
 void
@@ -246,82 +456,66 @@ hash_iterator_init (struct hash *hash,
   hash_iterator_init_range (hash, hi, 0, hash->n_buckets);
 }
 
-static inline void
-hash_iterator_lock (struct hash_iterator *hi, struct hash_bucket *b)
-{
-  hi->bucket = b;
-  hi->last = NULL;
-  hi->bucket_marked = false;
-}
-
-static inline void
-hash_iterator_unlock (struct hash_iterator *hi)
-{
-  if (hi->bucket)
-    {
-      if (hi->bucket_marked)
-	{
-	  hash_remove_marked (hi->hash, hi->bucket);
-	  hi->bucket_marked = false;
-	}
-      hi->bucket = NULL;
-      hi->last = NULL;
-    }
-}
-
-static inline void
-hash_iterator_advance (struct hash_iterator *hi)
-{
-  hi->last = hi->elem;
-  hi->elem = hi->elem->next;
-}
-
 void
 hash_iterator_free (struct hash_iterator *hi)
 {
-  hash_iterator_unlock (hi);
+  if (hi->hash)
+    {
+      ASSERT (hi->hash->n_iterators > 0);
+      if (!--hi->hash->n_iterators)
+	hash_free_retired (hi->hash);
+      hi->hash = NULL;
+    }
+  hi->last = NULL;
 }
 
+/*
+ * Once hash_rebuild has replaced the arrays being iterated, they
+ * are kept as they were, and each element found in them is looked
+ * up in the table to return its current state, or skipped if it
+ * has been removed since.
+ */
 struct hash_element *
 hash_iterator_next (struct hash_iterator *hi)
 {
-  struct hash_element *ret = NULL;
-  if (hi->elem)
-    {
-      ret = hi->elem;
-      hash_iterator_advance (hi);
-    }
-  else
+  while (true)
     {
       while (++hi->bucket_index < hi->bucket_index_end)
 	{
-	  struct hash_bucket *b;
-	  hash_iterator_unlock (hi);
-	  b = &hi->hash->buckets[hi->bucket_index];
-	  if (b->list)
+	  struct hash_element *he = &hi->buckets[hi->bucket_index].elem;
+	  if (hash_element_live (he)
+	      && (hi->generation == hi->hash->generation
+		  || (he = hash_find_copy (hi->hash, he))))
 	    {
-	      hash_iterator_lock (hi, b);
-	      hi->elem = b->list;
-	      if (hi->elem)
-		{
-		  ret = hi->elem;
-		  hash_iterator_advance (hi);
-		  break;
-		}
+	      hi->last = he;
+	      return he;
 	    }
 	}
+      if (!hi->old_buckets)
+	break;
+
+      /* continue with the elements not yet moved by a resize */
+      hi->buckets = hi->old_buckets;
+      hi->bucket_index = -1;
+      hi->bucket_index_end = hi->old_n_buckets;
+      hi->old_buckets = NULL;
     }
-  return ret;
+  hi->last = NULL;
+  return NULL;
 }
 
 void
 hash_iterator_delete_element (struct hash_iterator *hi)
 {
-  ASSERT (hi->last);
-  hi->last->key = NULL;
-  hi->bucket_marked = true;
-}
+  struct hash_element *he = hi->last;
 
+  ASSERT (he);
+  if (hi->generation != hi->hash->generation)
+    he = hash_find_copy (hi->hash, he);
+  if (he)
+    hash_delete_element (hi->hash, he);
+  hi->last = NULL;
+}
 
 #ifdef LIST_TEST
 
@@ -500,142 +694,91 @@ list_test (void)
 #endif
 
 /*
---------------------------------------------------------------------
-hash() -- hash a variable-length key into a 32-bit value
-  k     : the key (the unaligned variable-length array of bytes)
-  len   : the length of the key, counting by bytes
-  level : can be any 4-byte value
-Returns a 32-bit value.  Every bit of the key affects every bit of
-the return value.  Every 1-bit and 2-bit delta achieves avalanche.
-About 36+6len instructions.
-
-The best hash table sizes are powers of 2.  There is no need to do
-mod a prime (mod is sooo slow!).  If you need less than 32 bits,
-use a bitmask.  For example, if you need only 10 bits, do
-  h = (h & hashmask(10));
-In which case, the hash table should have hashsize(10) elements.
-
-If you are hashing n strings (uint8_t **)k, do it like this:
-  for (i=0, h=0; i<n; ++i) h = hash( k[i], len[i], h);
-
-By Bob Jenkins, 1996.  bob_jenkins@burtleburtle.net.  You may use this
-code any way you wish, private, educational, or commercial.  It's free.
-
-See http://burlteburtle.net/bob/hash/evahash.html
-Use for hash table lookup, or anything where one collision in 2^32 is
-acceptable.  Do NOT use for cryptographic purposes.
-
---------------------------------------------------------------------
-
-mix -- mix 3 32-bit values reversibly.
-For every delta with one or two bit set, and the deltas of all three
-  high bits or all three low bits, whether the original value of a,b,c
-  is almost all zero or is uniformly distributed,
-* If mix() is run forward or backward, at least 32 bits in a,b,c
-  have at least 1/4 probability of changing.
-* If mix() is run forward, every bit of c will change between 1/3 and
-  2/3 of the time.  (Well, 22/100 and 78/100 for some 2-bit deltas.)
-mix() was built out of 36 single-cycle latency instructions in a 
-  structure that could supported 2x parallelism, like so:
-      a -= b; 
-      a -= c; x = (c>>13);
-      b -= c; a ^= x;
-      b -= a; x = (a<<8);
-      c -= a; b ^= x;
-      c -= b; x = (b>>13);
-      ...
-  Unfortunately, superscalar Pentiums and Sparcs can't take advantage 
-  of that parallelism.  They've also turned some of those single-cycle
-  latency instructions into multi-cycle latency instructions.  Still,
-  this is the fastest good hash I could find.  There were about 2^^68
-  to choose from.  I only looked at a billion or so.
-
-James Yonan Notes:
-
-* This function is faster than it looks, and appears to be
-  appropriate for our usage in OpenVPN which is primarily
-  for hash-table based address lookup (IPv4, IPv6, and Ethernet MAC).
-  NOTE: This function is never used for cryptographic purposes, only
-  to produce evenly-distributed indexes into hash tables.
-
-* Benchmark results: 11.39 machine cycles per byte on a P2 266Mhz,
-                     and 12.1 machine cycles per byte on a
-                     2.2 Ghz P4 when hashing a 6 byte string.
---------------------------------------------------------------------
-*/
-
-#define mix(a,b,c)               \
-{                                \
-  a -= b; a -= c; a ^= (c>>13);  \
-  b -= c; b -= a; b ^= (a<<8);   \
-  c -= a; c -= b; c ^= (b>>13);  \
-  a -= b; a -= c; a ^= (c>>12);  \
-  b -= c; b -= a; b ^= (a<<16);  \
-  c -= a; c -= b; c ^= (b>>5);   \
-  a -= b; a -= c; a ^= (c>>3);   \
-  b -= c; b -= a; b ^= (a<<10);  \
-  c -= a; c -= b; c ^= (b>>15);  \
+ * SipHash-1-3 (Aumasson and Bernstein), keyed with a random
+ * per-process secret mixed with initval, truncated to 32 bits.
+ *
+ * Keys such as client addresses are chosen by peers, so a
+ * keyed hash keeps them from forcing many elements onto the
+ * same probe sequence.  One compression round per 8-byte
+ * word makes this cheaper than Bob Jenkins' lookup2 for the
+ * short keys we hash, while still resisting such attacks.
+ * Hash values are only meaningful within one process.
+ */
+
+#define SIP_ROTL(x,b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIP_ROUND(v0,v1,v2,v3)                                          \
+{                                                                       \
+  v0 += v1; v1 = SIP_ROTL(v1,13); v1 ^= v0; v0 = SIP_ROTL(v0,32);       \
+  v2 += v3; v3 = SIP_ROTL(v3,16); v3 ^= v2;                             \
+  v0 += v3; v3 = SIP_ROTL(v3,21); v3 ^= v0;                             \
+  v2 += v1; v1 = SIP_ROTL(v1,17); v1 ^= v2; v2 = SIP_ROTL(v2,32);       \
+}
+
+static inline uint64_t
+sip_load64 (const uint8_t *p)
+{
+  return (uint64_t) p[0]
+    | ((uint64_t) p[1] << 8)
+    | ((uint64_t) p[2] << 16)
+    | ((uint64_t) p[3] << 24)
+    | ((uint64_t) p[4] << 32)
+    | ((uint64_t) p[5] << 40)
+    | ((uint64_t) p[6] << 48)
+    | ((uint64_t) p[7] << 56);
 }
 
 uint32_t
 hash_func (const uint8_t *k, uint32_t length, uint32_t initval)
 {
-  uint32_t a, b, c, len;
-
-  /* Set up the internal state */
-  len = length;
-  a = b = 0x9e3779b9;	     /* the golden ratio; an arbitrary value */
-  c = initval;		     /* the previous hash value */
-
-   /*---------------------------------------- handle most of the key */
-  while (len >= 12)
+  const uint64_t k0 = hash_secret[0] ^ initval;
+  const uint64_t k1 = hash_secret[1];
+  uint64_t v0 = k0 ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = k1 ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = k0 ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = k1 ^ 0x7465646279746573ULL;
+  uint64_t b = (uint64_t) length << 56;
+  uint32_t len = length;
+
+  while (len >= 8)
     {
-      a += (k[0] + ((uint32_t) k[1] << 8)
-	         + ((uint32_t) k[2] << 16)
-	         + ((uint32_t) k[3] << 24));
-      b += (k[4] + ((uint32_t) k[5] << 8)
-	         + ((uint32_t) k[6] << 16)
-	         + ((uint32_t) k[7] << 24));
-      c += (k[8] + ((uint32_t) k[9] << 8)
-	         + ((uint32_t) k[10] << 16)
-	         + ((uint32_t) k[11] << 24));
-      mix (a, b, c);
-      k += 12;
-      len -= 12;
+      const uint64_t m = sip_load64 (k);
+      v3 ^= m;
+      SIP_ROUND (v0, v1, v2, v3);
+      v0 ^= m;
+      k += 8;
+      len -= 8;
     }
 
-   /*------------------------------------- handle the last 11 bytes */
-  c += length;
   switch (len)		    /* all the case statements fall through */
     {
-    case 11:
-      c += ((uint32_t) k[10] << 24);
-    case 10:
-      c += ((uint32_t) k[9] << 16);
-    case 9:
-      c += ((uint32_t) k[8] << 8);
-      /* the first byte of c is reserved for the length */
-    case 8:
-      b += ((uint32_t) k[7] << 24);
     case 7:
-      b += ((uint32_t) k[6] << 16);
+      b |= (uint64_t) k[6] << 48;
     case 6:
-      b += ((uint32_t) k[5] << 8);
+      b |= (uint64_t) k[5] << 40;
     case 5:
-      b += k[4];
+      b |= (uint64_t) k[4] << 32;
     case 4:
-      a += ((uint32_t) k[3] << 24);
+      b |= (uint64_t) k[3] << 24;
     case 3:
-      a += ((uint32_t) k[2] << 16);
+      b |= (uint64_t) k[2] << 16;
     case 2:
-      a += ((uint32_t) k[1] << 8);
+      b |= (uint64_t) k[1] << 8;
     case 1:
-      a += k[0];
+      b |= (uint64_t) k[0];
       /* case 0: nothing left to add */
     }
-  mix (a, b, c);
-   /*-------------------------------------- report the result */
-  return c;
+
+  v3 ^= b;
+  SIP_ROUND (v0, v1, v2, v3);
+  v0 ^= b;
+
+  v2 ^= 0xff;
+  SIP_ROUND (v0, v1, v2, v3);
+  SIP_ROUND (v0, v1, v2, v3);
+  SIP_ROUND (v0, v1, v2, v3);
+
+  return (uint32_t) (v0 ^ v1 ^ v2 ^ v3);
 }
 
 #else
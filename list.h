@@ -26,12 +26,31 @@
 #define LIST_H
 
 /*
- * This code is a fairly straightforward hash
- * table implementation using Bob Jenkins'
- * hash function.
+ * Open-addressing hash table with linear probing, keyed
+ * with SipHash.
  *
  * Hash tables are used in OpenVPN to keep track of
  * client instances over various key spaces.
+ *
+ * Elements live directly in the bucket array, so a lookup
+ * compares the stored hash values of neighbouring slots
+ * before calling the compare function, instead of chasing
+ * a list of separately allocated elements.  The table
+ * doubles when it becomes 3/4 full, moving a few buckets of
+ * the old array on each subsequent add or remove rather than
+ * rehashing everything at once.
+ *
+ * A struct hash_element returned by a lookup or iterator
+ * stays valid only until the next add or remove on the
+ * same table.
+ *
+ * Moving buckets is paused while iterators are active, so
+ * adds made during an iteration may load the table above
+ * 3/4.  If the table fills up before the last iterator is
+ * freed, all elements are copied into a fresh array; the
+ * arrays the active iterations walk are kept until then, so
+ * they still visit every element present when they started
+ * and not removed since.
  */
 
 #if P2MP_SERVER
@@ -42,31 +61,40 @@
 #include "basic.h"
 #include "buffer.h"
 
-#define hashsize(n) ((uint32_t)1<<(n))
-#define hashmask(n) (hashsize(n)-1)
-
 struct hash_element
 {
   void *value;
-  const void *key;
+  const void *key;          /* NULL if the bucket is empty */
   unsigned int hash_value;
-  struct hash_element *next;
 };
 
+/* a bucket holds at most one element */
 struct hash_bucket
 {
-  struct hash_element *list;
+  struct hash_element elem;
 };
 
+/* number of old buckets moved per add or remove while resizing */
+#define HASH_MIGRATE_STEP 8
+
 struct hash
 {
   int n_buckets;
   int n_elements;
+  int n_deleted;            /* removed-element markers in buckets */
   int mask;
   uint32_t iv;
   uint32_t (*hash_function)(const void *key, uint32_t iv);
   bool (*compare_function)(const void *key1, const void *key2); /* return true if equal */
   struct hash_bucket *buckets;
+
+  /* incremental resize */
+  struct hash_bucket *old_buckets; /* array being moved into buckets, or NULL */
+  int old_n_buckets;
+  int migrate_index;        /* next bucket of old_buckets to move */
+  int n_iterators;          /* resizing is paused while iterators are active */
+  unsigned int generation;  /* bumped when iterated arrays are replaced */
+  struct hash_retired *retired; /* replaced arrays, freed with the last iterator */
 };
 
 struct hash *hash_init (const int n_buckets,
@@ -93,13 +121,14 @@ void hash_remove_by_value (struct hash *hash, void *value);
 struct hash_iterator
 {
   struct hash *hash;
+  struct hash_bucket *buckets; /* array being iterated */
   int bucket_index;
-  struct hash_bucket *bucket;
-  struct hash_element *elem;
   struct hash_element *last;
-  bool bucket_marked;
   int bucket_index_start;
   int bucket_index_end;
+  struct hash_bucket *old_buckets; /* iterated afterwards, or NULL */
+  int old_n_buckets;
+  unsigned int generation;     /* hash->generation at init */
 };
 
 void hash_iterator_init_range (struct hash *hash,
@@ -139,6 +168,11 @@ hash_n_buckets (const struct hash *hash)
   return hash->n_buckets;
 }
 
+/*
+ * Return the bucket where probing for hv starts.  The bucket
+ * is only a hint; the _fast functions locate elements from
+ * hv alone.
+ */
 static inline struct hash_bucket *
 hash_bucket (struct hash *hash, uint32_t hv)
 {
@@ -151,9 +185,8 @@ hash_lookup (struct hash *hash, const void *key)
   void *ret = NULL;
   struct hash_element *he;
   uint32_t hv = hash_value (hash, key);
-  struct hash_bucket *bucket = &hash->buckets[hv & hash->mask];
 
-  he = hash_lookup_fast (hash, bucket, key, hv);
+  he = hash_lookup_fast (hash, NULL, key, hv);
   if (he)
     ret = he->value;
 
@@ -161,35 +194,16 @@ hash_lookup (struct hash *hash, const void *key)
 }
 
 /* NOTE: assumes that key is not a duplicate */
-static inline void
-hash_add_fast (struct hash *hash,
-	       struct hash_bucket *bucket,
-	       const void *key,
-	       uint32_t hv,
-	       void *value)
-{
-  struct hash_element *he;
-
-  ALLOC_OBJ (he, struct hash_element);
-  he->value = value;
-  he->key = key;
-  he->hash_value = hv;
-  he->next = bucket->list;
-  bucket->list = he;
-  ++hash->n_elements;
-}
+void hash_add_fast (struct hash *hash,
+		    struct hash_bucket *bucket,
+		    const void *key,
+		    uint32_t hv,
+		    void *value);
 
 static inline bool
 hash_remove (struct hash *hash, const void *key)
 {
-  uint32_t hv;
-  struct hash_bucket *bucket;
-  bool ret;
-
-  hv = hash_value (hash, key);
-  bucket = &hash->buckets[hv & hash->mask];
-  ret = hash_remove_fast (hash, bucket, key, hv);
-  return ret;
+  return hash_remove_fast (hash, NULL, key, hash_value (hash, key));
 }
 
 #endif /* P2MP_SERVER */
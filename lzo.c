@@ -37,6 +37,53 @@
 #include "memdbg.h"
 
 #ifndef LZO_STUB
+/**
+ * LZO library working memory.
+ *
+ * OpenVPN processes all packets of a thread sequentially, so no more
+ * than one compression is ever in progress at a time.  Instead of giving
+ * every VPN tunnel its own \c LZO_WORKSPACE sized buffer, which adds up
+ * quickly on a server with many clients, one buffer is shared by all
+ * compression workspace structures and reference counted.
+ */
+static struct {
+  lzo_voidp wmem;
+  int refcount;
+} lzo_shared;
+
+/**
+ * Take a reference to the shared LZO working memory, allocating it and
+ * initializing the lzo library on first use.
+ */
+static void
+lzo_shared_wmem_ref (void)
+{
+  if (!lzo_shared.refcount++)
+    {
+      if (lzo_init () != LZO_E_OK)
+	msg (M_FATAL, "Cannot initialize LZO compression library");
+      lzo_shared.wmem = (lzo_voidp) lzo_malloc (LZO_WORKSPACE);
+      check_malloc_return (lzo_shared.wmem);
+      dmsg (D_COMP, "LZO shared workspace allocated (%d bytes)", (int) LZO_WORKSPACE);
+    }
+}
+
+/**
+ * Drop a reference to the shared LZO working memory, freeing it once the
+ * last reference is gone.
+ */
+static void
+lzo_shared_wmem_unref (void)
+{
+  ASSERT (lzo_shared.refcount > 0);
+  if (!--lzo_shared.refcount)
+    {
+      lzo_free (lzo_shared.wmem);
+      lzo_shared.wmem = NULL;
+      dmsg (D_COMP, "LZO shared workspace freed");
+    }
+}
+
 /**
  * Perform adaptive compression housekeeping.
  * 
@@ -110,12 +157,7 @@ lzo_compress_init (struct lzo_compress_workspace *lzowork, unsigned int flags)
 
   lzowork->flags = flags;
 #ifndef LZO_STUB
-  lzowork->wmem_size = LZO_WORKSPACE;
-
-  if (lzo_init () != LZO_E_OK)
-    msg (M_FATAL, "Cannot initialize LZO compression library");
-  lzowork->wmem = (lzo_voidp) lzo_malloc (lzowork->wmem_size);
-  check_malloc_return (lzowork->wmem);
+  lzo_shared_wmem_ref ();
   msg (D_INIT_MEDIUM, "LZO compression initialized");
 #else
   msg (D_INIT_MEDIUM, "LZO stub compression initialized");
@@ -130,8 +172,7 @@ lzo_compress_uninit (struct lzo_compress_workspace *lzowork)
     {
       ASSERT (lzowork->defined);
 #ifndef LZO_STUB
-      lzo_free (lzowork->wmem);
-      lzowork->wmem = NULL;
+      lzo_shared_wmem_unref ();
 #endif
       lzowork->defined = false;
     }
@@ -185,7 +226,7 @@ lzo_compress (struct buffer *buf, struct buffer work,
 	  return;
 	}
 
-      err = LZO_COMPRESS (BPTR (buf), BLEN (buf), BPTR (&work), &zlen, lzowork->wmem);
+      err = LZO_COMPRESS (BPTR (buf), BLEN (buf), BPTR (&work), &zlen, lzo_shared.wmem);
       if (err != LZO_E_OK)
 	{
 	  dmsg (D_COMP_ERRORS, "LZO compression error: %d", err);
@@ -247,7 +288,7 @@ lzo_decompress (struct buffer *buf, struct buffer work,
 #ifndef LZO_STUB
       ASSERT (buf_safe (&work, zlen));
       err = LZO_DECOMPRESS (BPTR (buf), BLEN (buf), BPTR (&work), &zlen,
-			    lzowork->wmem);
+			    lzo_shared.wmem);
       if (err != LZO_E_OK)
 	{
 	  dmsg (D_COMP_ERRORS, "LZO decompression error: %d", err);
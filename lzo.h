@@ -152,18 +152,18 @@ struct lzo_adaptive_compress {
  * 
  * This structure contains compression module state, such as whether
  * compression is enabled and the status of the adaptive compression
- * routines.  It also contains an allocated working buffer.
+ * routines.
  * 
  * One of these compression workspace structures is maintained for each
- * VPN tunnel.
+ * VPN tunnel.  The LZO library's working memory is not part of this
+ * structure; it is shared by all VPN tunnels handled by the thread, see
+ * \c lzo_compress_init().
  */
 struct lzo_compress_workspace
 {
   bool defined;
   unsigned int flags;
 #ifndef LZO_STUB
-  lzo_voidp wmem;
-  int wmem_size;
   struct lzo_adaptive_compress ac;
 
   /* statistics */
@@ -196,11 +196,13 @@ void lzo_adjust_frame_parameters(struct frame *frame);
 /**
  * Initialize a compression workspace structure.
  * 
- * This function initializes the given workspace structure \a lzowork.
- * This includes allocating a work buffer for internal use and setting its
- * flags to the given value of \a flags.
+ * This function initializes the given workspace structure \a lzowork and
+ * sets its flags to the given value of \a flags.
  * 
- * This function also initializes the lzo library.
+ * The LZO library's working memory is shared between all workspace
+ * structures, because only one compression runs at a time.  The first
+ * call of this function initializes the lzo library and allocates the
+ * shared working memory; subsequent calls only take a reference to it.
  * 
  * @param lzowork      - A pointer to the workspace structure to
  *                       initialize.
@@ -213,7 +215,8 @@ void lzo_compress_init (struct lzo_compress_workspace *lzowork, unsigned int fla
  * Cleanup a compression workspace structure.
  * 
  * This function cleans up the given workspace structure \a lzowork.  This
- * includes freeing the structure's internal work buffer.
+ * includes dropping its reference to the shared working memory, which is
+ * freed when the last workspace structure is cleaned up.
  * 
  * @param lzowork      - A pointer to the workspace structure to clean up.
  */
@@ -59,14 +59,16 @@ struct management *management; /* GLOBAL */
 
 /* static forward declarations */
 static void man_output_standalone (struct management *man, volatile int *signal_received);
-static void man_reset_client_socket (struct management *man, const bool exiting);
+static void man_reset_client_socket (struct management *man, struct man_client *mc, const bool exiting);
 
 static void
 man_help ()
 {
   msg (M_CLIENT, "Management Interface for %s", title_string);
   msg (M_CLIENT, "Commands:");
+  msg (M_CLIENT, "admission-stats        : Show per source admission control counters.");
   msg (M_CLIENT, "auth-retry t           : Auth failure retry mode (none,interact,nointeract).");
+  msg (M_CLIENT, "auth-stats             : Show deferred plugin authentication counters.");
   msg (M_CLIENT, "bytecount n            : Show bytes in/out, update every n secs (0=off).");
   msg (M_CLIENT, "echo [on|off] [N|all]  : Like log, but only show messages in echo buffer.");
   msg (M_CLIENT, "exit|quit              : Close management session.");
@@ -76,6 +78,7 @@ man_help ()
   msg (M_CLIENT, "                         release current hold and start tunnel."); 
   msg (M_CLIENT, "kill cn                : Kill the client instance(s) having common name cn.");
   msg (M_CLIENT, "kill IP:port           : Kill the client instance connecting from IP:port.");
+  msg (M_CLIENT, "kill-user name         : Kill the client instance(s) authenticated as username name.");
   msg (M_CLIENT, "load-stats             : Show global server load stats.");
   msg (M_CLIENT, "log [on|off] [N|all]   : Turn on/off realtime log display");
   msg (M_CLIENT, "                         + show last N lines or 'all' for entire history.");
@@ -98,6 +101,7 @@ man_help ()
   msg (M_CLIENT, "                             text R and optional client reason text CR");
   msg (M_CLIENT, "client-kill CID [M]    : Kill client instance CID with message M (def=RESTART)");
   msg (M_CLIENT, "env-filter [level]     : Set env-var filter level");
+  msg (M_CLIENT, "metrics n              : Show changed per-client counters every n secs (0=off).");
 #ifdef MANAGEMENT_PF
   msg (M_CLIENT, "client-pf CID          : Define packet filter for client CID (MULTILINE)");
 #endif
@@ -165,50 +169,128 @@ man_welcome (struct management *man)
 }
 
 static inline bool
-man_password_needed (struct management *man)
+man_password_needed (const struct management *man, const struct man_client *mc)
 {
-  return man->settings.up.defined && !man->connection.password_verified;
+  return man->settings.up.defined && !mc->password_verified;
 }
 
 static void
-man_check_password (struct management *man, const char *line)
+man_check_password (struct management *man, struct man_client *mc, const char *line)
 {
-  if (man_password_needed (man))
+  if (man_password_needed (man, mc))
     {
       if (streq (line, man->settings.up.password))
 	{
-	  man->connection.password_verified = true;
+	  mc->password_verified = true;
 	  msg (M_CLIENT, "SUCCESS: password is correct");
 	  man_welcome (man);
 	}
       else
 	{
-	  man->connection.password_verified = false;
+	  mc->password_verified = false;
 	  msg (M_CLIENT, "ERROR: bad password");
-	  if (++man->connection.password_tries >= MANAGEMENT_N_PASSWORD_RETRIES)
+	  if (++mc->password_tries >= MANAGEMENT_N_PASSWORD_RETRIES)
 	    {
 	      msg (M_WARN, "MAN: client connection rejected after %d failed password attempts",
 		   MANAGEMENT_N_PASSWORD_RETRIES);
-	      man->connection.halt = true;
+	      mc->halt = true;
 	    }
 	}
     }
 }
 
+static inline bool
+man_client_connected (const struct man_client *mc)
+{
+  return mc->state == MS_CC_WAIT_READ || mc->state == MS_CC_WAIT_WRITE;
+}
+
+/*
+ * Return true if some connected client has passed
+ * password verification.
+ */
+static bool
+man_client_verified (const struct management *man)
+{
+  int i;
+  for (i = 0; i < man->connection.n_slots; ++i)
+    {
+      const struct man_client *mc = &man->connection.clients[i];
+      if (man_client_connected (mc) && !man_password_needed (man, mc))
+	return true;
+    }
+  return false;
+}
+
+/*
+ * The daemon-wide bytecount and metrics intervals are the
+ * shortest ones requested by any client.
+ */
 static void
-man_update_io_state (struct management *man)
+man_update_intervals (struct management *man)
 {
-  if (socket_defined (man->connection.sd_cli))
+  struct man_connection *mcn = &man->connection;
+  int i;
+
+  mcn->bytecount_update_seconds = 0;
+#ifdef MANAGEMENT_DEF_AUTH
+  mcn->metrics_update_seconds = 0;
+#endif
+  for (i = 0; i < man->connection.n_slots; ++i)
     {
-      if (buffer_list_defined (man->connection.out))
+      const struct man_client *mc = &mcn->clients[i];
+      if (man_client_connected (mc))
 	{
-	  man->connection.state = MS_CC_WAIT_WRITE;
+	  if (mc->bytecount_update_seconds > 0
+	      && (!mcn->bytecount_update_seconds || mc->bytecount_update_seconds < mcn->bytecount_update_seconds))
+	    mcn->bytecount_update_seconds = mc->bytecount_update_seconds;
+#ifdef MANAGEMENT_DEF_AUTH
+	  if (mc->metrics_update_seconds > 0
+	      && (!mcn->metrics_update_seconds || mc->metrics_update_seconds < mcn->metrics_update_seconds))
+	    mcn->metrics_update_seconds = mc->metrics_update_seconds;
+#endif
 	}
-      else
+    }
+}
+
+static void
+man_update_io_state (struct management *man)
+{
+  struct man_connection *mcn = &man->connection;
+  bool write = false;
+  int i;
+
+  /* close clients that were dropped while we were busy elsewhere */
+  for (i = 0; i < man->connection.n_slots; ++i)
+    {
+      struct man_client *mc = &mcn->clients[i];
+      if (man_client_connected (mc) && mc->halt && mc != mcn->cur)
+	man_reset_client_socket (man, mc, false);
+    }
+
+  mcn->n_clients = 0;
+  for (i = 0; i < man->connection.n_slots; ++i)
+    {
+      struct man_client *mc = &mcn->clients[i];
+      if (man_client_connected (mc))
 	{
-	  man->connection.state = MS_CC_WAIT_READ;
+	  if (buffer_list_defined (mc->out))
+	    {
+	      mc->state = MS_CC_WAIT_WRITE;
+	      write = true;
+	    }
+	  else
+	    {
+	      mc->state = MS_CC_WAIT_READ;
+	    }
+	  ++mcn->n_clients;
 	}
     }
+
+  if (mcn->n_clients)
+    mcn->state = write ? MS_CC_WAIT_WRITE : MS_CC_WAIT_READ;
+  else if (mcn->state != MS_INITIAL)
+    mcn->state = socket_defined (mcn->sd_top) ? MS_LISTEN : MS_INITIAL;
 }
 
 static void
@@ -226,29 +308,145 @@ man_output_list_push_finalize (struct management *man)
 }
 
 static void
-man_output_list_push_str (struct management *man, const char *str)
+man_client_push (struct management *man, struct man_client *mc, const char *str)
 {
-  if (management_connected (man) && str)
+  if (man_client_connected (mc) && str)
     {
-      buffer_list_push (man->connection.out, (const unsigned char *) str);
+      if (!mc->out_bytes)
+	mc->out_progress = now;
+      buffer_list_push (mc->out, (const unsigned char *) str);
+      mc->out_bytes += strlen (str);
+      mc->state = MS_CC_WAIT_WRITE;
     }
 }
 
 static void
-man_output_list_push (struct management *man, const char *str)
+man_client_out_reset (struct man_client *mc)
 {
-  man_output_list_push_str (man, str);
-  man_output_list_push_finalize (man);
+  buffer_list_reset (mc->out);
+  mc->out_bytes = 0;
+  mc->out_progress = now;
 }
 
+/* notification classes */
+#define MN_CLIENT    0  /* unconditional notification */
+#define MN_LOG       1
+#define MN_STATE     2
+#define MN_ECHO      3
+#define MN_BYTECOUNT 4
+#define MN_METRICS   5
+
+static bool
+man_client_wants (const struct man_client *mc, const int type)
+{
+  switch (type)
+    {
+    case MN_LOG:
+      return mc->log_realtime;
+    case MN_STATE:
+      return mc->state_realtime;
+    case MN_ECHO:
+      return mc->echo_realtime;
+    case MN_BYTECOUNT:
+      return mc->bytecount_update_seconds > 0;
+#ifdef MANAGEMENT_DEF_AUTH
+    case MN_METRICS:
+      return mc->metrics_update_seconds > 0;
+#endif
+    case MN_CLIENT:
+      return true;
+    default:
+      return false;
+    }
+}
+
+static inline bool
+man_client_notifiable (const struct management *man, const struct man_client *mc, const int type)
+{
+  return man_client_connected (mc)
+    && !mc->halt
+    && !man_password_needed (man, mc)
+    && man_client_wants (mc, type);
+}
+
+/*
+ * Drop a client which does not read its output, so that it cannot
+ * grow our memory use without bound; one which keeps up never is,
+ * however many notifications it receives.  Return true if mc was
+ * dropped.
+ */
+static bool
+man_client_drop_stuck (struct man_client *mc)
+{
+  if (mc->out_bytes > MANAGEMENT_OUT_MAX
+      || (mc->out_bytes && now > mc->out_progress + MANAGEMENT_OUT_STALL))
+    {
+      msg (D_MANAGEMENT, "MANAGEMENT: dropping client, %u bytes of output queued, none read for %d seconds",
+	   (unsigned int) mc->out_bytes, (int) (now - mc->out_progress));
+      mc->halt = true;
+      man_client_out_reset (mc);
+      return true;
+    }
+  return false;
+}
+
+/*
+ * Queue a notification for one client.
+ */
+static void
+man_client_notify (struct management *man, struct man_client *mc, const int type, const char *str)
+{
+  if (!man_client_drop_stuck (mc))
+    man_client_push (man, mc, str);
+}
+
+/*
+ * Queue a notification for every authenticated client
+ * which asked for this type.
+ */
 static void
-man_prompt (struct management *man)
+man_notify (struct management *man, const int type, const char *str)
 {
-  if (man_password_needed (man))
-    man_output_list_push (man, "ENTER PASSWORD:");
+  int i;
+
+  if (!str)
+    return;
+  for (i = 0; i < man->connection.n_slots; ++i)
+    {
+      struct man_client *mc = &man->connection.clients[i];
+      if (man_client_notifiable (man, mc, type))
+	man_client_notify (man, mc, type, str);
+    }
+}
+
+/*
+ * Output produced while a client's command is being processed
+ * goes to that client only, anything else is a notification.
+ */
+static void
+man_output_list_push_str (struct management *man, const char *str)
+{
+  struct man_client *mc = man->connection.cur;
+  if (mc)
+    man_client_push (man, mc, str);
+  else
+    man_notify (man, MN_CLIENT, str);
+}
+
+static void
+man_prompt (struct management *man, struct man_client *mc)
+{
+  if (man_password_needed (man, mc))
+    {
+      man_client_push (man, mc, "ENTER PASSWORD:");
+      man_output_list_push_finalize (man);
+    }
 #if 0 /* should we use prompt? */
   else
-    man_output_list_push (man, ">");
+    {
+      man_client_push (man, mc, ">");
+      man_output_list_push_finalize (man);
+    }
 #endif
 }
 
@@ -302,29 +500,31 @@ virtual_output_callback_func (void *arg, const unsigned int flags, const char *s
       if (flags != M_CLIENT)
 	log_history_add (man->persist.log, &e);
 
-      if (!man_password_needed (man))
+      if (management_connected (man))
 	{
 	  if (flags == M_CLIENT)
-	    out = log_entry_print (&e, LOG_PRINT_CRLF, &gc);
-	  else if (man->connection.log_realtime)
-	    out = log_entry_print (&e, LOG_PRINT_INT_DATE
-				   |   LOG_PRINT_MSG_FLAGS
-				   |   LOG_PRINT_LOG_PREFIX
-				   |   LOG_PRINT_CRLF, &gc);
-	  if (out)
 	    {
-	      man_output_list_push_str (man, out);
-	      did_push = true;
+	      out = log_entry_print (&e, LOG_PRINT_CRLF, &gc);
+	      if (!man->connection.cur || !man_password_needed (man, man->connection.cur))
+		man_output_list_push_str (man, out);
 	    }
+	  else
+	    {
+	      out = log_entry_print (&e, LOG_PRINT_INT_DATE
+				     |   LOG_PRINT_MSG_FLAGS
+				     |   LOG_PRINT_LOG_PREFIX
+				     |   LOG_PRINT_CRLF, &gc);
+	      man_notify (man, MN_LOG, out);
+	    }
+	  did_push = true;
 	  if (flags & M_FATAL)
 	    {
+	      int i;
 	      out = log_entry_print (&e, LOG_FATAL_NOTIFY|LOG_PRINT_CRLF, &gc);
-	      if (out)
-		{
-		  man_output_list_push_str (man, out);
-		  did_push = true;
-		  man_reset_client_socket (man, true);
-		}
+	      man->connection.cur = NULL;
+	      man_notify (man, MN_CLIENT, out);
+	      for (i = 0; i < man->connection.n_slots; ++i)
+		man_reset_client_socket (man, &man->connection.clients[i], true);
 	    }
 	}
 
@@ -402,27 +602,64 @@ man_status (struct management *man, const int version, struct status_output *so)
 static void
 man_bytecount (struct management *man, const int update_seconds)
 {
+  struct man_client *mc = man->connection.cur;
   if (update_seconds >= 0)
-    man->connection.bytecount_update_seconds = update_seconds;
+    mc->bytecount_update_seconds = update_seconds;
   else
-    man->connection.bytecount_update_seconds = 0;
+    mc->bytecount_update_seconds = 0;
+  man_update_intervals (man);
   msg (M_CLIENT, "SUCCESS: bytecount interval changed");
 }
 
+/*
+ * Bytecount notifications go only to the clients which asked for them.
+ */
+static void
+man_bytecount_notify (struct management *man, const char *line)
+{
+  man_notify (man, MN_BYTECOUNT, line);
+  man_output_list_push_finalize (man);
+}
+
 void
 man_bytecount_output_client (struct management *man)
 {
   char in[32];
   char out[32];
+  char line[128];
   /* do in a roundabout way to work around possible mingw or mingw-glibc bug */
   openvpn_snprintf (in, sizeof (in), counter_format, man->persist.bytes_in);
   openvpn_snprintf (out, sizeof (out), counter_format, man->persist.bytes_out);
-  msg (M_CLIENT, ">BYTECOUNT:%s,%s", in, out);
+  openvpn_snprintf (line, sizeof (line), ">BYTECOUNT:%s,%s\r\n", in, out);
+  man_bytecount_notify (man, line);
   man->connection.bytecount_last_update = now;
 }
 
 #ifdef MANAGEMENT_DEF_AUTH
 
+static void
+man_metrics (struct management *man, const int update_seconds)
+{
+  if (!(man->persist.callback.flags & MCF_SERVER))
+    {
+      msg (M_CLIENT, "ERROR: The 'metrics' command is only supported in server mode");
+      return;
+    }
+
+  /*
+   * A new stream starts over from each client's totals, while
+   * a subscriber joining a running stream just shares it.
+   */
+  if (!man->connection.metrics_update_seconds)
+    {
+      man->connection.metrics_last_update = 0;
+      ++man->persist.metrics_epoch;
+    }
+  man->connection.cur->metrics_update_seconds = max_int (update_seconds, 0);
+  man_update_intervals (man);
+  msg (M_CLIENT, "SUCCESS: metrics interval changed");
+}
+
 void
 man_bytecount_output_server (struct management *man,
 			     const counter_type *bytes_in_total,
@@ -431,10 +668,12 @@ man_bytecount_output_server (struct management *man,
 {
   char in[32];
   char out[32];
+  char line[128];
   /* do in a roundabout way to work around possible mingw or mingw-glibc bug */
   openvpn_snprintf (in, sizeof (in), counter_format, *bytes_in_total);
   openvpn_snprintf (out, sizeof (out), counter_format, *bytes_out_total);
-  msg (M_CLIENT, ">BYTECOUNT_CLI:%lu,%s,%s", mdac->cid, in, out);
+  openvpn_snprintf (line, sizeof (line), ">BYTECOUNT_CLI:%lu,%s,%s\r\n", mdac->cid, in, out);
+  man_bytecount_notify (man, line);
   mdac->bytecount_last_update = now;
 }
 
@@ -517,6 +756,23 @@ man_kill (struct management *man, const char *victim)
   gc_free (&gc);
 }
 
+static void
+man_kill_user (struct management *man, const char *username)
+{
+  if (man->persist.callback.kill_by_username)
+    {
+      const int n_killed = (*man->persist.callback.kill_by_username) (man->persist.callback.arg, username);
+      if (n_killed > 0)
+	msg (M_CLIENT, "SUCCESS: username '%s' found, %d client(s) killed", username, n_killed);
+      else
+	msg (M_CLIENT, "ERROR: username '%s' not found", username);
+    }
+  else
+    {
+      msg (M_CLIENT, "ERROR: The 'kill-user' command is not supported by the current daemon mode");
+    }
+}
+
 /*
  * General-purpose history command handler
  * for the log and echo commands.
@@ -574,7 +830,7 @@ man_log (struct management *man, const char *parm)
 	       parm,
 	       "log",
 	       man->persist.log,
-	       &man->connection.log_realtime,
+	       &man->connection.cur->log_realtime,
 	       LOG_PRINT_INT_DATE|LOG_PRINT_MSG_FLAGS);
 }
 
@@ -585,7 +841,7 @@ man_echo (struct management *man, const char *parm)
 	       parm,
 	       "echo",
 	       man->persist.echo,
-	       &man->connection.echo_realtime,
+	       &man->connection.cur->echo_realtime,
 	       LOG_PRINT_INT_DATE|MANAGEMENT_ECHO_FLAGS);
 }
 
@@ -596,7 +852,7 @@ man_state (struct management *man, const char *parm)
 	       parm,
 	       "state",
 	       man->persist.state,
-	       &man->connection.state_realtime,
+	       &man->connection.cur->state_realtime,
 	       LOG_PRINT_INT_DATE|LOG_PRINT_STATE|
 	       LOG_PRINT_LOCAL_IP|LOG_PRINT_REMOTE_IP);
 }
@@ -778,7 +1034,7 @@ man_hold (struct management *man, const char *cmd)
 #define IER_NEW        1
 
 static void
-in_extra_reset (struct man_connection *mc, const int mode)
+in_extra_reset (struct man_client *mc, const int mode)
 {
   if (mc)
     {
@@ -803,7 +1059,8 @@ in_extra_reset (struct man_connection *mc, const int mode)
 static void
 in_extra_dispatch (struct management *man)
 {
-   switch (man->connection.in_extra_cmd)
+   struct man_client *mc = man->connection.cur;
+   switch (mc->in_extra_cmd)
     {
 #ifdef MANAGEMENT_DEF_AUTH
     case IEC_CLIENT_AUTH:
@@ -811,13 +1068,13 @@ in_extra_dispatch (struct management *man)
 	{
 	  const bool status = (*man->persist.callback.client_auth)
 	    (man->persist.callback.arg,
-	     man->connection.in_extra_cid,
-	     man->connection.in_extra_kid,
+	     mc->in_extra_cid,
+	     mc->in_extra_kid,
 	     true,
 	     NULL,
 	     NULL,
-	     man->connection.in_extra);
-	  man->connection.in_extra = NULL;
+	     mc->in_extra);
+	  mc->in_extra = NULL;
 	  if (status)
 	    {
 	      msg (M_CLIENT, "SUCCESS: client-auth command succeeded");
@@ -839,9 +1096,9 @@ in_extra_dispatch (struct management *man)
 	{
 	  const bool status = (*man->persist.callback.client_pf)
 	    (man->persist.callback.arg,
-	     man->connection.in_extra_cid,
-	     man->connection.in_extra);
-	  man->connection.in_extra = NULL;
+	     mc->in_extra_cid,
+	     mc->in_extra);
+	  mc->in_extra = NULL;
 	  if (status)
 	    {
 	      msg (M_CLIENT, "SUCCESS: client-pf command succeeded");
@@ -861,12 +1118,12 @@ in_extra_dispatch (struct management *man)
     case IEC_RSA_SIGN:
       man->connection.ext_key_state = EKS_READY;
       buffer_list_free (man->connection.ext_key_input);
-      man->connection.ext_key_input = man->connection.in_extra;
-      man->connection.in_extra = NULL;
+      man->connection.ext_key_input = mc->in_extra;
+      mc->in_extra = NULL;
       return;
 #endif
     }
-   in_extra_reset (&man->connection, IER_RESET);
+   in_extra_reset (mc, IER_RESET);
 }
 
 #endif /* MANAGEMENT_IN_EXTRA */
@@ -900,7 +1157,7 @@ parse_kid (const char *str, unsigned int *kid)
 static void
 man_client_auth (struct management *man, const char *cid_str, const char *kid_str, const bool extra)
 {
-  struct man_connection *mc = &man->connection;
+  struct man_client *mc = man->connection.cur;
   mc->in_extra_cid = 0;
   mc->in_extra_kid = 0;
   if (parse_cid (cid_str, &mc->in_extra_cid)
@@ -988,7 +1245,7 @@ man_client_n_clients (struct management *man)
 static void
 man_env_filter (struct management *man, const int level)
 {
-  man->connection.env_filter_level = level;
+  man->connection.cur->env_filter_level = level;
   msg (M_CLIENT, "SUCCESS: env_filter_level=%d", level);
 }
 
@@ -997,7 +1254,7 @@ man_env_filter (struct management *man, const int level)
 static void
 man_client_pf (struct management *man, const char *cid_str)
 {
-  struct man_connection *mc = &man->connection;
+  struct man_client *mc = man->connection.cur;
   mc->in_extra_cid = 0;
   mc->in_extra_kid = 0;
   if (parse_cid (cid_str, &mc->in_extra_cid))
@@ -1015,10 +1272,10 @@ man_client_pf (struct management *man, const char *cid_str)
 static void
 man_rsa_sig (struct management *man)
 {
-  struct man_connection *mc = &man->connection;
-  if (mc->ext_key_state == EKS_SOLICIT)
+  struct man_client *mc = man->connection.cur;
+  if (man->connection.ext_key_state == EKS_SOLICIT)
     {
-      mc->ext_key_state = EKS_INPUT;
+      man->connection.ext_key_state = EKS_INPUT;
       mc->in_extra_cmd = IEC_RSA_SIGN;
       in_extra_reset (mc, IER_NEW);
     }
@@ -1098,7 +1355,7 @@ man_dispatch_command (struct management *man, struct status_output *so, const ch
   ASSERT (p[0]);
   if (streq (p[0], "exit") || streq (p[0], "quit"))
     {
-      man->connection.halt = true;
+      man->connection.cur->halt = true;
       goto done;
     }
   else if (streq (p[0], "help"))
@@ -1133,6 +1390,20 @@ man_dispatch_command (struct management *man, struct status_output *so, const ch
       if (man_need (man, p, 1, 0))
 	man_signal (man, p[1]);
     }
+  else if (streq (p[0], "admission-stats"))
+    {
+      if (man->persist.callback.admission_stats)
+	(*man->persist.callback.admission_stats) (man->persist.callback.arg);
+      else
+	msg (M_CLIENT, "ERROR: The 'admission-stats' command is not supported by the current daemon mode");
+    }
+  else if (streq (p[0], "auth-stats"))
+    {
+      if (man->persist.callback.auth_stats)
+	(*man->persist.callback.auth_stats) (man->persist.callback.arg);
+      else
+	msg (M_CLIENT, "ERROR: The 'auth-stats' command is not supported by the current daemon mode");
+    }
   else if (streq (p[0], "load-stats"))
     {
       man_load_stats (man);
@@ -1149,6 +1420,11 @@ man_dispatch_command (struct management *man, struct status_output *so, const ch
       if (man_need (man, p, 1, 0))
 	man_kill (man, p[1]);
     }
+  else if (streq (p[0], "kill-user"))
+    {
+      if (man_need (man, p, 1, 0))
+	man_kill_user (man, p[1]);
+    }
   else if (streq (p[0], "verb"))
     {
       if (p[1])
@@ -1262,6 +1538,13 @@ man_dispatch_command (struct management *man, struct status_output *so, const ch
       if (man_need (man, p, 1, 0))
 	man_bytecount (man, atoi(p[1]));
     }
+#ifdef MANAGEMENT_DEF_AUTH
+  else if (streq (p[0], "metrics"))
+    {
+      if (man_need (man, p, 1, 0))
+	man_metrics (man, atoi(p[1]));
+    }
+#endif
 #ifdef MANAGEMENT_DEF_AUTH
   else if (streq (p[0], "client-kill"))
     {
@@ -1344,6 +1627,11 @@ man_dispatch_command (struct management *man, struct status_output *so, const ch
 
 #ifdef WIN32
 
+/*
+ * Windows follows the listening socket or the client socket
+ * with a single ne32 object, so we only ever have one client
+ * there (see man_settings_init).
+ */
 static void
 man_start_ne32 (struct management *man)
 {
@@ -1354,7 +1642,7 @@ man_start_ne32 (struct management *man)
       break;
     case MS_CC_WAIT_READ:
     case MS_CC_WAIT_WRITE:
-      net_event_win32_start (&man->connection.ne32, FD_READ|FD_WRITE|FD_CLOSE, man->connection.sd_cli);
+      net_event_win32_start (&man->connection.ne32, FD_READ|FD_WRITE|FD_CLOSE, man->connection.clients[0].sd);
       break;
     default:
       ASSERT (0);
@@ -1370,21 +1658,21 @@ man_stop_ne32 (struct management *man)
 #endif
 
 static void
-man_record_peer_info (struct management *man)
+man_record_peer_info (struct management *man, const struct man_client *mc)
 {
   struct gc_arena gc = gc_new ();
   if (man->settings.write_peer_info_file)
     {
       bool success = false;
 #ifdef HAVE_GETSOCKNAME
-      if (socket_defined (man->connection.sd_cli))
+      if (socket_defined (mc->sd))
 	{
 	  struct sockaddr_in addr;
 	  socklen_t addrlen = sizeof (addr);
 	  int status;
 
 	  CLEAR (addr);
-	  status = getsockname (man->connection.sd_cli, (struct sockaddr *)&addr, &addrlen);
+	  status = getsockname (mc->sd, (struct sockaddr *)&addr, &addrlen);
 	  if (!status && addrlen == sizeof (addr))
 	    {
 	      const in_addr_t a = ntohl (addr.sin_addr.s_addr);
@@ -1410,27 +1698,34 @@ man_record_peer_info (struct management *man)
 }
 
 static void
-man_connection_settings_reset (struct management *man)
+man_client_settings_reset (struct man_client *mc)
 {
-  man->connection.state_realtime = false;
-  man->connection.log_realtime = false;
-  man->connection.echo_realtime = false;
-  man->connection.bytecount_update_seconds = 0;
-  man->connection.password_verified = false;
-  man->connection.password_tries = 0;
-  man->connection.halt = false;
-  man->connection.state = MS_CC_WAIT_WRITE;
+  mc->state_realtime = false;
+  mc->log_realtime = false;
+  mc->echo_realtime = false;
+  mc->bytecount_update_seconds = 0;
+#ifdef MANAGEMENT_DEF_AUTH
+  mc->metrics_update_seconds = 0;
+#endif
+  mc->env_filter_level = 0;
+  mc->password_verified = false;
+  mc->password_tries = 0;
+  mc->persist_rwflags = 0;
+  mc->halt = false;
+  mc->state = MS_CC_WAIT_WRITE;
 }
 
 static void
-man_new_connection_post (struct management *man, const char *description)
+man_new_connection_post (struct management *man, struct man_client *mc, const char *description)
 {
   struct gc_arena gc = gc_new ();
+  struct man_client *cur = man->connection.cur;
 
-  set_nonblock (man->connection.sd_cli);
-  set_cloexec (man->connection.sd_cli);
+  set_nonblock (mc->sd);
+  set_cloexec (mc->sd);
 
-  man_connection_settings_reset (man);
+  man_client_settings_reset (mc);
+  man->connection.state = MS_CC_WAIT_WRITE;
 
 #ifdef WIN32
   man_start_ne32 (man);
@@ -1449,11 +1744,14 @@ man_new_connection_post (struct management *man, const char *description)
 	 description,
 	 print_sockaddr (&man->settings.local, &gc));
 
-  buffer_list_reset (man->connection.out);
+  man_client_out_reset (mc);
 
-  if (!man_password_needed (man))
+  /* the greeting is for the new client only */
+  man->connection.cur = mc;
+  if (!man_password_needed (man, mc))
     man_welcome (man);
-  man_prompt (man);
+  man_prompt (man, mc);
+  man->connection.cur = cur;
   man_update_io_state (man);
 
   gc_free (&gc);
@@ -1467,7 +1765,7 @@ man_verify_unix_peer_uid_gid (struct management *man, const socket_descriptor_t
     {
       static const char err_prefix[] = "MANAGEMENT: unix domain socket client connection rejected --";
       int uid, gid;
-      if (unix_socket_get_peer_uid_gid (man->connection.sd_cli, &uid, &gid))
+      if (unix_socket_get_peer_uid_gid (sd, &uid, &gid))
 	{
 	  if (man->settings.client_uid != -1 && man->settings.client_uid != uid)
 	    {
@@ -1496,6 +1794,24 @@ static void
 man_accept (struct management *man)
 {
   struct link_socket_actual act;
+  struct man_client *mc = NULL;
+  int i;
+
+  /*
+   * Find a free client slot, we don't listen
+   * for connections while all are taken.
+   */
+  for (i = 0; i < man->connection.n_slots; ++i)
+    {
+      if (man->connection.clients[i].state == MS_INITIAL)
+	{
+	  mc = &man->connection.clients[i];
+	  break;
+	}
+    }
+  if (!mc)
+    return;
+
   CLEAR (act);
 
   /*
@@ -1505,17 +1821,17 @@ man_accept (struct management *man)
   if (man->settings.flags & MF_UNIX_SOCK)
     {
       struct sockaddr_un remote;
-      man->connection.sd_cli = socket_accept_unix (man->connection.sd_top, &remote);
-      if (!man_verify_unix_peer_uid_gid (man, man->connection.sd_cli))
-	sd_close (&man->connection.sd_cli);
+      mc->sd = socket_accept_unix (man->connection.sd_top, &remote);
+      if (!man_verify_unix_peer_uid_gid (man, mc->sd))
+	sd_close (&mc->sd);
     }
   else
 #endif
-    man->connection.sd_cli = socket_do_accept (man->connection.sd_top, &act, false);
+    mc->sd = socket_do_accept (man->connection.sd_top, &act, false);
 
-  if (socket_defined (man->connection.sd_cli))
+  if (socket_defined (mc->sd))
     {
-      man->connection.remote = act.dest;
+      mc->remote = act.dest;
 
       if (socket_defined (man->connection.sd_top))
 	{
@@ -1524,7 +1840,7 @@ man_accept (struct management *man)
 #endif
 	}
 
-      man_new_connection_post (man, "Client connected from");
+      man_new_connection_post (man, mc, "Client connected from");
     }
 }
 
@@ -1537,7 +1853,6 @@ man_listen (struct management *man)
    * Initialize state
    */
   man->connection.state = MS_LISTEN;
-  man->connection.sd_cli = SOCKET_UNDEFINED;
 
   /*
    * Initialize listening socket
@@ -1561,7 +1876,7 @@ man_listen (struct management *man)
       /*
        * Listen for connection
        */
-      if (listen (man->connection.sd_top, 1))
+      if (listen (man->connection.sd_top, man->connection.n_slots))
 	msg (M_SOCKERR, "MANAGEMENT: listen() failed");
 
       /*
@@ -1593,6 +1908,7 @@ static void
 man_connect (struct management *man)
 {
   struct gc_arena gc = gc_new ();
+  struct man_client *mc = &man->connection.clients[0];
   int status;
   int signal_received = 0;
 
@@ -1605,23 +1921,23 @@ man_connect (struct management *man)
 #if UNIX_SOCK_SUPPORT
   if (man->settings.flags & MF_UNIX_SOCK)
     {
-      man->connection.sd_cli = create_socket_unix ();
-      status = socket_connect_unix (man->connection.sd_cli, &man->settings.local_unix);
-      if (!status && !man_verify_unix_peer_uid_gid (man, man->connection.sd_cli))
+      mc->sd = create_socket_unix ();
+      status = socket_connect_unix (mc->sd, &man->settings.local_unix);
+      if (!status && !man_verify_unix_peer_uid_gid (man, mc->sd))
 	  {
 #ifdef EPERM
 	    status = EPERM;
 #else
 	    status = 1;
 #endif
-	    sd_close (&man->connection.sd_cli);
+	    sd_close (&mc->sd);
 	  }
     }
   else
 #endif
     {
-      man->connection.sd_cli = create_socket_tcp ();
-      status = openvpn_connect (man->connection.sd_cli,
+      mc->sd = create_socket_tcp ();
+      status = openvpn_connect (mc->sd,
 				&man->settings.local,
 				5,
 				&signal_received);
@@ -1653,58 +1969,62 @@ man_connect (struct management *man)
       goto done;
     }
 
-  man_record_peer_info (man);
-  man_new_connection_post (man, "Connected to management server at");
+  man_record_peer_info (man, mc);
+  man_new_connection_post (man, mc, "Connected to management server at");
 
  done:
   gc_free (&gc);
 }
 
 static void
-man_reset_client_socket (struct management *man, const bool exiting)
+man_reset_client_socket (struct management *man, struct man_client *mc, const bool exiting)
 {
-  if (socket_defined (man->connection.sd_cli))
+  if (socket_defined (mc->sd))
     {
 #ifdef WIN32
       man_stop_ne32 (man);
 #endif
-      man_close_socket (man, man->connection.sd_cli);
-      man->connection.sd_cli = SOCKET_UNDEFINED;
-      man->connection.state = MS_INITIAL;
-      command_line_reset (man->connection.in);
-      buffer_list_reset (man->connection.out);
+      man_close_socket (man, mc->sd);
+      mc->sd = SOCKET_UNDEFINED;
+      mc->state = MS_INITIAL;
+      command_line_reset (mc->in);
+      man_client_out_reset (mc);
 #ifdef MANAGEMENT_IN_EXTRA
-      in_extra_reset (&man->connection, IER_RESET);
+      in_extra_reset (mc, IER_RESET);
 #endif
+      man_update_intervals (man);
+      man_update_io_state (man);
       msg (D_MANAGEMENT, "MANAGEMENT: Client disconnected");
-    }
-  if (!exiting)
-    {
+
+      /* the remaining actions follow the last client out */
+      if (!exiting && !man->connection.n_clients)
+	{
 #if defined(USE_CRYPTO) && defined(USE_SSL)
-      if (man->settings.flags & MF_FORGET_DISCONNECT)
-	ssl_purge_auth (false);
+	  if (man->settings.flags & MF_FORGET_DISCONNECT)
+	    ssl_purge_auth (false);
 #endif
-      if (man->settings.flags & MF_SIGNAL) {
-      	  int mysig = man_mod_signal (man, SIGUSR1);
-	  if (mysig >= 0)
+	  if (man->settings.flags & MF_SIGNAL) {
+	      int mysig = man_mod_signal (man, SIGUSR1);
+	      if (mysig >= 0)
+		{
+		  msg (D_MANAGEMENT, "MANAGEMENT: Triggering management signal");
+		  throw_signal_soft (mysig, "management-disconnect");
+		}
+	  }
+
+	  if (man->settings.flags & MF_CONNECT_AS_CLIENT)
 	    {
-	      msg (D_MANAGEMENT, "MANAGEMENT: Triggering management signal");
-	      throw_signal_soft (mysig, "management-disconnect");
+	      msg (D_MANAGEMENT, "MANAGEMENT: Triggering management exit");
+	      throw_signal_soft (SIGTERM, "management-exit");
 	    }
-      }
-
-      if (man->settings.flags & MF_CONNECT_AS_CLIENT)
-	{
-	  msg (D_MANAGEMENT, "MANAGEMENT: Triggering management exit");
-	  throw_signal_soft (SIGTERM, "management-exit");
+	  else
+	    man_listen (man);
 	}
-      else
-	man_listen (man);
     }
 }
 
 static void
-man_process_command (struct management *man, const char *line)
+man_process_command (struct management *man, struct man_client *mc, const char *line)
 {
   struct gc_arena gc = gc_new ();
   struct status_output *so;
@@ -1714,12 +2034,12 @@ man_process_command (struct management *man, const char *line)
   CLEAR (parms);
   so = status_open (NULL, 0, -1, &man->persist.vout, 0);
 #ifdef MANAGEMENT_IN_EXTRA
-  in_extra_reset (&man->connection, IER_RESET);
+  in_extra_reset (mc, IER_RESET);
 #endif
 
-  if (man_password_needed (man))
+  if (man_password_needed (man, mc))
     {
-      man_check_password (man, line);
+      man_check_password (man, mc, line);
     }
   else
     {
@@ -1766,7 +2086,7 @@ man_io_error (struct management *man, const char *prefix)
 }
 
 static int
-man_read (struct management *man)
+man_read (struct management *man, struct man_client *mc)
 {
   /*
    * read command line from socket
@@ -1774,92 +2094,103 @@ man_read (struct management *man)
   unsigned char buf[256];
   int len = 0;
 
-  len = recv (man->connection.sd_cli, buf, sizeof (buf), MSG_NOSIGNAL);
+  len = recv (mc->sd, buf, sizeof (buf), MSG_NOSIGNAL);
   if (len == 0)
     {
-      man_reset_client_socket (man, false);
+      man_reset_client_socket (man, mc, false);
     }
   else if (len > 0)
     {
+      struct man_client *cur = man->connection.cur;
       bool processed_command = false;
 
       ASSERT (len <= (int) sizeof (buf));
-      command_line_add (man->connection.in, buf, len);
+      command_line_add (mc->in, buf, len);
 
       /*
        * Reset output object
        */
-      buffer_list_reset (man->connection.out);
+      man_client_out_reset (mc);
 
       /*
-       * process command line if complete
+       * process command line if complete, sending
+       * the responses to this client
        */
+      man->connection.cur = mc;
       {
 	const unsigned char *line;
-	while ((line = command_line_get (man->connection.in)))
+	while ((line = command_line_get (mc->in)))
 	  {
 #ifdef MANAGEMENT_IN_EXTRA
-	    if (man->connection.in_extra)
+	    if (mc->in_extra)
 	      {
 		if (!strcmp ((char *)line, "END"))
 		  in_extra_dispatch (man);
 		else
-		  buffer_list_push (man->connection.in_extra, line);
+		  buffer_list_push (mc->in_extra, line);
 	      }
 	    else
 #endif
-	      man_process_command (man, (char *) line);
-	    if (man->connection.halt)
+	      man_process_command (man, mc, (char *) line);
+	    if (mc->halt || !man_client_connected (mc))
 	      break;
-	    command_line_next (man->connection.in);
+	    command_line_next (mc->in);
 	    processed_command = true;
 	  }
       }
+      man->connection.cur = cur;
 
       /*
        * Reset output state to MS_CC_WAIT_(READ|WRITE)
        */
-      if (man->connection.halt)
+      if (mc->halt)
+	{
+	  man_reset_client_socket (man, mc, false);
+	  len = 0;
+	}
+      else if (!man_client_connected (mc))
 	{
-	  man_reset_client_socket (man, false);
 	  len = 0;
 	}
       else
 	{
 	  if (processed_command)
-	    man_prompt (man);
+	    man_prompt (man, mc);
 	  man_update_io_state (man);
 	}
     }
   else /* len < 0 */
     {
       if (man_io_error (man, "recv"))
-	man_reset_client_socket (man, false);
+	man_reset_client_socket (man, mc, false);
     }
   return len;
 }
 
 static int
-man_write (struct management *man)
+man_write (struct management *man, struct man_client *mc)
 {
   const int size_hint = 1024;
   int sent = 0;
   const struct buffer *buf;
 
-  buffer_list_aggregate(man->connection.out, size_hint);
-  buf = buffer_list_peek (man->connection.out);
+  buffer_list_aggregate(mc->out, size_hint);
+  buf = buffer_list_peek (mc->out);
   if (buf && BLEN (buf))
     {
       const int len = min_int (size_hint, BLEN (buf));
-      sent = send (man->connection.sd_cli, BPTR (buf), len, MSG_NOSIGNAL);
+      sent = send (mc->sd, BPTR (buf), len, MSG_NOSIGNAL);
       if (sent >= 0)
 	{
-	  buffer_list_advance (man->connection.out, sent);
+	  buffer_list_advance (mc->out, sent);
+	  mc->out_bytes -= min_int (sent, (int) mc->out_bytes);
+	  if (sent > 0)
+	    mc->out_progress = now;
 	}
       else if (sent < 0)
 	{
 	  if (man_io_error (man, "send"))
-	    man_reset_client_socket (man, false);
+	    man_reset_client_socket (man, mc, false);
 	}
     }
 
@@ -1881,7 +2212,6 @@ man_connection_clear (struct man_connection *mc)
 
   /* clear socket descriptors */
   mc->sd_top = SOCKET_UNDEFINED;
-  mc->sd_cli = SOCKET_UNDEFINED;
 }
 
 static void
@@ -1947,6 +2277,7 @@ man_settings_init (struct man_settings *ms,
 		   const char *pass_file,
 		   const char *client_user,
 		   const char *client_group,
+		   const int max_clients,
 		   const int log_history_cache,
 		   const int echo_buffer_size,
 		   const int state_buffer_size,
@@ -1990,6 +2321,19 @@ man_settings_init (struct man_settings *ms,
 
       ms->write_peer_info_file = string_alloc (write_peer_info_file, NULL);
 
+      /*
+       * As a client we make exactly one connection.  Windows
+       * can only follow one client socket, see man_start_ne32().
+       */
+      ms->max_clients = constrain_int (max_clients, 1, MANAGEMENT_MAX_CLIENTS);
+#ifdef WIN32
+      if (ms->max_clients > 1)
+	msg (M_WARN, "MANAGEMENT: only one client at a time is supported on Windows");
+      ms->max_clients = 1;
+#endif
+      if (flags & MF_CONNECT_AS_CLIENT)
+	ms->max_clients = 1;
+
 #if UNIX_SOCK_SUPPORT
       if (ms->flags & MF_UNIX_SOCK)
 	sockaddr_unix_init (&ms->local_unix, addr);
@@ -2050,6 +2394,8 @@ man_connection_init (struct management *man)
 {
   if (man->connection.state == MS_INITIAL)
     {
+      int i;
+
 #ifdef WIN32
       /*
        * This object is a sort of TCP/IP helper
@@ -2059,18 +2405,26 @@ man_connection_init (struct management *man)
 #endif
 
       /*
-       * Allocate helper objects for command line input and
-       * command output from/to the socket.
+       * Allocate client slots, each with helper objects for
+       * command line input and command output from/to its socket.
        */
-      man->connection.in = command_line_new (1024);
-      man->connection.out = buffer_list_new (0);
+      man->connection.n_slots = man->settings.max_clients;
+      ALLOC_ARRAY_CLEAR (man->connection.clients, struct man_client, man->connection.n_slots);
+      for (i = 0; i < man->connection.n_slots; ++i)
+	{
+	  struct man_client *mc = &man->connection.clients[i];
+	  mc->state = MS_INITIAL;
+	  mc->sd = SOCKET_UNDEFINED;
+	  mc->in = command_line_new (1024);
+	  mc->out = buffer_list_new (0);
+	}
 
       /*
        * Initialize event set for standalone usage, when we are
        * running outside of the primary event loop.
        */
       {
-	int maxevents = 1;
+	int maxevents = man->connection.n_slots + 1;
 	man->connection.es = event_set_init (&maxevents, EVENT_METHOD_FAST);
       }
 
@@ -2088,6 +2442,7 @@ static void
 man_connection_close (struct management *man)
 {
   struct man_connection *mc = &man->connection;
+  int i;
 
   if (mc->es)
     event_free (mc->es);
@@ -2099,15 +2454,20 @@ man_connection_close (struct management *man)
       man_close_socket (man, mc->sd_top);
       man_delete_unix_socket (man);
     }
-  if (socket_defined (mc->sd_cli))
-    man_close_socket (man, mc->sd_cli);
-  if (mc->in)
-    command_line_free (mc->in);
-  if (mc->out)
-    buffer_list_free (mc->out);
+  for (i = 0; i < mc->n_slots; ++i)
+    {
+      struct man_client *cli = &mc->clients[i];
+      if (socket_defined (cli->sd))
+	man_close_socket (man, cli->sd);
+      if (cli->in)
+	command_line_free (cli->in);
+      if (cli->out)
+	buffer_list_free (cli->out);
 #ifdef MANAGEMENT_IN_EXTRA
-  in_extra_reset (&man->connection, IER_RESET);
+      in_extra_reset (cli, IER_RESET);
 #endif
+    }
+  free (mc->clients);
 #ifdef MANAGMENT_EXTERNAL_KEY
   buffer_list_free (mc->ext_key_input);
 #endif
@@ -2137,6 +2497,7 @@ management_open (struct management *man,
 		 const char *pass_file,
 		 const char *client_user,
 		 const char *client_group,
+		 const int max_clients,
 		 const int log_history_cache,
 		 const int echo_buffer_size,
 		 const int state_buffer_size,
@@ -2156,6 +2517,7 @@ management_open (struct management *man,
 		     pass_file,
 		     client_user,
 		     client_group,
+		     max_clients,
 		     log_history_cache,
 		     echo_buffer_size,
 		     state_buffer_size,
@@ -2237,17 +2599,15 @@ management_set_state (struct management *man,
       
       log_history_add (man->persist.state, &e);
 
-      if (man->connection.state_realtime)
-	out = log_entry_print (&e, LOG_PRINT_STATE_PREFIX
-			       |   LOG_PRINT_INT_DATE
-                               |   LOG_PRINT_STATE
-			       |   LOG_PRINT_LOCAL_IP
-			       |   LOG_PRINT_REMOTE_IP
-                               |   LOG_PRINT_CRLF
-			       |   LOG_ECHO_TO_LOG, &gc);
-
-      if (out)
-	man_output_list_push (man, out);
+      out = log_entry_print (&e, LOG_PRINT_STATE_PREFIX
+			     |   LOG_PRINT_INT_DATE
+			     |   LOG_PRINT_STATE
+			     |   LOG_PRINT_LOCAL_IP
+			     |   LOG_PRINT_REMOTE_IP
+			     |   LOG_PRINT_CRLF
+			     |   LOG_ECHO_TO_LOG, &gc);
+      man_notify (man, MN_STATE, out);
+      man_output_list_push_finalize (man);
 
       gc_free (&gc);
     }
@@ -2293,20 +2653,45 @@ env_filter_match (const char *env_str, const int env_filter_level)
   return false;
 }
 
+/*
+ * Send an environment to each client, applying
+ * the client's env-filter level if filter is set.
+ */
 static void
-man_output_env (const struct env_set *es, const bool tail, const int env_filter_level, const char *prefix)
+man_output_env (struct management *man, const struct env_set *es, const bool tail, const bool filter, const char *prefix)
 {
-  if (es)
+  struct gc_arena gc = gc_new ();
+  int i;
+
+  for (i = 0; i < man->connection.n_slots; ++i)
     {
-      struct env_item *e;
-      for (e = es->list; e != NULL; e = e->next)
+      struct man_client *mc = &man->connection.clients[i];
+      const int env_filter_level = filter ? mc->env_filter_level : 0;
+
+      if (!man_client_notifiable (man, mc, MN_CLIENT))
+	continue;
+      if (es)
+	{
+	  struct env_item *e;
+	  for (e = es->list; e != NULL; e = e->next)
+	    {
+	      if (e->string && (!env_filter_level || env_filter_match(e->string, env_filter_level)))
+		{
+		  struct buffer out = alloc_buf_gc (strlen (e->string) + strlen (prefix) + 16, &gc);
+		  buf_printf (&out, ">%s:ENV,%s\r\n", prefix, e->string);
+		  man_client_notify (man, mc, MN_CLIENT, BSTR (&out));
+		}
+	    }
+	}
+      if (tail)
 	{
-	  if (e->string && (!env_filter_level || env_filter_match(e->string, env_filter_level)))
-	    msg (M_CLIENT, ">%s:ENV,%s", prefix, e->string);
+	  struct buffer out = alloc_buf_gc (strlen (prefix) + 16, &gc);
+	  buf_printf (&out, ">%s:ENV,END\r\n", prefix);
+	  man_client_notify (man, mc, MN_CLIENT, BSTR (&out));
 	}
     }
-  if (tail)
-    msg (M_CLIENT, ">%s:ENV,END", prefix);
+  man_output_list_push_finalize (man);
+  gc_free (&gc);
 }
 
 static void
@@ -2319,7 +2704,7 @@ man_output_extra_env (struct management *man, const char *prefix)
       const int nclients = (*man->persist.callback.n_clients) (man->persist.callback.arg);
       setenv_int (es, "n_clients", nclients);
     }
-  man_output_env (es, false, man->connection.env_filter_level, prefix);
+  man_output_env (man, es, false, true, prefix);
   gc_free (&gc);
 }
 
@@ -2329,7 +2714,7 @@ management_up_down(struct management *man, const char *updown, const struct env_
   if (man->settings.flags & MF_UP_DOWN)
     {
       msg (M_CLIENT, ">UPDOWN:%s", updown);
-      man_output_env (es, true, 0, "UPDOWN");
+      man_output_env (man, es, true, false, "UPDOWN");
     }
 }
 
@@ -2407,7 +2792,7 @@ management_notify_client_needing_auth (struct management *management,
       msg (M_CLIENT, ">CLIENT:%s,%lu,%u", mode, mdac->cid, mda_key_id);
       man_output_extra_env (management, "CLIENT");
       man_output_peer_info_env(management, mdac);
-      man_output_env (es, true, management->connection.env_filter_level, "CLIENT");
+      man_output_env (management, es, true, true, "CLIENT");
       mdac->flags |= DAF_INITIAL_AUTH;
     }
 }
@@ -2420,7 +2805,7 @@ management_connection_established (struct management *management,
   mdac->flags |= DAF_CONNECTION_ESTABLISHED;
   msg (M_CLIENT, ">CLIENT:ESTABLISHED,%lu", mdac->cid);
   man_output_extra_env (management, "CLIENT");
-  man_output_env (es, true, management->connection.env_filter_level, "CLIENT");
+  man_output_env (management, es, true, true, "CLIENT");
 }
 
 void
@@ -2431,7 +2816,7 @@ management_notify_client_close (struct management *management,
   if ((mdac->flags & DAF_INITIAL_AUTH) && !(mdac->flags & DAF_CONNECTION_CLOSED))
     {
       msg (M_CLIENT, ">CLIENT:DISCONNECT,%lu", mdac->cid);
-      man_output_env (es, true, management->connection.env_filter_level, "CLIENT");
+      man_output_env (management, es, true, true, "CLIENT");
       mdac->flags |= DAF_CONNECTION_CLOSED;
     }
 }
@@ -2453,6 +2838,88 @@ management_learn_addr (struct management *management,
   gc_free (&gc);
 }
 
+/*
+ * All subscribers share one stream of metrics, so a round waits
+ * until each of them has room for it.  A subscriber which stopped
+ * reading is dropped rather than waited for.
+ */
+bool
+management_metrics_due (struct management *man)
+{
+  int i;
+
+  if (man->connection.metrics_update_seconds <= 0
+      || now < man->connection.metrics_last_update + man->connection.metrics_update_seconds)
+    return false;
+  for (i = 0; i < man->connection.n_slots; ++i)
+    {
+      struct man_client *mc = &man->connection.clients[i];
+      if (man_client_notifiable (man, mc, MN_METRICS)
+	  && mc->out->size > MANAGEMENT_METRICS_BACKLOG
+	  && !man_client_drop_stuck (mc))
+	return false;
+    }
+  return true;
+}
+
+/*
+ * Queue a ">METRICS:" record for a client if its counters changed
+ * since the last one.  Return true if a record was queued.
+ */
+bool
+management_metrics_client (struct management *management,
+			   struct man_def_auth_context *mdac,
+			   const struct man_metrics *current)
+{
+  struct man_metrics *last = &mdac->metrics_reported;
+  bool ret = false;
+
+  if (mdac->metrics_epoch != management->persist.metrics_epoch)
+    {
+      CLEAR (*last);
+      mdac->metrics_epoch = management->persist.metrics_epoch;
+    }
+
+  if (current->bytes_in != last->bytes_in
+      || current->bytes_out != last->bytes_out
+      || current->packets_in != last->packets_in
+      || current->packets_out != last->packets_out
+      || current->drops != last->drops
+      || current->key_negotiations != last->key_negotiations)
+    {
+      struct gc_arena gc = gc_new ();
+      struct buffer out = alloc_buf_gc (256, &gc);
+
+      /* do in a roundabout way to work around possible mingw or mingw-glibc bug */
+      buf_printf (&out, ">METRICS:%lu", mdac->cid);
+      buf_printf (&out, "," counter_format, current->bytes_in - last->bytes_in);
+      buf_printf (&out, "," counter_format, current->bytes_out - last->bytes_out);
+      buf_printf (&out, "," counter_format, current->packets_in - last->packets_in);
+      buf_printf (&out, "," counter_format, current->packets_out - last->packets_out);
+      buf_printf (&out, "," counter_format, current->drops - last->drops);
+      buf_printf (&out, ",%d,%d\r\n", current->rtt, current->key_negotiations - last->key_negotiations);
+      man_notify (management, MN_METRICS, BSTR (&out));
+      *last = *current;
+      ret = true;
+      gc_free (&gc);
+    }
+  return ret;
+}
+
+/*
+ * Close a round of "metrics" output.
+ */
+void
+management_metrics_end (struct management *management, const int n_records)
+{
+  char buf[64];
+
+  openvpn_snprintf (buf, sizeof (buf), ">METRICS_END:%u,%d\r\n", (unsigned int)now, n_records);
+  man_notify (management, MN_METRICS, buf);
+  man_output_list_push_finalize (management);
+  management->connection.metrics_last_update = now;
+}
+
 #endif /* MANAGEMENT_DEF_AUTH */
 
 void
@@ -2472,11 +2939,9 @@ management_echo (struct management *man, const char *string, const bool pull)
 
       log_history_add (man->persist.echo, &e);
 
-      if (man->connection.echo_realtime)
-	out = log_entry_print (&e, LOG_PRINT_INT_DATE|LOG_PRINT_ECHO_PREFIX|LOG_PRINT_CRLF|MANAGEMENT_ECHO_FLAGS, &gc);
-
-      if (out)
-	man_output_list_push (man, out);
+      out = log_entry_print (&e, LOG_PRINT_INT_DATE|LOG_PRINT_ECHO_PREFIX|LOG_PRINT_CRLF|MANAGEMENT_ECHO_FLAGS, &gc);
+      man_notify (man, MN_ECHO, out);
+      man_output_list_push_finalize (man);
 
       gc_free (&gc);
     }
@@ -2571,13 +3036,14 @@ management_io (struct management *man)
 {
   if (man->connection.state != MS_INITIAL)
     {
+      struct man_client *mc = &man->connection.clients[0];
       long net_events;
       net_event_win32_reset (&man->connection.ne32);
       net_events = net_event_win32_get_event_mask (&man->connection.ne32);
 
       if (net_events & FD_CLOSE)
 	{
-	  man_reset_client_socket (man, false);
+	  man_reset_client_socket (man, mc, false);
 	}
       else
 	{
@@ -2593,7 +3059,7 @@ management_io (struct management *man)
 	    {
 	      if (net_events & FD_READ)
 		{
-		  while (man_read (man) > 0)
+		  while (man_read (man, mc) > 0)
 		    ;
 		  net_event_win32_clear_selected_events (&man->connection.ne32, FD_READ);
 		}
@@ -2601,7 +3067,7 @@ management_io (struct management *man)
 	      if (net_events & FD_WRITE)
 		{
 		  int status;
-		  status = man_write (man);
+		  status = man_write (man, mc);
 		  if (status < 0 && WSAGetLastError() == WSAEWOULDBLOCK)
 		    {
 		      net_event_win32_clear_selected_events (&man->connection.ne32, FD_WRITE);
@@ -2614,51 +3080,109 @@ management_io (struct management *man)
 
 #else
 
+static inline unsigned int
+man_listen_rwflags (const struct man_connection *mcn)
+{
+  return mcn->n_clients < mcn->n_slots ? EVENT_READ : 0;
+}
+
+static inline unsigned int
+man_client_rwflags (const struct man_client *mc)
+{
+  return mc->state == MS_CC_WAIT_WRITE ? EVENT_WRITE : EVENT_READ;
+}
+
+/*
+ * Register the listening socket, while there is a free client
+ * slot, and every client socket.  With a persistent event set,
+ * only the sockets whose wanted events changed are updated.
+ */
 void
 management_socket_set (struct management *man,
 		       struct event_set *es,
 		       void *arg,
 		       unsigned int *persistent)
 {
-  switch (man->connection.state)
+  struct man_connection *mcn = &man->connection;
+  int i;
+
+  if (mcn->state == MS_INITIAL)
+    return;
+
+  if (persistent && !*persistent)
     {
-    case MS_LISTEN:
-      if (man_persist_state (persistent, 1))
-	event_ctl (es, man->connection.sd_top, EVENT_READ, arg);
-      break;
-    case MS_CC_WAIT_READ:
-      if (man_persist_state (persistent, 2))
-	event_ctl (es, man->connection.sd_cli, EVENT_READ, arg);
-      break;
-    case MS_CC_WAIT_WRITE:
-      if (man_persist_state (persistent, 3))
-	event_ctl (es, man->connection.sd_cli, EVENT_WRITE, arg);
-      break;
-    case MS_INITIAL:
-      break;
-    default:
-      ASSERT (0);
+      /* a new event set knows about none of our sockets */
+      mcn->listen_rwflags = 0;
+      for (i = 0; i < mcn->n_slots; ++i)
+	mcn->clients[i].persist_rwflags = 0;
+      *persistent = 1;
+    }
+
+  if (socket_defined (mcn->sd_top))
+    {
+      const unsigned int rwflags = man_listen_rwflags (mcn);
+      if (!persistent || mcn->listen_rwflags != rwflags)
+	{
+	  event_ctl (es, mcn->sd_top, rwflags, arg);
+	  mcn->listen_rwflags = rwflags;
+	}
+    }
+
+  for (i = 0; i < mcn->n_slots; ++i)
+    {
+      struct man_client *mc = &mcn->clients[i];
+      if (man_client_connected (mc))
+	{
+	  const unsigned int rwflags = man_client_rwflags (mc);
+	  if (!persistent || mc->persist_rwflags != rwflags)
+	    {
+	      event_ctl (es, mc->sd, rwflags, arg);
+	      mc->persist_rwflags = rwflags;
+	    }
+	}
     }
 }
 
+/*
+ * The caller's event set only tells us that one of our sockets
+ * is ready, so poll them again to find out which.
+ */
 void
 management_io (struct management *man)
 {
-  switch (man->connection.state)
+  struct man_connection *mcn = &man->connection;
+  struct event_set_return esr[MANAGEMENT_MAX_CLIENTS + 1];
+  struct timeval tv;
+  int i, status;
+
+  if (mcn->state == MS_INITIAL)
+    return;
+
+  event_reset (mcn->es);
+  if (socket_defined (mcn->sd_top))
+    event_ctl (mcn->es, mcn->sd_top, man_listen_rwflags (mcn), mcn);
+  for (i = 0; i < mcn->n_slots; ++i)
     {
-    case MS_LISTEN:
-      man_accept (man);
-      break;
-    case MS_CC_WAIT_READ:
-      man_read (man);
-      break;
-    case MS_CC_WAIT_WRITE:
-      man_write (man);
-      break;
-    case MS_INITIAL:
-      break;
-    default:
-      ASSERT (0);
+      struct man_client *mc = &mcn->clients[i];
+      if (man_client_connected (mc))
+	event_ctl (mcn->es, mc->sd, man_client_rwflags (mc), mc);
+    }
+
+  tv.tv_sec = 0;
+  tv.tv_usec = 0;
+  status = event_wait (mcn->es, &tv, esr, mcn->n_slots + 1);
+  for (i = 0; i < status; ++i)
+    {
+      if (esr[i].arg == mcn)
+	man_accept (man);
+      else
+	{
+	  struct man_client *mc = (struct man_client *) esr[i].arg;
+	  if (mc->state == MS_CC_WAIT_READ)
+	    man_read (man, mc);
+	  else if (mc->state == MS_CC_WAIT_WRITE)
+	    man_write (man, mc);
+	}
     }
 }
 
@@ -2682,11 +3206,34 @@ man_check_for_signals (volatile int *signal_received)
   return false;
 }
 
+/*
+ * Wait only for clients which have output pending.  Interest in
+ * every other socket is cleared explicitly, since event_reset()
+ * keeps earlier registrations with epoll.
+ */
+static void
+man_socket_set_output (struct management *man, struct event_set *es)
+{
+#ifdef WIN32
+  management_socket_set (man, es, NULL, NULL);
+#else
+  int i;
+  if (socket_defined (man->connection.sd_top))
+    event_ctl (es, man->connection.sd_top, 0, NULL);
+  for (i = 0; i < man->connection.n_slots; ++i)
+    {
+      const struct man_client *mc = &man->connection.clients[i];
+      if (socket_defined (mc->sd))
+	event_ctl (es, mc->sd, mc->state == MS_CC_WAIT_WRITE ? EVENT_WRITE : 0, NULL);
+    }
+#endif
+}
+
 /*
  * Wait for socket I/O when outside primary event loop
  */
 static int
-man_block (struct management *man, volatile int *signal_received, const time_t expire)
+man_block (struct management *man, volatile int *signal_received, const time_t expire, const bool output_only)
 {
   struct timeval tv;
   struct event_set_return esr;
@@ -2697,7 +3244,10 @@ man_block (struct management *man, volatile int *signal_received, const time_t e
       while (true)
 	{
 	  event_reset (man->connection.es);
-	  management_socket_set (man, man->connection.es, NULL, NULL);
+	  if (output_only)
+	    man_socket_set_output (man, man->connection.es);
+	  else
+	    management_socket_set (man, man->connection.es, NULL, NULL);
 	  tv.tv_usec = 0;
 	  tv.tv_sec = 1;
 	  if (man_check_for_signals (signal_received))
@@ -2736,11 +3286,18 @@ man_output_standalone (struct management *man, volatile int *signal_received)
 {
   if (man_standalone_ok (man))
     {
+      /* only write here, reading could run a command in the middle of another */
       while (man->connection.state == MS_CC_WAIT_WRITE)
 	{
-	  management_io (man);
+	  int i;
+	  for (i = 0; i < man->connection.n_slots; ++i)
+	    {
+	      struct man_client *mc = &man->connection.clients[i];
+	      if (mc->state == MS_CC_WAIT_WRITE)
+		man_write (man, mc);
+	    }
 	  if (man->connection.state == MS_CC_WAIT_WRITE)
-	    man_block (man, signal_received, 0);
+	    man_block (man, signal_received, 0, true);
 	  if (signal_received && *signal_received)
 	    break;
 	}
@@ -2756,7 +3313,7 @@ man_standalone_event_loop (struct management *man, volatile int *signal_received
   int status = -1;
   if (man_standalone_ok (man))
     {
-      status = man_block (man, signal_received, expire);
+      status = man_block (man, signal_received, expire, false);
       if (status > 0)
 	management_io (man);
     }
@@ -2789,7 +3346,7 @@ man_wait_for_client_connection (struct management *man,
 	man_standalone_event_loop (man, signal_received, expire);
 	if (signal_received && *signal_received)
 	  break;
-      } while (man->connection.state == MS_LISTEN || man_password_needed (man));
+      } while (!man_client_verified (man));
     }
 }
 
@@ -3010,10 +3567,17 @@ management_query_rsa_sig (struct management *man,
   else if (mc->ext_key_state == EKS_INPUT || mc->ext_key_state == EKS_READY)
     msg (M_CLIENT, "ERROR: rsa-sig command failed");
 
-  /* revert state */
+  /* revert state, including any half-read signature */
   man->persist.standalone_disabled = standalone_disabled_save;
   man->persist.special_state_msg = NULL;
-  in_extra_reset (mc, IER_RESET);
+  {
+    int i;
+    for (i = 0; i < mc->n_slots; ++i)
+      {
+	if (mc->clients[i].in_extra_cmd == IEC_RSA_SIGN)
+	  in_extra_reset (&mc->clients[i], IER_RESET);
+      }
+  }
   mc->ext_key_state = EKS_UNDEF;
   buffer_list_free (mc->ext_key_input);
   mc->ext_key_input = NULL;
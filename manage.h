@@ -37,11 +37,33 @@
 #define MANAGEMENT_LOG_HISTORY_INITIAL_SIZE   100
 #define MANAGEMENT_ECHO_BUFFER_SIZE           100
 #define MANAGEMENT_STATE_BUFFER_SIZE          100
+#define MANAGEMENT_MAX_CLIENTS                 16
+
+/*
+ * Drop a management client when a notification arrives while more
+ * than MANAGEMENT_OUT_MAX bytes are queued for it, or while its
+ * queue has not shrunk for MANAGEMENT_OUT_STALL seconds.
+ */
+#define MANAGEMENT_OUT_MAX             (4*1024*1024)
+#define MANAGEMENT_OUT_STALL                    60
 
 /*
  * Management-interface-based deferred authentication
  */
 #ifdef MANAGEMENT_DEF_AUTH
+/*
+ * Per-client counters streamed by the "metrics" command.
+ */
+struct man_metrics {
+  counter_type bytes_in;
+  counter_type bytes_out;
+  counter_type packets_in;
+  counter_type packets_out;
+  counter_type drops;
+  int key_negotiations;
+  int rtt;                      /* control channel round trip in ms, 0 if unknown */
+};
+
 struct man_def_auth_context {
   unsigned long cid;
 
@@ -53,7 +75,17 @@ struct man_def_auth_context {
   unsigned int mda_key_id_counter;
 
   time_t bytecount_last_update;
+
+  /* last values sent by the "metrics" command, valid for metrics_epoch */
+  struct man_metrics metrics_reported;
+  unsigned int metrics_epoch;
 };
+
+/*
+ * Don't start a new round of metrics while more than this many
+ * lines wait to be sent to any subscribed management client.
+ */
+#define MANAGEMENT_METRICS_BACKLOG 1024
 #endif
 
 /*
@@ -153,6 +185,9 @@ struct management_callback
   void (*show_net) (void *arg, const int msglevel);
   int (*kill_by_cn) (void *arg, const char *common_name);
   int (*kill_by_addr) (void *arg, const in_addr_t addr, const int port);
+  int (*kill_by_username) (void *arg, const char *username);
+  void (*admission_stats) (void *arg);
+  void (*auth_stats) (void *arg);
   void (*delete_event) (void *arg, event_t event);
   int (*n_clients) (void *arg);
 #ifdef MANAGEMENT_DEF_AUTH
@@ -208,6 +243,10 @@ struct man_persist {
 
   counter_type bytes_in;
   counter_type bytes_out;
+
+#ifdef MANAGEMENT_DEF_AUTH
+  unsigned int metrics_epoch;   /* bumped by each "metrics" command */
+#endif
 };
 
 struct man_settings {
@@ -225,6 +264,7 @@ struct man_settings {
   char *write_peer_info_file;
   int client_uid;
   int client_gid;
+  int max_clients;
 
 /* flags for handling the management interface "signal" command */
 # define MANSIG_IGNORE_USR1_HUP  (1<<0)
@@ -243,26 +283,27 @@ struct man_settings {
 /* states */
 #define MS_INITIAL          0  /* all sockets are closed */
 #define MS_LISTEN           1  /* no client is connected */
-#define MS_CC_WAIT_READ     2  /* client is connected, waiting for read on socket */
-#define MS_CC_WAIT_WRITE    3  /* client is connected, waiting for ability to write to socket */
+#define MS_CC_WAIT_READ     2  /* client(s) connected, waiting for read on socket */
+#define MS_CC_WAIT_WRITE    3  /* client(s) connected, some waiting for ability to write to socket */
 
-struct man_connection {
-  int state;
+/*
+ * One connected management client, with its own
+ * command parser, output queue and notification flags.
+ */
+struct man_client {
+  int state;                    /* MS_INITIAL if unused, else MS_CC_WAIT_x */
 
-  socket_descriptor_t sd_top;
-  socket_descriptor_t sd_cli;
+  socket_descriptor_t sd;
   struct openvpn_sockaddr remote;
 
-#ifdef WIN32
-  struct net_event_win32 ne32;
-#endif
-
   bool halt;
   bool password_verified;
   int password_tries;
 
   struct command_line *in;
   struct buffer_list *out;
+  size_t out_bytes;             /* bytes queued in out */
+  time_t out_progress;          /* last time out was empty or shrank */
 
 #ifdef MANAGEMENT_IN_EXTRA
 # define IEC_UNDEF       0
@@ -275,6 +316,37 @@ struct man_connection {
   unsigned long in_extra_cid;
   unsigned int in_extra_kid;
 #endif
+#endif
+  int env_filter_level;
+
+  bool state_realtime;
+  bool log_realtime;
+  bool echo_realtime;
+  int bytecount_update_seconds;
+#ifdef MANAGEMENT_DEF_AUTH
+  int metrics_update_seconds;
+#endif
+
+  unsigned int persist_rwflags; /* last events set in a persistent event set */
+};
+
+struct man_connection {
+  int state;                    /* aggregate of the listener and all clients */
+
+  socket_descriptor_t sd_top;
+  unsigned int listen_rwflags;  /* last events set in a persistent event set */
+
+#ifdef WIN32
+  struct net_event_win32 ne32;
+#endif
+
+  struct man_client *clients;   /* n_slots == settings.max_clients slots */
+  int n_slots;
+  int n_clients;                /* connected clients */
+
+  /* client whose command is being processed, if any */
+  struct man_client *cur;
+
 #ifdef MANAGMENT_EXTERNAL_KEY
 # define EKS_UNDEF   0
 # define EKS_SOLICIT 1
@@ -282,16 +354,16 @@ struct man_connection {
 # define EKS_READY   3
   int ext_key_state;
   struct buffer_list *ext_key_input;
-#endif
 #endif
   struct event_set *es;
-  int env_filter_level;
 
-  bool state_realtime;
-  bool log_realtime;
-  bool echo_realtime;
+  /* shortest interval requested by any client, 0 if none */
   int bytecount_update_seconds;
   time_t bytecount_last_update;
+#ifdef MANAGEMENT_DEF_AUTH
+  int metrics_update_seconds;
+  time_t metrics_last_update;
+#endif
 
   const char *up_query_type;
   int up_query_mode;
@@ -340,6 +412,7 @@ bool management_open (struct management *man,
 		      const char *pass_file,
 		      const char *client_user,
 		      const char *client_group,
+		      const int max_clients,
 		      const int log_history_cache,
 		      const int echo_buffer_size,
 		      const int state_buffer_size,
@@ -395,6 +468,13 @@ void management_learn_addr (struct management *management,
 			    struct man_def_auth_context *mdac,
 			    const struct mroute_addr *addr,
 			    const bool primary);
+
+bool management_metrics_client (struct management *management,
+				struct man_def_auth_context *mdac,
+				const struct man_metrics *current);
+
+void management_metrics_end (struct management *management, const int n_records);
+
 #endif
 
 #ifdef MANAGMENT_EXTERNAL_KEY
@@ -538,6 +618,11 @@ management_bytes_server (struct management *man,
     man_bytecount_output_server (man, bytes_in_total, bytes_out_total, mdac);
 }
 
+/*
+ * Is a round of "metrics" output due?
+ */
+bool management_metrics_due (struct management *man);
+
 #endif /* MANAGEMENT_DEF_AUTH */
 
 #if HTTP_PROXY_FALLBACK
@@ -33,6 +33,34 @@
 
 #include "memdbg.h"
 
+static struct buffer_pool mbuf_pool; /* GLOBAL */
+
+void
+mbuf_pool_init (int buf_size, int max_free, int n_prealloc, bool hugepages)
+{
+  const int slot_size = (int) ((MBUF_HDR_SIZE + buf_size + MBUF_SLOT_ALIGN - 1) & ~(MBUF_SLOT_ALIGN - 1));
+
+  mbuf_pool_free ();
+  buffer_pool_init (&mbuf_pool, slot_size, max_free, 0);
+  mbuf_pool.align = MBUF_SLOT_ALIGN;
+  if (n_prealloc)
+    mbuf_pool.limit = buffer_pool_prealloc (&mbuf_pool, n_prealloc, hugepages);
+}
+
+void
+mbuf_pool_free (void)
+{
+  buffer_pool_free (&mbuf_pool);
+  CLEAR (mbuf_pool);
+}
+
+void
+mbuf_pool_stats (int *max_out, unsigned int *n_exhausted)
+{
+  *max_out = mbuf_pool.max_out;
+  *n_exhausted = mbuf_pool.n_exhausted;
+}
+
 struct mbuf_set *
 mbuf_init (unsigned int size)
 {
@@ -63,8 +91,25 @@ struct mbuf_buffer *
 mbuf_alloc_buf (const struct buffer *buf)
 {
   struct mbuf_buffer *ret;
-  ALLOC_OBJ (ret, struct mbuf_buffer);
-  ret->buf = clone_buf (buf);
+
+  if (mbuf_pool.buf_size && buf->capacity <= mbuf_pool.buf_size - (int) MBUF_HDR_SIZE)
+    {
+      struct buffer slot = buffer_pool_get (&mbuf_pool);
+      if (!slot.data)
+	return NULL;
+      ret = (struct mbuf_buffer *) slot.data;
+      ret->buf = *buf;
+      ret->buf.data = slot.data + MBUF_HDR_SIZE;
+      ret->buf.capacity = slot.capacity - (int) MBUF_HDR_SIZE;
+      memcpy (ret->buf.data, buf->data, buf->offset + buf->len);
+      ret->pooled = true;
+    }
+  else
+    {
+      ALLOC_OBJ (ret, struct mbuf_buffer);
+      ret->buf = clone_buf (buf);
+      ret->pooled = false;
+    }
   ret->refcount = 1;
   ret->flags = 0;
   return ret;
@@ -77,8 +122,19 @@ mbuf_free_buf (struct mbuf_buffer *mb)
     {
       if (--mb->refcount <= 0)
 	{
-	  free_buf (&mb->buf);
-	  free (mb);
+	  if (mb->pooled)
+	    {
+	      struct buffer slot;
+	      CLEAR (slot);
+	      slot.data = (uint8_t *) mb;
+	      slot.capacity = mbuf_pool.buf_size;
+	      buffer_pool_put (&mbuf_pool, &slot);
+	    }
+	  else
+	    {
+	      free_buf (&mb->buf);
+	      free (mb);
+	    }
 	}
     }
 }
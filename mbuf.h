@@ -41,10 +41,19 @@ struct multi_instance;
 
 #define MBUF_INDEX(head, offset, size) (((head) + (offset)) & ((size)-1))
 
+/*
+ * Queued packets are copied into fixed-size slots of a shared pool.
+ * Each slot holds the mbuf_buffer header followed by the packet data,
+ * and slots are sized in multiples of the cache line size.
+ */
+#define MBUF_SLOT_ALIGN 64
+#define MBUF_HDR_SIZE   ((sizeof (struct mbuf_buffer) + MBUF_SLOT_ALIGN - 1) & ~(MBUF_SLOT_ALIGN - 1))
+
 struct mbuf_buffer
 {
   struct buffer buf;
   int refcount;
+  bool pooled;   /* header and data live in a pool slot */
 
 # define MF_UNICAST (1<<0)
   unsigned int flags;
@@ -68,6 +77,20 @@ struct mbuf_set
 struct mbuf_set *mbuf_init (unsigned int size);
 void mbuf_free (struct mbuf_set *ms);
 
+/*
+ * Set up the packet pool for packets of up to buf_size bytes.  If
+ * n_prealloc is nonzero, exactly that many slots are preallocated,
+ * optionally on huge pages, and the pool never grows beyond them.
+ * Otherwise slots are allocated on demand and up to max_free of them
+ * are kept for reuse.
+ */
+void mbuf_pool_init (int buf_size, int max_free, int n_prealloc, bool hugepages);
+void mbuf_pool_free (void);
+
+/* high-water mark of slots in use, and allocations refused by a full pool */
+void mbuf_pool_stats (int *max_out, unsigned int *n_exhausted);
+
+/* returns NULL if the packet pool is exhausted */
 struct mbuf_buffer *mbuf_alloc_buf (const struct buffer *buf);
 void mbuf_free_buf (struct mbuf_buffer *mb);
 
@@ -36,6 +36,7 @@
 #include "crypto.h"
 #include "route.h"
 #include "win32.h"
+#include "fdmisc.h"
 
 #include "memdbg.h"
 
@@ -496,6 +497,613 @@ openvpn_execve_allowed (const unsigned int flags)
 }
 
 
+#if defined(ENABLE_EXECVE) && !defined(WIN32)
+
+/*
+ * Close most of parent's fds.
+ * Keep stdin/stdout/stderr, plus one
+ * other fd which is presumed to be
+ * our pipe back to parent.
+ * Admittedly, a bit of a kludge,
+ * but posix doesn't give us a kind
+ * of FD_CLOEXEC which will stop
+ * fds from crossing a fork().
+ */
+void
+close_fds_except (int keep)
+{
+  int i;
+  closelog ();
+  for (i = 3; i <= 100; ++i)
+    {
+      if (i != keep)
+	close (i);
+    }
+}
+
+/*
+ * Script helper.
+ *
+ * openvpn_execve forks the main process for every script, which
+ * stalls the event loop for longer the bigger the process gets.
+ * With --script-helper a small process is forked once, right after
+ * privileges have been dropped, and forks the scripts instead.
+ * Requests and exit statuses travel over a socketpair.  Requests
+ * nobody is blocked on are run at most max_running at a time.
+ */
+
+#define SH_WAIT   (1<<0)  /* caller blocks on the result, don't queue */
+#define SH_ABORT  (1<<1)  /* send SIGTERM to the script of request id */
+
+struct script_helper_request
+{
+  unsigned int id;
+  unsigned int flags;
+  unsigned int argc;
+  unsigned int envc;
+  unsigned int len;     /* bytes of NUL terminated argv then env strings which follow */
+};
+
+struct script_helper_reply
+{
+  unsigned int id;
+  int status;           /* as from waitpid, -1 if the script could not be started */
+};
+
+struct script_helper_result
+{
+  struct script_helper_reply reply;
+  struct script_helper_result *next;
+};
+
+struct script_helper
+{
+  bool enabled;         /* ids returned by openvpn_execve_async are ours */
+  int fd;               /* -1 once the helper has gone away */
+  pid_t pid;
+  int seq;
+  struct script_helper_result *results;  /* not yet collected */
+};
+
+static struct script_helper script_helper = { false, -1, -1, 0, NULL }; /* GLOBAL */
+
+/*
+ * Read len bytes.  Returns 1 on success, -1 on EOF or error,
+ * and 0 if block is false and nothing is available yet.  Once
+ * part of a record has arrived, the rest is waited for.
+ */
+static int
+script_helper_read (const int fd, void *buf, const size_t len, const bool block)
+{
+  size_t done = 0;
+
+  while (done < len)
+    {
+      const ssize_t n = read (fd, (uint8_t *)buf + done, len - done);
+      if (n > 0)
+	done += n;
+      else if (n == 0)
+	return -1;
+      else if (errno == EAGAIN || errno == EWOULDBLOCK)
+	{
+	  fd_set rfds;
+
+	  if (!block && !done)
+	    return 0;
+	  FD_ZERO (&rfds);
+	  FD_SET (fd, &rfds);
+	  select (fd + 1, &rfds, NULL, NULL, NULL);
+	}
+      else if (errno != EINTR)
+	return -1;
+    }
+  return 1;
+}
+
+static bool
+script_helper_write (const int fd, const void *buf, const size_t len)
+{
+  size_t done = 0;
+
+  while (done < len)
+    {
+      const ssize_t n = write (fd, (const uint8_t *)buf + done, len - done);
+      if (n > 0)
+	done += n;
+      else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+	  fd_set wfds;
+	  FD_ZERO (&wfds);
+	  FD_SET (fd, &wfds);
+	  select (fd + 1, NULL, &wfds, NULL, NULL);
+	}
+      else if (n == 0 || errno != EINTR)
+	return false;
+    }
+  return true;
+}
+
+/*
+ * Background process side.
+ */
+
+struct script_helper_job
+{
+  unsigned int id;
+  unsigned int flags;
+  pid_t pid;            /* 0 while queued */
+  char **argv;
+  char **envp;
+  char *strings;
+  struct script_helper_job *next;
+};
+
+static int script_helper_sigchld_fd = -1; /* GLOBAL */
+
+static void
+script_helper_sigchld (int signum)
+{
+  const int save_errno = errno;
+  const char c = 0;
+  if (write (script_helper_sigchld_fd, &c, 1) < 0)
+    ;
+  errno = save_errno;
+}
+
+static void
+script_helper_job_free (struct script_helper_job *job)
+{
+  free (job->argv);
+  free (job->envp);
+  free (job->strings);
+  free (job);
+}
+
+/*
+ * Receive a request and turn it into a job.  Returns false if
+ * the main process has gone away.  *job is NULL for an abort.
+ */
+static bool
+script_helper_recv (const int fd, struct script_helper_job **job, struct script_helper_request *req)
+{
+  struct script_helper_job *j;
+  char *s;
+  unsigned int i;
+
+  *job = NULL;
+  if (script_helper_read (fd, req, sizeof (*req), true) != 1)
+    return false;
+  if (req->flags & SH_ABORT)
+    return true;
+  if (!req->argc || !req->len || req->argc > req->len || req->envc > req->len)
+    return false;
+
+  ALLOC_OBJ_CLEAR (j, struct script_helper_job);
+  j->id = req->id;
+  j->flags = req->flags;
+  ALLOC_ARRAY_CLEAR (j->argv, char *, req->argc + 1);
+  ALLOC_ARRAY_CLEAR (j->envp, char *, req->envc + 1);
+  j->strings = (char *) malloc (req->len);
+  check_malloc_return (j->strings);
+  if (script_helper_read (fd, j->strings, req->len, true) != 1
+      || j->strings[req->len - 1] != '\0')
+    {
+      script_helper_job_free (j);
+      return false;
+    }
+
+  for (s = j->strings, i = 0; i < req->argc + req->envc; ++i)
+    {
+      if (s >= j->strings + req->len)
+	{
+	  script_helper_job_free (j);
+	  return false;
+	}
+      if (i < req->argc)
+	j->argv[i] = s;
+      else
+	j->envp[i - req->argc] = s;
+      s += strlen (s) + 1;
+    }
+
+  *job = j;
+  return true;
+}
+
+static void
+script_helper_reply (const int fd, const unsigned int id, const int status)
+{
+  struct script_helper_reply reply;
+
+  reply.id = id;
+  reply.status = status;
+  script_helper_write (fd, &reply, sizeof (reply));
+}
+
+static void
+script_helper_spawn (const int fd, struct script_helper_job *job)
+{
+  const pid_t pid = fork ();
+
+  if (pid == (pid_t)0) /* script */
+    {
+      signal (SIGCHLD, SIG_DFL);
+      signal (SIGTERM, SIG_DFL);
+      signal (SIGINT, SIG_DFL);
+      signal (SIGHUP, SIG_DFL);
+      signal (SIGUSR1, SIG_DFL);
+      signal (SIGUSR2, SIG_DFL);
+      execve (job->argv[0], job->argv, job->envp);
+      exit (127);
+    }
+  else if (pid < (pid_t)0)
+    {
+      job->pid = -1;
+      script_helper_reply (fd, job->id, -1);
+    }
+  else
+    job->pid = pid;
+}
+
+static void
+script_helper_loop (const int fd, const int max_running)
+{
+  struct script_helper_job *jobs = NULL; /* running ones first, then queued in order */
+  int sigpipe[2];
+  int n_running = 0;
+  bool eof = false;
+
+  if (pipe (sigpipe) != 0)
+    return;
+  set_nonblock (sigpipe[0]);
+  set_nonblock (sigpipe[1]);
+  set_cloexec (sigpipe[0]);
+  set_cloexec (sigpipe[1]);
+  set_cloexec (fd);
+  script_helper_sigchld_fd = sigpipe[1];
+  signal (SIGCHLD, script_helper_sigchld);
+
+  while (!eof || n_running)
+    {
+      struct script_helper_job **jp;
+      fd_set rfds;
+
+      FD_ZERO (&rfds);
+      FD_SET (sigpipe[0], &rfds);
+      if (!eof)
+	FD_SET (fd, &rfds);
+      if (select (max_int (fd, sigpipe[0]) + 1, &rfds, NULL, NULL, NULL) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  break;
+	}
+
+      /* collect scripts which have exited */
+      if (FD_ISSET (sigpipe[0], &rfds))
+	{
+	  char buf[64];
+	  pid_t pid;
+	  int status;
+
+	  while (read (sigpipe[0], buf, sizeof (buf)) > 0)
+	    ;
+	  while ((pid = waitpid (-1, &status, WNOHANG)) > 0)
+	    {
+	      for (jp = &jobs; *jp; jp = &(*jp)->next)
+		{
+		  if ((*jp)->pid == pid)
+		    {
+		      struct script_helper_job *done = *jp;
+		      if (!eof)
+			script_helper_reply (fd, done->id, status);
+		      *jp = done->next;
+		      --n_running;
+		      script_helper_job_free (done);
+		      break;
+		    }
+		}
+	    }
+	}
+
+      /* new request from the main process */
+      if (!eof && FD_ISSET (fd, &rfds))
+	{
+	  struct script_helper_request req;
+	  struct script_helper_job *job;
+
+	  if (!script_helper_recv (fd, &job, &req))
+	    eof = true;
+	  else if (job)
+	    {
+	      /* a blocked caller jumps the queue */
+	      for (jp = &jobs; *jp && ((job->flags & SH_WAIT) ? (*jp)->pid : true); jp = &(*jp)->next)
+		;
+	      job->next = *jp;
+	      *jp = job;
+	      if (job->flags & SH_WAIT)
+		{
+		  script_helper_spawn (fd, job);
+		  if (job->pid > 0)
+		    ++n_running;
+		}
+	    }
+	  else
+	    {
+	      for (jp = &jobs; *jp; jp = &(*jp)->next)
+		{
+		  if ((*jp)->id == req.id)
+		    {
+		      if ((*jp)->pid > 0)
+			kill ((*jp)->pid, SIGTERM);
+		      else if (!(*jp)->pid)
+			{
+			  struct script_helper_job *gone = *jp;
+			  script_helper_reply (fd, gone->id, -1);
+			  *jp = gone->next;
+			  script_helper_job_free (gone);
+			}
+		      break;
+		    }
+		}
+	    }
+	}
+
+      /* drop jobs which could not be started, start queued ones */
+      for (jp = &jobs; *jp; )
+	{
+	  struct script_helper_job *job = *jp;
+	  if (job->pid < 0 || (eof && !job->pid))
+	    {
+	      *jp = job->next;
+	      script_helper_job_free (job);
+	      continue;
+	    }
+	  if (!job->pid && n_running < max_running)
+	    {
+	      script_helper_spawn (fd, job);
+	      if (job->pid > 0)
+		++n_running;
+	      continue;
+	    }
+	  jp = &job->next;
+	}
+    }
+}
+
+/*
+ * Fork the script helper.  Should be called early, while the
+ * process is still small, and with the privileges scripts are
+ * to run with.
+ */
+bool
+script_helper_start (const int max_running)
+{
+  int fd[2];
+  pid_t pid;
+
+  if (script_helper.enabled)
+    return true;
+
+  if (socketpair (PF_UNIX, SOCK_STREAM, 0, fd) == -1)
+    {
+      msg (M_WARN|M_ERRNO, "SCRIPT HELPER: socketpair call failed");
+      return false;
+    }
+
+  pid = fork ();
+  if (pid < (pid_t)0)
+    {
+      msg (M_WARN|M_ERRNO, "SCRIPT HELPER: fork failed");
+      close (fd[0]);
+      close (fd[1]);
+      return false;
+    }
+  else if (pid == (pid_t)0)
+    {
+      /* Ignore most signals (the parent will receive them),
+	 exit once the parent closes its end of the socket */
+      signal (SIGTERM, SIG_IGN);
+      signal (SIGINT, SIG_IGN);
+      signal (SIGHUP, SIG_IGN);
+      signal (SIGUSR1, SIG_IGN);
+      signal (SIGUSR2, SIG_IGN);
+      signal (SIGPIPE, SIG_IGN);
+
+      /* Let msg know that we forked */
+      msg_forked ();
+
+#ifdef ENABLE_MANAGEMENT
+      /* Don't interact with management interface */
+      management = NULL;
+#endif
+
+      /* close all parent fds except our socket back to parent */
+      close_fds_except (fd[1]);
+
+      script_helper_loop (fd[1], max_running);
+      exit (0);
+    }
+
+  close (fd[1]);
+  set_cloexec (fd[0]);
+  set_nonblock (fd[0]);
+
+  script_helper.enabled = true;
+  script_helper.fd = fd[0];
+  script_helper.pid = pid;
+  msg (M_INFO, "SCRIPT HELPER: running scripts from process %d, at most %d in the background",
+       (int) pid, max_running);
+  return true;
+}
+
+static void
+script_helper_close (void)
+{
+  if (script_helper.fd >= 0)
+    {
+      close (script_helper.fd);
+      script_helper.fd = -1;
+      if (script_helper.pid > 0)
+	waitpid (script_helper.pid, NULL, 0);
+      script_helper.pid = -1;
+    }
+}
+
+/*
+ * Called on exit.  The helper waits for scripts which are
+ * still running before it exits.
+ */
+void
+script_helper_stop (void)
+{
+  struct script_helper_result *r;
+
+  script_helper_close ();
+  while ((r = script_helper.results))
+    {
+      script_helper.results = r->next;
+      free (r);
+    }
+  script_helper.enabled = false;
+}
+
+static void
+script_helper_lost (void)
+{
+  msg (M_WARN, "SCRIPT HELPER: helper process went away, forking scripts directly");
+  script_helper_close ();
+}
+
+/*
+ * Read one reply into the results list.  Returns false if none
+ * is available and block is false, or if the helper went away.
+ */
+static bool
+script_helper_read_reply (const bool block)
+{
+  struct script_helper_reply reply;
+  struct script_helper_result *r;
+  const int status = script_helper_read (script_helper.fd, &reply, sizeof (reply), block);
+
+  if (status < 0)
+    script_helper_lost ();
+  if (status != 1)
+    return false;
+
+  ALLOC_OBJ_CLEAR (r, struct script_helper_result);
+  r->reply = reply;
+  r->next = script_helper.results;
+  script_helper.results = r;
+  return true;
+}
+
+/*
+ * Send a request to the helper.  Returns its id, or 0 if the
+ * helper is not running.
+ */
+static int
+script_helper_send (const struct argv *a, char *const *envp, const unsigned int flags, int id)
+{
+  struct gc_arena gc = gc_new ();
+  struct script_helper_request req;
+  struct buffer buf;
+  size_t len = 0;
+  int i;
+
+  if (script_helper.fd < 0)
+    return 0;
+
+  CLEAR (req);
+  req.flags = flags;
+  if (!id)
+    {
+      if (++script_helper.seq <= 0)
+	script_helper.seq = 1;
+      id = script_helper.seq;
+    }
+  req.id = id;
+
+  if (!(flags & SH_ABORT))
+    {
+      for (i = 0; a->argv[i]; ++i, ++req.argc)
+	len += strlen (a->argv[i]) + 1;
+      for (i = 0; envp && envp[i]; ++i, ++req.envc)
+	len += strlen (envp[i]) + 1;
+    }
+  req.len = len;
+
+  buf = alloc_buf_gc (sizeof (req) + len, &gc);
+  buf_write (&buf, &req, sizeof (req));
+  for (i = 0; i < (int) req.argc; ++i)
+    buf_write (&buf, a->argv[i], strlen (a->argv[i]) + 1);
+  for (i = 0; i < (int) req.envc; ++i)
+    buf_write (&buf, envp[i], strlen (envp[i]) + 1);
+
+  /*
+   * Keep reading replies while we wait for room, the helper
+   * may be blocked writing one to us.
+   */
+  while (script_helper.fd >= 0 && BLEN (&buf))
+    {
+      const ssize_t n = write (script_helper.fd, BPTR (&buf), BLEN (&buf));
+      if (n > 0)
+	buf_advance (&buf, n);
+      else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	{
+	  fd_set rfds, wfds;
+	  FD_ZERO (&rfds);
+	  FD_ZERO (&wfds);
+	  FD_SET (script_helper.fd, &rfds);
+	  FD_SET (script_helper.fd, &wfds);
+	  if (select (script_helper.fd + 1, &rfds, &wfds, NULL, NULL) > 0
+	      && FD_ISSET (script_helper.fd, &rfds))
+	    script_helper_read_reply (false);
+	}
+      else if (n == 0 || errno != EINTR)
+	script_helper_lost ();
+    }
+
+  gc_free (&gc);
+  return script_helper.fd >= 0 ? id : 0;
+}
+
+/*
+ * Collect the result of request id.  Returns false if it is
+ * not available yet and block is false.  A request the helper
+ * took with it when it went away fails with status -1.
+ */
+static bool
+script_helper_collect (const int id, int *status, const bool block)
+{
+  while (true)
+    {
+      struct script_helper_result **rp;
+
+      for (rp = &script_helper.results; *rp; rp = &(*rp)->next)
+	{
+	  if ((*rp)->reply.id == (unsigned int) id)
+	    {
+	      struct script_helper_result *r = *rp;
+	      *status = r->reply.status;
+	      *rp = r->next;
+	      free (r);
+	      return true;
+	    }
+	}
+
+      if (script_helper.fd < 0)
+	{
+	  *status = -1;
+	  return true;
+	}
+      if (!script_helper_read_reply (block) && !block)
+	return false;
+    }
+}
+
+#endif
+
 #ifndef WIN32
 /*
  * Run execve() inside a fork().  Designed to replicate the semantics of system() but
@@ -519,20 +1127,26 @@ openvpn_execve (const struct argv *a, const struct env_set *es, const unsigned i
 	      const char *cmd = a->argv[0];
 	      char *const *argv = a->argv;
 	      char *const *envp = (char *const *)make_env_array (es, true, &gc);
+	      const int id = script_helper_send (a, envp, SH_WAIT, 0);
 	      pid_t pid;
 
-	      pid = fork ();
-	      if (pid == (pid_t)0) /* child side */
-		{
-		  execve (cmd, argv, envp);
-		  exit (127);
-		}
-	      else if (pid < (pid_t)0) /* fork failed */
-		;
-	      else /* parent side */
+	      if (id)
+		script_helper_collect (id, &ret, true);
+	      else
 		{
-		  if (waitpid (pid, &ret, 0) != pid)
-		    ret = -1;
+		  pid = fork ();
+		  if (pid == (pid_t)0) /* child side */
+		    {
+		      execve (cmd, argv, envp);
+		      exit (127);
+		    }
+		  else if (pid < (pid_t)0) /* fork failed */
+		    ;
+		  else /* parent side */
+		    {
+		      if (waitpid (pid, &ret, 0) != pid)
+			ret = -1;
+		    }
 		}
 	    }
 	  else if (script_method == SM_SYSTEM)
@@ -563,6 +1177,92 @@ openvpn_execve (const struct argv *a, const struct env_set *es, const unsigned i
 }
 #endif
 
+/*
+ * Like openvpn_execve, but return as soon as the child has been
+ * forked.  Returns its pid, or the id of the request when the
+ * script helper runs it, or -1 if the program could not be
+ * started this way, in which case the caller should fall back to
+ * openvpn_execve.  The child must be collected with
+ * openvpn_execve_reap.
+ */
+int
+openvpn_execve_async (const struct argv *a, const struct env_set *es, const unsigned int flags)
+{
+  int ret = -1;
+
+#if defined(ENABLE_EXECVE) && !defined(WIN32)
+  if (a && a->argv[0] && script_method == SM_EXECVE && openvpn_execve_allowed (flags))
+    {
+      struct gc_arena gc = gc_new ();
+      char *const *envp = (char *const *)make_env_array (es, true, &gc);
+
+      if (script_helper.enabled)
+	{
+	  const int id = script_helper_send (a, envp, 0, 0);
+	  if (id)
+	    ret = id;
+	}
+      else
+	{
+	  const pid_t pid = fork ();
+	  if (pid == (pid_t)0) /* child side */
+	    {
+	      execve (a->argv[0], a->argv, envp);
+	      exit (127);
+	    }
+	  else if (pid > (pid_t)0) /* parent side */
+	    ret = (int) pid;
+	}
+      gc_free (&gc);
+    }
+#endif
+
+  return ret;
+}
+
+/*
+ * Collect a child started by openvpn_execve_async.  Returns false
+ * while it is still running, unless block is set.  Otherwise *stat
+ * is set to its exit status, as openvpn_execve would return it.
+ */
+bool
+openvpn_execve_reap (const int pid, int *stat, const bool block)
+{
+#if defined(ENABLE_EXECVE) && !defined(WIN32)
+  pid_t ret;
+
+  if (script_helper.enabled)
+    return script_helper_collect (pid, stat, block);
+
+  do {
+    ret = waitpid ((pid_t) pid, stat, block ? 0 : WNOHANG);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret == (pid_t)0)
+    return false;
+  if (ret != (pid_t) pid)
+    *stat = -1;
+#else
+  ASSERT (0);
+#endif
+  return true;
+}
+
+/*
+ * Ask a child started by openvpn_execve_async to terminate.
+ * It still has to be collected with openvpn_execve_reap.
+ */
+void
+openvpn_execve_abort (const int pid)
+{
+#if defined(ENABLE_EXECVE) && !defined(WIN32)
+  if (script_helper.enabled)
+    script_helper_send (NULL, NULL, SH_ABORT, pid);
+  else
+    kill ((pid_t) pid, SIGTERM);
+#endif
+}
+
 /*
  * Wrapper around the system() call.
  */
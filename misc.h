@@ -135,6 +135,19 @@ const char *system_error_message (int, struct gc_arena *gc);
 int openvpn_execve (const struct argv *a, const struct env_set *es, const unsigned int flags);
 bool openvpn_execve_check (const struct argv *a, const struct env_set *es, const unsigned int flags, const char *error_message);
 bool openvpn_execve_allowed (const unsigned int flags);
+int openvpn_execve_async (const struct argv *a, const struct env_set *es, const unsigned int flags);
+bool openvpn_execve_reap (const int pid, int *stat, const bool block);
+void openvpn_execve_abort (const int pid);
+
+/* run scripts from a small process forked early, see misc.c */
+#define SCRIPT_HELPER_MAX_RUNNING_DEFAULT 16
+#if defined(ENABLE_EXECVE) && !defined(WIN32)
+bool script_helper_start (const int max_running);
+void script_helper_stop (void);
+
+/* close fds other than stdin/stdout/stderr and keep after a fork */
+void close_fds_except (int keep);
+#endif
 int openvpn_system (const char *command, const struct env_set *es, unsigned int flags);
 
 static inline bool
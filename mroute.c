@@ -258,6 +258,278 @@ mroute_extract_addr_ether (struct mroute_addr *src,
   return ret;
 }
 
+/*
+ * IGMP / MLD snooping.
+ */
+
+#define MCAST_IPV6_NEXTHDR_HOPOPTS 0   /* IPv6 hop-by-hop options header */
+#define MCAST_IPV6_NEXTHDR_ICMPV6  58  /* ICMPv6 */
+
+#define IGMP_MEMBERSHIP_QUERY      0x11
+#define IGMP_V1_MEMBERSHIP_REPORT  0x12
+#define IGMP_V2_MEMBERSHIP_REPORT  0x16
+#define IGMP_V2_LEAVE_GROUP        0x17
+#define IGMP_V3_MEMBERSHIP_REPORT  0x22
+
+#define MLD_LISTENER_QUERY         130
+#define MLD_V1_LISTENER_REPORT     131
+#define MLD_V1_LISTENER_DONE       132
+#define MLD_V2_LISTENER_REPORT     143
+
+/* IGMPv3 / MLDv2 group record types (RFC 3376 4.2.12) */
+#define MCAST_MODE_IS_INCLUDE      1
+#define MCAST_CHANGE_TO_INCLUDE    3
+#define MCAST_BLOCK_OLD_SOURCES    6
+
+/*
+ * Groups which must reach every host on the link, because
+ * hosts never report membership of them (RFC 4541 2.1.2):
+ * 224.0.0.0/24 and IPv6 groups of interface- or link-local scope.
+ */
+static bool
+mroute_mcast_group_snoopable (const struct mroute_addr *group)
+{
+  switch (group->type & MR_ADDR_MASK)
+    {
+    case MR_ADDR_IPV4:
+      return group->addr[0] >= 224 && group->addr[0] <= 239
+	&& !(group->addr[0] == 224 && group->addr[1] == 0 && group->addr[2] == 0);
+    case MR_ADDR_IPV6:
+      return group->addr[0] == 0xff && (group->addr[1] & 0x0f) > 2;
+    default:
+      return false;
+    }
+}
+
+/*
+ * Locate the IP header of a tun or tap packet, returning the
+ * IP version (4 or 6) or 0 if buf does not hold an IP packet.
+ */
+static int
+mroute_mcast_ip_header (struct buffer *ip, const struct buffer *buf, int tunnel_type)
+{
+  *ip = *buf;
+  if (tunnel_type == DEV_TYPE_TAP)
+    {
+      const struct openvpn_ethhdr *eth = (const struct openvpn_ethhdr *) BPTR (buf);
+      if (!buf_advance (ip, sizeof (struct openvpn_ethhdr)))
+	return 0;
+      if (ntohs (eth->proto) != OPENVPN_ETH_P_IPV4
+	  && ntohs (eth->proto) != OPENVPN_ETH_P_IPV6)
+	return 0;
+    }
+  if (BLEN (ip) < 1)
+    return 0;
+  switch (OPENVPN_IPH_GET_VER (*BPTR (ip)))
+    {
+    case 4:
+      if (BLEN (ip) >= (int) sizeof (struct openvpn_iphdr))
+	return 4;
+      break;
+    case 6:
+      if (BLEN (ip) >= (int) sizeof (struct openvpn_ipv6hdr))
+	return 6;
+      break;
+    }
+  return 0;
+}
+
+/*
+ * If the packet in buf is addressed to a multicast group whose
+ * members are tracked by snooping, return true and set group.
+ */
+bool
+mroute_extract_mcast_group (struct mroute_addr *group, const struct buffer *buf, int tunnel_type)
+{
+  struct buffer ip;
+
+  switch (mroute_mcast_ip_header (&ip, buf, tunnel_type))
+    {
+    case 4:
+      {
+	const struct openvpn_iphdr *iph = (const struct openvpn_iphdr *) BPTR (&ip);
+	mroute_get_in_addr_t (group, iph->daddr, 0);
+	break;
+      }
+    case 6:
+      {
+	const struct openvpn_ipv6hdr *ipv6 = (const struct openvpn_ipv6hdr *) BPTR (&ip);
+	mroute_get_in6_addr (group, ipv6->daddr, 0);
+	break;
+      }
+    default:
+      return false;
+    }
+  return mroute_mcast_group_snoopable (group);
+}
+
+static void
+mroute_mcast_report_group (struct mroute_addr *group,
+			   const uint8_t *addr,
+			   const int version,
+			   const int op,
+			   mroute_mcast_report_func report,
+			   void *arg)
+{
+  if (version == 4)
+    {
+      in_addr_t a;
+      memcpy (&a, addr, sizeof (a));
+      mroute_get_in_addr_t (group, a, 0);
+    }
+  else
+    {
+      struct in6_addr a6;
+      memcpy (&a6, addr, sizeof (a6));
+      mroute_get_in6_addr (group, a6, 0);
+    }
+  if (mroute_mcast_group_snoopable (group))
+    (*report) (arg, group, op);
+}
+
+/*
+ * Walk the group records of an IGMPv3 or MLDv2 report,
+ * which share the same layout apart from the address size.
+ */
+static int
+mroute_mcast_report_records (const uint8_t *p,
+			     int len,
+			     const int version,
+			     mroute_mcast_report_func report,
+			     void *arg)
+{
+  const int addr_len = (version == 4) ? 4 : 16;
+  struct mroute_addr group;
+  int n_records;
+  int n = 0;
+
+  if (len < 8)
+    return 0;
+  n_records = (p[6] << 8) | p[7];
+  p += 8;
+  len -= 8;
+
+  while (n_records-- > 0 && len >= 4 + addr_len)
+    {
+      const int type = p[0];
+      const int rec_len = 4 + addr_len + (((p[2] << 8) | p[3]) * addr_len) + (p[1] * 4);
+
+      if (rec_len > len)
+	break;
+
+      /* source lists are not tracked, only whether any traffic is wanted */
+      if (type != MCAST_BLOCK_OLD_SOURCES)
+	{
+	  const bool no_sources = (p[2] | p[3]) == 0;
+	  const int op = ((type == MCAST_MODE_IS_INCLUDE || type == MCAST_CHANGE_TO_INCLUDE) && no_sources)
+	    ? MROUTE_MCAST_LEAVE : MROUTE_MCAST_JOIN;
+	  mroute_mcast_report_group (&group, p + 4, version, op, report, arg);
+	  ++n;
+	}
+
+      p += rec_len;
+      len -= rec_len;
+    }
+  return n;
+}
+
+/*
+ * Parse the IGMP (v1/v2/v3) or MLD (v1/v2) membership reports
+ * and leaves in buf, calling report once per group.  Returns the
+ * number of group records seen.  A membership query is passed to
+ * report with a NULL group and MROUTE_MCAST_QUERY.
+ */
+int
+mroute_extract_mcast_reports (const struct buffer *buf,
+			      int tunnel_type,
+			      mroute_mcast_report_func report,
+			      void *arg)
+{
+  struct mroute_addr group;
+  struct buffer ip;
+  const uint8_t *p;
+  int len;
+
+  switch (mroute_mcast_ip_header (&ip, buf, tunnel_type))
+    {
+    case 4:
+      {
+	const struct openvpn_iphdr *iph = (const struct openvpn_iphdr *) BPTR (&ip);
+	const int hlen = OPENVPN_IPH_GET_LEN (iph->version_len);
+
+	if (iph->protocol != OPENVPN_IPPROTO_IGMP
+	    || hlen < (int) sizeof (struct openvpn_iphdr)
+	    || (ntohs (iph->frag_off) & (OPENVPN_IP_OFFMASK|0x2000))
+	    || !buf_advance (&ip, hlen))
+	  return 0;
+	p = BPTR (&ip);
+	len = BLEN (&ip);
+	if (len < 8)
+	  return 0;
+	switch (p[0])
+	  {
+	  case IGMP_MEMBERSHIP_QUERY:
+	    (*report) (arg, NULL, MROUTE_MCAST_QUERY);
+	    return 0;
+	  case IGMP_V1_MEMBERSHIP_REPORT:
+	  case IGMP_V2_MEMBERSHIP_REPORT:
+	    mroute_mcast_report_group (&group, p + 4, 4, MROUTE_MCAST_JOIN, report, arg);
+	    return 1;
+	  case IGMP_V2_LEAVE_GROUP:
+	    mroute_mcast_report_group (&group, p + 4, 4, MROUTE_MCAST_LEAVE, report, arg);
+	    return 1;
+	  case IGMP_V3_MEMBERSHIP_REPORT:
+	    return mroute_mcast_report_records (p, len, 4, report, arg);
+	  }
+	return 0;
+      }
+    case 6:
+      {
+	const struct openvpn_ipv6hdr *ipv6 = (const struct openvpn_ipv6hdr *) BPTR (&ip);
+	int nexthdr = ipv6->nexthdr;
+
+	if (!buf_advance (&ip, sizeof (struct openvpn_ipv6hdr)))
+	  return 0;
+
+	/* MLD messages carry a router alert in a hop-by-hop header */
+	if (nexthdr == MCAST_IPV6_NEXTHDR_HOPOPTS)
+	  {
+	    if (BLEN (&ip) < 2)
+	      return 0;
+	    nexthdr = BPTR (&ip)[0];
+	    if (!buf_advance (&ip, (BPTR (&ip)[1] + 1) * 8))
+	      return 0;
+	  }
+	if (nexthdr != MCAST_IPV6_NEXTHDR_ICMPV6)
+	  return 0;
+	p = BPTR (&ip);
+	len = BLEN (&ip);
+	if (len < 8)
+	  return 0;
+	switch (p[0])
+	  {
+	  case MLD_LISTENER_QUERY:
+	    (*report) (arg, NULL, MROUTE_MCAST_QUERY);
+	    return 0;
+	  case MLD_V1_LISTENER_REPORT:
+	    if (len < 24)
+	      return 0;
+	    mroute_mcast_report_group (&group, p + 8, 6, MROUTE_MCAST_JOIN, report, arg);
+	    return 1;
+	  case MLD_V1_LISTENER_DONE:
+	    if (len < 24)
+	      return 0;
+	    mroute_mcast_report_group (&group, p + 8, 6, MROUTE_MCAST_LEAVE, report, arg);
+	    return 1;
+	  case MLD_V2_LISTENER_REPORT:
+	    return mroute_mcast_report_records (p, len, 6, report, arg);
+	  }
+	return 0;
+      }
+    }
+  return 0;
+}
+
 /*
  * Translate a struct openvpn_sockaddr (osaddr)
  * to a struct mroute_addr (addr).
@@ -441,9 +713,11 @@ mroute_addr_print_ex (const struct mroute_addr *ma,
   }
 
 /*
- * mroute_helper's main job is keeping track of
- * currently used CIDR netlengths, so we don't
- * have to cycle through all 33.
+ * mroute_helper's main job is keeping a longest-prefix-match
+ * index of the CIDR routes in the virtual address hash table,
+ * so that a lookup walks at most one trie node per distinct
+ * prefix on the path to the address, rather than probing the
+ * hash table once for every netlength in use.
  */
 
 struct mroute_helper *
@@ -455,33 +729,10 @@ mroute_helper_init (int ageable_ttl_secs)
   return mh;
 }
 
-static void
-mroute_helper_regenerate (struct mroute_helper *mh)
-{
-  int i, j = 0;
-  for (i = MR_HELPER_NET_LEN - 1; i >= 0; --i)
-    {
-      if (mh->net_len_refcount[i] > 0)
-	mh->net_len[j++] = (uint8_t) i;
-    }
-  mh->n_net_len = j;
-
-#ifdef ENABLE_DEBUG
-  if (check_debug_level (D_MULTI_DEBUG))
-    {
-      struct gc_arena gc = gc_new ();
-      struct buffer out = alloc_buf_gc (256, &gc);
-      buf_printf (&out, "MROUTE CIDR netlen:");
-      for (i = 0; i < mh->n_net_len; ++i)
-	{
-	  buf_printf (&out, " /%d", mh->net_len[i]);
-	}
-      dmsg (D_MULTI_DEBUG, "%s", BSTR (&out));
-      gc_free (&gc);
-    }
-#endif
-}
-
+/*
+ * Adding or deleting an iroute invalidates the host
+ * route cache.
+ */
 void
 mroute_helper_add_iroute (struct mroute_helper *mh, const struct iroute *ir)
 {
@@ -489,9 +740,6 @@ mroute_helper_add_iroute (struct mroute_helper *mh, const struct iroute *ir)
     {
       ASSERT (ir->netbits < MR_HELPER_NET_LEN);
       ++mh->cache_generation;
-      ++mh->net_len_refcount[ir->netbits];
-      if (mh->net_len_refcount[ir->netbits] == 1)
-	mroute_helper_regenerate (mh);
     }
 }
 
@@ -502,18 +750,9 @@ mroute_helper_del_iroute (struct mroute_helper *mh, const struct iroute *ir)
     {
       ASSERT (ir->netbits < MR_HELPER_NET_LEN);
       ++mh->cache_generation;
-      --mh->net_len_refcount[ir->netbits];
-      ASSERT (mh->net_len_refcount[ir->netbits] >= 0);
-      if (!mh->net_len_refcount[ir->netbits])
-	mroute_helper_regenerate (mh);
     }
 }
 
-/* this is a bit inelegant, we really should have a helper to that 
- * is only passed the netbits value, and not the whole struct iroute *
- * - thus one helper could do IPv4 and IPv6.  For the sake of "not change
- * code unrelated to IPv4" this is left for later cleanup, for now.
- */
 void
 mroute_helper_add_iroute6 (struct mroute_helper *mh, 
                            const struct iroute_ipv6 *ir6)
@@ -522,9 +761,6 @@ mroute_helper_add_iroute6 (struct mroute_helper *mh,
     {
       ASSERT (ir6->netbits < MR_HELPER_NET_LEN);
       ++mh->cache_generation;
-      ++mh->net_len_refcount[ir6->netbits];
-      if (mh->net_len_refcount[ir6->netbits] == 1)
-	mroute_helper_regenerate (mh);
     }
 }
 
@@ -536,16 +772,211 @@ mroute_helper_del_iroute6 (struct mroute_helper *mh,
     {
       ASSERT (ir6->netbits < MR_HELPER_NET_LEN);
       ++mh->cache_generation;
-      --mh->net_len_refcount[ir6->netbits];
-      ASSERT (mh->net_len_refcount[ir6->netbits] >= 0);
-      if (!mh->net_len_refcount[ir6->netbits])
-	mroute_helper_regenerate (mh);
+    }
+}
+
+static inline int
+mroute_trie_bit (const uint8_t *a, const int bit)
+{
+  return (a[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+/*
+ * Return the number of leading bits, up to max, which
+ * a and b have in common.
+ */
+static int
+mroute_trie_common_bits (const uint8_t *a, const uint8_t *b, const int max)
+{
+  int i;
+  for (i = 0; i < max; i += 8)
+    {
+      const uint8_t diff = a[i >> 3] ^ b[i >> 3];
+      if (diff)
+	{
+	  int n = i;
+	  while (!(diff & (0x80 >> (n - i))))
+	    ++n;
+	  return min_int (n, max);
+	}
+    }
+  return max;
+}
+
+static struct mroute_trie_node *
+mroute_trie_node_new (struct mroute_helper *mh, const uint8_t *prefix, const int netbits, void *route)
+{
+  struct mroute_trie_node *node;
+  ALLOC_OBJ_CLEAR (node, struct mroute_trie_node);
+  memcpy (node->prefix, prefix, sizeof (node->prefix));
+  node->netbits = netbits;
+  node->route = route;
+  ++mh->n_trie_nodes;
+  return node;
+}
+
+static void
+mroute_trie_node_free (struct mroute_helper *mh, struct mroute_trie_node *node)
+{
+  free (node);
+  --mh->n_trie_nodes;
+}
+
+/*
+ * Check that addr is an IPv4 or IPv6 address and copy it
+ * into a trie key.  Returns the number of bits in the address,
+ * or 0 if the address cannot be indexed.
+ */
+static int
+mroute_trie_key (const struct mroute_addr *addr, uint8_t *key)
+{
+  const int type = addr->type & MR_ADDR_MASK;
+  if ((type != MR_ADDR_IPV4 && type != MR_ADDR_IPV6) || addr->len > 16)
+    return 0;
+  memset (key, 0, 16);
+  memcpy (key, addr->addr, addr->len);
+  return addr->len * 8;
+}
+
+void
+mroute_helper_add_route (struct mroute_helper *mh, const struct mroute_addr *net, void *route)
+{
+  struct mroute_trie_node **link;
+  struct mroute_trie_node *node;
+  uint8_t key[16];
+  int netbits;
+
+  ASSERT (net->type & MR_WITH_NETBITS);
+  if (!mroute_trie_key (net, key))
+    return;
+  netbits = min_int (net->netbits, net->len * 8);
+
+  link = &mh->cidr_trie[net->type & MR_ADDR_MASK];
+  while ((node = *link) != NULL)
+    {
+      const int common = mroute_trie_common_bits (node->prefix, key, min_int (node->netbits, netbits));
+
+      if (common < node->netbits)
+	{
+	  /* node's prefix is not a prefix of net, split here */
+	  if (common == netbits)
+	    {
+	      struct mroute_trie_node *n = mroute_trie_node_new (mh, key, netbits, route);
+	      n->child[mroute_trie_bit (node->prefix, netbits)] = node;
+	      *link = n;
+	    }
+	  else
+	    {
+	      struct mroute_trie_node *join = mroute_trie_node_new (mh, key, common, NULL);
+	      join->child[mroute_trie_bit (key, common)] = mroute_trie_node_new (mh, key, netbits, route);
+	      join->child[mroute_trie_bit (node->prefix, common)] = node;
+	      *link = join;
+	    }
+	  return;
+	}
+      if (node->netbits == netbits)
+	{
+	  node->route = route;
+	  return;
+	}
+      link = &node->child[mroute_trie_bit (key, node->netbits)];
+    }
+  *link = mroute_trie_node_new (mh, key, netbits, route);
+}
+
+/*
+ * Remove node if it has no route and at most one child.
+ */
+static void
+mroute_trie_prune (struct mroute_helper *mh, struct mroute_trie_node **link)
+{
+  struct mroute_trie_node *node = *link;
+  if (node && !node->route && !(node->child[0] && node->child[1]))
+    {
+      *link = node->child[0] ? node->child[0] : node->child[1];
+      mroute_trie_node_free (mh, node);
+    }
+}
+
+void
+mroute_helper_del_route (struct mroute_helper *mh, const struct mroute_addr *net, const void *route)
+{
+  struct mroute_trie_node **parent = NULL;
+  struct mroute_trie_node **link;
+  struct mroute_trie_node *node;
+  uint8_t key[16];
+  int netbits;
+
+  if (!(net->type & MR_WITH_NETBITS) || !mroute_trie_key (net, key))
+    return;
+  netbits = min_int (net->netbits, net->len * 8);
+
+  link = &mh->cidr_trie[net->type & MR_ADDR_MASK];
+  while ((node = *link) != NULL
+	 && node->netbits <= netbits
+	 && mroute_trie_common_bits (node->prefix, key, node->netbits) == node->netbits)
+    {
+      if (node->netbits == netbits)
+	{
+	  if (node->route == route)
+	    {
+	      node->route = NULL;
+	      mroute_trie_prune (mh, link);
+	      if (parent)
+		mroute_trie_prune (mh, parent);
+	    }
+	  return;
+	}
+      parent = link;
+      link = &node->child[mroute_trie_bit (key, node->netbits)];
+    }
+}
+
+void *
+mroute_helper_lookup (const struct mroute_helper *mh,
+		      const struct mroute_addr *addr,
+		      mroute_route_usable_func usable,
+		      const void *arg)
+{
+  const struct mroute_trie_node *node;
+  void *ret = NULL;
+  uint8_t key[16];
+  const int bits = mroute_trie_key (addr, key);
+
+  if (!bits)
+    return NULL;
+
+  node = mh->cidr_trie[addr->type & MR_ADDR_MASK];
+  while (node
+	 && node->netbits <= bits
+	 && mroute_trie_common_bits (node->prefix, key, node->netbits) == node->netbits)
+    {
+      if (node->route && (*usable) (node->route, arg))
+	ret = node->route;
+      if (node->netbits == bits)
+	break;
+      node = node->child[mroute_trie_bit (key, node->netbits)];
+    }
+  return ret;
+}
+
+static void
+mroute_trie_free (struct mroute_trie_node *node)
+{
+  if (node)
+    {
+      mroute_trie_free (node->child[0]);
+      mroute_trie_free (node->child[1]);
+      free (node);
     }
 }
 
 void
 mroute_helper_free (struct mroute_helper *mh)
 {
+  int i;
+  for (i = 0; i <= MR_ADDR_MASK; ++i)
+    mroute_trie_free (mh->cidr_trie[i]);
   free (mh);
 }
 
@@ -87,17 +87,31 @@ struct mroute_addr {
  */
 #define MR_HELPER_NET_LEN 129
 
+/*
+ * Node of the path-compressed binary trie used for
+ * longest-prefix-match lookups of CIDR routes.  Nodes
+ * without a route only join two subtries.
+ */
+struct mroute_trie_node {
+  struct mroute_trie_node *child[2]; /* indexed by the address bit following the prefix */
+  void *route;                       /* route for this prefix, or NULL */
+  int netbits;                       /* prefix length */
+  uint8_t prefix[16];                /* network address, large enough for IPv6 */
+};
+
 /*
  * Used to help maintain CIDR routing table.
  */
 struct mroute_helper {
   unsigned int cache_generation; /* incremented when route added */
   int ageable_ttl_secs;          /* host route cache entry time-to-live*/
-  int n_net_len;                 /* length of net_len array */
-  uint8_t net_len[MR_HELPER_NET_LEN];      /* CIDR netlengths in descending order */
-  int net_len_refcount[MR_HELPER_NET_LEN]; /* refcount of each netlength */
+  int n_trie_nodes;              /* number of nodes in cidr_trie */
+  struct mroute_trie_node *cidr_trie[MR_ADDR_MASK+1]; /* CIDR routes, by address type */
 };
 
+/* used by mroute_helper_lookup to skip routes which are no longer valid */
+typedef bool (*mroute_route_usable_func)(const void *route, const void *arg);
+
 struct openvpn_sockaddr;
 
 bool mroute_extract_openvpn_sockaddr (struct mroute_addr *addr,
@@ -130,6 +144,44 @@ void mroute_helper_del_iroute (struct mroute_helper *mh, const struct iroute *ir
 void mroute_helper_add_iroute6 (struct mroute_helper *mh, const struct iroute_ipv6 *ir6);
 void mroute_helper_del_iroute6 (struct mroute_helper *mh, const struct iroute_ipv6 *ir6);
 
+/*
+ * Index a CIDR route (an address with MR_WITH_NETBITS), replacing
+ * any route already indexed under the same network.
+ */
+void mroute_helper_add_route (struct mroute_helper *mh, const struct mroute_addr *net, void *route);
+
+/* remove a CIDR route from the index, if it is still the one indexed for net */
+void mroute_helper_del_route (struct mroute_helper *mh, const struct mroute_addr *net, const void *route);
+
+/*
+ * Return the route for the longest network prefix containing addr
+ * for which usable(route, arg) is true, or NULL.
+ */
+void *mroute_helper_lookup (const struct mroute_helper *mh,
+			    const struct mroute_addr *addr,
+			    mroute_route_usable_func usable,
+			    const void *arg);
+
+/*
+ * Multicast group membership snooping (IGMP/MLD).
+ */
+#define MROUTE_MCAST_JOIN  1
+#define MROUTE_MCAST_LEAVE 2
+#define MROUTE_MCAST_QUERY 3  /* group is NULL */
+
+typedef void (*mroute_mcast_report_func) (void *arg,
+					  const struct mroute_addr *group,
+					  const int op);
+
+int mroute_extract_mcast_reports (const struct buffer *buf,
+				  int tunnel_type,
+				  mroute_mcast_report_func report,
+				  void *arg);
+
+bool mroute_extract_mcast_group (struct mroute_addr *group,
+				 const struct buffer *buf,
+				 int tunnel_type);
+
 /*
  * Given a raw packet in buf, return the src and dest
  * addresses of the packet.
@@ -55,6 +55,9 @@
 #ifdef ENABLE_MANAGEMENT
 # define MTCP_MANAGEMENT ((void*)4)
 #endif
+#ifdef PLUGIN_DEF_AUTH
+# define MTCP_PLUGIN_AUTH ((void*)5)
+#endif
 
 #define MTCP_N           ((void*)16) /* upper bound on MTCP_x */
 
@@ -240,6 +243,9 @@ multi_tcp_wait (const struct context *c,
 #ifdef ENABLE_MANAGEMENT
   if (management)
     management_socket_set (management, mtcp->es, MTCP_MANAGEMENT, &mtcp->management_persist_flags);
+#endif
+#ifdef PLUGIN_DEF_AUTH
+  plugin_auth_event_set (c->plugins, mtcp->es, MTCP_PLUGIN_AUTH, &mtcp->plugin_auth_persist_flags);
 #endif
   status = event_wait (mtcp->es, &c->c2.timeval, mtcp->esr, mtcp->maxevents);
   update_time ();
@@ -298,11 +304,16 @@ multi_tcp_process_outgoing_link (struct multi_context *m, bool defer, const unsi
 	      struct mbuf_item item;
 
 	      set_prefix (mi);
-	      dmsg (D_MULTI_TCP, "MULTI TCP: queuing deferred packet");
-	      item.buffer = mb;
-	      item.instance = mi;
-	      mbuf_add_item (mi->tcp_link_out_deferred, &item);
-	      mbuf_free_buf (mb);
+	      if (mb)
+		{
+		  dmsg (D_MULTI_TCP, "MULTI TCP: queuing deferred packet");
+		  item.buffer = mb;
+		  item.instance = mi;
+		  mbuf_add_item (mi->tcp_link_out_deferred, &item);
+		  mbuf_free_buf (mb);
+		}
+	      else
+		msg (D_MULTI_DROPPED, "MULTI TCP: deferred packet dropped due to packet pool exhaustion");
 	      buf_reset (buf);
 	      ret = multi_process_post (m, mi, mpp_flags);
 	      if (!ret)
@@ -608,6 +619,14 @@ multi_tcp_process_io (struct multi_context *m)
 	      management_io (management);
 	    }
 	  else
+#endif
+#ifdef PLUGIN_DEF_AUTH
+	  /* deferred auth results from plugins? */
+	  if (e->arg == MTCP_PLUGIN_AUTH)
+	    {
+	      multi_process_plugin_auth (m);
+	    }
+	  else
 #endif
 	  /* incoming data on TUN? */
 	  if (e->arg == MTCP_TUN)
@@ -46,6 +46,9 @@ struct multi_tcp
 #ifdef ENABLE_MANAGEMENT
   unsigned int management_persist_flags;
 #endif
+#ifdef PLUGIN_DEF_AUTH
+  unsigned int plugin_auth_persist_flags;
+#endif
 };
 
 struct multi_instance;
@@ -57,12 +57,25 @@ multi_get_create_instance_udp (struct multi_context *m)
 	{
 	  mi = (struct multi_instance *) he->value;
 	}
+      else if (multi_admit_penalized (m, &real))
+	{
+	  dmsg (D_MULTI_DEBUG, "MULTI: packet from %s ignored by --tls-auth-penalty",
+		mroute_addr_print (&real, &gc));
+	}
       else
 	{
+	  bool hmac_failed = false;
+
 	  if (!m->top.c2.tls_auth_standalone
-	      || tls_pre_decrypt_lite (m->top.c2.tls_auth_standalone, &m->top.c2.from, &m->top.c2.buf))
+	      || tls_pre_decrypt_lite (m->top.c2.tls_auth_standalone, &m->top.c2.from, &m->top.c2.buf, &hmac_failed))
 	    {
-	      if (frequency_limit_event_allowed (m->new_connection_limiter))
+	      if (!multi_admit_new_session (m, &real))
+		{
+		  dmsg (D_MULTI_DEBUG,
+			"MULTI: Connection from %s would exceed new connection frequency limit as controlled by --connect-freq-source",
+			mroute_addr_print (&real, &gc));
+		}
+	      else if (frequency_limit_event_allowed (m->new_connection_limiter))
 		{
 		  mi = multi_create_instance (m, &real);
 		  if (mi)
@@ -70,14 +83,19 @@ multi_get_create_instance_udp (struct multi_context *m)
 		      hash_add_fast (hash, bucket, &mi->real, hv, mi);
 		      mi->did_real_hash = true;
 		    }
+		  else
+		    multi_admit_new_session_refund (m, &real);
 		}
 	      else
 		{
+		  multi_admit_new_session_refund (m, &real);
 		  msg (D_MULTI_ERRORS,
 		       "MULTI: Connection from %s would exceed new connection frequency limit as controlled by --connect-freq",
 		       mroute_addr_print (&real, &gc));
 		}
 	    }
+	  else if (hmac_failed)
+	    multi_admit_hmac_failed (m, &real);
 	}
 
 #ifdef ENABLE_DEBUG
@@ -148,6 +166,11 @@ multi_process_io_udp (struct multi_context *m)
     }
 #endif
 
+#ifdef PLUGIN_DEF_AUTH
+  if (status & PLUGIN_AUTH_READ)
+    multi_process_plugin_auth (m);
+#endif
+
   /* UDP port ready to accept write */
   if (status & SOCKET_WRITE)
     {
@@ -122,11 +122,97 @@ void
 multi_ifconfig_pool_persist (struct multi_context *m, bool force)
 {
  /* write pool data to file */
-  if (m->ifconfig_pool
-      && m->top.c1.ifconfig_pool_persist
-      && (force || ifconfig_pool_write_trigger (m->top.c1.ifconfig_pool_persist)))
+  if (m->ifconfig_pool && m->top.c1.ifconfig_pool_persist)
+    ifconfig_pool_write (m->top.c1.ifconfig_pool_persist, m->ifconfig_pool, force);
+}
+
+/*
+ * Cached host route LRU list.
+ */
+
+static void
+multi_route_cache_link (struct multi_reap *mr, struct multi_route *r)
+{
+  r->lru_prev = NULL;
+  r->lru_next = mr->cache_head;
+  if (mr->cache_head)
+    mr->cache_head->lru_prev = r;
+  else
+    mr->cache_tail = r;
+  mr->cache_head = r;
+  ++mr->n_cached;
+  ++r->instance->cached_route_count;
+}
+
+static void
+multi_route_cache_unlink (struct multi_reap *mr, struct multi_route *r)
+{
+  if (r->lru_prev)
+    r->lru_prev->lru_next = r->lru_next;
+  else
+    mr->cache_head = r->lru_next;
+  if (r->lru_next)
+    r->lru_next->lru_prev = r->lru_prev;
+  else
+    mr->cache_tail = r->lru_prev;
+  r->lru_prev = r->lru_next = NULL;
+  --mr->n_cached;
+  --r->instance->cached_route_count;
+}
+
+static inline void
+multi_route_cache_touch (struct multi_reap *mr, struct multi_route *r)
+{
+  if (mr->cache_head != r)
+    {
+      multi_route_cache_unlink (mr, r);
+      multi_route_cache_link (mr, r);
+    }
+}
+
+/*
+ * Remove a cached route from vhash and free it.
+ */
+static void
+multi_route_cache_delete (const struct multi_context *m, struct multi_route *r)
+{
+  struct gc_arena gc = gc_new ();
+  dmsg (D_MULTI_DEBUG, "MULTI: REAP DEL %s",
+	mroute_addr_print (&r->addr, &gc));
+  learn_address_script (m, NULL, "delete", &r->addr);
+  multi_route_cache_unlink (m->reaper, r);
+  ASSERT (hash_remove (m->vhash, &r->addr));
+  multi_route_del (r);
+  gc_free (&gc);
+}
+
+/*
+ * Delete cached routes which are no longer defined.  Routes expire
+ * in LRU order, so normally only the tail needs to be checked.  If
+ * iroutes changed since the last sweep, invalidating the routes
+ * cached before, the whole list is walked once.
+ */
+static void
+multi_route_cache_age (const struct multi_context *m)
+{
+  struct multi_reap *mr = m->reaper;
+
+  if (mr->cache_generation != m->route_helper->cache_generation)
+    {
+      struct multi_route *r = mr->cache_tail;
+      while (r)
+	{
+	  struct multi_route *prev = r->lru_prev;
+	  if (!multi_route_defined (m, r))
+	    multi_route_cache_delete (m, r);
+	  r = prev;
+	}
+      mr->cache_generation = m->route_helper->cache_generation;
+    }
+  else
     {
-      ifconfig_pool_write (m->top.c1.ifconfig_pool_persist, m->ifconfig_pool);
+      while (mr->cache_tail && !multi_route_defined (m, mr->cache_tail))
+	multi_route_cache_delete (m, mr->cache_tail);
     }
 }
 
@@ -155,6 +241,9 @@ multi_reap_range (const struct multi_context *m,
 	  dmsg (D_MULTI_DEBUG, "MULTI: REAP DEL %s",
 	       mroute_addr_print (&r->addr, &gc));
 	  learn_address_script (m, NULL, "delete", &r->addr);
+	  if (r->flags & MULTI_ROUTE_CACHE)
+	    multi_route_cache_unlink (m->reaper, r);
+	  mroute_helper_del_route (m->route_helper, &r->addr, r);
 	  multi_route_del (r);
 	  hash_iterator_delete_element (&hi);
 	}
@@ -169,25 +258,62 @@ multi_reap_all (const struct multi_context *m)
   multi_reap_range (m, -1, 0);
 }
 
+/*
+ * How many buckets in vhash to reap per pass.
+ */
+static int
+reap_buckets_per_pass (int n_buckets)
+{
+  return constrain_int (n_buckets / REAP_DIVISOR, REAP_MIN, REAP_MAX);
+}
+
 static struct multi_reap *
-multi_reap_new (int buckets_per_pass)
+multi_reap_new (int buckets_per_pass, int max_cached)
 {
   struct multi_reap *mr;
-  ALLOC_OBJ (mr, struct multi_reap);
+  ALLOC_OBJ_CLEAR (mr, struct multi_reap);
   mr->bucket_base = 0;
   mr->buckets_per_pass = buckets_per_pass;
+  mr->max_cached = max_cached;
   mr->last_call = now;
   return mr;
 }
 
+/*
+ * Routes of a closed instance stay in vhash until the reaper
+ * finds them, so walk the whole table once after each close.
+ */
+static void
+multi_reap_schedule_scan (const struct multi_context *m)
+{
+  struct multi_reap *mr = m->reaper;
+  mr->n_buckets_seen = hash_n_buckets (m->vhash);
+  mr->buckets_to_scan = mr->n_buckets_seen;
+}
+
 void
 multi_reap_process_dowork (const struct multi_context *m)
 {
   struct multi_reap *mr = m->reaper;
-  if (mr->bucket_base >= hash_n_buckets (m->vhash))
-    mr->bucket_base = 0;
-  multi_reap_range (m, mr->bucket_base, mr->bucket_base + mr->buckets_per_pass); 
-  mr->bucket_base += mr->buckets_per_pass;
+
+  multi_route_cache_age (m);
+
+  /* restart the walk if vhash was resized while it was in progress */
+  if (mr->buckets_to_scan > 0 && mr->n_buckets_seen != hash_n_buckets (m->vhash))
+    multi_reap_schedule_scan (m);
+
+  if (mr->buckets_to_scan > 0)
+    {
+      if (mr->bucket_base >= hash_n_buckets (m->vhash))
+	{
+	  /* vhash grows with the number of routes, rescale each cycle */
+	  mr->bucket_base = 0;
+	  mr->buckets_per_pass = reap_buckets_per_pass (hash_n_buckets (m->vhash));
+	}
+      multi_reap_range (m, mr->bucket_base, mr->bucket_base + mr->buckets_per_pass); 
+      mr->bucket_base += mr->buckets_per_pass;
+      mr->buckets_to_scan -= mr->buckets_per_pass;
+    }
   mr->last_call = now;
 }
 
@@ -198,12 +324,339 @@ multi_reap_free (struct multi_reap *mr)
 }
 
 /*
- * How many buckets in vhash to reap per pass.
+ * Per source prefix admission control.
  */
-static int
-reap_buckets_per_pass (int n_buckets)
+
+static struct multi_admit *
+multi_admit_init (const struct options *o)
 {
-  return constrain_int (n_buckets / REAP_DIVISOR, REAP_MIN, REAP_MAX);
+  struct multi_admit *a;
+  int n = 1024;
+
+  while (n < 4 * o->max_clients && n < 65536)
+    n <<= 1;
+
+  ALLOC_OBJ_CLEAR (a, struct multi_admit);
+  ALLOC_ARRAY_CLEAR (a->entries, struct multi_admit_entry, n);
+  a->n_entries = n;
+  a->iv = get_random ();
+  a->connect_max = o->cf_source_max;
+  a->connect_per = o->cf_source_per;
+  a->control_max = o->ctl_source_max;
+  a->control_per = o->ctl_source_per;
+  a->penalty = o->tls_auth_penalty;
+  a->netbits = o->source_netbits;
+  a->netbits_ipv6 = o->source_netbits_ipv6;
+
+  msg (D_MULTI_LOW, "MULTI: per source admission control, %d entries, prefix /%d /%d",
+       n, a->netbits, a->netbits_ipv6);
+  return a;
+}
+
+static void
+multi_admit_free (struct multi_admit *a)
+{
+  if (a)
+    {
+      free (a->entries);
+      free (a);
+    }
+}
+
+/*
+ * Take one event out of a bucket allowing max events per per
+ * seconds, refilling it for the time elapsed since last use.
+ */
+static bool
+multi_token_bucket_take (struct multi_token_bucket *b, const int max, const int per)
+{
+  const int capacity = max * per;
+
+  if (now > b->last_refill)
+    {
+      const time_t elapsed = now - b->last_refill;
+      if (elapsed >= per)
+	b->tokens = capacity;
+      else
+	b->tokens = min_int (capacity, b->tokens + (int) elapsed * max);
+      b->last_refill = now;
+    }
+
+  if (b->tokens >= per)
+    {
+      b->tokens -= per;
+      return true;
+    }
+  return false;
+}
+
+/*
+ * Reduce a real address to the source prefix it is accounted under.
+ */
+static void
+multi_admit_prefix (const struct multi_admit *a, struct mroute_addr *prefix, const struct mroute_addr *real)
+{
+  *prefix = *real;
+  if (prefix->type & MR_WITH_PORT)
+    {
+      prefix->type &= ~MR_WITH_PORT;
+      prefix->len -= 2;
+    }
+  prefix->type |= MR_WITH_NETBITS;
+  prefix->netbits = ((prefix->type & MR_ADDR_MASK) == MR_ADDR_IPV6) ? a->netbits_ipv6 : a->netbits;
+  mroute_addr_mask_host_bits (prefix);
+}
+
+/*
+ * Find the entry of real's source prefix.  If there is none and
+ * create is set, take over a free entry of its set, or else the
+ * least recently seen one, sparing sources in the penalty box.
+ */
+static struct multi_admit_entry *
+multi_admit_lookup (struct multi_admit *a, const struct mroute_addr *real, const bool create)
+{
+  struct mroute_addr prefix;
+  struct multi_admit_entry *set;
+  struct multi_admit_entry *victim = NULL;
+  int i;
+
+  multi_admit_prefix (a, &prefix, real);
+  set = &a->entries[mroute_addr_hash_function (&prefix, a->iv)
+		    & (a->n_entries - 1) & ~(MULTI_ADMIT_WAYS - 1)];
+
+  for (i = 0; i < MULTI_ADMIT_WAYS; ++i)
+    {
+      struct multi_admit_entry *e = &set[i];
+      if (e->prefix.len && mroute_addr_equal (&e->prefix, &prefix))
+	{
+	  e->last_seen = now;
+	  return e;
+	}
+    }
+
+  if (!create)
+    return NULL;
+
+  for (i = 0; i < MULTI_ADMIT_WAYS; ++i)
+    {
+      struct multi_admit_entry *e = &set[i];
+      if (!e->prefix.len)
+	{
+	  victim = e;
+	  break;
+	}
+      if (!victim
+	  || (victim->penalty_until > now && e->penalty_until <= now)
+	  || ((victim->penalty_until > now) == (e->penalty_until > now)
+	      && e->last_seen < victim->last_seen))
+	victim = e;
+    }
+
+  if (victim->prefix.len)
+    ++a->n_evicted;
+  else
+    ++a->n_used;
+
+  CLEAR (*victim);
+  victim->prefix = prefix;
+  victim->last_seen = now;
+  victim->connect.tokens = a->connect_max * a->connect_per;
+  victim->connect.last_refill = now;
+  victim->control.tokens = a->control_max * a->control_per;
+  victim->control.last_refill = now;
+  return victim;
+}
+
+/*
+ * Is real's source prefix in the penalty box for failing
+ * the --tls-auth HMAC test?
+ */
+bool
+multi_admit_penalized (struct multi_context *m, const struct mroute_addr *real)
+{
+  struct multi_admit *a = m->admit;
+  if (a && a->penalty)
+    {
+      const struct multi_admit_entry *e = multi_admit_lookup (a, real, false);
+      if (e && e->penalty_until > now)
+	{
+	  ++a->n_penalized;
+	  return true;
+	}
+    }
+  return false;
+}
+
+/*
+ * A packet from real, which has no instance, failed
+ * the --tls-auth HMAC test.
+ */
+void
+multi_admit_hmac_failed (struct multi_context *m, const struct mroute_addr *real)
+{
+  struct multi_admit *a = m->admit;
+  if (a)
+    {
+      ++a->n_hmac_failed;
+      if (a->penalty)
+	{
+	  struct multi_admit_entry *e = multi_admit_lookup (a, real, true);
+	  if (e->penalty_until <= now)
+	    {
+	      struct gc_arena gc = gc_new ();
+	      msg (D_MULTI_LOW, "MULTI: %s failed the --tls-auth HMAC test, ignoring new connections from %s for %d seconds",
+		   mroute_addr_print (real, &gc),
+		   mroute_addr_print (&e->prefix, &gc),
+		   a->penalty);
+	      gc_free (&gc);
+	    }
+	  e->penalty_until = now + a->penalty;
+	}
+    }
+}
+
+/*
+ * May real start a new session under --connect-freq-source?
+ */
+bool
+multi_admit_new_session (struct multi_context *m, const struct mroute_addr *real)
+{
+  struct multi_admit *a = m->admit;
+  if (a)
+    {
+      if (a->connect_max)
+	{
+	  struct multi_admit_entry *e = multi_admit_lookup (a, real, true);
+	  if (!multi_token_bucket_take (&e->connect, a->connect_max, a->connect_per))
+	    {
+	      ++a->n_connect_limited;
+	      return false;
+	    }
+	}
+      ++a->n_admitted;
+    }
+  return true;
+}
+
+/*
+ * Give back the --connect-freq-source token taken by
+ * multi_admit_new_session() for a session which was
+ * then refused for another reason.
+ */
+void
+multi_admit_new_session_refund (struct multi_context *m, const struct mroute_addr *real)
+{
+  struct multi_admit *a = m->admit;
+  if (a)
+    {
+      if (a->connect_max)
+	{
+	  struct multi_admit_entry *e = multi_admit_lookup (a, real, false);
+	  if (e)
+	    e->connect.tokens = min_int (a->connect_max * a->connect_per,
+					 e->connect.tokens + a->connect_per);
+	}
+      --a->n_admitted;
+    }
+}
+
+/*
+ * Charge a control channel packet of mi to its source
+ * under --control-freq-source, false if it should be dropped.
+ */
+static bool
+multi_admit_control (struct multi_context *m, const struct multi_instance *mi, const struct buffer *buf)
+{
+  struct multi_admit *a = m->admit;
+  if (a && a->control_max && BLEN (buf) > 0
+      && (*BPTR (buf) >> P_OPCODE_SHIFT) != P_DATA_V1)
+    {
+      struct multi_admit_entry *e = multi_admit_lookup (a, &mi->real, true);
+      if (!multi_token_bucket_take (&e->control, a->control_max, a->control_per))
+	{
+	  ++a->n_control_limited;
+	  return false;
+	}
+    }
+  return true;
+}
+
+static uint32_t
+name_hash_function (const void *key, uint32_t iv)
+{
+  return hash_func ((const uint8_t *)key, strlen ((const char *)key) + 1, iv);
+}
+
+static bool
+name_compare_function (const void *key1, const void *key2)
+{
+  return !strcmp ((const char *)key1, (const char *)key2);
+}
+
+/*
+ * Add an instance to secondary index idx under name.  The first
+ * instance with a given name is the hash entry and owns its key,
+ * later ones are chained behind it so that the key never moves
+ * unless the first instance goes away.
+ */
+static void
+multi_name_index_add (struct multi_context *m, struct multi_instance *mi, const int idx, const char *name)
+{
+  struct multi_name_link *link = &mi->name_link[idx];
+  struct hash *h = m->name_index[idx];
+  const uint32_t hv = hash_value (h, name);
+  struct hash_element *he;
+
+  ASSERT (!link->name);
+  link->name = string_alloc (name, &mi->gc);
+  link->prev = link->next = NULL;
+
+  he = hash_lookup_fast (h, hash_bucket (h, hv), name, hv);
+  if (he)
+    {
+      struct multi_instance *first = (struct multi_instance *) he->value;
+      link->prev = first;
+      link->next = first->name_link[idx].next;
+      if (link->next)
+	link->next->name_link[idx].prev = mi;
+      first->name_link[idx].next = mi;
+    }
+  else
+    ASSERT (hash_add (h, link->name, mi, false));
+}
+
+static void
+multi_name_index_remove (struct multi_context *m, struct multi_instance *mi, const int idx)
+{
+  struct multi_name_link *link = &mi->name_link[idx];
+
+  if (!link->name)
+    return;
+
+  if (link->next)
+    link->next->name_link[idx].prev = link->prev;
+  if (link->prev)
+    link->prev->name_link[idx].next = link->next;
+  else
+    {
+      /* first instance: hand the hash entry over to the next one */
+      ASSERT (hash_remove (m->name_index[idx], link->name));
+      if (link->next)
+	ASSERT (hash_add (m->name_index[idx], link->next->name_link[idx].name, link->next, false));
+    }
+
+  link->name = NULL;
+  link->prev = link->next = NULL;
+}
+
+/*
+ * Return the first established instance named name in index idx,
+ * the others follow through name_link[idx].next.
+ */
+static struct multi_instance *
+multi_name_index_lookup (struct multi_context *m, const int idx, const char *name)
+{
+  return (struct multi_instance *) hash_lookup (m->name_index[idx], name);
 }
 
 #ifdef MANAGEMENT_DEF_AUTH
@@ -225,6 +678,239 @@ cid_compare_function (const void *key1, const void *key2)
 
 #endif
 
+/*
+ * Multicast group membership, learned by snooping the
+ * IGMP/MLD reports that clients send.
+ *
+ * Hosts repeat their reports only in answer to queries, which
+ * the server does not send.  Memberships therefore only expire
+ * while a querier is seen on the tunnel, and then only once it
+ * has been present long enough to have solicited fresh reports.
+ * Without a querier, a membership lasts until its leave or the
+ * client's disconnect, and groups nobody reported are flooded.
+ */
+
+static inline bool
+multi_mcast_querier_present (const struct multi_context *m)
+{
+  return m->mcast_querier_last && now < m->mcast_querier_last + MULTI_MCAST_QUERIER_TTL;
+}
+
+static inline bool
+multi_mcast_expiring (const struct multi_context *m)
+{
+  return multi_mcast_querier_present (m)
+    && now >= m->mcast_querier_since + MULTI_MCAST_MEMBER_TTL;
+}
+
+static void
+multi_mcast_query (struct multi_context *m)
+{
+  if (!multi_mcast_querier_present (m))
+    {
+      m->mcast_querier_since = now;
+      dmsg (D_MULTI_DEBUG, "MULTI: MCAST querier seen");
+    }
+  m->mcast_querier_last = now;
+}
+
+static void
+multi_mcast_group_free (struct multi_mcast_group *g)
+{
+  struct multi_mcast_member *mm = g->members;
+  while (mm)
+    {
+      struct multi_mcast_member *next = mm->next;
+      --mm->instance->n_mcast_groups;
+      free (mm);
+      mm = next;
+    }
+  free (g);
+}
+
+/*
+ * Drop the members of g which belong to mi, if defined, and
+ * if expire is true those which have expired.  Return true
+ * if g is now empty.
+ */
+static bool
+multi_mcast_group_prune (struct multi_mcast_group *g, const struct multi_instance *mi, const bool expire)
+{
+  struct multi_mcast_member **mp = &g->members;
+  struct multi_mcast_member *mm;
+
+  while ((mm = *mp))
+    {
+      if (mm->instance == mi || (expire && mm->expires <= now))
+	{
+	  *mp = mm->next;
+	  --mm->instance->n_mcast_groups;
+	  free (mm);
+	}
+      else
+	mp = &mm->next;
+    }
+  return g->members == NULL;
+}
+
+/*
+ * Prune every group, see multi_mcast_group_prune().
+ */
+static void
+multi_mcast_prune (struct multi_context *m, const struct multi_instance *mi)
+{
+  const bool expire = multi_mcast_expiring (m);
+  struct hash_iterator hi;
+  struct hash_element *he;
+
+  hash_iterator_init (m->mcast_groups, &hi);
+  while ((he = hash_iterator_next (&hi)))
+    {
+      struct multi_mcast_group *g = (struct multi_mcast_group *) he->value;
+      if (multi_mcast_group_prune (g, mi, expire))
+	{
+	  hash_iterator_delete_element (&hi);
+	  multi_mcast_group_free (g);
+	}
+    }
+  hash_iterator_free (&hi);
+}
+
+/*
+ * Remove a closing instance from all groups it joined.
+ */
+static void
+multi_mcast_forget (struct multi_context *m, const struct multi_instance *mi)
+{
+  if (m->mcast_groups && mi->n_mcast_groups > 0)
+    multi_mcast_prune (m, mi);
+}
+
+static void
+multi_mcast_free (struct multi_context *m)
+{
+  if (m->mcast_groups)
+    {
+      struct hash_iterator hi;
+      struct hash_element *he;
+
+      hash_iterator_init (m->mcast_groups, &hi);
+      while ((he = hash_iterator_next (&hi)))
+	{
+	  struct multi_mcast_group *g = (struct multi_mcast_group *) he->value;
+	  hash_iterator_delete_element (&hi);
+	  multi_mcast_group_free (g);
+	}
+      hash_iterator_free (&hi);
+      hash_free (m->mcast_groups);
+      m->mcast_groups = NULL;
+    }
+}
+
+/*
+ * Called by mroute_extract_mcast_reports() for each group
+ * in a membership report sent by m->pending.
+ */
+static void
+multi_mcast_report (void *arg, const struct mroute_addr *group, const int op)
+{
+  struct multi_context *m = (struct multi_context *) arg;
+  struct multi_instance *mi = m->pending;
+  uint32_t hv;
+  struct hash_element *he;
+  struct multi_mcast_group *g;
+  struct multi_mcast_member *mm = NULL;
+  struct gc_arena gc;
+
+  if (op == MROUTE_MCAST_QUERY)
+    {
+      multi_mcast_query (m);
+      return;
+    }
+
+  /* reports seen on the tun/tap side are not ours to track */
+  if (!mi)
+    return;
+
+  hv = hash_value (m->mcast_groups, group);
+  he = hash_lookup_fast (m->mcast_groups, NULL, group, hv);
+  g = he ? (struct multi_mcast_group *) he->value : NULL;
+  gc = gc_new ();
+
+  if (g)
+    {
+      for (mm = g->members; mm; mm = mm->next)
+	if (mm->instance == mi)
+	  break;
+    }
+
+  if (op == MROUTE_MCAST_JOIN)
+    {
+      if (!mm)
+	{
+	  if (mi->n_mcast_groups >= MULTI_MCAST_MAX_GROUPS)
+	    {
+	      msg (D_MULTI_ERRORS, "MULTI: client has joined too many multicast groups (%d), ignoring join of %s",
+		   MULTI_MCAST_MAX_GROUPS,
+		   mroute_addr_print (group, &gc));
+	      gc_free (&gc);
+	      return;
+	    }
+	  if (!g)
+	    {
+	      ALLOC_OBJ_CLEAR (g, struct multi_mcast_group);
+	      g->addr = *group;
+	      hash_add_fast (m->mcast_groups, NULL, &g->addr, hv, g);
+	    }
+	  ALLOC_OBJ_CLEAR (mm, struct multi_mcast_member);
+	  mm->instance = mi;
+	  mm->next = g->members;
+	  g->members = mm;
+	  ++mi->n_mcast_groups;
+	  dmsg (D_MULTI_DEBUG, "MULTI: MCAST JOIN %s", mroute_addr_print (group, &gc));
+	}
+      mm->expires = now + MULTI_MCAST_MEMBER_TTL;
+    }
+  else if (mm)
+    {
+      /*
+       * A tap client may bridge other hosts still listening to the
+       * group, and we never query them, so let the membership age out.
+       */
+      if (TUNNEL_TYPE (m->top.c1.tuntap) == DEV_TYPE_TUN)
+	{
+	  if (multi_mcast_group_prune (g, mi, multi_mcast_expiring (m)))
+	    {
+	      hash_remove_fast (m->mcast_groups, NULL, &g->addr, hv);
+	      multi_mcast_group_free (g);
+	    }
+	  dmsg (D_MULTI_DEBUG, "MULTI: MCAST LEAVE %s", mroute_addr_print (group, &gc));
+	}
+    }
+  gc_free (&gc);
+}
+
+/*
+ * Learn group memberships from a multicast packet sent by m->pending,
+ * or only the presence of a querier if m->pending is NULL.
+ */
+static inline void
+multi_mcast_snoop (struct multi_context *m, const struct buffer *buf, int tunnel_type)
+{
+  if (m->mcast_groups)
+    mroute_extract_mcast_reports (buf, tunnel_type, multi_mcast_report, m);
+}
+
+static void
+multi_mcast_sweep (struct multi_context *m)
+{
+  if (m->mcast_groups && now >= m->mcast_sweep_time)
+    {
+      multi_mcast_prune (m, NULL);
+      m->mcast_sweep_time = now + MULTI_MCAST_SWEEP_INTERVAL;
+    }
+}
+
 /*
  * Main initialization function, init multi_context object.
  */
@@ -232,6 +918,7 @@ void
 multi_init (struct multi_context *m, struct context *t, bool tcp_mode, int thread_mode)
 {
   int dev = DEV_TYPE_UNDEF;
+  int i;
 
   msg (D_MULTI_LOW, "MULTI: multi_init called, r=%d v=%d",
        t->options.real_hash_size,
@@ -279,6 +966,17 @@ multi_init (struct multi_context *m, struct context *t, bool tcp_mode, int threa
 		       mroute_addr_hash_function,
 		       mroute_addr_compare_function);
 
+  /*
+   * Secondary indexes of established instances by common
+   * name and username, for duplicate-cn handling and the
+   * management interface.
+   */
+  for (i = 0; i < MULTI_N_INDEX; ++i)
+    m->name_index[i] = hash_init (t->options.real_hash_size,
+				  get_random (),
+				  name_hash_function,
+				  name_compare_function);
+
 #ifdef MANAGEMENT_DEF_AUTH
   m->cid_hash = hash_init (t->options.real_hash_size,
 			   0,
@@ -299,6 +997,22 @@ multi_init (struct multi_context *m, struct context *t, bool tcp_mode, int threa
   m->new_connection_limiter = frequency_limit_init (t->options.cf_max,
 						    t->options.cf_per);
 
+  /*
+   * The same, and a penalty box for --tls-auth failures,
+   * per source address prefix.
+   */
+  if (t->options.cf_source_max || t->options.ctl_source_max || t->options.tls_auth_penalty)
+    m->admit = multi_admit_init (&t->options);
+
+  /*
+   * Set up the pool which holds the packets queued for
+   * broadcast/multicast and deferred TCP output
+   */
+  mbuf_pool_init (BUF_SIZE (&t->c2.frame),
+		  t->options.n_bcast_buf,
+		  t->options.n_packet_buf,
+		  t->options.packet_buf_hugepages);
+
   /*
    * Allocate broadcast/multicast buffer list
    */
@@ -342,7 +1056,21 @@ multi_init (struct multi_context *m, struct context *t, bool tcp_mode, int threa
   /*
    * Initialize route and instance reaper.
    */
-  m->reaper = multi_reap_new (reap_buckets_per_pass (t->options.virtual_hash_size));
+  m->reaper = multi_reap_new (reap_buckets_per_pass (t->options.virtual_hash_size),
+			      t->options.max_cached_routes);
+
+  /*
+   * Deliver multicast only to the clients which
+   * joined the group?
+   */
+  if (t->options.mcast_snooping)
+    {
+      m->mcast_groups = hash_init (16,
+				   get_random (),
+				   mroute_addr_hash_function,
+				   mroute_addr_compare_function);
+      m->mcast_sweep_time = now + MULTI_MCAST_SWEEP_INTERVAL;
+    }
 
   /*
    * Get local ifconfig address
@@ -457,6 +1185,72 @@ multi_client_disconnect_setenv (struct multi_context *m,
   }
 }
 
+/*
+ * Remember an asynchronous script which nobody waits
+ * for, so that it is collected once it exits.
+ */
+static void
+multi_script_child_add (struct multi_context *m, const int pid, const char *hook)
+{
+  struct multi_script_child *sc;
+
+  ALLOC_OBJ_CLEAR (sc, struct multi_script_child);
+  sc->pid = pid;
+  sc->hook = hook;
+  sc->next = m->script_children;
+  m->script_children = sc;
+}
+
+/*
+ * Collect the asynchronous scripts which have exited,
+ * or wait for all of them if block is set.
+ */
+static void
+multi_script_children_reap (struct multi_context *m, const bool block)
+{
+  struct multi_script_child **sc = &m->script_children;
+
+  while (*sc)
+    {
+      int stat;
+
+      if (openvpn_execve_reap ((*sc)->pid, &stat, block))
+	{
+	  struct multi_script_child *done = *sc;
+
+	  if (!system_ok (stat))
+	    {
+	      struct gc_arena gc = gc_new ();
+	      msg (M_WARN, "WARNING: Failed running command (%s): %s",
+		   done->hook, system_error_message (stat, &gc));
+	      gc_free (&gc);
+	    }
+	  *sc = done->next;
+	  free (done);
+	}
+      else
+	sc = &(*sc)->next;
+    }
+}
+
+/*
+ * Run a client script.  With --client-script-async, return
+ * the pid of the script as soon as it has been started.
+ * Otherwise return 0 once it has exited successfully, or
+ * -1 if it failed.
+ */
+static int
+multi_client_script_run (struct multi_instance *mi, const struct argv *argv, const char *hook)
+{
+  if (mi->context.options.client_script_async)
+    {
+      const int pid = openvpn_execve_async (argv, mi->context.c2.es, S_SCRIPT);
+      if (pid > 0)
+	return pid;
+    }
+  return openvpn_run_script (argv, mi->context.c2.es, 0, hook) ? 0 : -1;
+}
+
 static void
 multi_client_disconnect_script (struct multi_context *m,
 				struct multi_instance *mi)
@@ -475,9 +1269,12 @@ multi_client_disconnect_script (struct multi_context *m,
       if (mi->context.options.client_disconnect_script)
 	{
 	  struct argv argv = argv_new ();
+	  int pid;
 	  setenv_str (mi->context.c2.es, "script_type", "client-disconnect");
 	  argv_printf (&argv, "%sc", mi->context.options.client_disconnect_script);
-	  openvpn_run_script (&argv, mi->context.c2.es, 0, "--client-disconnect");
+	  pid = multi_client_script_run (mi, &argv, "--client-disconnect");
+	  if (pid > 0)
+	    multi_script_child_add (m, pid, "--client-disconnect");
 	  argv_reset (&argv);
 	}
 #ifdef MANAGEMENT_DEF_AUTH
@@ -488,15 +1285,21 @@ multi_client_disconnect_script (struct multi_context *m,
     }
 }
 
+static void multi_client_connect_abort (struct multi_context *m, struct multi_instance *mi);
+
 void
 multi_close_instance (struct multi_context *m,
 		      struct multi_instance *mi,
 		      bool shutdown)
 {
+  int i;
+
   perf_push (PERF_MULTI_CLOSE_INSTANCE);
 
   ASSERT (!mi->halt);
   mi->halt = true;
+  ++m->instance_generation;
+  multi_reap_schedule_scan (m);
 
   dmsg (D_MULTI_DEBUG, "MULTI: multi_close_instance called");
 
@@ -520,6 +1323,8 @@ multi_close_instance (struct multi_context *m,
 	{
 	  ASSERT (hash_remove (m->iter, &mi->real));
 	}
+      for (i = 0; i < MULTI_N_INDEX; ++i)
+	multi_name_index_remove (m, mi, i);
 #ifdef MANAGEMENT_DEF_AUTH
       if (mi->did_cid_hash)
 	{
@@ -543,10 +1348,21 @@ multi_close_instance (struct multi_context *m,
       mbuf_dereference_instance (m->mbuf, mi);
     }
 
+  multi_mcast_forget (m, mi);
+
+#ifdef ENABLE_PF
+  free (mi->bcast_peers);
+  mi->bcast_peers = NULL;
+  mi->bcast_peers_valid = false;
+#endif
+
 #ifdef MANAGEMENT_DEF_AUTH
   set_cc_config (mi, NULL);
 #endif
 
+  if (!mi->connection_established_flag && mi->cc.stage != CC_STAGE_BEGIN)
+    multi_client_connect_abort (m, mi);
+
   multi_client_disconnect_script (m, mi);
 
   if (mi->did_open_context)
@@ -569,6 +1385,8 @@ multi_close_instance (struct multi_context *m,
 /*
  * Called on shutdown or restart.
  */
+static void multi_status_free (struct multi_status *ms);
+
 void
 multi_uninit (struct multi_context *m)
 {
@@ -583,6 +1401,7 @@ multi_uninit (struct multi_context *m)
 	{
 	  struct hash_iterator hi;
 	  struct hash_element *he;
+	  int i;
 
 	  hash_iterator_init (m->iter, &hi);
 	  while ((he = hash_iterator_next (&hi)))
@@ -594,10 +1413,19 @@ multi_uninit (struct multi_context *m)
 	  hash_iterator_free (&hi);
 
 	  multi_reap_all (m);
+	  multi_script_children_reap (m, true);
+
+	  if (m->status)
+	    {
+	      multi_status_free (m->status);
+	      m->status = NULL;
+	    }
 
 	  hash_free (m->hash);
 	  hash_free (m->vhash);
 	  hash_free (m->iter);
+	  for (i = 0; i < MULTI_N_INDEX; ++i)
+	    hash_free (m->name_index[i]);
 #ifdef MANAGEMENT_DEF_AUTH
 	  hash_free (m->cid_hash);
 #endif
@@ -605,9 +1433,13 @@ multi_uninit (struct multi_context *m)
 
 	  schedule_free (m->schedule);
 	  mbuf_free (m->mbuf);
+	  mbuf_pool_free ();
 	  ifconfig_pool_free (m->ifconfig_pool);
 	  frequency_limit_free (m->new_connection_limiter);
+	  multi_admit_free (m->admit);
+	  m->admit = NULL;
 	  multi_reap_free (m->reaper);
+	  multi_mcast_free (m);
 	  mroute_helper_free (m->route_helper);
 	  multi_tcp_free (m->mtcp);
 	  m->thread_mode = MC_UNDEF;
@@ -630,7 +1462,7 @@ multi_create_instance (struct multi_context *m, const struct mroute_addr *real)
 
   ALLOC_OBJ_CLEAR (mi, struct multi_instance);
 
-  mi->gc = gc_new ();
+  mi->gc = gc_new_unchunked ();
   multi_instance_inc_refcount (mi);
   mi->vaddr_handle = -1;
   mi->created = now;
@@ -669,6 +1501,7 @@ multi_create_instance (struct multi_context *m, const struct mroute_addr *real)
       goto err;
     }
   mi->did_iter = true;
+  ++m->instance_generation;
 
 #ifdef MANAGEMENT_DEF_AUTH
   do {
@@ -677,6 +1510,11 @@ multi_create_instance (struct multi_context *m, const struct mroute_addr *real)
   mi->did_cid_hash = true;
 #endif
 
+#ifdef PLUGIN_DEF_AUTH
+  if (mi->context.c2.tls_multi)
+    mi->context.c2.tls_multi->opt.plugin_auth_context = mi;
+#endif
+
   mi->context.c2.push_reply_deferred = true;
 
   if (!multi_process_post (m, mi, MPP_PRE_SELECT))
@@ -697,178 +1535,498 @@ multi_create_instance (struct multi_context *m, const struct mroute_addr *real)
 }
 
 /*
- * Dump tables -- triggered by SIGUSR2.
- * If status file is defined, write to file.
- * If status file is NULL, write to syslog.
+ * Print one line of the GLOBAL STATS section
+ * in the given status file format version.
  */
-void
-multi_print_status (struct multi_context *m, struct status_output *so, const int version)
+static void
+multi_print_global_stat (struct status_output *so, const int version,
+			 const char *name, const counter_type value)
 {
-  if (m->hash)
+  if (version == 1)
+    status_printf (so, "%s," counter_format, name, value);
+  else if (version == 4)
+    status_printf (so, "GLOBAL\t%s\t" counter_format, name, value);
+  else
     {
-      struct gc_arena gc_top = gc_new ();
-      struct hash_iterator hi;
-      const struct hash_element *he;
+      const char sep = (version == 3) ? '\t' : ',';
+      status_printf (so, "GLOBAL_STATS%c%s%c" counter_format, sep, name, sep, value);
+    }
+}
+
+/*
+ * Report host route cache statistics.
+ */
+static void
+multi_print_route_cache_stats (struct multi_context *m, struct status_output *so, const int version)
+{
+  if (m->reaper)
+    {
+      multi_print_global_stat (so, version, "Cached routes", m->reaper->n_cached);
+      multi_print_global_stat (so, version, "Cached route evictions", m->reaper->n_evicted);
+    }
+}
+
+/*
+ * Report multicast snooping statistics.
+ */
+static void
+multi_print_mcast_stats (struct multi_context *m, struct status_output *so, const int version)
+{
+  if (m->mcast_groups)
+    multi_print_global_stat (so, version, "Multicast groups", hash_n_elements (m->mcast_groups));
+}
+
+/*
+ * Report queued packet statistics.
+ */
+static void
+multi_print_mbuf_stats (struct multi_context *m, struct status_output *so, const int version)
+{
+  int max_out;
+  unsigned int n_exhausted;
+
+  if (!m->mbuf)
+    return;
 
-      status_reset (so);
+  multi_print_global_stat (so, version, "Max bcast/mcast queue length",
+			   mbuf_maximum_queued (m->mbuf));
+  mbuf_pool_stats (&max_out, &n_exhausted);
+  multi_print_global_stat (so, version, "Max packet pool buffers in use", max_out);
+  multi_print_global_stat (so, version, "Packet pool exhaustions", n_exhausted);
+}
+
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+/*
+ * Report control channel buffer memory.
+ */
+static void
+multi_print_tls_buffer_stats (struct multi_context *m, struct status_output *so, const int version)
+{
+  struct hash_iterator hi;
+  const struct hash_element *he;
+  size_t in_use, pooled, max_client = 0;
+  int n_clients = 0;
 
-      if (version == 1) /* WAS: m->status_file_version */
+  hash_iterator_init (m->hash, &hi);
+  while ((he = hash_iterator_next (&hi)))
+    {
+      const struct multi_instance *mi = (struct multi_instance *) he->value;
+      const size_t size = tls_multi_buffer_size (mi->context.c2.tls_multi);
+      if (size)
 	{
-	  /*
-	   * Status file version 1
-	   */
-	  status_printf (so, "OpenVPN CLIENT LIST");
-	  status_printf (so, "Updated,%s", time_string (0, 0, false, &gc_top));
-	  status_printf (so, "Common Name,Real Address,Bytes Received,Bytes Sent,Connected Since");
-	  hash_iterator_init (m->hash, &hi);
-	  while ((he = hash_iterator_next (&hi)))
-	    {
-	      struct gc_arena gc = gc_new ();
-	      const struct multi_instance *mi = (struct multi_instance *) he->value;
+	  ++n_clients;
+	  if (size > max_client)
+	    max_client = size;
+	}
+    }
+  hash_iterator_free (&hi);
 
-	      if (!mi->halt)
-		{
-		  status_printf (so, "%s,%s," counter_format "," counter_format ",%s",
-				 tls_common_name (mi->context.c2.tls_multi, false),
-				 mroute_addr_print (&mi->real, &gc),
-				 mi->context.c2.link_read_bytes,
-				 mi->context.c2.link_write_bytes,
-				 time_string (mi->created, 0, false, &gc));
-		}
-	      gc_free (&gc);
-	    }
-	  hash_iterator_free (&hi);
+  tls_buffer_pool_stats (&in_use, &pooled);
+  multi_print_global_stat (so, version, "Control channel buffer bytes in use", in_use);
+  multi_print_global_stat (so, version, "Control channel buffer bytes pooled", pooled);
+  multi_print_global_stat (so, version, "Clients holding control channel buffers", n_clients);
+  multi_print_global_stat (so, version, "Max control channel buffer bytes per client", max_client);
+}
+#endif
 
-	  status_printf (so, "ROUTING TABLE");
-	  status_printf (so, "Virtual Address,Common Name,Real Address,Last Ref");
-	  hash_iterator_init (m->vhash, &hi);
-	  while ((he = hash_iterator_next (&hi)))
-	    {
-	      struct gc_arena gc = gc_new ();
-	      const struct multi_route *route = (struct multi_route *) he->value;
+#ifdef ENABLE_FRAGMENT
+/*
+ * Report fragment buffer pool usage.
+ */
+static void
+multi_print_fragment_stats (struct multi_context *m, struct status_output *so, const int version)
+{
+  size_t in_use;
+  counter_type drops;
 
-	      if (multi_route_defined (m, route))
-		{
-		  const struct multi_instance *mi = route->instance;
-		  const struct mroute_addr *ma = &route->addr;
-		  char flags[2] = {0, 0};
-
-		  if (route->flags & MULTI_ROUTE_CACHE)
-		    flags[0] = 'C';
-		  status_printf (so, "%s%s,%s,%s,%s",
-				 mroute_addr_print (ma, &gc),
-				 flags,
-				 tls_common_name (mi->context.c2.tls_multi, false),
-				 mroute_addr_print (&mi->real, &gc),
-				 time_string (route->last_reference, 0, false, &gc));
-		}
-	      gc_free (&gc);
-	    }
-	  hash_iterator_free (&hi);
+  if (!m->top.options.fragment)
+    return;
 
-	  status_printf (so, "GLOBAL STATS");
-	  if (m->mbuf)
-	    status_printf (so, "Max bcast/mcast queue length,%d",
-			   mbuf_maximum_queued (m->mbuf));
+  fragment_pool_stats (&in_use, &drops);
+  multi_print_global_stat (so, version, "Fragment buffer bytes in use", in_use);
+  multi_print_global_stat (so, version, "Fragment buffer pool drops", drops);
+}
+#endif
 
-	  status_printf (so, "END");
+/*
+ * Copy what the status output needs from the client list
+ * and routing table.
+ */
+static struct multi_status *
+multi_status_new (struct multi_context *m, struct status_output *so, const int version)
+{
+  struct multi_status *ms;
+  struct hash_iterator hi;
+  const struct hash_element *he;
+
+  ALLOC_OBJ_CLEAR (ms, struct multi_status);
+  ms->gc = gc_new ();
+  ms->stage = MULTI_STATUS_HEAD;
+  ms->so = so;
+  ms->version = version;
+  ms->time = now;
+
+  ALLOC_ARRAY_GC (ms->clients, struct multi_status_client, hash_n_elements (m->hash), &ms->gc);
+  hash_iterator_init (m->hash, &hi);
+  while ((he = hash_iterator_next (&hi)))
+    {
+      const struct multi_instance *mi = (struct multi_instance *) he->value;
+
+      if (!mi->halt)
+	{
+	  struct multi_status_client *c = &ms->clients[ms->n_clients++];
+	  c->common_name = string_alloc (tls_common_name (mi->context.c2.tls_multi, false), &ms->gc);
+	  c->real = mi->real;
+	  c->reporting_addr = mi->reporting_addr;
+	  c->bytes_in = mi->context.c2.link_read_bytes;
+	  c->bytes_out = mi->context.c2.link_write_bytes;
+	  c->created = mi->created;
+	  c->rtt = tls_multi_rtt (mi->context.c2.tls_multi);
 	}
-      else if (version == 2 || version == 3)
+    }
+  hash_iterator_free (&hi);
+
+  ALLOC_ARRAY_GC (ms->routes, struct multi_status_route, hash_n_elements (m->vhash), &ms->gc);
+  hash_iterator_init (m->vhash, &hi);
+  while ((he = hash_iterator_next (&hi)))
+    {
+      const struct multi_route *route = (struct multi_route *) he->value;
+
+      if (multi_route_defined (m, route))
 	{
-	  const char sep = (version == 3) ? '\t' : ',';
+	  const struct multi_instance *mi = route->instance;
+	  struct multi_status_route *r = &ms->routes[ms->n_routes++];
+	  r->addr = route->addr;
+	  r->cached = (route->flags & MULTI_ROUTE_CACHE) != 0;
+	  r->common_name = string_alloc (tls_common_name (mi->context.c2.tls_multi, false), &ms->gc);
+	  r->real = mi->real;
+	  r->last_reference = route->last_reference;
+	}
+    }
+  hash_iterator_free (&hi);
 
-	  /*
-	   * Status file version 2 and 3
-	   */
-	  status_printf (so, "TITLE%c%s", sep, title_string);
-	  status_printf (so, "TIME%c%s%c%u", sep, time_string (now, 0, false, &gc_top), sep, (unsigned int)now);
-	  status_printf (so, "HEADER%cCLIENT_LIST%cCommon Name%cReal Address%cVirtual Address%cBytes Received%cBytes Sent%cConnected Since%cConnected Since (time_t)",
-			 sep, sep, sep, sep, sep, sep, sep, sep);
-	  hash_iterator_init (m->hash, &hi);
-	  while ((he = hash_iterator_next (&hi)))
+  return ms;
+}
+
+static void
+multi_status_free (struct multi_status *ms)
+{
+  gc_free (&ms->gc);
+  free (ms);
+}
+
+static void
+multi_status_print_client (const struct multi_status *ms, const struct multi_status_client *c)
+{
+  struct gc_arena gc = gc_new ();
+  struct status_output *so = ms->so;
+
+  if (ms->version == 1)
+    {
+      status_printf (so, "%s,%s," counter_format "," counter_format ",%s",
+		     c->common_name,
+		     mroute_addr_print (&c->real, &gc),
+		     c->bytes_in,
+		     c->bytes_out,
+		     time_string (c->created, 0, false, &gc));
+    }
+  else if (ms->version == 4)
+    {
+      status_printf (so, "CLIENT\t%s\t%s\t%s\t" counter_format "\t" counter_format "\t%u\t%d",
+		     c->common_name,
+		     mroute_addr_print (&c->real, &gc),
+		     print_in_addr_t (c->reporting_addr, IA_EMPTY_IF_UNDEF, &gc),
+		     c->bytes_in,
+		     c->bytes_out,
+		     (unsigned int)c->created,
+		     c->rtt);
+    }
+  else
+    {
+      const char sep = (ms->version == 3) ? '\t' : ',';
+      status_printf (so, "CLIENT_LIST%c%s%c%s%c%s%c" counter_format "%c" counter_format "%c%s%c%u%c%d",
+		     sep, c->common_name,
+		     sep, mroute_addr_print (&c->real, &gc),
+		     sep, print_in_addr_t (c->reporting_addr, IA_EMPTY_IF_UNDEF, &gc),
+		     sep, c->bytes_in,
+		     sep, c->bytes_out,
+		     sep, time_string (c->created, 0, false, &gc),
+		     sep, (unsigned int)c->created,
+		     sep, c->rtt);
+    }
+  gc_free (&gc);
+}
+
+static void
+multi_status_print_route (const struct multi_status *ms, const struct multi_status_route *r)
+{
+  struct gc_arena gc = gc_new ();
+  struct status_output *so = ms->so;
+  const char *flags = r->cached ? "C" : "";
+
+  if (ms->version == 1)
+    {
+      status_printf (so, "%s%s,%s,%s,%s",
+		     mroute_addr_print (&r->addr, &gc),
+		     flags,
+		     r->common_name,
+		     mroute_addr_print (&r->real, &gc),
+		     time_string (r->last_reference, 0, false, &gc));
+    }
+  else if (ms->version == 4)
+    {
+      status_printf (so, "ROUTE\t%s%s\t%s\t%s\t%u",
+		     mroute_addr_print (&r->addr, &gc), flags,
+		     r->common_name,
+		     mroute_addr_print (&r->real, &gc),
+		     (unsigned int)r->last_reference);
+    }
+  else
+    {
+      const char sep = (ms->version == 3) ? '\t' : ',';
+      status_printf (so, "ROUTING_TABLE%c%s%s%c%s%c%s%c%s%c%u",
+		     sep, mroute_addr_print (&r->addr, &gc), flags,
+		     sep, r->common_name,
+		     sep, mroute_addr_print (&r->real, &gc),
+		     sep, time_string (r->last_reference, 0, false, &gc),
+		     sep, (unsigned int)r->last_reference);
+    }
+  gc_free (&gc);
+}
+
+static void
+multi_status_print_head (const struct multi_status *ms)
+{
+  struct gc_arena gc = gc_new ();
+  struct status_output *so = ms->so;
+
+  status_reset (so);
+
+  if (ms->version == 1)
+    {
+      /*
+       * Status file version 1
+       */
+      status_printf (so, "OpenVPN CLIENT LIST");
+      status_printf (so, "Updated,%s", time_string (ms->time, 0, false, &gc));
+      status_printf (so, "Common Name,Real Address,Bytes Received,Bytes Sent,Connected Since");
+    }
+  else if (ms->version == 2 || ms->version == 3)
+    {
+      const char sep = (ms->version == 3) ? '\t' : ',';
+
+      /*
+       * Status file version 2 and 3
+       */
+      status_printf (so, "TITLE%c%s", sep, title_string);
+      status_printf (so, "TIME%c%s%c%u", sep, time_string (ms->time, 0, false, &gc), sep, (unsigned int)ms->time);
+      status_printf (so, "HEADER%cCLIENT_LIST%cCommon Name%cReal Address%cVirtual Address%cBytes Received%cBytes Sent%cConnected Since%cConnected Since (time_t)%cControl RTT (ms)",
+		     sep, sep, sep, sep, sep, sep, sep, sep, sep);
+    }
+  else if (ms->version == 4)
+    {
+      /*
+       * Status file version 4: one tab separated record per
+       * line, times as time_t, no headers
+       */
+      status_printf (so, "STATUS\t4\t%u", (unsigned int)ms->time);
+    }
+  gc_free (&gc);
+}
+
+static void
+multi_status_print_routes_head (const struct multi_status *ms)
+{
+  struct status_output *so = ms->so;
+
+  if (ms->version == 1)
+    {
+      status_printf (so, "ROUTING TABLE");
+      status_printf (so, "Virtual Address,Common Name,Real Address,Last Ref");
+    }
+  else if (ms->version == 2 || ms->version == 3)
+    {
+      const char sep = (ms->version == 3) ? '\t' : ',';
+      status_printf (so, "HEADER%cROUTING_TABLE%cVirtual Address%cCommon Name%cReal Address%cLast Ref%cLast Ref (time_t)",
+		     sep, sep, sep, sep, sep, sep);
+    }
+}
+
+static void
+multi_status_print_tail (struct multi_context *m, const struct multi_status *ms)
+{
+  struct status_output *so = ms->so;
+  const int version = ms->version;
+
+  if (version == 1)
+    status_printf (so, "GLOBAL STATS");
+  multi_print_mbuf_stats (m, so, version);
+  multi_print_route_cache_stats (m, so, version);
+  multi_print_mcast_stats (m, so, version);
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+  multi_print_tls_buffer_stats (m, so, version);
+#endif
+#ifdef ENABLE_FRAGMENT
+  multi_print_fragment_stats (m, so, version);
+#endif
+  status_printf (so, "END");
+}
+
+/*
+ * Format up to n more clients or routes of ms.  Return true
+ * once the output is complete.
+ */
+static bool
+multi_status_format (struct multi_context *m, struct multi_status *ms, int n)
+{
+  const bool valid = (ms->version >= 1 && ms->version <= 4);
+
+  while (true)
+    {
+      switch (ms->stage)
+	{
+	case MULTI_STATUS_HEAD:
+	  if (valid)
+	    multi_status_print_head (ms);
+	  else
 	    {
-	      struct gc_arena gc = gc_new ();
-	      const struct multi_instance *mi = (struct multi_instance *) he->value;
+	      status_reset (ms->so);
+	      status_printf (ms->so, "ERROR: bad status format version number");
+	      ms->stage = MULTI_STATUS_TAIL;
+	      break;
+	    }
+	  ms->stage = MULTI_STATUS_CLIENTS;
+	  ms->index = 0;
+	  break;
 
-	      if (!mi->halt)
-		{
-		  status_printf (so, "CLIENT_LIST%c%s%c%s%c%s%c" counter_format "%c" counter_format "%c%s%c%u",
-				 sep, tls_common_name (mi->context.c2.tls_multi, false),
-				 sep, mroute_addr_print (&mi->real, &gc),
-				 sep, print_in_addr_t (mi->reporting_addr, IA_EMPTY_IF_UNDEF, &gc),
-				 sep, mi->context.c2.link_read_bytes,
-				 sep, mi->context.c2.link_write_bytes,
-				 sep, time_string (mi->created, 0, false, &gc),
-				 sep, (unsigned int)mi->created);
-		}
-	      gc_free (&gc);
+	case MULTI_STATUS_CLIENTS:
+	  if (ms->index < ms->n_clients)
+	    {
+	      if (n-- <= 0)
+		return false;
+	      multi_status_print_client (ms, &ms->clients[ms->index++]);
 	    }
-	  hash_iterator_free (&hi);
+	  else
+	    {
+	      multi_status_print_routes_head (ms);
+	      ms->stage = MULTI_STATUS_ROUTES;
+	      ms->index = 0;
+	    }
+	  break;
 
-	  status_printf (so, "HEADER%cROUTING_TABLE%cVirtual Address%cCommon Name%cReal Address%cLast Ref%cLast Ref (time_t)",
-			 sep, sep, sep, sep, sep, sep);
-	  hash_iterator_init (m->vhash, &hi);
-	  while ((he = hash_iterator_next (&hi)))
+	case MULTI_STATUS_ROUTES:
+	  if (ms->index < ms->n_routes)
 	    {
-	      struct gc_arena gc = gc_new ();
-	      const struct multi_route *route = (struct multi_route *) he->value;
+	      if (n-- <= 0)
+		return false;
+	      multi_status_print_route (ms, &ms->routes[ms->index++]);
+	    }
+	  else
+	    {
+	      multi_status_print_tail (m, ms);
+	      ms->stage = MULTI_STATUS_TAIL;
+	    }
+	  break;
+
+	case MULTI_STATUS_TAIL:
+	default:
+#ifdef PACKET_TRUNCATION_CHECK
+	  {
+	    struct status_output *so = ms->so;
+	    struct hash_iterator hi;
+	    const struct hash_element *he;
+
+	    status_printf (so, "HEADER,ERRORS,Common Name,TUN Read Trunc,TUN Write Trunc,Pre-encrypt Trunc,Post-decrypt Trunc");
+	    hash_iterator_init (m->hash, &hi);
+	    while ((he = hash_iterator_next (&hi)))
+	      {
+		const struct multi_instance *mi = (struct multi_instance *) he->value;
+
+		if (!mi->halt)
+		  {
+		    status_printf (so, "ERRORS,%s," counter_format "," counter_format "," counter_format "," counter_format,
+				   tls_common_name (mi->context.c2.tls_multi, false),
+				   m->top.c2.n_trunc_tun_read,
+				   mi->context.c2.n_trunc_tun_write,
+				   mi->context.c2.n_trunc_pre_encrypt,
+				   mi->context.c2.n_trunc_post_decrypt);
+		  }
+	      }
+	    hash_iterator_free (&hi);
+	  }
+#endif
+	  status_flush (ms->so);
+	  return true;
+	}
+    }
+}
+
+/*
+ * Dump tables -- triggered by SIGUSR2 or the management interface.
+ * If status file is defined, write to file.
+ * If status file is NULL, write to syslog.
+ */
+void
+multi_print_status (struct multi_context *m, struct status_output *so, const int version)
+{
+  if (m->hash)
+    {
+      struct multi_status *ms = multi_status_new (m, so, version);
+      multi_status_format (m, ms, INT_MAX);
+      multi_status_free (ms);
+    }
+}
 
-	      if (multi_route_defined (m, route))
-		{
-		  const struct multi_instance *mi = route->instance;
-		  const struct mroute_addr *ma = &route->addr;
-		  char flags[2] = {0, 0};
-
-		  if (route->flags & MULTI_ROUTE_CACHE)
-		    flags[0] = 'C';
-		  status_printf (so, "ROUTING_TABLE%c%s%s%c%s%c%s%c%s%c%u",
-				 sep, mroute_addr_print (ma, &gc), flags,
-				 sep, tls_common_name (mi->context.c2.tls_multi, false),
-				 sep, mroute_addr_print (&mi->real, &gc),
-				 sep, time_string (route->last_reference, 0, false, &gc),
-				 sep, (unsigned int)route->last_reference);
-		}
-	      gc_free (&gc);
-	    }
-	  hash_iterator_free (&hi);
+#ifdef MANAGEMENT_DEF_AUTH
+/*
+ * One round of the management "metrics" command: a record for
+ * each client whose counters changed since the last round.
+ */
+static void
+multi_print_metrics (struct multi_context *m)
+{
+  struct hash_iterator hi;
+  const struct hash_element *he;
+  int n_records = 0;
 
-	  if (m->mbuf)
-	    status_printf (so, "GLOBAL_STATS%cMax bcast/mcast queue length%c%d",
-			   sep, sep, mbuf_maximum_queued (m->mbuf));
+  hash_iterator_init (m->hash, &hi);
+  while ((he = hash_iterator_next (&hi)))
+    {
+      struct multi_instance *mi = (struct multi_instance *) he->value;
+      struct context_2 *c2 = &mi->context.c2;
 
-	  status_printf (so, "END");
-	}
-      else
+      if (!mi->halt
+	  && (c2->mda_context.flags & (DAF_CONNECTION_ESTABLISHED|DAF_CONNECTION_CLOSED)) == DAF_CONNECTION_ESTABLISHED)
 	{
-	  status_printf (so, "ERROR: bad status format version number");
+	  struct man_metrics current;
+
+	  current.bytes_in = c2->link_read_bytes;
+	  current.bytes_out = c2->link_write_bytes;
+	  current.packets_in = c2->link_read_packets;
+	  current.packets_out = c2->link_write_packets;
+	  current.drops = c2->link_read_drops;
+	  current.key_negotiations = tls_multi_key_negotiations (c2->tls_multi);
+	  current.rtt = tls_multi_rtt (c2->tls_multi);
+	  if (management_metrics_client (management, &c2->mda_context, &current))
+	    ++n_records;
 	}
+    }
+  hash_iterator_free (&hi);
 
-#ifdef PACKET_TRUNCATION_CHECK
-      {
-	status_printf (so, "HEADER,ERRORS,Common Name,TUN Read Trunc,TUN Write Trunc,Pre-encrypt Trunc,Post-decrypt Trunc");
-	hash_iterator_init (m->hash, &hi);
-	while ((he = hash_iterator_next (&hi)))
-	    {
-	      struct gc_arena gc = gc_new ();
-	      const struct multi_instance *mi = (struct multi_instance *) he->value;
-
-	      if (!mi->halt)
-		{
-		  status_printf (so, "ERRORS,%s," counter_format "," counter_format "," counter_format "," counter_format,
-				 tls_common_name (mi->context.c2.tls_multi, false),
-				 m->top.c2.n_trunc_tun_read,
-				 mi->context.c2.n_trunc_tun_write,
-				 mi->context.c2.n_trunc_pre_encrypt,
-				 mi->context.c2.n_trunc_post_decrypt);
-		}
-	      gc_free (&gc);
-	    }
-	hash_iterator_free (&hi);
-      }
+  management_metrics_end (management, n_records);
+}
 #endif
 
-      status_flush (so);
-      gc_free (&gc_top);
+/*
+ * Format the next MULTI_STATUS_STEP lines of the --status file.
+ */
+void
+multi_status_continue (struct multi_context *m)
+{
+  if (multi_status_format (m, m->status, MULTI_STATUS_STEP))
+    {
+      multi_status_free (m->status);
+      m->status = NULL;
     }
 }
 
@@ -929,11 +2087,16 @@ multi_learn_addr (struct multi_context *m,
 	      route_quota_inc (mi);
 
 	      /* delete old route */
+	      if (oldroute->flags & MULTI_ROUTE_CACHE)
+		multi_route_cache_unlink (m->reaper, oldroute);
+	      mroute_helper_del_route (m->route_helper, &oldroute->addr, oldroute);
 	      multi_route_del (oldroute);
 
 	      /* modify hash table entry, replacing old route */
 	      he->key = &newroute->addr;
 	      he->value = newroute;
+	      if (newroute->addr.type & MR_WITH_NETBITS)
+		mroute_helper_add_route (m->route_helper, &newroute->addr, newroute);
 	    }
 	}
       else
@@ -947,6 +2110,8 @@ multi_learn_addr (struct multi_context *m,
 
 	      /* add new route */
 	      hash_add_fast (m->vhash, bucket, &newroute->addr, hv, newroute);
+	      if (newroute->addr.type & MR_WITH_NETBITS)
+		mroute_helper_add_route (m->route_helper, &newroute->addr, newroute);
 	    }
 	}
       
@@ -957,6 +2122,16 @@ multi_learn_addr (struct multi_context *m,
 
       if (!learn_succeeded)
 	free (newroute);
+      else if (flags & MULTI_ROUTE_CACHE)
+	{
+	  struct multi_reap *mr = m->reaper;
+	  multi_route_cache_link (mr, newroute);
+	  while (mr->n_cached > mr->max_cached && mr->cache_tail != newroute)
+	    {
+	      multi_route_cache_delete (m, mr->cache_tail);
+	      ++mr->n_evicted;
+	    }
+	}
 
       gc_free (&gc);
     }
@@ -964,6 +2139,13 @@ multi_learn_addr (struct multi_context *m,
   return owner;
 }
 
+static bool
+multi_route_usable (const void *route, const void *arg)
+{
+  return multi_route_defined ((const struct multi_context *) arg,
+			      (const struct multi_route *) route);
+}
+
 /*
  * Get client instance based on virtual address.
  */
@@ -986,33 +2168,23 @@ multi_get_instance_by_virtual_addr (struct multi_context *m,
     {
       struct multi_instance *mi = route->instance;
       route->last_reference = now;
+      if (route->flags & MULTI_ROUTE_CACHE)
+	multi_route_cache_touch (m->reaper, route);
       ret = mi;
     }
   else if (cidr_routing) /* do we need to regenerate a host route cache entry? */
     {
-      struct mroute_helper *rh = m->route_helper;
-      struct mroute_addr tryaddr;
-      int i;
-
-      /* cycle through each CIDR length */
-      for (i = 0; i < rh->n_net_len; ++i)
+      /* find the longest matching CIDR route */
+      route = (struct multi_route *) mroute_helper_lookup (m->route_helper, addr,
+							   multi_route_usable, m);
+      if (route)
 	{
-	  tryaddr = *addr;
-	  tryaddr.type |= MR_WITH_NETBITS;
-	  tryaddr.netbits = rh->net_len[i];
-	  mroute_addr_mask_host_bits (&tryaddr);
-
-	  /* look up a possible route with netbits netmask */
-	  route = (struct multi_route *) hash_lookup (m->vhash, &tryaddr);
-
-	  if (route && multi_route_defined (m, route))
-	    {
-	      /* found an applicable route, cache host route */
-	      struct multi_instance *mi = route->instance;
-	      multi_learn_addr (m, mi, addr, MULTI_ROUTE_CACHE|MULTI_ROUTE_AGEABLE);
-	      ret = mi;
-	      break;
-	    }
+	  /* found an applicable route, cache host route unless over quota */
+	  struct multi_instance *mi = route->instance;
+	  const int quota = mi->context.options.max_cached_routes_per_client;
+	  if (!quota || mi->cached_route_count < quota)
+	    multi_learn_addr (m, mi, addr, MULTI_ROUTE_CACHE|MULTI_ROUTE_AGEABLE);
+	  ret = mi;
 	}
     }
   
@@ -1168,27 +2340,19 @@ multi_delete_dup (struct multi_context *m, struct multi_instance *new_mi)
       const char *new_cn = tls_common_name (new_mi->context.c2.tls_multi, true);
       if (new_cn)
 	{
-	  struct hash_iterator hi;
-	  struct hash_element *he;
+	  struct multi_instance *mi = multi_name_index_lookup (m, MULTI_INDEX_CN, new_cn);
 	  int count = 0;
 
-	  hash_iterator_init (m->iter, &hi);
-	  while ((he = hash_iterator_next (&hi)))
+	  while (mi)
 	    {
-	      struct multi_instance *mi = (struct multi_instance *) he->value;
+	      struct multi_instance *next = mi->name_link[MULTI_INDEX_CN].next;
 	      if (mi != new_mi && !mi->halt)
 		{
-		  const char *cn = tls_common_name (mi->context.c2.tls_multi, true);
-		  if (cn && !strcmp (cn, new_cn))
-		    {
-		      mi->did_iter = false;
-		      multi_close_instance (m, mi, false);
-		      hash_iterator_delete_element (&hi);
-		      ++count;
-		    }
+		  multi_close_instance (m, mi, false);
+		  ++count;
 		}
+	      mi = next;
 	    }
-	  hash_iterator_free (&hi);
 
 	  if (count)
 	    msg (D_MULTI_LOW, "MULTI: new connection by client '%s' will cause previous active sessions by this client to be dropped.  Remember to use the --duplicate-cn option if you want multiple clients using the same certificate or username to concurrently connect.", new_cn);
@@ -1522,305 +2686,591 @@ multi_client_connect_setenv (struct multi_context *m,
 }
 
 /*
- * Called as soon as the SSL/TLS connection authenticates.
- *
- * Instance-specific directives to be processed:
- *
- *   iroute start-ip end-ip
- *   ifconfig-push local remote-netmask
- *   push
+ * Options which a client-connect hook may set for its client.
+ */
+#define CC_OPTION_PERMISSIONS_MASK \
+  (OPT_P_INSTANCE | OPT_P_INHERIT | OPT_P_PUSH | OPT_P_TIMER \
+   | OPT_P_CONFIG | OPT_P_ECHO | OPT_P_COMP | OPT_P_SOCKFLAGS)
+
+/*
+ * How often an instance held for an asynchronous
+ * --client-connect script checks whether it has exited.
+ */
+#define CC_SCRIPT_POLL_USEC 100000
+
+static void multi_schedule_context_wakeup (struct multi_context *m, struct multi_instance *mi);
+
+/*
+ * First part of establishing a connection: index the instance,
+ * source its --client-config-dir file and call the deprecated
+ * client-connect plugins.
  */
 static void
-multi_connection_established (struct multi_context *m, struct multi_instance *mi)
+multi_client_connect_begin (struct multi_context *m, struct multi_instance *mi)
 {
-  if (tls_authentication_status (mi->context.c2.tls_multi, 0) == TLS_AUTHENTICATION_SUCCEEDED)
-    {
-      struct gc_arena gc = gc_new ();
-      unsigned int option_types_found = 0;
+  struct gc_arena gc = gc_new ();
+  struct multi_connect_state *cc = &mi->cc;
 
-      const unsigned int option_permissions_mask =
-	  OPT_P_INSTANCE
-	| OPT_P_INHERIT
-	| OPT_P_PUSH
-	| OPT_P_TIMER
-	| OPT_P_CONFIG
-	| OPT_P_ECHO
-	| OPT_P_COMP
-	| OPT_P_SOCKFLAGS;
+  ASSERT (mi->context.c1.tuntap);
 
-      int cc_succeeded = true; /* client connect script status */
-      int cc_succeeded_count = 0;
+  cc->succeeded = true;
+  cc->succeeded_count = 0;
+  cc->option_types_found = 0;
+  cc->expire = now + mi->context.options.handshake_window;
 
-      ASSERT (mi->context.c1.tuntap);
+  /* lock down the common name and cert hashes so they can't change during future TLS renegotiations */
+  tls_lock_common_name (mi->context.c2.tls_multi);
+  tls_lock_cert_hash_set (mi->context.c2.tls_multi);
 
-      /* lock down the common name and cert hashes so they can't change during future TLS renegotiations */
-      tls_lock_common_name (mi->context.c2.tls_multi);
-      tls_lock_cert_hash_set (mi->context.c2.tls_multi);
+  /* generate a msg() prefix for this client instance */
+  generate_prefix (mi);
 
-      /* generate a msg() prefix for this client instance */
-      generate_prefix (mi);
+  /* delete instances of previous clients with same common-name */
+  if (!mi->context.options.duplicate_cn)
+    multi_delete_dup (m, mi);
 
-      /* delete instances of previous clients with same common-name */
-      if (!mi->context.options.duplicate_cn)
-	multi_delete_dup (m, mi);
+  /* index by the names we were authenticated with */
+  multi_name_index_add (m, mi, MULTI_INDEX_CN,
+			tls_common_name (mi->context.c2.tls_multi, false));
+  {
+    const char *username = tls_username (mi->context.c2.tls_multi);
+    if (username)
+      multi_name_index_add (m, mi, MULTI_INDEX_USERNAME, username);
+  }
+
+  /* reset pool handle to null */
+  mi->vaddr_handle = -1;
 
-      /* reset pool handle to null */
-      mi->vaddr_handle = -1;
+  /*
+   * Try to source a dynamic config file from the
+   * --client-config-dir directory.
+   */
+  if (mi->context.options.client_config_dir)
+    {
+      const char *ccd_file;
+	  
+      ccd_file = gen_path (mi->context.options.client_config_dir,
+			   tls_common_name (mi->context.c2.tls_multi, false),
+			   &gc);
 
-      /*
-       * Try to source a dynamic config file from the
-       * --client-config-dir directory.
-       */
-      if (mi->context.options.client_config_dir)
+      /* try common-name file */
+      if (test_file (ccd_file))
+	{
+	  options_server_import (&mi->context.options,
+				 ccd_file,
+				 D_IMPORT_ERRORS|M_OPTERR,
+				 CC_OPTION_PERMISSIONS_MASK,
+				 &cc->option_types_found,
+				 mi->context.c2.es);
+	}
+      else /* try default file */
 	{
-	  const char *ccd_file;
-	  
 	  ccd_file = gen_path (mi->context.options.client_config_dir,
-			       tls_common_name (mi->context.c2.tls_multi, false),
+			       CCD_DEFAULT,
 			       &gc);
 
-	  /* try common-name file */
 	  if (test_file (ccd_file))
 	    {
 	      options_server_import (&mi->context.options,
 				     ccd_file,
 				     D_IMPORT_ERRORS|M_OPTERR,
-				     option_permissions_mask,
-				     &option_types_found,
+				     CC_OPTION_PERMISSIONS_MASK,
+				     &cc->option_types_found,
 				     mi->context.c2.es);
 	    }
-	  else /* try default file */
-	    {
-	      ccd_file = gen_path (mi->context.options.client_config_dir,
-				   CCD_DEFAULT,
-				   &gc);
-
-	      if (test_file (ccd_file))
-		{
-		  options_server_import (&mi->context.options,
-					 ccd_file,
-					 D_IMPORT_ERRORS|M_OPTERR,
-					 option_permissions_mask,
-					 &option_types_found,
-					 mi->context.c2.es);
-		}
-	    }
 	}
+    }
 
-      /*
-       * Select a virtual address from either --ifconfig-push in --client-config-dir file
-       * or --ifconfig-pool.
-       */
-      multi_select_virtual_addr (m, mi);
+  /*
+   * Select a virtual address from either --ifconfig-push in --client-config-dir file
+   * or --ifconfig-pool.
+   */
+  multi_select_virtual_addr (m, mi);
 
-      /* do --client-connect setenvs */
-      multi_client_connect_setenv (m, mi);
+  /* do --client-connect setenvs */
+  multi_client_connect_setenv (m, mi);
 
 #ifdef ENABLE_PLUGIN
-      /*
-       * Call client-connect plug-in.
-       */
+  /*
+   * Call client-connect plug-in.
+   */
+
+  /* deprecated callback, use a file for passing back return info */
+  if (plugin_defined (mi->context.plugins, OPENVPN_PLUGIN_CLIENT_CONNECT))
+    {
+      struct argv argv = argv_new ();
+      const char *dc_file = create_temp_file (mi->context.options.tmp_dir, "cc", &gc);
+
+      if( !dc_file ) {
+	cc->succeeded = false;
+	goto script_depr_failed;
+      }
 
-      /* deprecated callback, use a file for passing back return info */
-      if (plugin_defined (mi->context.plugins, OPENVPN_PLUGIN_CLIENT_CONNECT))
+      argv_printf (&argv, "%s", dc_file);
+      if (plugin_call (mi->context.plugins, OPENVPN_PLUGIN_CLIENT_CONNECT, &argv, NULL, mi->context.c2.es) != OPENVPN_PLUGIN_FUNC_SUCCESS)
 	{
-	  struct argv argv = argv_new ();
-	  const char *dc_file = create_temp_file (mi->context.options.tmp_dir, "cc", &gc);
+	  msg (M_WARN, "WARNING: client-connect plugin call failed");
+	  cc->succeeded = false;
+	}
+      else
+	{
+	  multi_client_connect_post (m, mi, dc_file, CC_OPTION_PERMISSIONS_MASK, &cc->option_types_found);
+	  ++cc->succeeded_count;
+	}
+    script_depr_failed:
+      argv_reset (&argv);
+    }
+#endif
 
-          if( !dc_file ) {
-            cc_succeeded = false;
-            goto script_depr_failed;
-          }
+  gc_free (&gc);
+}
 
-	  argv_printf (&argv, "%s", dc_file);
-	  if (plugin_call (mi->context.plugins, OPENVPN_PLUGIN_CLIENT_CONNECT, &argv, NULL, mi->context.c2.es) != OPENVPN_PLUGIN_FUNC_SUCCESS)
-	    {
-	      msg (M_WARN, "WARNING: client-connect plugin call failed");
-	      cc_succeeded = false;
-	    }
-	  else
-	    {
-	      multi_client_connect_post (m, mi, dc_file, option_permissions_mask, &option_types_found);
-	      ++cc_succeeded_count;
-	    }
-        script_depr_failed:
-	  argv_reset (&argv);
+/*
+ * Call the client-connect-v2 plugins.  Returns true if some of
+ * them deferred, to report later on the auth completion pipe.
+ */
+static bool
+multi_client_connect_call_plugin (struct multi_context *m, struct multi_instance *mi)
+{
+  bool deferred = false;
+#ifdef ENABLE_PLUGIN
+  struct multi_connect_state *cc = &mi->cc;
+
+  /* V2 callback, use a plugin_return struct for passing back return info */
+  if (plugin_defined (mi->context.plugins, OPENVPN_PLUGIN_CLIENT_CONNECT_V2))
+    {
+      struct plugin_return pr;
+      int status;
+#ifdef PLUGIN_DEF_AUTH
+      unsigned int handle = plugin_auth_new_handle (mi->context.plugins);
+      int n_async, n_legacy;
+
+      /* a deferring plugin writes its options to this file */
+      if (handle)
+	cc->dc_file = create_temp_file (mi->context.options.tmp_dir, "cc", &mi->gc);
+      if (cc->dc_file)
+	setenv_str (mi->context.c2.es, "client_connect_config_file", cc->dc_file);
+      else
+	handle = 0;
+
+      status = plugin_call_deferred (mi->context.plugins, OPENVPN_PLUGIN_CLIENT_CONNECT_V2, &pr,
+				     mi->context.c2.es, handle, &n_async, &n_legacy);
+      setenv_del (mi->context.c2.es, "client_connect_config_file");
+
+      if (status == OPENVPN_PLUGIN_FUNC_DEFERRED && n_async && !n_legacy)
+	{
+	  /* apply what the other plugins returned, then wait */
+	  multi_client_connect_post_plugin (m, mi, &pr, CC_OPTION_PERMISSIONS_MASK, &cc->option_types_found);
+	  plugin_auth_begin (mi->context.plugins, handle, n_async, mi);
+	  cc->plugin_handle = handle;
+	  deferred = true;
+	}
+      else if (cc->dc_file)
+	{
+	  delete_file (cc->dc_file);
+	  cc->dc_file = NULL;
+	}
+#else
+      plugin_return_init (&pr);
+      status = plugin_call (mi->context.plugins, OPENVPN_PLUGIN_CLIENT_CONNECT_V2, NULL, &pr, mi->context.c2.es);
+#endif
+
+      if (deferred)
+	;
+      else if (status != OPENVPN_PLUGIN_FUNC_SUCCESS)
+	{
+	  msg (M_WARN, "WARNING: client-connect-v2 plugin call failed");
+	  cc->succeeded = false;
+	}
+      else
+	{
+	  multi_client_connect_post_plugin (m, mi, &pr, CC_OPTION_PERMISSIONS_MASK, &cc->option_types_found);
+	  ++cc->succeeded_count;
 	}
 
-      /* V2 callback, use a plugin_return struct for passing back return info */
-      if (plugin_defined (mi->context.plugins, OPENVPN_PLUGIN_CLIENT_CONNECT_V2))
+      plugin_return_free (&pr);
+    }
+#endif
+  return deferred;
+}
+
+/*
+ * Check on the client-connect-v2 plugins which deferred.
+ * Returns true while their result is outstanding.
+ */
+static bool
+multi_client_connect_wait_plugin (struct multi_context *m, struct multi_instance *mi)
+{
+#ifdef PLUGIN_DEF_AUTH
+  struct multi_connect_state *cc = &mi->cc;
+
+  if (cc->plugin_handle)
+    {
+      if (now < cc->expire)
+	return true;
+      msg (D_MULTI_ERRORS, "MULTI: deferred client-connect-v2 plugin call timed out");
+      plugin_auth_cancel (mi->context.plugins, cc->plugin_handle, true);
+      cc->plugin_handle = 0;
+      cc->plugin_succeeded = false;
+    }
+
+  if (cc->dc_file)
+    {
+      if (cc->plugin_succeeded)
+	{
+	  multi_client_connect_post (m, mi, cc->dc_file, CC_OPTION_PERMISSIONS_MASK, &cc->option_types_found);
+	  ++cc->succeeded_count;
+	}
+      else
 	{
-	  struct plugin_return pr;
+	  msg (M_WARN, "WARNING: client-connect-v2 plugin call failed");
+	  cc->succeeded = false;
+	  delete_file (cc->dc_file);
+	}
+      cc->dc_file = NULL;
+    }
+#endif
+  return false;
+}
+
+/*
+ * Run --client-connect script.  Returns true if it is
+ * still running.
+ */
+static bool
+multi_client_connect_call_script (struct multi_context *m, struct multi_instance *mi)
+{
+  struct multi_connect_state *cc = &mi->cc;
+  bool deferred = false;
+
+  if (mi->context.options.client_connect_script && cc->succeeded)
+    {
+      struct argv argv = argv_new ();
+      int pid;
+
+      setenv_str (mi->context.c2.es, "script_type", "client-connect");
+
+      cc->dc_file = create_temp_file (mi->context.options.tmp_dir, "cc", &mi->gc);
+      if( !cc->dc_file ) {
+	cc->succeeded = false;
+	goto script_failed;
+      }
 
-	  plugin_return_init (&pr);
+      argv_printf (&argv, "%sc %s",
+		   mi->context.options.client_connect_script,
+		   cc->dc_file);
 
-	  if (plugin_call (mi->context.plugins, OPENVPN_PLUGIN_CLIENT_CONNECT_V2, NULL, &pr, mi->context.c2.es) != OPENVPN_PLUGIN_FUNC_SUCCESS)
+      pid = multi_client_script_run (mi, &argv, "--client-connect");
+      if (pid > 0)
+	{
+	  cc->script_pid = pid;
+	  deferred = true;
+	}
+      else
+	{
+	  if (pid == 0)
 	    {
-	      msg (M_WARN, "WARNING: client-connect-v2 plugin call failed");
-	      cc_succeeded = false;
+	      multi_client_connect_post (m, mi, cc->dc_file, CC_OPTION_PERMISSIONS_MASK, &cc->option_types_found);
+	      ++cc->succeeded_count;
 	    }
 	  else
-	    {
-	      multi_client_connect_post_plugin (m, mi, &pr, option_permissions_mask, &option_types_found);
-	      ++cc_succeeded_count;
-	    }
-
-	  plugin_return_free (&pr);
+	    cc->succeeded = false;
+	  cc->dc_file = NULL;
 	}
+    script_failed:
+      argv_reset (&argv);
+    }
+  return deferred;
+}
+
+/*
+ * Check on an asynchronous --client-connect script.
+ * Returns true while it is still running.
+ */
+static bool
+multi_client_connect_wait_script (struct multi_context *m, struct multi_instance *mi)
+{
+  struct multi_connect_state *cc = &mi->cc;
+  int stat;
+
+  if (cc->script_pid <= 0)
+    return false;
+
+  if (!openvpn_execve_reap (cc->script_pid, &stat, false))
+    {
+      if (now < cc->expire)
+	return true;
+      msg (D_MULTI_ERRORS, "MULTI: --client-connect script timed out");
+      openvpn_execve_abort (cc->script_pid);
+      multi_script_child_add (m, cc->script_pid, "--client-connect");
+      cc->succeeded = false;
+    }
+  else if (system_ok (stat))
+    {
+      multi_client_connect_post (m, mi, cc->dc_file, CC_OPTION_PERMISSIONS_MASK, &cc->option_types_found);
+      ++cc->succeeded_count;
+    }
+  else
+    {
+      struct gc_arena gc = gc_new ();
+      msg (M_WARN, "WARNING: Failed running command (--client-connect): %s",
+	   system_error_message (stat, &gc));
+      gc_free (&gc);
+      cc->succeeded = false;
+    }
+
+  if (!cc->succeeded)
+    delete_file (cc->dc_file);
+  cc->script_pid = 0;
+  cc->dc_file = NULL;
+  return false;
+}
+
+/*
+ * Hold the instance while a client-connect hook runs.  Its
+ * control channel keeps running, but PUSH_REQUEST stays
+ * unanswered.  A plugin result wakes the instance up, a
+ * script has to be polled.
+ */
+static void
+multi_client_connect_hold (struct multi_context *m, struct multi_instance *mi)
+{
+  struct timeval tv;
+
+  tv.tv_sec = 1;
+  tv.tv_usec = 0;
+  if (mi->cc.script_pid > 0)
+    {
+      tv.tv_sec = 0;
+      tv.tv_usec = CC_SCRIPT_POLL_USEC;
+    }
+
+  if (tv_lt (&tv, &mi->context.c2.timeval))
+    {
+      mi->context.c2.timeval = tv;
+      multi_schedule_context_wakeup (m, mi);
+    }
+}
+
+/*
+ * Give up on the client-connect hooks of an instance
+ * which is closed while it is held.
+ */
+static void
+multi_client_connect_abort (struct multi_context *m, struct multi_instance *mi)
+{
+  struct multi_connect_state *cc = &mi->cc;
+
+#ifdef PLUGIN_DEF_AUTH
+  if (cc->plugin_handle)
+    {
+      plugin_auth_cancel (mi->context.plugins, cc->plugin_handle, false);
+      cc->plugin_handle = 0;
+    }
+#endif
+  if (cc->script_pid > 0)
+    {
+      multi_script_child_add (m, cc->script_pid, "--client-connect");
+      cc->script_pid = 0;
+    }
+  if (cc->dc_file)
+    {
+      delete_file (cc->dc_file);
+      cc->dc_file = NULL;
+    }
+
+  /* let --client-disconnect undo the hooks which succeeded */
+  if (cc->succeeded_count)
+    mi->context.c2.context_auth = CAS_PARTIAL;
+}
+
+/*
+ * Last part of establishing a connection, once every
+ * client-connect hook has returned.
+ */
+static void
+multi_client_connect_finish (struct multi_context *m, struct multi_instance *mi)
+{
+  struct gc_arena gc = gc_new ();
+  struct multi_connect_state *cc = &mi->cc;
+
+  /*
+   * Check for client-connect script left by management interface client
+   */
+#ifdef MANAGEMENT_DEF_AUTH
+  if (cc->succeeded && mi->cc_config)
+    {
+      multi_client_connect_mda (m, mi, mi->cc_config, CC_OPTION_PERMISSIONS_MASK, &cc->option_types_found);
+      ++cc->succeeded_count;
+    }
 #endif
 
+  /*
+   * Check for "disable" directive in client-config-dir file
+   * or config file generated by --client-connect script.
+   */
+  if (mi->context.options.disable)
+    {
+      msg (D_MULTI_ERRORS, "MULTI: client has been rejected due to 'disable' directive");
+      cc->succeeded = false;
+    }
+
+  if (cc->succeeded)
+    {
       /*
-       * Run --client-connect script.
+       * Process sourced options.
        */
-      if (mi->context.options.client_connect_script && cc_succeeded)
-	{
-	  struct argv argv = argv_new ();
-	  const char *dc_file = NULL;
-
-	  setenv_str (mi->context.c2.es, "script_type", "client-connect");
-
-	  dc_file = create_temp_file (mi->context.options.tmp_dir, "cc", &gc);
-          if( !dc_file ) {
-            cc_succeeded = false;
-            goto script_failed;
-          }
-
-	  argv_printf (&argv, "%sc %s",
-		       mi->context.options.client_connect_script,
-		       dc_file);
-
-	  if (openvpn_run_script (&argv, mi->context.c2.es, 0, "--client-connect"))
-	    {
-	      multi_client_connect_post (m, mi, dc_file, option_permissions_mask, &option_types_found);
-	      ++cc_succeeded_count;
-	    }
-	  else
-	    cc_succeeded = false;
-        script_failed:
-	  argv_reset (&argv);
-	}
-
+      do_deferred_options (&mi->context, cc->option_types_found);
       /*
-       * Check for client-connect script left by management interface client
+       * make sure we got ifconfig settings from somewhere
        */
-#ifdef MANAGEMENT_DEF_AUTH
-      if (cc_succeeded && mi->cc_config)
+      if (!mi->context.c2.push_ifconfig_defined)
 	{
-	  multi_client_connect_mda (m, mi, mi->cc_config, option_permissions_mask, &option_types_found);
-	  ++cc_succeeded_count;
+	  msg (D_MULTI_ERRORS, "MULTI: no dynamic or static remote --ifconfig address is available for %s",
+	       multi_instance_string (mi, false, &gc));
 	}
-#endif
 
       /*
-       * Check for "disable" directive in client-config-dir file
-       * or config file generated by --client-connect script.
+       * make sure that ifconfig settings comply with constraints
        */
-      if (mi->context.options.disable)
+      if (!ifconfig_push_constraint_satisfied (&mi->context))
 	{
-	  msg (D_MULTI_ERRORS, "MULTI: client has been rejected due to 'disable' directive");
-	  cc_succeeded = false;
+	  /* JYFIXME -- this should cause the connection to fail */
+	  msg (D_MULTI_ERRORS, "MULTI ERROR: primary virtual IP for %s (%s) violates tunnel network/netmask constraint (%s/%s)",
+	       multi_instance_string (mi, false, &gc),
+	       print_in_addr_t (mi->context.c2.push_ifconfig_local, 0, &gc),
+	       print_in_addr_t (mi->context.options.push_ifconfig_constraint_network, 0, &gc),
+	       print_in_addr_t (mi->context.options.push_ifconfig_constraint_netmask, 0, &gc));
 	}
 
-      if (cc_succeeded)
+      /*
+       * For routed tunnels, set up internal route to endpoint
+       * plus add all iroute routes.
+       */
+      if (TUNNEL_TYPE (mi->context.c1.tuntap) == DEV_TYPE_TUN)
 	{
-	  /*
-	   * Process sourced options.
-	   */
-	  do_deferred_options (&mi->context, option_types_found);
-
-	  /*
-	   * make sure we got ifconfig settings from somewhere
-	   */
-	  if (!mi->context.c2.push_ifconfig_defined)
+	  if (mi->context.c2.push_ifconfig_defined)
 	    {
-	      msg (D_MULTI_ERRORS, "MULTI: no dynamic or static remote --ifconfig address is available for %s",
-		   multi_instance_string (mi, false, &gc));
+	      multi_learn_in_addr_t (m, mi, mi->context.c2.push_ifconfig_local, -1, true);
+	      msg (D_MULTI_LOW, "MULTI: primary virtual IP for %s: %s",
+		   multi_instance_string (mi, false, &gc),
+		   print_in_addr_t (mi->context.c2.push_ifconfig_local, 0, &gc));
 	    }
 
-	  /*
-	   * make sure that ifconfig settings comply with constraints
-	   */
-	  if (!ifconfig_push_constraint_satisfied (&mi->context))
+	  if (mi->context.c2.push_ifconfig_ipv6_defined)
 	    {
-	      /* JYFIXME -- this should cause the connection to fail */
-	      msg (D_MULTI_ERRORS, "MULTI ERROR: primary virtual IP for %s (%s) violates tunnel network/netmask constraint (%s/%s)",
+	      multi_learn_in6_addr (m, mi, mi->context.c2.push_ifconfig_ipv6_local, -1, true);
+	      /* TODO: find out where addresses are "unlearned"!! */
+	      msg (D_MULTI_LOW, "MULTI: primary virtual IPv6 for %s: %s",
 		   multi_instance_string (mi, false, &gc),
-		   print_in_addr_t (mi->context.c2.push_ifconfig_local, 0, &gc),
-		   print_in_addr_t (mi->context.options.push_ifconfig_constraint_network, 0, &gc),
-		   print_in_addr_t (mi->context.options.push_ifconfig_constraint_netmask, 0, &gc));
+		   print_in6_addr (mi->context.c2.push_ifconfig_ipv6_local, 0, &gc));
 	    }
 
+	  /* add routes locally, pointing to new client, if
+	     --iroute options have been specified */
+	  multi_add_iroutes (m, mi);
+
 	  /*
-	   * For routed tunnels, set up internal route to endpoint
-	   * plus add all iroute routes.
+	   * iroutes represent subnets which are "owned" by a particular
+	   * client.  Therefore, do not actually push a route to a client
+	   * if it matches one of the client's iroutes.
 	   */
-	  if (TUNNEL_TYPE (mi->context.c1.tuntap) == DEV_TYPE_TUN)
-	    {
-	      if (mi->context.c2.push_ifconfig_defined)
-		{
-		  multi_learn_in_addr_t (m, mi, mi->context.c2.push_ifconfig_local, -1, true);
-		  msg (D_MULTI_LOW, "MULTI: primary virtual IP for %s: %s",
-		       multi_instance_string (mi, false, &gc),
-		       print_in_addr_t (mi->context.c2.push_ifconfig_local, 0, &gc));
-		}
+	  remove_iroutes_from_push_route_list (&mi->context.options);
+	}
+      else if (mi->context.options.iroutes)
+	{
+	  msg (D_MULTI_ERRORS, "MULTI: --iroute options rejected for %s -- iroute only works with tun-style tunnels",
+	       multi_instance_string (mi, false, &gc));
+	}
 
-	      if (mi->context.c2.push_ifconfig_ipv6_defined)
-		{
-		  multi_learn_in6_addr (m, mi, mi->context.c2.push_ifconfig_ipv6_local, -1, true);
-		  /* TODO: find out where addresses are "unlearned"!! */
-		  msg (D_MULTI_LOW, "MULTI: primary virtual IPv6 for %s: %s",
-		       multi_instance_string (mi, false, &gc),
-		       print_in6_addr (mi->context.c2.push_ifconfig_ipv6_local, 0, &gc));
-		}
+      /* set our client's VPN endpoint for status reporting purposes */
+      mi->reporting_addr = mi->context.c2.push_ifconfig_local;
 
-	      /* add routes locally, pointing to new client, if
-		 --iroute options have been specified */
-	      multi_add_iroutes (m, mi);
+      /* set context-level authentication flag */
+      mi->context.c2.context_auth = CAS_SUCCEEDED;
+    }
+  else
+    {
+      /* set context-level authentication flag */
+      mi->context.c2.context_auth = cc->succeeded_count ? CAS_PARTIAL : CAS_FAILED;
+    }
 
-	      /*
-	       * iroutes represent subnets which are "owned" by a particular
-	       * client.  Therefore, do not actually push a route to a client
-	       * if it matches one of the client's iroutes.
-	       */
-	      remove_iroutes_from_push_route_list (&mi->context.options);
-	    }
-	  else if (mi->context.options.iroutes)
-	    {
-	      msg (D_MULTI_ERRORS, "MULTI: --iroute options rejected for %s -- iroute only works with tun-style tunnels",
-		   multi_instance_string (mi, false, &gc));
-	    }
+  /* set flag so we don't get called again */
+  mi->connection_established_flag = true;
+  ++m->instance_generation;
+#ifdef ENABLE_PF
+  pf_c2c_invalidate ();
+#endif
 
-	  /* set our client's VPN endpoint for status reporting purposes */
-	  mi->reporting_addr = mi->context.c2.push_ifconfig_local;
+  /* increment number of current authenticated clients */
+  ++m->n_clients;
+  --mi->n_clients_delta;
 
-	  /* set context-level authentication flag */
-	  mi->context.c2.context_auth = CAS_SUCCEEDED;
-	}
-      else
+#ifdef MANAGEMENT_DEF_AUTH
+  if (management)
+    management_connection_established (management, &mi->context.c2.mda_context, mi->context.c2.es);
+#endif
+
+
+  gc_free (&gc);
+}
+
+/*
+ * Called as soon as the SSL/TLS connection authenticates, and
+ * again on each pass through multi_process_post while the
+ * instance is held for a deferred client-connect hook.
+ *
+ * Instance-specific directives to be processed:
+ *
+ *   iroute start-ip end-ip
+ *   ifconfig-push local remote-netmask
+ *   push
+ */
+static void
+multi_connection_established (struct multi_context *m, struct multi_instance *mi)
+{
+  struct multi_connect_state *cc = &mi->cc;
+
+  if (cc->stage == CC_STAGE_BEGIN)
+    {
+      if (tls_authentication_status (mi->context.c2.tls_multi, 0) != TLS_AUTHENTICATION_SUCCEEDED)
 	{
-	  /* set context-level authentication flag */
-	  mi->context.c2.context_auth = cc_succeeded_count ? CAS_PARTIAL : CAS_FAILED;
+	  mi->context.c2.push_reply_deferred = false;
+	  return;
 	}
 
-      /* set flag so we don't get called again */
-      mi->connection_established_flag = true;
-
-      /* increment number of current authenticated clients */
-      ++m->n_clients;
-      --mi->n_clients_delta;
+      multi_client_connect_begin (m, mi);
+      cc->stage = CC_STAGE_PLUGIN;
+      if (multi_client_connect_call_plugin (m, mi))
+	goto hold;
+    }
 
-#ifdef MANAGEMENT_DEF_AUTH
-      if (management)
-	management_connection_established (management, &mi->context.c2.mda_context, mi->context.c2.es);
-#endif
+  if (cc->stage == CC_STAGE_PLUGIN)
+    {
+      if (multi_client_connect_wait_plugin (m, mi))
+	goto hold;
+      cc->stage = CC_STAGE_SCRIPT;
+      if (multi_client_connect_call_script (m, mi))
+	goto hold;
+    }
 
-      gc_free (&gc);
+  if (cc->stage == CC_STAGE_SCRIPT)
+    {
+      if (multi_client_connect_wait_script (m, mi))
+	goto hold;
+      cc->stage = CC_STAGE_DONE;
     }
 
+  multi_client_connect_finish (m, mi);
+
   /*
    * Reply now to client's PUSH_REQUEST query
    */
   mi->context.c2.push_reply_deferred = false;
+  return;
+
+ hold:
+  multi_client_connect_hold (m, mi);
 }
 
 /*
@@ -1858,19 +3308,78 @@ multi_unicast (struct multi_context *m,
   if (BLEN (buf) > 0)
     {
       mb = mbuf_alloc_buf (buf);
+      if (!mb)
+	{
+	  msg (D_MULTI_DROPPED, "MULTI: packet dropped due to packet pool exhaustion (multi_unicast)");
+	  return;
+	}
       mb->flags = MF_UNICAST;
       multi_add_mbuf (m, mi, mb);
       mbuf_free_buf (mb);
     }
 }
 
+#ifdef ENABLE_PF
+/*
+ * Return the instances that may receive broadcasts from sender
+ * under the packet filter, or NULL if there are too many instances
+ * to keep such a list per sender.  The list is rebuilt whenever
+ * instances come or go or any client's packet filter changes.
+ */
+static struct multi_instance **
+multi_bcast_peers (struct multi_context *m, struct multi_instance *sender)
+{
+  const int n = hash_n_elements (m->iter);
+
+  if (n > MULTI_BCAST_PEERS_MAX)
+    return NULL;
+
+  if (!sender->bcast_peers_valid
+      || sender->bcast_instance_generation != m->instance_generation
+      || sender->bcast_pf_generation != pf_rules_generation ())
+    {
+      struct hash_iterator hi;
+      struct hash_element *he;
+
+      if (sender->bcast_peers_size < n)
+	{
+	  free (sender->bcast_peers);
+	  ALLOC_ARRAY (sender->bcast_peers, struct multi_instance *, n);
+	  sender->bcast_peers_size = n;
+	}
+      sender->n_bcast_peers = 0;
+
+      hash_iterator_init (m->iter, &hi);
+      while ((he = hash_iterator_next (&hi)))
+	{
+	  struct multi_instance *mi = (struct multi_instance *) he->value;
+	  if (mi != sender && !mi->halt)
+	    {
+	      if (pf_c2c_test (&sender->context, &mi->context, "bcast_c2c"))
+		sender->bcast_peers[sender->n_bcast_peers++] = mi;
+	      else
+		msg (D_PF_DROPPED_BCAST, "PF: client[%s] -> client[%s] BCAST packets will be dropped by packet filter",
+		     mi_prefix (sender),
+		     mi_prefix (mi));
+	    }
+	}
+      hash_iterator_free (&hi);
+
+      sender->bcast_instance_generation = m->instance_generation;
+      sender->bcast_pf_generation = pf_rules_generation ();
+      sender->bcast_peers_valid = true;
+    }
+  return sender->bcast_peers;
+}
+#endif
+
 /*
  * Broadcast a packet to all clients.
  */
 static void
 multi_bcast (struct multi_context *m,
 	     const struct buffer *buf,
-	     const struct multi_instance *sender_instance,
+	     struct multi_instance *sender_instance,
 	     const struct mroute_addr *sender_addr)
 {
   struct hash_iterator hi;
@@ -1880,13 +3389,36 @@ multi_bcast (struct multi_context *m,
 
   if (BLEN (buf) > 0)
     {
+#ifdef ENABLE_PF
+      struct multi_instance **peers = NULL;
+#endif
       perf_push (PERF_MULTI_BCAST);
 #ifdef MULTI_DEBUG_EVENT_LOOP
       printf ("BCAST len=%d\n", BLEN (buf));
 #endif
       mb = mbuf_alloc_buf (buf);
-      hash_iterator_init (m->iter, &hi);
+      if (!mb)
+	{
+	  msg (D_MULTI_DROPPED, "MULTI: packet dropped due to packet pool exhaustion (multi_bcast)");
+	  perf_pop ();
+	  return;
+	}
+
+#ifdef ENABLE_PF
+      if (sender_instance)
+	peers = multi_bcast_peers (m, sender_instance);
+      if (peers)
+	{
+	  int i;
+	  for (i = 0; i < sender_instance->n_bcast_peers; ++i)
+	    multi_add_mbuf (m, peers[i], mb);
+	  mbuf_free_buf (mb);
+	  perf_pop ();
+	  return;
+	}
+#endif
 
+      hash_iterator_init (m->iter, &hi);
       while ((he = hash_iterator_next (&hi)))
 	{
 	  mi = (struct multi_instance *) he->value;
@@ -1926,6 +3458,95 @@ multi_bcast (struct multi_context *m,
     }
 }
 
+/*
+ * Send a multicast packet to the clients which joined its
+ * destination group.
+ */
+static void
+multi_mcast (struct multi_context *m,
+	     const struct buffer *buf,
+	     const struct mroute_addr *group,
+	     const struct multi_instance *sender_instance,
+	     const struct mroute_addr *sender_addr)
+{
+  struct multi_mcast_group *g;
+
+  if (BLEN (buf) > 0)
+    {
+      perf_push (PERF_MULTI_BCAST);
+      g = (struct multi_mcast_group *) hash_lookup (m->mcast_groups, group);
+      if (g && !multi_mcast_group_prune (g, NULL, multi_mcast_expiring (m)))
+	{
+	  struct multi_mcast_member *mm;
+	  struct mbuf_buffer *mb = mbuf_alloc_buf (buf);
+
+	  if (!mb)
+	    {
+	      msg (D_MULTI_DROPPED, "MULTI: packet dropped due to packet pool exhaustion (multi_mcast)");
+	      perf_pop ();
+	      return;
+	    }
+
+	  for (mm = g->members; mm; mm = mm->next)
+	    {
+	      struct multi_instance *mi = mm->instance;
+	      if (mi != sender_instance && !mi->halt)
+		{
+#ifdef ENABLE_PF
+		  if (sender_instance && !pf_c2c_test (&sender_instance->context, &mi->context, "mcast_c2c"))
+		    {
+		      msg (D_PF_DROPPED_BCAST, "PF: client[%s] -> client[%s] packet dropped by MCAST packet filter",
+			   mi_prefix (sender_instance),
+			   mi_prefix (mi));
+		      continue;
+		    }
+		  if (sender_addr && !pf_addr_test (&mi->context, sender_addr, "mcast_src_addr"))
+		    {
+		      struct gc_arena gc = gc_new ();
+		      msg (D_PF_DROPPED_BCAST, "PF: addr[%s] -> client[%s] packet dropped by MCAST packet filter",
+			   mroute_addr_print_ex (sender_addr, MAPF_SHOW_ARP, &gc),
+			   mi_prefix (mi));
+		      gc_free (&gc);
+		      continue;
+		    }
+#endif
+		  multi_add_mbuf (m, mi, mb);
+		}
+	    }
+	  mbuf_free_buf (mb);
+	}
+      else if (g)
+	{
+	  hash_remove (m->mcast_groups, &g->addr);
+	  multi_mcast_group_free (g);
+	}
+      perf_pop ();
+    }
+}
+
+/*
+ * Send a broadcast or multicast packet to its receivers: the
+ * members of its destination group if snooping tracks it,
+ * all clients otherwise.  Without a querier, clients may be
+ * members of groups they reported before we started tracking,
+ * so groups without known members are flooded.
+ */
+static void
+multi_fanout (struct multi_context *m,
+	      const struct buffer *buf,
+	      int tunnel_type,
+	      struct multi_instance *sender_instance,
+	      const struct mroute_addr *sender_addr)
+{
+  struct mroute_addr group;
+
+  if (m->mcast_groups && mroute_extract_mcast_group (&group, buf, tunnel_type)
+      && (multi_mcast_querier_present (m) || hash_lookup (m->mcast_groups, &group)))
+    multi_mcast (m, buf, &group, sender_instance, sender_addr);
+  else
+    multi_bcast (m, buf, sender_instance, sender_addr);
+}
+
 /*
  * Given a time delta, indicating that we wish to be
  * awoken by the scheduler at time now + delta, figure
@@ -1969,6 +3590,41 @@ multi_schedule_context_wakeup (struct multi_context *m, struct multi_instance *m
 		      compute_wakeup_sigma (&mi->context.c2.timeval));
 }
 
+#ifdef PLUGIN_DEF_AUTH
+
+void
+multi_process_plugin_auth (struct multi_context *m)
+{
+  struct plugin_auth_completion pac[16];
+  const int n = plugin_auth_read (m->top.plugins, pac, SIZE (pac));
+  int i;
+
+  for (i = 0; i < n; ++i)
+    {
+      struct multi_instance *mi = (struct multi_instance *) pac[i].arg;
+
+      if (!mi || mi->halt)
+	continue;
+
+      if (mi->cc.plugin_handle && pac[i].handle == mi->cc.plugin_handle)
+	{
+	  /* client-connect-v2 result, see multi_connection_established */
+	  mi->cc.plugin_handle = 0;
+	  mi->cc.plugin_succeeded = pac[i].success;
+	}
+      else if (!tls_authenticate_plugin_key (mi->context.c2.tls_multi, pac[i].handle, pac[i].success))
+	continue;
+
+      /* run the instance on the next pass of the event loop
+	 rather than at its next timer */
+      mi->context.c2.timeval.tv_sec = 0;
+      mi->context.c2.timeval.tv_usec = 0;
+      multi_schedule_context_wakeup (m, mi);
+    }
+}
+
+#endif
+
 /*
  * Figure instance-specific timers, convert
  * earliest to absolute time in mi->wakeup,
@@ -2074,6 +3730,13 @@ multi_process_incoming_link (struct multi_context *m, struct multi_instance *ins
 	  c->c2.from = m->top.c2.from;
 	}
 
+      /* drop control channel packets over --control-freq-source */
+      if (!multi_admit_control (m, m->pending, &c->c2.buf))
+	{
+	  dmsg (D_MULTI_DEBUG, "MULTI: control packet dropped by --control-freq-source");
+	  c->c2.buf.len = 0;
+	}
+
       if (BLEN (&c->c2.buf) > 0)
 	{
 	  /* decrypt in instance context */
@@ -2107,8 +3770,7 @@ multi_process_incoming_link (struct multi_context *m, struct multi_instance *ins
 		  /* multicast? */
 		  if (mroute_flags & MROUTE_EXTRACT_MCAST)
 		    {
-		      /* for now, treat multicast as broadcast */
-		      multi_bcast (m, &c->c2.to_tun, m->pending, NULL);
+		      multi_fanout (m, &c->c2.to_tun, DEV_TYPE_TUN, m->pending, NULL);
 		    }
 		  else /* possible client to client routing */
 		    {
@@ -2134,6 +3796,11 @@ multi_process_incoming_link (struct multi_context *m, struct multi_instance *ins
 			}
 		    }
 		}
+
+	      /* learn multicast group memberships of this client */
+	      if (c->c2.to_tun.len && (mroute_flags & MROUTE_EXTRACT_MCAST))
+		multi_mcast_snoop (m, &c->c2.to_tun, DEV_TYPE_TUN);
+
 #ifdef ENABLE_PF
 	      if (c->c2.to_tun.len && !pf_addr_test (c, &dest, "tun_dest_addr"))
 		{
@@ -2165,12 +3832,16 @@ multi_process_incoming_link (struct multi_context *m, struct multi_instance *ins
 		{
 		  if (multi_learn_addr (m, m->pending, &src, 0) == m->pending)
 		    {
+		      /* learn multicast group memberships of this client */
+		      if (mroute_flags & MROUTE_EXTRACT_BCAST)
+			multi_mcast_snoop (m, &c->c2.to_tun, DEV_TYPE_TAP);
+
 		      /* check for broadcast */
 		      if (m->enable_c2c)
 			{
 			  if (mroute_flags & (MROUTE_EXTRACT_BCAST|MROUTE_EXTRACT_MCAST))
 			    {
-			      multi_bcast (m, &c->c2.to_tun, m->pending, NULL);
+			      multi_fanout (m, &c->c2.to_tun, DEV_TYPE_TAP, m->pending, NULL);
 			    }
 			  else /* try client-to-client routing */
 			    {
@@ -2288,11 +3959,12 @@ multi_process_incoming_tun (struct multi_context *m, const unsigned int mpp_flag
 	  /* broadcast or multicast dest addr? */
 	  if (mroute_flags & (MROUTE_EXTRACT_BCAST|MROUTE_EXTRACT_MCAST))
 	    {
-	      /* for now, treat multicast as broadcast */
+	      /* a querier on the server side */
+	      multi_mcast_snoop (m, &m->top.c2.buf, dev_type);
 #ifdef ENABLE_PF
-	      multi_bcast (m, &m->top.c2.buf, NULL, e2);
+	      multi_fanout (m, &m->top.c2.buf, dev_type, NULL, e2);
 #else
-	      multi_bcast (m, &m->top.c2.buf, NULL, NULL);
+	      multi_fanout (m, &m->top.c2.buf, dev_type, NULL, NULL);
 #endif
 	    }
 	  else
@@ -2477,16 +4149,31 @@ multi_process_per_second_timers_dowork (struct multi_context *m)
   /* possibly reap instances/routes in vhash */
   multi_reap_process (m);
 
-  /* possibly print to status log */
-  if (m->top.c1.status_output)
+  /* possibly expire multicast group memberships */
+  multi_mcast_sweep (m);
+
+  /* collect asynchronous client scripts which have exited */
+  multi_script_children_reap (m, false);
+
+  /*
+   * possibly print to status log, by taking a snapshot now and
+   * formatting it over the next passes through the event loop
+   */
+  if (m->top.c1.status_output && !m->status && m->hash)
     {
       if (status_trigger (m->top.c1.status_output))
-	multi_print_status (m, m->top.c1.status_output, m->status_file_version);
+	m->status = multi_status_new (m, m->top.c1.status_output, m->status_file_version);
     }
 
   /* possibly flush ifconfig-pool file */
   multi_ifconfig_pool_persist (m, false);
 
+#ifdef MANAGEMENT_DEF_AUTH
+  /* possibly stream client counters to the management interface */
+  if (management && management_metrics_due (management))
+    multi_print_metrics (m);
+#endif
+
 #ifdef ENABLE_DEBUG
   gremlin_flood_clients (m);
 #endif
@@ -2553,6 +4240,30 @@ multi_signal_instance (struct multi_context *m, struct multi_instance *mi, const
 
 #ifdef ENABLE_MANAGEMENT
 
+/*
+ * Signal every established instance named name in secondary
+ * index idx, return the number signaled.
+ */
+static int
+multi_signal_by_name (struct multi_context *m, const int idx, const char *name, const int sig)
+{
+  struct multi_instance *mi = multi_name_index_lookup (m, idx, name);
+  int count = 0;
+
+  while (mi)
+    {
+      /* signaling may close mi and unlink it */
+      struct multi_instance *next = mi->name_link[idx].next;
+      if (!mi->halt)
+	{
+	  multi_signal_instance (m, mi, sig);
+	  ++count;
+	}
+      mi = next;
+    }
+  return count;
+}
+
 static void
 management_callback_status (void *arg, const int version, struct status_output *so)
 {
@@ -2575,34 +4286,62 @@ static int
 management_callback_kill_by_cn (void *arg, const char *del_cn)
 {
   struct multi_context *m = (struct multi_context *) arg;
-  struct hash_iterator hi;
-  struct hash_element *he;
-  int count = 0;
+  return multi_signal_by_name (m, MULTI_INDEX_CN, del_cn, SIGTERM);
+}
 
-  hash_iterator_init (m->iter, &hi);
-  while ((he = hash_iterator_next (&hi)))
-    {
-      struct multi_instance *mi = (struct multi_instance *) he->value;
-      if (!mi->halt)
-	{
-	  const char *cn = tls_common_name (mi->context.c2.tls_multi, false);
-	  if (cn && !strcmp (cn, del_cn))
-	    {
-	      multi_signal_instance (m, mi, SIGTERM);
-	      ++count;
-	    }
-	}
-    }
-  hash_iterator_free (&hi);
-  return count;
+static int
+management_callback_kill_by_username (void *arg, const char *username)
+{
+  struct multi_context *m = (struct multi_context *) arg;
+  return multi_signal_by_name (m, MULTI_INDEX_USERNAME, username, SIGTERM);
+}
+
+static void
+management_callback_admission_stats (void *arg)
+{
+  struct multi_context *m = (struct multi_context *) arg;
+  const struct multi_admit *a = m->admit;
+
+  if (a)
+    msg (M_CLIENT, "SUCCESS: sources=%d,admitted=" counter_format ",connect_limited=" counter_format
+	 ",penalized=" counter_format ",control_limited=" counter_format
+	 ",hmac_failed=" counter_format ",evicted=" counter_format,
+	 a->n_used,
+	 a->n_admitted,
+	 a->n_connect_limited,
+	 a->n_penalized,
+	 a->n_control_limited,
+	 a->n_hmac_failed,
+	 a->n_evicted);
+  else
+    msg (M_CLIENT, "ERROR: per source admission control is not enabled");
+}
+
+#ifdef PLUGIN_DEF_AUTH
+static void
+management_callback_auth_stats (void *arg)
+{
+  struct multi_context *m = (struct multi_context *) arg;
+  const struct plugin_auth_stats *s = plugin_auth_stats (m->top.plugins);
+
+  if (s)
+    msg (M_CLIENT, "SUCCESS: inflight=%d,started=" counter_format ",succeeded=" counter_format
+	 ",failed=" counter_format ",timed_out=" counter_format ",stale=" counter_format,
+	 s->n_inflight,
+	 s->n_started,
+	 s->n_succeeded,
+	 s->n_failed,
+	 s->n_timed_out,
+	 s->n_stale);
+  else
+    msg (M_CLIENT, "ERROR: no plugin auth completion pipe");
 }
+#endif
 
 static int
 management_callback_kill_by_addr (void *arg, const in_addr_t addr, const int port)
 {
   struct multi_context *m = (struct multi_context *) arg;
-  struct hash_iterator hi;
-  struct hash_element *he;
   struct openvpn_sockaddr saddr;
   struct mroute_addr maddr;
   int count = 0;
@@ -2613,17 +4352,13 @@ management_callback_kill_by_addr (void *arg, const in_addr_t addr, const int por
   saddr.addr.in4.sin_port = htons (port);
   if (mroute_extract_openvpn_sockaddr (&maddr, &saddr, true))
     {
-      hash_iterator_init (m->iter, &hi);
-      while ((he = hash_iterator_next (&hi)))
+      /* m->hash is keyed by real address and port */
+      struct multi_instance *mi = (struct multi_instance *) hash_lookup (m->hash, &maddr);
+      if (mi && !mi->halt)
 	{
-	  struct multi_instance *mi = (struct multi_instance *) he->value;
-	  if (!mi->halt && mroute_addr_equal (&maddr, &mi->real))
-	    {
-	      multi_signal_instance (m, mi, SIGTERM);
-	      ++count;
-	    }
+	  multi_signal_instance (m, mi, SIGTERM);
+	  ++count;
 	}
-      hash_iterator_free (&hi);
     }
   return count;
 }
@@ -2759,6 +4494,11 @@ init_management_callback_multi (struct multi_context *m)
       cb.show_net = management_show_net_callback;
       cb.kill_by_cn = management_callback_kill_by_cn;
       cb.kill_by_addr = management_callback_kill_by_addr;
+      cb.kill_by_username = management_callback_kill_by_username;
+      cb.admission_stats = management_callback_admission_stats;
+#ifdef PLUGIN_DEF_AUTH
+      cb.auth_stats = management_callback_auth_stats;
+#endif
       cb.delete_event = management_delete_event;
       cb.n_clients = management_callback_n_clients;
 #ifdef MANAGEMENT_DEF_AUTH
@@ -51,7 +51,128 @@ struct multi_reap
 {
   int bucket_base;
   int buckets_per_pass;
+  int buckets_to_scan;         /* buckets left to walk since an instance closed */
+  int n_buckets_seen;          /* vhash size when buckets_to_scan was set */
   time_t last_call;
+
+  /*
+   * Cached host routes, most recently referenced first.  Since
+   * they expire in that order, aging only visits the tail.
+   */
+  struct multi_route *cache_head;
+  struct multi_route *cache_tail;
+  int n_cached;
+  int max_cached;              /* evict least recently used routes beyond this */
+  unsigned int cache_generation; /* route helper generation of the last cache sweep */
+  counter_type n_evicted;
+};
+
+/*
+ * Token bucket holding up to max events per per seconds, kept
+ * in units of 1/max second so that refills stay integral.
+ */
+struct multi_token_bucket
+{
+  int tokens;
+  time_t last_refill;
+};
+
+/*
+ * Admission state of one source address prefix.
+ */
+struct multi_admit_entry
+{
+  struct mroute_addr prefix;    /* len == 0 if unused */
+  time_t last_seen;
+  time_t penalty_until;         /* ignore new sessions until then */
+  struct multi_token_bucket connect;
+  struct multi_token_bucket control;
+};
+
+/*
+ * Entries probed for one source, the table is set associative
+ * with this many ways so that it stays bounded under a flood
+ * of distinct sources.
+ */
+#define MULTI_ADMIT_WAYS 4
+
+/*
+ * Per source prefix admission control, enabled by
+ * --connect-freq-source, --control-freq-source or
+ * --tls-auth-penalty.
+ */
+struct multi_admit
+{
+  struct multi_admit_entry *entries;
+  int n_entries;                /* power of 2 */
+  int n_used;
+  uint32_t iv;
+
+  int connect_max;
+  int connect_per;
+  int control_max;
+  int control_per;
+  int penalty;
+  int netbits;
+  int netbits_ipv6;
+
+  counter_type n_admitted;      /* new sessions passed */
+  counter_type n_connect_limited; /* new sessions over the source limit */
+  counter_type n_penalized;     /* new sessions from sources in the penalty box */
+  counter_type n_control_limited; /* control packets over the source limit */
+  counter_type n_hmac_failed;   /* --tls-auth failures from unknown sources */
+  counter_type n_evicted;       /* entries reused for another source */
+};
+
+/*
+ * Secondary indexes of established instances by name.  Each
+ * index maps a name to the first instance using it, further
+ * instances with the same name (--duplicate-cn) are chained
+ * through multi_instance.name_link.
+ */
+#define MULTI_INDEX_CN        0  /* common name */
+#define MULTI_INDEX_USERNAME  1  /* --auth-user-pass-verify username */
+#define MULTI_N_INDEX         2
+
+struct multi_name_link
+{
+  const char *name;             /* key in the index, NULL if not indexed */
+  struct multi_instance *prev;  /* NULL if first in the index */
+  struct multi_instance *next;
+};
+
+/*
+ * Progress of the client-connect hooks of an instance, which
+ * is held with push_reply_deferred set while a deferred
+ * OPENVPN_PLUGIN_CLIENT_CONNECT_V2 plugin or an asynchronous
+ * --client-connect script is still running.
+ */
+struct multi_connect_state
+{
+# define CC_STAGE_BEGIN   0  /* connection not yet established */
+# define CC_STAGE_PLUGIN  1  /* waiting for client-connect-v2 plugins */
+# define CC_STAGE_SCRIPT  2  /* waiting for --client-connect script */
+# define CC_STAGE_DONE    3
+  int stage;
+  bool succeeded;
+  int succeeded_count;
+  unsigned int option_types_found;
+  time_t expire;                /* give up on a deferred hook at this time */
+  const char *dc_file;          /* config file written by the deferred hook */
+  unsigned int plugin_handle;   /* non-zero while plugins are pending */
+  bool plugin_succeeded;
+  int script_pid;               /* > 0 while the script is running */
+};
+
+/*
+ * Asynchronous client scripts whose result nobody waits
+ * for, collected once a second.
+ */
+struct multi_script_child
+{
+  int pid;
+  const char *hook;
+  struct multi_script_child *next;
 };
 
 
@@ -72,6 +193,8 @@ struct multi_instance {
   bool halt;
   int refcount;
   int route_count;             /* number of routes (including cached routes) owned by this instance */
+  int cached_route_count;      /* number of cached routes owned by this instance */
+  int n_mcast_groups;          /* number of multicast groups this instance has joined */
   time_t created;               /**< Time at which a VPN tunnel instance
                                  *   was created.  This parameter is set
                                  *   by the \c multi_create_instance()
@@ -97,14 +220,76 @@ struct multi_instance {
   struct buffer_list *cc_config;
 #endif
   bool connection_established_flag;
+  struct multi_connect_state cc;
   bool did_iroutes;
+  struct multi_name_link name_link[MULTI_N_INDEX];
   int n_clients_delta; /* added to multi_context.n_clients when instance is closed */
 
+#ifdef ENABLE_PF
+  /*
+   * Instances which may receive broadcasts from this one under
+   * the packet filter, valid while both generations match.
+   */
+  struct multi_instance **bcast_peers;
+  int n_bcast_peers;
+  int bcast_peers_size;
+  bool bcast_peers_valid;
+  unsigned int bcast_instance_generation;
+  unsigned int bcast_pf_generation;
+#endif
+
   struct context context;       /**< The context structure storing state
                                  *   for this VPN tunnel. */
 };
 
 
+/*
+ * Copy of the client list and routing table taken when status
+ * output is requested, so that it can be formatted a few lines
+ * at a time while the instances it describes come and go.
+ */
+struct multi_status_client
+{
+  const char *common_name;
+  struct mroute_addr real;
+  in_addr_t reporting_addr;
+  counter_type bytes_in;
+  counter_type bytes_out;
+  time_t created;
+  int rtt;                      /* control channel round trip time in ms, 0 if unknown */
+};
+
+struct multi_status_route
+{
+  struct mroute_addr addr;
+  bool cached;
+  const char *common_name;
+  struct mroute_addr real;
+  time_t last_reference;
+};
+
+struct multi_status
+{
+# define MULTI_STATUS_HEAD     0
+# define MULTI_STATUS_CLIENTS  1
+# define MULTI_STATUS_ROUTES   2
+# define MULTI_STATUS_TAIL     3
+  int stage;
+  int index;                    /* next client or route to format */
+
+  struct status_output *so;
+  int version;
+  time_t time;
+
+  struct multi_status_client *clients;
+  int n_clients;
+  struct multi_status_route *routes;
+  int n_routes;
+
+  struct gc_arena gc;
+};
+
+
 /**
  * Main OpenVPN server state structure.
  *
@@ -131,6 +316,8 @@ struct multi_context {
   struct hash *iter;            /**< VPN tunnel instances indexed by real
                                  *   address of the remote peer, optimized
                                  *   for iteration. */
+  struct hash *name_index[MULTI_N_INDEX]; /* established instances by
+                                 common name and username */
   struct schedule *schedule;
   struct mbuf_set *mbuf;        /**< Set of buffers for passing data
                                  *   channel packets between VPN tunnel
@@ -139,6 +326,7 @@ struct multi_context {
                                  *   as external transport. */
   struct ifconfig_pool *ifconfig_pool;
   struct frequency_limit *new_connection_limiter;
+  struct multi_admit *admit;    /* per source admission control, or NULL */
   struct mroute_helper *route_helper;
   struct multi_reap *reaper;
   struct mroute_addr local;
@@ -153,11 +341,22 @@ struct multi_context {
   unsigned long cid_counter;
 #endif
 
+  struct hash *mcast_groups;    /**< Multicast groups learned by
+                                 *   IGMP/MLD snooping, or NULL if
+                                 *   \c --mcast-snooping is off. */
+  time_t mcast_sweep_time;      /* next expiry sweep of mcast_groups */
+  time_t mcast_querier_since;   /* first IGMP/MLD query of the current querier */
+  time_t mcast_querier_last;    /* last IGMP/MLD query seen, 0 if none */
+  unsigned int instance_generation; /* bumped when instances come or go */
+
+  struct multi_status *status;  /* --status file output in progress */
+
   struct multi_instance *pending;
   struct multi_instance *earliest_wakeup;
   struct multi_instance **mpp_touched;
   struct context_buffers *context_buffers;
   time_t per_second_trigger;
+  struct multi_script_child *script_children;
 
   struct context top;           /**< Storage structure for process-wide
                                  *   configuration. */
@@ -177,6 +376,27 @@ struct multi_route
 
   unsigned int cache_generation;
   time_t last_reference;
+
+  /* position in the cached route LRU list, if MULTI_ROUTE_CACHE */
+  struct multi_route *lru_prev;
+  struct multi_route *lru_next;
+};
+
+
+/*
+ * Multicast group learned by IGMP/MLD snooping
+ */
+struct multi_mcast_member
+{
+  struct multi_mcast_member *next;
+  struct multi_instance *instance;
+  time_t expires;
+};
+
+struct multi_mcast_group
+{
+  struct mroute_addr addr;
+  struct multi_mcast_member *members;
 };
 
 
@@ -268,6 +488,23 @@ bool multi_process_post (struct multi_context *m, struct multi_instance *mi, con
  */
 bool multi_process_incoming_link (struct multi_context *m, struct multi_instance *instance, const unsigned int mpp_flags);
 
+/*
+ * Per source admission checks for packets which have no
+ * instance yet, see --connect-freq-source and --tls-auth-penalty.
+ */
+bool multi_admit_penalized (struct multi_context *m, const struct mroute_addr *real);
+void multi_admit_hmac_failed (struct multi_context *m, const struct mroute_addr *real);
+bool multi_admit_new_session (struct multi_context *m, const struct mroute_addr *real);
+void multi_admit_new_session_refund (struct multi_context *m, const struct mroute_addr *real);
+
+#ifdef PLUGIN_DEF_AUTH
+/*
+ * Apply deferred auth results which plugins wrote to
+ * the auth completion pipe.
+ */
+void multi_process_plugin_auth (struct multi_context *m);
+#endif
+
 
 /**
  * Determine the destination VPN tunnel of a packet received over the
@@ -455,6 +692,31 @@ clear_prefix (void)
  */
 #define MULTI_CACHE_ROUTE_TTL 60
 
+/*
+ * Multicast snooping: forget a membership which has not been
+ * reported for this many seconds (RFC 3376 Group Membership
+ * Interval), consider a querier gone after not seeing a query
+ * for this many seconds (Other Querier Present Interval), check
+ * for expired memberships this often, and cap the number of
+ * groups one client may join.
+ */
+#define MULTI_MCAST_MEMBER_TTL       260
+#define MULTI_MCAST_QUERIER_TTL      255
+#define MULTI_MCAST_SWEEP_INTERVAL    30
+#define MULTI_MCAST_MAX_GROUPS       256
+
+/*
+ * Don't cache per-sender broadcast receiver lists
+ * with more than this many instances.
+ */
+#define MULTI_BCAST_PEERS_MAX       1024
+
+/*
+ * Lines of --status file output formatted per pass
+ * through the event loop.
+ */
+#define MULTI_STATUS_STEP            256
+
 static inline void
 multi_reap_process (const struct multi_context *m)
 {
@@ -472,6 +734,11 @@ multi_process_per_second_timers (struct multi_context *m)
       multi_process_per_second_timers_dowork (m);
       m->per_second_trigger = now;
     }
+  if (m->status)
+    {
+      void multi_status_continue (struct multi_context *m);
+      multi_status_continue (m);
+    }
 }
 
 /*
@@ -505,6 +772,14 @@ multi_get_timeout (struct multi_context *m, struct timeval *dest)
       dest->tv_sec = REAP_MAX_WAKEUP;
       dest->tv_usec = 0;
     }
+
+  /* don't sleep while --status file output is in progress */
+  if (m->status && (dest->tv_sec || dest->tv_usec))
+    {
+      m->earliest_wakeup = NULL;
+      dest->tv_sec = 0;
+      dest->tv_usec = 0;
+    }
 }
 
 
@@ -186,9 +186,13 @@ struct openvpn_plugin_string_list
  * Version   Comment
  *    1      Initial plugin v3 structures providing the same API as
  *           the v2 plugin interface + X509 certificate information.
+ *    2      Asynchronous authentication: auth_complete_fd in
+ *           openvpn_plugin_args_open_in, flags in
+ *           openvpn_plugin_args_open_return and auth_handle in
+ *           openvpn_plugin_args_func_in.
  *
  */
-#define OPENVPN_PLUGINv3_STRUCTVER 1
+#define OPENVPN_PLUGINv3_STRUCTVER 2
 
 /**
  * Arguments used to transport variables to the plug-in.
@@ -207,12 +211,23 @@ struct openvpn_plugin_string_list
  *        variables in "name=value" format.  Note that for security reasons,
  *        these variables are not actually written to the "official"
  *        environmental variable store of the process.
+ *
+ * auth_complete_fd : (STRUCTVER >= 2) file descriptor on which the plug-in
+ *        reports the result of a deferred OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY
+ *        call, see openvpn_plugin_func_v3().  -1 if asynchronous
+ *        authentication is not available on this platform.  The
+ *        descriptor is inherited by processes the plug-in forks, so
+ *        privilege separated helpers may write to it directly.  It is
+ *        close-on-exec, so that scripts run by OpenVPN do not get it;
+ *        a helper which the plug-in starts with exec() must clear
+ *        FD_CLOEXEC on it (or dup2() it) in the child beforehand.
  */
 struct openvpn_plugin_args_open_in
 {
   const int type_mask;
   const char ** const argv;
   const char ** const envp;
+  const int auth_complete_fd;
 };
 
 
@@ -236,12 +251,20 @@ struct openvpn_plugin_args_open_in
  *
  * return_list : used to return data back to OpenVPN.
  *
+ * flags :      (STRUCTVER >= 2) logical OR of OPENVPN_PLUGIN_OPEN_x flags.
+ *              OPENVPN_PLUGIN_OPEN_ASYNC_AUTH tells OpenVPN that the plug-in
+ *              reports deferred authentication results on auth_complete_fd
+ *              instead of through auth_control_file.
+ *
  */
+#define OPENVPN_PLUGIN_OPEN_ASYNC_AUTH (1<<0)
+
 struct openvpn_plugin_args_open_return
 {
   int  type_mask;
   openvpn_plugin_handle_t *handle;
   struct openvpn_plugin_string_list **return_list;
+  unsigned int flags;
 };
 
 /**
@@ -271,6 +294,11 @@ struct openvpn_plugin_args_open_return
  *
  * *current_cert : X509 Certificate object received from the client (only if compiled with USE_SSL defined)
  *
+ * auth_handle : (STRUCTVER >= 2) identifies an OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY
+ *        or OPENVPN_PLUGIN_CLIENT_CONNECT_V2 call whose result may be reported
+ *        on auth_complete_fd.  0 for other plug-in types, or if the plug-in did
+ *        not set OPENVPN_PLUGIN_OPEN_ASYNC_AUTH.
+ *
  */
 struct openvpn_plugin_args_func_in
 {
@@ -286,6 +314,7 @@ struct openvpn_plugin_args_func_in
   int __current_cert_depth_disabled; /* Unused, for compatibility purposes only */
   void *__current_cert_disabled; /* Unused, for compatibility purposes only */
 #endif
+  const unsigned int auth_handle;
 };
 
 
@@ -305,6 +334,27 @@ struct openvpn_plugin_args_func_return
   struct openvpn_plugin_string_list **return_list;
 };
 
+/**
+ * Record written to auth_complete_fd to report the result of a deferred
+ * OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY or OPENVPN_PLUGIN_CLIENT_CONNECT_V2
+ * call.
+ *
+ * STRUCT MEMBERS:
+ *
+ * auth_handle : the auth_handle passed to openvpn_plugin_func_v3().
+ *
+ * status : OPENVPN_PLUGIN_FUNC_SUCCESS or OPENVPN_PLUGIN_FUNC_ERROR.
+ *
+ * The record must be written with a single write() call.  It is smaller
+ * than PIPE_BUF, so records written concurrently by several threads or
+ * processes are never interleaved.
+ */
+struct openvpn_plugin_auth_result
+{
+  unsigned int auth_handle;
+  int status;
+};
+
 /*
  * Multiple plugin modules can be cascaded, and modules can be
  * used in tandem with scripts.  The order of operation is that
@@ -419,6 +469,24 @@ OPENVPN_PLUGIN_DEF openvpn_plugin_handle_t OPENVPN_PLUGIN_FUNC(openvpn_plugin_op
  *
  * OpenVPN will delete the auth_control_file after it goes out of scope.
  *
+ * A plug-in which set OPENVPN_PLUGIN_OPEN_ASYNC_AUTH at open time does
+ * not use auth_control_file (it is only created while some other
+ * plug-in still relies on it).  Instead it writes a struct
+ * openvpn_plugin_auth_result carrying arguments->auth_handle to the
+ * auth_complete_fd it was given by openvpn_plugin_open_v3().  OpenVPN
+ * waits on that descriptor in its event loop, so the result takes effect
+ * as soon as it is written.  Results which arrive after the deferred
+ * authentication window (--hand-window) has expired are ignored.
+ *
+ * The same plug-in may also return OPENVPN_PLUGIN_FUNC_DEFERRED from
+ * OPENVPN_PLUGIN_CLIENT_CONNECT_V2 when arguments->auth_handle is
+ * non-zero.  The client is held, with its control channel kept alive,
+ * until the result is written to auth_complete_fd.  Options for the
+ * client may be written beforehand to the file named by the
+ * environmental variable client_connect_config_file, which is read in
+ * the same way as a --client-connect script's config file.  Any
+ * return_list filled in by the deferring call is applied immediately.
+ *
  * If an OPENVPN_PLUGIN_ENABLE_PF handler is defined and returns success
  * for a particular client instance, packet filtering will be enabled for that
  * instance.  OpenVPN will then attempt to read the packet filter configuration
@@ -534,6 +602,24 @@ OPENVPN_PLUGIN_DEF int OPENVPN_PLUGIN_FUNC(openvpn_plugin_open_v3)
  *
  * OpenVPN will delete the auth_control_file after it goes out of scope.
  *
+ * A plug-in which set OPENVPN_PLUGIN_OPEN_ASYNC_AUTH at open time does
+ * not use auth_control_file (it is only created while some other
+ * plug-in still relies on it).  Instead it writes a struct
+ * openvpn_plugin_auth_result carrying arguments->auth_handle to the
+ * auth_complete_fd it was given by openvpn_plugin_open_v3().  OpenVPN
+ * waits on that descriptor in its event loop, so the result takes effect
+ * as soon as it is written.  Results which arrive after the deferred
+ * authentication window (--hand-window) has expired are ignored.
+ *
+ * The same plug-in may also return OPENVPN_PLUGIN_FUNC_DEFERRED from
+ * OPENVPN_PLUGIN_CLIENT_CONNECT_V2 when arguments->auth_handle is
+ * non-zero.  The client is held, with its control channel kept alive,
+ * until the result is written to auth_complete_fd.  Options for the
+ * client may be written beforehand to the file named by the
+ * environmental variable client_connect_config_file, which is read in
+ * the same way as a --client-connect script's config file.  Any
+ * return_list filled in by the deferring call is applied immediately.
+ *
  * If an OPENVPN_PLUGIN_ENABLE_PF handler is defined and returns success
  * for a particular client instance, packet filtering will be enabled for that
  * instance.  OpenVPN will then attempt to read the packet filter configuration
@@ -247,6 +247,9 @@ struct context_2
 # ifdef ENABLE_MANAGEMENT
 #  define MANAGEMENT_READ  (1<<6)
 #  define MANAGEMENT_WRITE (1<<7)
+# endif
+# ifdef PLUGIN_DEF_AUTH
+#  define PLUGIN_AUTH_READ (1<<8)
 # endif
 
   unsigned int event_set_status;
@@ -284,6 +287,9 @@ struct context_2
   counter_type link_read_bytes;
   counter_type link_read_bytes_auth;
   counter_type link_write_bytes;
+  counter_type link_read_packets;
+  counter_type link_write_packets;
+  counter_type link_read_drops;     /* packets failing authentication */
 #ifdef PACKET_TRUNCATION_CHECK
   counter_type n_trunc_tun_read;
   counter_type n_trunc_tun_write;
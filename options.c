@@ -188,6 +188,12 @@ static const char usage_message[] =
   "--tun-ipv6      : Build tun link capable of forwarding IPv6 traffic.\n"
 #ifdef CONFIG_FEATURE_IPROUTE
   "--iproute cmd   : Use this command instead of default " IPROUTE_PATH ".\n"
+#endif
+#if defined(TARGET_LINUX) && defined(ENABLE_RTNETLINK)
+  "--route-method m : Which method to use for adding routes and addresses?\n"
+  "                  adaptive (default) -- Try netlink then fall back to exe.\n"
+  "                  netlink -- Talk to the kernel over rtnetlink.\n"
+  "                  exe -- Run the ip/route/ifconfig commands.\n"
 #endif
   "--ifconfig l rn : TUN: configure device to use IP address l as a local\n"
   "                  endpoint and rn as a remote endpoint.  l & rn should be\n"
@@ -250,6 +256,8 @@ static const char usage_message[] =
   "                  1 -- (default) only call built-ins such as ifconfig\n"
   "                  2 -- allow calling of built-ins and scripts\n"
   "                  3 -- allow password to be passed to scripts via env\n"
+  "--script-helper [n] : Run scripts from a helper process forked at startup,\n"
+  "                  at most n of them (default=%d) in the background.\n"
   "--shaper n      : Restrict output to peer to n bytes per second.\n"
   "--keepalive n m : Helper option for setting timeouts in server mode.  Send\n"
   "                  ping once every n seconds, restart if ping not received\n"
@@ -291,6 +299,9 @@ static const char usage_message[] =
   "--fragment max  : Enable internal datagram fragmentation so that no UDP\n"
   "                  datagrams are sent which are larger than max bytes.\n"
   "                  Adds 4 bytes of overhead per datagram.\n"
+  "--fragment-buffers n : Share at most n packet buffers between all peers\n"
+  "                  for reassembling and sending fragmented datagrams\n"
+  "                  (default=1024).\n"
 #endif
   "--mssfix [n]    : Set upper bound on TCP MSS, default = tun-mtu size\n"
   "                  or --fragment max value, whichever is lower.\n"
@@ -345,7 +356,7 @@ static const char usage_message[] =
   "--mute n        : Log at most n consecutive messages in the same category.\n"
   "--status file n : Write operational status to file every n seconds.\n"
   "--status-version [n] : Choose the status file format version number.\n"
-  "                  Currently, n can be 1, 2, or 3 (default=1).\n"
+  "                  Currently, n can be 1, 2, 3, or 4 (default=1).\n"
 #ifdef ENABLE_OCC
   "--disable-occ   : Disable options consistency check between peers.\n"
 #endif
@@ -378,6 +389,7 @@ static const char usage_message[] =
   "--management-up-down : Report tunnel up/down events to management interface.\n"
   "--management-log-cache n : Cache n lines of log file history for usage\n"
   "                  by the management channel.\n"
+  "--management-max-clients n : Accept up to n management clients at a time.\n"
 #if UNIX_SOCK_SUPPORT
   "--management-client-user u  : When management interface is a unix socket, only\n"
   "                              allow connections from user u.\n"
@@ -447,23 +459,41 @@ static const char usage_message[] =
   "--no-name-remapping : Allow Common Name and X509 Subject to include\n"
   "                      any printable character.\n"
   "--client-to-client : Internally route client-to-client traffic.\n"
+  "--mcast-snooping : Learn multicast group membership from client IGMP/MLD\n"
+  "                  reports and send multicast only to group members.\n"
   "--duplicate-cn  : Allow multiple clients with the same common name to\n"
   "                  concurrently connect.\n"
   "--client-connect cmd : Run script cmd on client connection.\n"
   "--client-disconnect cmd : Run script cmd on client disconnection.\n"
+  "--client-script-async : Don't hold up other clients while the\n"
+  "                  --client-connect and --client-disconnect scripts run.\n"
   "--client-config-dir dir : Directory for custom client config files.\n"
   "--ccd-exclusive : Refuse connection unless custom client config is found.\n"
   "--tmp-dir dir   : Temporary directory, used for --client-connect return file and plugin communication.\n"
   "--hash-size r v : Set the size of the real address hash table to r and the\n"
   "                  virtual address table to v.\n"
   "--bcast-buffers n : Allocate n broadcast buffers.\n"
+  "--packet-buffers n [hugepages] : Preallocate a fixed pool of n buffers for\n"
+  "                  queued packets, optionally backed by huge pages.\n"
   "--tcp-queue-limit n : Maximum number of queued TCP output packets.\n"
   "--tcp-nodelay   : Macro that sets TCP_NODELAY socket flag on the server\n"
   "                  as well as pushes it to connecting clients.\n"
   "--learn-address cmd : Run script cmd to validate client virtual addresses.\n"
   "--connect-freq n s : Allow a maximum of n new connections per s seconds.\n"
+  "--connect-freq-source n s : Allow a maximum of n new connections per s\n"
+  "                  seconds from each source address prefix.\n"
+  "--control-freq-source n s : Allow a maximum of n control channel packets\n"
+  "                  per s seconds from each source address prefix.\n"
+  "--tls-auth-penalty s : Ignore new connections from a source address prefix\n"
+  "                  for s seconds after it fails the --tls-auth HMAC test.\n"
+  "                  Spoofed packets can lock out other sources, see the man page.\n"
+  "--source-prefix n [n6] : Group source addresses into IPv4 /n and\n"
+  "                  IPv6 /n6 prefixes for the above (default=32 64).\n"
   "--max-clients n : Allow a maximum of n simultaneously connected clients.\n"
   "--max-routes-per-client n : Allow a maximum of n internal routes per client.\n"
+  "--max-cached-routes n : Cache at most n host routes derived from --iroute\n"
+  "                  networks, evicting the least recently used (default=65536).\n"
+  "--max-cached-routes-per-client n : Cache at most n such routes per client.\n"
 #if PORT_SHARE
   "--port-share host port [dir] : When run in TCP mode, proxy incoming HTTPS\n"
   "                  sessions to a web server at host:port.  dir specifies an\n"
@@ -566,6 +596,8 @@ static const char usage_message[] =
   "                : Use --show-tls to see a list of supported TLS ciphers.\n"
   "--tls-timeout n : Packet retransmit timeout on TLS control channel\n"
   "                  if no ACK from remote within n seconds (default=%d).\n"
+  "--tls-window n  : Send up to n control channel packets before waiting for\n"
+  "                  their ACKs, and accept 2n out of order (default=4).\n"
   "--reneg-bytes n : Renegotiate data chan. key after n bytes sent and recvd.\n"
   "--reneg-pkts n  : Renegotiate data chan. key after n packets sent and recvd.\n"
   "--reneg-sec n   : Renegotiate data chan. key after n seconds (default=%d).\n"
@@ -734,7 +766,7 @@ init_options (struct options *o, const bool init_gc)
   CLEAR (*o);
   if (init_gc)
     {
-      gc_init (&o->gc);
+      gc_init_unchunked (&o->gc);
       o->gc_owned = true;
     }
   o->mode = MODE_POINT_TO_POINT;
@@ -763,6 +795,7 @@ init_options (struct options *o, const bool init_gc)
   o->management_log_history_cache = 250;
   o->management_echo_buffer_size = 100;
   o->management_state_buffer_size = 100;
+  o->management_max_clients = 1;
 #endif
 #ifdef TUNSETPERSIST
   o->persist_mode = 1;
@@ -773,6 +806,7 @@ init_options (struct options *o, const bool init_gc)
 #endif
 #ifdef TARGET_LINUX
   o->tuntap_options.txqueuelen = 100;
+  o->tuntap_options.route_method = ROUTE_METHOD_ADAPTIVE;
 #endif
 #ifdef WIN32
 #if 0
@@ -784,13 +818,19 @@ init_options (struct options *o, const bool init_gc)
   o->tuntap_options.dhcp_masq_offset = 0;       /* use network address as internal DHCP server address */
   o->route_method = ROUTE_METHOD_ADAPTIVE;
 #endif
+#ifdef ENABLE_FRAGMENT
+  o->n_fragment_buf = FRAG_POOL_DEFAULT_BUFFERS;
+#endif
 #if P2MP_SERVER
   o->real_hash_size = 256;
   o->virtual_hash_size = 256;
   o->n_bcast_buf = 256;
   o->tcp_queue_limit = 64;
   o->max_clients = 1024;
+  o->source_netbits = 32;
+  o->source_netbits_ipv6 = 64;
   o->max_routes_per_client = 256;
+  o->max_cached_routes = 65536;
   o->ifconfig_pool_persist_refresh_freq = 600;
 #endif
 #if P2MP
@@ -812,6 +852,7 @@ init_options (struct options *o, const bool init_gc)
 #ifdef USE_SSL
   o->key_method = 2;
   o->tls_timeout = 2;
+  o->tls_window = TLS_RELIABLE_N_SEND_BUFFERS;
   o->renegotiate_seconds = 3600;
   o->handshake_window = 60;
   o->transition_window = 3600;
@@ -1172,12 +1213,15 @@ show_p2mp_parms (const struct options *o)
   msg (D_SHOW_PARMS, "  ifconfig_ipv6_pool_base = %s", print_in6_addr (o->ifconfig_ipv6_pool_base, 0, &gc));
   SHOW_INT (ifconfig_ipv6_pool_netbits);
   SHOW_INT (n_bcast_buf);
+  SHOW_INT (n_packet_buf);
+  SHOW_BOOL (packet_buf_hugepages);
   SHOW_INT (tcp_queue_limit);
   SHOW_INT (real_hash_size);
   SHOW_INT (virtual_hash_size);
   SHOW_STR (client_connect_script);
   SHOW_STR (learn_address_script);
   SHOW_STR (client_disconnect_script);
+  SHOW_BOOL (client_script_async);
   SHOW_STR (client_config_dir);
   SHOW_BOOL (ccd_exclusive);
   SHOW_STR (tmp_dir);
@@ -1188,11 +1232,21 @@ show_p2mp_parms (const struct options *o)
   msg (D_SHOW_PARMS, "  push_ifconfig_ipv6_local = %s/%d", print_in6_addr (o->push_ifconfig_ipv6_local, 0, &gc), o->push_ifconfig_ipv6_netbits );
   msg (D_SHOW_PARMS, "  push_ifconfig_ipv6_remote = %s", print_in6_addr (o->push_ifconfig_ipv6_remote, 0, &gc));
   SHOW_BOOL (enable_c2c);
+  SHOW_BOOL (mcast_snooping);
   SHOW_BOOL (duplicate_cn);
   SHOW_INT (cf_max);
   SHOW_INT (cf_per);
+  SHOW_INT (cf_source_max);
+  SHOW_INT (cf_source_per);
+  SHOW_INT (ctl_source_max);
+  SHOW_INT (ctl_source_per);
+  SHOW_INT (tls_auth_penalty);
+  SHOW_INT (source_netbits);
+  SHOW_INT (source_netbits_ipv6);
   SHOW_INT (max_clients);
   SHOW_INT (max_routes_per_client);
+  SHOW_INT (max_cached_routes);
+  SHOW_INT (max_cached_routes_per_client);
   SHOW_STR (auth_user_pass_verify_script);
   SHOW_BOOL (auth_user_pass_verify_script_via_file);
 #if PORT_SHARE
@@ -1421,6 +1475,7 @@ show_settings (const struct options *o)
 
 #ifdef ENABLE_FRAGMENT
   SHOW_INT (fragment);
+  SHOW_INT (n_fragment_buf);
 #endif
 
   SHOW_INT (mtu_discover_type);
@@ -1464,6 +1519,7 @@ show_settings (const struct options *o)
 #endif
   SHOW_STR (writepid);
   SHOW_STR (up_script);
+  SHOW_INT (script_helper);
   SHOW_STR (down_script);
   SHOW_BOOL (down_pre);
   SHOW_BOOL (up_restart);
@@ -1523,6 +1579,7 @@ show_settings (const struct options *o)
   SHOW_STR (management_write_peer_info_file);
   SHOW_STR (management_client_user);
   SHOW_STR (management_client_group);
+  SHOW_INT (management_max_clients);
   SHOW_INT (management_flags);
 #endif
 #ifdef ENABLE_PLUGIN
@@ -1579,6 +1636,7 @@ show_settings (const struct options *o)
   SHOW_INT (ssl_flags);
 
   SHOW_INT (tls_timeout);
+  SHOW_INT (tls_window);
 
   SHOW_INT (renegotiate_bytes);
   SHOW_INT (renegotiate_packets);
@@ -1632,6 +1690,9 @@ show_settings (const struct options *o)
   SHOW_INT (route_method);
   show_tuntap_options (&o->tuntap_options);
 #endif
+#ifdef TARGET_LINUX
+  SHOW_INT (tuntap_options.route_method);
+#endif
 #endif
 }
 
@@ -1997,7 +2058,8 @@ options_postprocess_verify_ce (const struct options *options, const struct conne
   if (!options->management_addr &&
       (options->management_flags
        || options->management_write_peer_info_file
-       || options->management_log_history_cache != defaults.management_log_history_cache))
+       || options->management_log_history_cache != defaults.management_log_history_cache
+       || options->management_max_clients != defaults.management_max_clients))
     msg (M_USAGE, "--management is not specified, however one or more options which modify the behavior of --management were specified");
 
   if ((options->management_client_user || options->management_client_group)
@@ -2141,6 +2203,12 @@ options_postprocess_verify_ce (const struct options *options, const struct conne
 	     );
       if (!proto_is_udp(ce->proto) && (options->cf_max || options->cf_per))
 	msg (M_USAGE, "--connect-freq only works with --mode server --proto udp.  Try --max-clients instead.");
+      if (!proto_is_udp(ce->proto) && options->cf_source_max)
+	msg (M_USAGE, "--connect-freq-source only works with --mode server --proto udp.");
+      if (!proto_is_udp(ce->proto) && options->tls_auth_penalty)
+	msg (M_USAGE, "--tls-auth-penalty only works with --mode server --proto udp.");
+      if (options->tls_auth_penalty && !options->tls_auth_file)
+	msg (M_USAGE, "--tls-auth-penalty requires --tls-auth");
       if (!(dev == DEV_TYPE_TAP || (dev == DEV_TYPE_TUN && options->topology == TOP_SUBNET)) && options->ifconfig_pool_netmask)
 	msg (M_USAGE, "The third parameter to --ifconfig-pool (netmask) is only valid in --dev tap mode");
 #ifdef ENABLE_OCC
@@ -2202,14 +2270,20 @@ options_postprocess_verify_ce (const struct options *options, const struct conne
 	msg (M_USAGE, "--client-connect requires --mode server");
       if (options->client_disconnect_script)
 	msg (M_USAGE, "--client-disconnect requires --mode server");
+      if (options->client_script_async)
+	msg (M_USAGE, "--client-script-async requires --mode server");
       if (options->client_config_dir || options->ccd_exclusive)
 	msg (M_USAGE, "--client-config-dir/--ccd-exclusive requires --mode server");
       if (options->enable_c2c)
 	msg (M_USAGE, "--client-to-client requires --mode server");
+      if (options->mcast_snooping)
+	msg (M_USAGE, "--mcast-snooping requires --mode server");
       if (options->duplicate_cn)
 	msg (M_USAGE, "--duplicate-cn requires --mode server");
       if (options->cf_max || options->cf_per)
 	msg (M_USAGE, "--connect-freq requires --mode server");
+      if (options->cf_source_max || options->ctl_source_max || options->tls_auth_penalty)
+	msg (M_USAGE, "--connect-freq-source, --control-freq-source and --tls-auth-penalty require --mode server");
       if (options->ssl_flags & SSLF_CLIENT_CERT_NOT_REQUIRED)
 	msg (M_USAGE, "--client-cert-not-required requires --mode server");
       if (options->ssl_flags & SSLF_USERNAME_AS_COMMON_NAME)
@@ -2368,6 +2442,7 @@ options_postprocess_verify_ce (const struct options *options, const struct conne
       MUST_BE_UNDEF (tls_export_cert);
       MUST_BE_UNDEF (tls_remote);
       MUST_BE_UNDEF (tls_timeout);
+      MUST_BE_UNDEF (tls_window);
       MUST_BE_UNDEF (renegotiate_bytes);
       MUST_BE_UNDEF (renegotiate_packets);
       MUST_BE_UNDEF (renegotiate_seconds);
@@ -3192,6 +3267,7 @@ usage (void)
 	   title_string,
 	   o.ce.connect_retry_seconds,
 	   o.ce.local_port, o.ce.remote_port,
+	   SCRIPT_HELPER_MAX_RUNNING_DEFAULT,
 	   TUN_MTU_DEFAULT, TAP_MTU_EXTRA_DEFAULT,
 	   o.verbosity,
 	   o.authname, o.ciphername,
@@ -3203,6 +3279,7 @@ usage (void)
 	   title_string,
 	   o.ce.connect_retry_seconds,
 	   o.ce.local_port, o.ce.remote_port,
+	   SCRIPT_HELPER_MAX_RUNNING_DEFAULT,
 	   TUN_MTU_DEFAULT, TAP_MTU_EXTRA_DEFAULT,
 	   o.verbosity,
 	   o.authname, o.ciphername,
@@ -3212,6 +3289,7 @@ usage (void)
 	   title_string,
 	   o.ce.connect_retry_seconds,
 	   o.ce.local_port, o.ce.remote_port,
+	   SCRIPT_HELPER_MAX_RUNNING_DEFAULT,
 	   TUN_MTU_DEFAULT, TAP_MTU_EXTRA_DEFAULT,
 	   o.verbosity);
 #endif
@@ -4027,6 +4105,19 @@ add_option (struct options *options,
 	}
       options->management_log_history_cache = cache;
     }
+  else if (streq (p[0], "management-max-clients") && p[1])
+    {
+      int n;
+
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      n = atoi (p[1]);
+      if (n < 1 || n > MANAGEMENT_MAX_CLIENTS)
+	{
+	  msg (msglevel, "--management-max-clients must be between 1 and %d", MANAGEMENT_MAX_CLIENTS);
+	  goto err;
+	}
+      options->management_max_clients = n;
+    }
 #endif
 #ifdef ENABLE_PLUGIN
   else if (streq (p[0], "plugin") && p[1])
@@ -4097,6 +4188,10 @@ add_option (struct options *options,
     {
       VERIFY_PERMISSION (OPT_P_GENERAL);
       iproute_path = p[1];
+#ifdef TARGET_LINUX
+      /* a custom command replaces rtnetlink too */
+      options->tuntap_options.route_method = ROUTE_METHOD_EXE;
+#endif
     }
 #endif
   else if (streq (p[0], "ifconfig") && p[1] && p[2])
@@ -4490,9 +4585,9 @@ add_option (struct options *options,
 
       VERIFY_PERMISSION (OPT_P_GENERAL);
       version = atoi (p[1]);
-      if (version < 1 || version > 3)
+      if (version < 1 || version > 4)
 	{
-	  msg (msglevel, "--status-version must be 1 to 3");
+	  msg (msglevel, "--status-version must be 1 to 4");
 	  goto err;
 	}
       options->status_file_version = version;
@@ -4540,6 +4635,19 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_MTU);
       options->fragment = positive_atoi (p[1]);
     }
+  else if (streq (p[0], "fragment-buffers") && p[1])
+    {
+      int n_fragment_buf;
+
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      n_fragment_buf = atoi (p[1]);
+      if (n_fragment_buf < 1)
+	{
+	  msg (msglevel, "--fragment-buffers parameter must be > 0");
+	  goto err;
+	}
+      options->n_fragment_buf = n_fragment_buf;
+    }
 #endif
   else if (streq (p[0], "mtu-disc") && p[1])
     {
@@ -5133,6 +5241,20 @@ add_option (struct options *options,
       else
 	script_method = SM_EXECVE;
     }
+  else if (streq (p[0], "script-helper"))
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->script_helper = SCRIPT_HELPER_MAX_RUNNING_DEFAULT;
+      if (p[1])
+	{
+	  options->script_helper = positive_atoi (p[1]);
+	  if (options->script_helper < 1)
+	    {
+	      msg (msglevel, "--script-helper parameter must be at least 1");
+	      goto err;
+	    }
+	}
+    }
   else if (streq (p[0], "mssfix"))
     {
       VERIFY_PERMISSION (OPT_P_GENERAL);
@@ -5345,6 +5467,58 @@ add_option (struct options *options,
       options->cf_max = cf_max;
       options->cf_per = cf_per;
     }
+  else if ((streq (p[0], "connect-freq-source") || streq (p[0], "control-freq-source")) && p[1] && p[2])
+    {
+      int n, sec;
+
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      n = atoi (p[1]);
+      sec = atoi (p[2]);
+      if (n < 1 || n > 65535 || sec < 1 || sec > 3600)
+	{
+	  msg (msglevel, "--%s parms must be n=1..65535 and sec=1..3600", p[0]);
+	  goto err;
+	}
+      if (streq (p[0], "connect-freq-source"))
+	{
+	  options->cf_source_max = n;
+	  options->cf_source_per = sec;
+	}
+      else
+	{
+	  options->ctl_source_max = n;
+	  options->ctl_source_per = sec;
+	}
+    }
+  else if (streq (p[0], "tls-auth-penalty") && p[1])
+    {
+      int sec;
+
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      sec = atoi (p[1]);
+      if (sec < 0 || sec > 86400)
+	{
+	  msg (msglevel, "--tls-auth-penalty parameter must be between 0 and 86400");
+	  goto err;
+	}
+      options->tls_auth_penalty = sec;
+    }
+  else if (streq (p[0], "source-prefix") && p[1])
+    {
+      int bits, bits6 = options->source_netbits_ipv6;
+
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      bits = atoi (p[1]);
+      if (p[2])
+	bits6 = atoi (p[2]);
+      if (bits < 1 || bits > 32 || bits6 < 1 || bits6 > 128)
+	{
+	  msg (msglevel, "--source-prefix parms must be 1..32 and 1..128");
+	  goto err;
+	}
+      options->source_netbits = bits;
+      options->source_netbits_ipv6 = bits6;
+    }
   else if (streq (p[0], "max-clients") && p[1])
     {
       int max_clients;
@@ -5363,6 +5537,16 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_INHERIT);
       options->max_routes_per_client = max_int (atoi (p[1]), 1);
     }
+  else if (streq (p[0], "max-cached-routes") && p[1])
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->max_cached_routes = max_int (atoi (p[1]), 1);
+    }
+  else if (streq (p[0], "max-cached-routes-per-client") && p[1])
+    {
+      VERIFY_PERMISSION (OPT_P_INHERIT);
+      options->max_cached_routes_per_client = max_int (atoi (p[1]), 1);
+    }
   else if (streq (p[0], "client-cert-not-required"))
     {
       VERIFY_PERMISSION (OPT_P_GENERAL);
@@ -5429,6 +5613,11 @@ add_option (struct options *options,
       warn_multiple_script (options->client_disconnect_script, "client-disconnect");
       options->client_disconnect_script = p[1];
     }
+  else if (streq (p[0], "client-script-async"))
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->client_script_async = true;
+    }
   else if (streq (p[0], "learn-address") && p[1])
     {
       VERIFY_PERMISSION (OPT_P_SCRIPT);
@@ -5462,6 +5651,29 @@ add_option (struct options *options,
 	msg (msglevel, "--bcast-buffers parameter must be > 0");
       options->n_bcast_buf = n_bcast_buf;
     }
+  else if (streq (p[0], "packet-buffers") && p[1])
+    {
+      int n_packet_buf;
+
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      n_packet_buf = atoi (p[1]);
+      if (n_packet_buf < 1)
+	{
+	  msg (msglevel, "--packet-buffers parameter must be > 0");
+	  goto err;
+	}
+      options->n_packet_buf = n_packet_buf;
+      if (p[2])
+	{
+	  if (streq (p[2], "hugepages"))
+	    options->packet_buf_hugepages = true;
+	  else
+	    {
+	      msg (msglevel, "--packet-buffers: unknown flag '%s'", p[2]);
+	      goto err;
+	    }
+	}
+    }
   else if (streq (p[0], "tcp-queue-limit") && p[1])
     {
       int tcp_queue_limit;
@@ -5495,6 +5707,11 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_GENERAL);
       options->enable_c2c = true;
     }
+  else if (streq (p[0], "mcast-snooping"))
+    {
+      VERIFY_PERMISSION (OPT_P_GENERAL);
+      options->mcast_snooping = true;
+    }
   else if (streq (p[0], "duplicate-cn"))
     {
       VERIFY_PERMISSION (OPT_P_GENERAL);
@@ -5901,11 +6118,33 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_IPWIN32);
       foreign_option (options, p, 3, es);
     }
+#ifdef TARGET_LINUX
+  else if (streq (p[0], "route-method") && p[1])
+    {
+      VERIFY_PERMISSION (OPT_P_ROUTE_EXTRAS);
+      if (pull_mode)
+	; /* ignore when pushed, servers push this for Windows clients */
+      else if (streq (p[1], "adaptive"))
+	options->tuntap_options.route_method = ROUTE_METHOD_ADAPTIVE;
+#ifdef ENABLE_RTNETLINK
+      else if (streq (p[1], "netlink"))
+	options->tuntap_options.route_method = ROUTE_METHOD_NETLINK;
+#endif
+      else if (streq (p[1], "exe"))
+	options->tuntap_options.route_method = ROUTE_METHOD_EXE;
+      else
+	{
+	  msg (msglevel, "--route method must be 'adaptive', 'netlink', or 'exe'");
+	  goto err;
+	}
+    }
+#else
   else if (streq (p[0], "route-method") && p[1]) /* ignore when pushed to non-Windows OS */
     {
       VERIFY_PERMISSION (OPT_P_ROUTE_EXTRAS);
     }
 #endif
+#endif
 #if PASSTOS_CAPABILITY
   else if (streq (p[0], "passtos"))
     {
@@ -6372,6 +6611,19 @@ add_option (struct options *options,
       VERIFY_PERMISSION (OPT_P_TLS_PARMS);
       options->tls_timeout = positive_atoi (p[1]);
     }
+  else if (streq (p[0], "tls-window") && p[1])
+    {
+      int n;
+
+      VERIFY_PERMISSION (OPT_P_TLS_PARMS);
+      n = atoi (p[1]);
+      if (n < 1 || n > TLS_RELIABLE_MAX_WINDOW)
+	{
+	  msg (msglevel, "--tls-window must be between 1 and %d", TLS_RELIABLE_MAX_WINDOW);
+	  goto err;
+	}
+      options->tls_window = n;
+    }
   else if (streq (p[0], "reneg-bytes") && p[1])
     {
       VERIFY_PERMISSION (OPT_P_TLS_PARMS);
@@ -239,6 +239,7 @@ struct options
 #endif
 
   int fragment;                 /* internal fragmentation size */
+  int n_fragment_buf;           /* max buffers shared for fragmented packets */
 
   bool mlock;
 
@@ -289,6 +290,7 @@ struct options
   const char *writepid;
   const char *up_script;
   const char *down_script;
+  int script_helper;            /* max scripts the helper runs in the background, 0 if disabled */
   bool down_pre;
   bool up_delay;
   bool up_restart;
@@ -363,6 +365,7 @@ struct options
 
   const char *management_client_user;
   const char *management_client_group;
+  int management_max_clients;
 
   /* Mask of MF_ values of manage.h */
   unsigned int management_flags;
@@ -413,11 +416,14 @@ struct options
   int virtual_hash_size;
   const char *client_connect_script;
   const char *client_disconnect_script;
+  bool client_script_async;
   const char *learn_address_script;
   const char *client_config_dir;
   bool ccd_exclusive;
   bool disable;
   int n_bcast_buf;
+  int n_packet_buf;
+  bool packet_buf_hugepages;
   int tcp_queue_limit;
   struct iroute *iroutes;
   struct iroute_ipv6 *iroutes_ipv6;			/* IPv6 */
@@ -435,11 +441,21 @@ struct options
   int 		  push_ifconfig_ipv6_netbits;		/* IPv6 */
   struct in6_addr push_ifconfig_ipv6_remote;		/* IPv6 */
   bool enable_c2c;
+  bool mcast_snooping;
   bool duplicate_cn;
   int cf_max;
   int cf_per;
+  int cf_source_max;
+  int cf_source_per;
+  int ctl_source_max;
+  int ctl_source_per;
+  int tls_auth_penalty;
+  int source_netbits;
+  int source_netbits_ipv6;
   int max_clients;
   int max_routes_per_client;
+  int max_cached_routes;
+  int max_cached_routes_per_client;
 
   const char *auth_user_pass_verify_script;
   bool auth_user_pass_verify_script_via_file;
@@ -537,6 +553,9 @@ struct options
   /* Per-packet timeout on control channel */
   int tls_timeout;
 
+  /* Control channel packets sent before waiting for ACKs */
+  int tls_window;
+
   /* Data channel key renegotiation parameters */
   int renegotiate_bytes;
   int renegotiate_packets;
@@ -640,6 +659,8 @@ struct options
 
 #ifdef WIN32
 #define ROUTE_OPTION_FLAGS(o) ((o)->route_method & ROUTE_METHOD_MASK)
+#elif defined(TARGET_LINUX)
+#define ROUTE_OPTION_FLAGS(o) ((o)->tuntap_options.route_method & ROUTE_METHOD_MASK)
 #else
 #define ROUTE_OPTION_FLAGS(o) (0)
 #endif
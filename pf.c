@@ -29,11 +29,72 @@
 #if defined(ENABLE_PF)
 
 #include "init.h"
+#include "fdmisc.h"
 
 #include "memdbg.h"
 
 #include "pf-inline.h"
 
+/*
+ * Bumped whenever a client's packet filter changes or a client
+ * comes or goes, so that cached filter decisions can be revalidated.
+ */
+static unsigned int pf_generation; /* GLOBAL */
+
+unsigned int
+pf_rules_generation (void)
+{
+  return pf_generation;
+}
+
+void
+pf_c2c_invalidate (void)
+{
+  ++pf_generation;
+}
+
+/*
+ * Client slot numbers, which index the c2c decision caches.
+ * Freed slots are reused first to keep the caches small.
+ */
+static int *pf_free_slots;       /* GLOBAL */
+static int pf_n_free_slots;      /* GLOBAL */
+static int pf_free_slots_size;   /* GLOBAL */
+static int pf_n_slots;           /* GLOBAL */
+
+static int
+pf_slot_alloc (void)
+{
+  if (pf_n_free_slots > 0)
+    return pf_free_slots[--pf_n_free_slots];
+  return ++pf_n_slots;
+}
+
+static void
+pf_slot_release (const int slot)
+{
+  if (pf_n_free_slots == pf_free_slots_size)
+    {
+      int *s;
+      const int size = pf_free_slots_size ? pf_free_slots_size * 2 : 64;
+      ALLOC_ARRAY (s, int, size);
+      if (pf_n_free_slots)
+	memcpy (s, pf_free_slots, pf_n_free_slots * sizeof (int));
+      free (pf_free_slots);
+      pf_free_slots = s;
+      pf_free_slots_size = size;
+    }
+  pf_free_slots[pf_n_free_slots++] = slot;
+
+  /* all slots returned? */
+  if (pf_n_free_slots == pf_n_slots)
+    {
+      free (pf_free_slots);
+      pf_free_slots = NULL;
+      pf_n_free_slots = pf_free_slots_size = pf_n_slots = 0;
+    }
+}
+
 static void
 pf_destroy (struct pf_set *pfs)
 {
@@ -61,6 +122,8 @@ pf_destroy (struct pf_set *pfs)
 	    l = next;
 	  }
       }
+      free (pfs->sns.rules);
+      free (pfs->sns.trie);
       free (pfs);
     }
 }
@@ -168,6 +231,60 @@ genhash (struct pf_cn_set *cns, const char *prefix, const int n_clients)
   return status;
 }
 
+/*
+ * Compile the subnet rules into a binary trie over the address
+ * bits, in which each prefix node records the first rule for that
+ * prefix.  The first matching rule of the list is then the lowest
+ * rule index seen on the path of at most 32 nodes for the address.
+ */
+static void
+pf_subnet_compile (struct pf_subnet_set *sns, const int n_subnets)
+{
+  struct pf_subnet_node *trie;
+  struct pf_subnet *e;
+  int n_nodes = 1;
+  int i = 0;
+
+  if (!n_subnets)
+    return;
+
+  ALLOC_ARRAY (sns->rules, struct ipv4_subnet *, n_subnets);
+  ALLOC_ARRAY (trie, struct pf_subnet_node, 1 + 32 * n_subnets);
+  CLEAR (trie[0]);
+  trie[0].rule = -1;
+
+  for (e = sns->list; e != NULL; e = e->next, ++i)
+    {
+      const in_addr_t network = e->rule.network;
+      int netbits = 0;
+      int node = 0;
+      int bit;
+
+      while (netbits < 32 && (e->rule.netmask & (0x80000000u >> netbits)))
+	++netbits;
+
+      sns->rules[i] = &e->rule;
+      for (bit = 0; bit < netbits; ++bit)
+	{
+	  const int b = (network >> (31 - bit)) & 1;
+	  if (!trie[node].child[b])
+	    {
+	      CLEAR (trie[n_nodes]);
+	      trie[n_nodes].rule = -1;
+	      trie[node].child[b] = n_nodes++;
+	    }
+	  node = trie[node].child[b];
+	}
+      if (trie[node].rule < 0)
+	trie[node].rule = i;
+    }
+
+  ALLOC_ARRAY (sns->trie, struct pf_subnet_node, n_nodes);
+  memcpy (sns->trie, trie, n_nodes * sizeof (struct pf_subnet_node));
+  sns->n_trie_nodes = n_nodes;
+  free (trie);
+}
+
 static struct pf_set *
 pf_init (const struct buffer_list *bl, const char *prefix, const bool allow_kill)
 {
@@ -281,6 +398,7 @@ pf_init (const struct buffer_list *bl, const char *prefix, const bool allow_kill
 	{
 	  if (!genhash (&pfs->cns, prefix, n_clients))
 	    ++n_errors;
+	  pf_subnet_compile (&pfs->sns, n_subnets);
 	}
       if (n_errors)
 	msg (D_PF_INFO, "PF: %s rejected due to %d error(s)", prefix, n_errors);
@@ -299,6 +417,84 @@ pf_init (const struct buffer_list *bl, const char *prefix, const bool allow_kill
   return pfs;
 }
 
+/*
+ * Rule sets are interned by their text, so that the many clients
+ * which usually share a handful of policies also share one parsed
+ * and compiled copy of each.
+ */
+static struct hash *pf_sets; /* GLOBAL */
+
+static char *
+pf_set_key (const struct buffer_list *bl, const bool allow_kill)
+{
+  const struct buffer_entry *be;
+  size_t len = 2;
+  char *key;
+  char *p;
+
+  for (be = bl->head; be != NULL; be = be->next)
+    len += strlen (BSTR (&be->buf)) + 1;
+
+  key = (char *) malloc (len);
+  check_malloc_return (key);
+  p = key;
+  *p++ = allow_kill ? 'K' : '-';
+  for (be = bl->head; be != NULL; be = be->next)
+    {
+      const size_t n = strlen (BSTR (&be->buf));
+      memcpy (p, BSTR (&be->buf), n);
+      p += n;
+      *p++ = '\n';
+    }
+  *p = '\0';
+  return key;
+}
+
+static struct pf_set *
+pf_set_acquire (const struct buffer_list *bl, const char *prefix, const bool allow_kill)
+{
+  char *key = pf_set_key (bl, allow_kill);
+  struct pf_set *pfs;
+
+  if (!pf_sets)
+    pf_sets = hash_init (64, 0, cn_hash_function, cn_compare_function);
+
+  pfs = (struct pf_set *) hash_lookup (pf_sets, key);
+  if (pfs)
+    {
+      ++pfs->refcount;
+      free (key);
+      return pfs;
+    }
+
+  pfs = pf_init (bl, prefix, allow_kill);
+  if (pfs)
+    {
+      pfs->refcount = 1;
+      pfs->key = key;
+      hash_add (pf_sets, pfs->key, pfs, false);
+    }
+  else
+    free (key);
+  return pfs;
+}
+
+static void
+pf_set_release (struct pf_set *pfs)
+{
+  if (pfs && --pfs->refcount <= 0)
+    {
+      hash_remove (pf_sets, pfs->key);
+      free (pfs->key);
+      pf_destroy (pfs);
+      if (!hash_n_elements (pf_sets))
+	{
+	  hash_free (pf_sets);
+	  pf_sets = NULL;
+	}
+    }
+}
+
 #ifdef PLUGIN_PF
 static struct pf_set *
 pf_init_from_file (const char *fn)
@@ -306,7 +502,7 @@ pf_init_from_file (const char *fn)
   struct buffer_list *bl = buffer_list_file (fn, PF_MAX_LINE_LEN);
   if (bl)
     {
-      struct pf_set *pfs = pf_init (bl, fn, true);
+      struct pf_set *pfs = pf_set_acquire (bl, fn, true);
       buffer_list_free (bl);
       return pfs;
     }
@@ -449,6 +645,108 @@ pf_cn_test (struct pf_set *pfs, const struct tls_multi *tm, const int type, cons
   return false;
 }
 
+static inline bool
+pf_c2c_test_uncached (const struct context *src, const struct context *dest, const char *prefix)
+{
+  return  (!src->c2.pf.enabled  || pf_cn_test (src->c2.pf.pfs,  dest->c2.tls_multi, PCT_DEST, prefix))
+       && (!dest->c2.pf.enabled || pf_cn_test (dest->c2.pf.pfs, src->c2.tls_multi,  PCT_SRC,  prefix));
+}
+
+static void
+pf_c2c_cache_grow (struct pf_c2c_cache *cache, const int slot)
+{
+  const int n_slots = (slot + 64) & ~63;
+  const int old_bytes = cache->n_slots / 8;
+  const int bytes = n_slots / 8;
+  uint8_t *known;
+  uint8_t *allow;
+
+  ALLOC_ARRAY_CLEAR (known, uint8_t, bytes);
+  ALLOC_ARRAY_CLEAR (allow, uint8_t, bytes);
+  if (old_bytes)
+    {
+      memcpy (known, cache->known, old_bytes);
+      memcpy (allow, cache->allow, old_bytes);
+    }
+  free (cache->known);
+  free (cache->allow);
+  cache->known = known;
+  cache->allow = allow;
+  cache->n_slots = n_slots;
+}
+
+/*
+ * Test whether src may send to dest, remembering the decision in
+ * src's per-receiver bitset until any filter changes or any client
+ * comes or goes.
+ */
+bool
+pf_c2c_test_dowork (const struct context *src, const struct context *dest, const char *prefix)
+{
+  struct pf_c2c_cache *cache = src->c2.pf.c2c;
+  const int slot = dest->c2.pf.slot - 1;
+  uint8_t mask;
+  bool allow;
+
+  /* keep the per-decision debug output */
+  if (!cache || slot < 0
+#ifdef ENABLE_DEBUG
+      || check_debug_level (D_PF_DEBUG)
+#endif
+      )
+    return pf_c2c_test_uncached (src, dest, prefix);
+
+  if (cache->generation != pf_generation)
+    {
+      if (cache->n_slots)
+	memset (cache->known, 0, cache->n_slots / 8);
+      cache->generation = pf_generation;
+    }
+  if (slot >= cache->n_slots)
+    pf_c2c_cache_grow (cache, slot);
+
+  mask = 1 << (slot & 7);
+  if (cache->known[slot >> 3] & mask)
+    return (cache->allow[slot >> 3] & mask) != 0;
+
+  allow = pf_c2c_test_uncached (src, dest, prefix);
+  cache->known[slot >> 3] |= mask;
+  if (allow)
+    cache->allow[slot >> 3] |= mask;
+  else
+    cache->allow[slot >> 3] &= ~mask;
+  return allow;
+}
+
+/*
+ * Return the index of the first subnet rule matching addr, or -1.
+ */
+static inline int
+pf_subnet_lookup (const struct pf_subnet_set *sns, const in_addr_t addr)
+{
+  const struct pf_subnet_node *trie = sns->trie;
+  int best = -1;
+
+  if (trie)
+    {
+      int node = 0;
+      int bit = 0;
+      while (true)
+	{
+	  const int r = trie[node].rule;
+	  if (r >= 0 && (best < 0 || r < best))
+	    best = r;
+	  if (bit == 32)
+	    break;
+	  node = trie[node].child[(addr >> (31 - bit)) & 1];
+	  if (!node)
+	    break;
+	  ++bit;
+	}
+    }
+  return best;
+}
+
 bool
 pf_addr_test_dowork (const struct context *src, const struct mroute_addr *dest, const char *prefix)
 {
@@ -456,18 +754,15 @@ pf_addr_test_dowork (const struct context *src, const struct mroute_addr *dest,
   if (pfs && !pfs->kill)
     {
       const in_addr_t addr = in_addr_t_from_mroute_addr (dest);
-      const struct pf_subnet *se = pfs->sns.list;
-      while (se)
+      const int r = pf_subnet_lookup (&pfs->sns, addr);
+      if (r >= 0)
 	{
-	  if ((addr & se->rule.netmask) == se->rule.network)
-	    {
+	  const struct ipv4_subnet *rule = pfs->sns.rules[r];
 #ifdef ENABLE_DEBUG
-	      if (check_debug_level (D_PF_DEBUG))
-		pf_addr_test_print ("PF_ADDR_MATCH", prefix, src, dest, !se->rule.exclude, &se->rule);
+	  if (check_debug_level (D_PF_DEBUG))
+	    pf_addr_test_print ("PF_ADDR_MATCH", prefix, src, dest, !rule->exclude, rule);
 #endif
-	      return !se->rule.exclude;
-	    }
-	  se = se->next;
+	  return !rule->exclude;
 	}
 #ifdef ENABLE_DEBUG
       if (check_debug_level (D_PF_DEBUG))
@@ -485,6 +780,190 @@ pf_addr_test_dowork (const struct context *src, const struct mroute_addr *dest,
     }
 }
 
+#if defined(PLUGIN_PF) && defined(HAVE_SYS_INOTIFY_H)
+
+/*
+ * Rather than stat() every client's pf file on a timer, watch the
+ * directories holding them with inotify and only look at the files
+ * which were written.
+ */
+struct pf_notify_dir {
+  struct pf_notify_dir *next;
+  int wd;
+  char *dir;
+};
+
+static int pf_notify_fd = -1;              /* GLOBAL */
+static struct pf_notify_dir *pf_notify_dirs; /* GLOBAL */
+static struct hash *pf_notify_files;       /* GLOBAL: pf file name -> struct pf_context */
+static time_t pf_notify_last_poll;         /* GLOBAL */
+
+static void
+pf_notify_mark (const char *fn)
+{
+  struct pf_context *pfc = (struct pf_context *) hash_lookup (pf_notify_files, fn);
+  if (pfc)
+    pfc->notified = true;
+}
+
+static void
+pf_notify_mark_all (void)
+{
+  struct hash_iterator hi;
+  struct hash_element *he;
+
+  hash_iterator_init (pf_notify_files, &hi);
+  while ((he = hash_iterator_next (&hi)))
+    ((struct pf_context *) he->value)->notified = true;
+  hash_iterator_free (&hi);
+}
+
+/*
+ * Drain pending inotify events, at most once per second.
+ */
+static void
+pf_notify_poll (void)
+{
+  union {
+    struct inotify_event ev;
+    char buf[4096];
+  } u;
+  ssize_t len;
+
+  if (pf_notify_fd < 0 || pf_notify_last_poll == now)
+    return;
+  pf_notify_last_poll = now;
+
+  while ((len = read (pf_notify_fd, u.buf, sizeof (u.buf))) > 0)
+    {
+      char *p = u.buf;
+      while (p + sizeof (struct inotify_event) <= u.buf + len)
+	{
+	  const struct inotify_event *ev = (const struct inotify_event *) p;
+
+	  if (ev->mask & IN_Q_OVERFLOW)
+	    pf_notify_mark_all ();
+	  else if (ev->len)
+	    {
+	      const struct pf_notify_dir *d;
+	      for (d = pf_notify_dirs; d != NULL; d = d->next)
+		{
+		  if (d->wd == ev->wd)
+		    {
+		      struct gc_arena gc = gc_new ();
+		      struct buffer fn = alloc_buf_gc (strlen (d->dir) + ev->len + 2, &gc);
+		      buf_printf (&fn, "%s/%s", d->dir, ev->name);
+		      pf_notify_mark (BSTR (&fn));
+		      gc_free (&gc);
+		      break;
+		    }
+		}
+	    }
+	  p += sizeof (struct inotify_event) + ev->len;
+	}
+    }
+}
+
+static void
+pf_notify_close (void)
+{
+  while (pf_notify_dirs)
+    {
+      struct pf_notify_dir *next = pf_notify_dirs->next;
+      free (pf_notify_dirs->dir);
+      free (pf_notify_dirs);
+      pf_notify_dirs = next;
+    }
+  if (pf_notify_fd >= 0)
+    {
+      close (pf_notify_fd);
+      pf_notify_fd = -1;
+    }
+  if (pf_notify_files)
+    {
+      hash_free (pf_notify_files);
+      pf_notify_files = NULL;
+    }
+}
+
+/*
+ * Start watching the pf file of pfc.  On failure the
+ * caller falls back to polling the file.
+ */
+static void
+pf_notify_add (struct pf_context *pfc)
+{
+  struct gc_arena gc = gc_new ();
+  const struct pf_notify_dir *d;
+  char *path = string_alloc (pfc->filename, &gc);
+  const char *dir = path;
+  char *slash = strrchr (path, '/');
+
+  if (pf_notify_fd < 0)
+    {
+      pf_notify_fd = inotify_init ();
+      if (pf_notify_fd < 0)
+	{
+	  msg (D_PF_INFO|M_ERRNO, "PF: inotify_init failed, polling pf files");
+	  goto done;
+	}
+      set_nonblock (pf_notify_fd);
+      set_cloexec (pf_notify_fd);
+      pf_notify_files = hash_init (64, 0, cn_hash_function, cn_compare_function);
+    }
+
+  if (slash)
+    *slash = '\0';
+  else
+    dir = ".";
+
+  for (d = pf_notify_dirs; d != NULL; d = d->next)
+    if (!strcmp (d->dir, dir))
+      break;
+
+  if (!d)
+    {
+      struct pf_notify_dir *nd;
+      const int wd = inotify_add_watch (pf_notify_fd, dir, IN_CLOSE_WRITE|IN_MOVED_TO);
+      if (wd < 0)
+	{
+	  msg (D_PF_INFO|M_ERRNO, "PF: cannot watch %s, polling pf files", dir);
+	  goto done;
+	}
+      ALLOC_OBJ_CLEAR (nd, struct pf_notify_dir);
+      nd->wd = wd;
+      nd->dir = string_alloc (dir, NULL);
+      nd->next = pf_notify_dirs;
+      pf_notify_dirs = nd;
+    }
+
+  if (hash_add (pf_notify_files, pfc->filename, pfc, false))
+    {
+      pfc->notify = true;
+      /* the plugin may have written the file before we watched it */
+      pfc->notified = true;
+    }
+
+ done:
+  if (pf_notify_files && !hash_n_elements (pf_notify_files))
+    pf_notify_close ();
+  gc_free (&gc);
+}
+
+static void
+pf_notify_del (struct pf_context *pfc)
+{
+  if (pfc->notify)
+    {
+      hash_remove (pf_notify_files, pfc->filename);
+      pfc->notify = false;
+      if (!hash_n_elements (pf_notify_files))
+	pf_notify_close ();
+    }
+}
+
+#endif
+
 #ifdef PLUGIN_PF
 void
 pf_check_reload (struct context *c)
@@ -499,16 +978,27 @@ pf_check_reload (struct context *c)
       && event_timeout_trigger (&c->c2.pf.reload, &c->c2.timeval, ETT_DEFAULT))
     {
       struct stat s;
-      if (!stat (c->c2.pf.filename, &s))
+      bool check = true;
+      bool written = false;
+
+#ifdef HAVE_SYS_INOTIFY_H
+      if (c->c2.pf.notify)
+	{
+	  pf_notify_poll ();
+	  check = written = c->c2.pf.notified;
+	  c->c2.pf.notified = false;
+	}
+#endif
+      if (check && !stat (c->c2.pf.filename, &s))
 	{
-	  if (s.st_mtime > c->c2.pf.file_last_mod)
+	  if (written || s.st_mtime > c->c2.pf.file_last_mod)
 	    {
 	      struct pf_set *pfs = pf_init_from_file (c->c2.pf.filename);
 	      if (pfs)
 		{
-		  if (c->c2.pf.pfs)
-		    pf_destroy (c->c2.pf.pfs);
+		  pf_set_release (c->c2.pf.pfs);
 		  c->c2.pf.pfs = pfs;
+		  ++pf_generation;
 		  reloaded = true;
 		  if (pf_kill_test (pfs))
 		    {
@@ -539,12 +1029,12 @@ pf_check_reload (struct context *c)
 bool
 pf_load_from_buffer_list (struct context *c, const struct buffer_list *config)
 {
-  struct pf_set *pfs = pf_init (config, "[SERVER-PF]", false);
+  struct pf_set *pfs = pf_set_acquire (config, "[SERVER-PF]", false);
   if (pfs)
     {
-      if (c->c2.pf.pfs)
-	pf_destroy (c->c2.pf.pfs);
+      pf_set_release (c->c2.pf.pfs);
       c->c2.pf.pfs = pfs;
+      ++pf_generation;
       return true;
     }
   else
@@ -556,6 +1046,11 @@ void
 pf_init_context (struct context *c)
 {
   struct gc_arena gc = gc_new ();
+
+  c->c2.pf.slot = pf_slot_alloc ();
+  ALLOC_OBJ_CLEAR (c->c2.pf.c2c, struct pf_c2c_cache);
+  ++pf_generation;
+
 #ifdef PLUGIN_PF
   if (plugin_defined (c->plugins, OPENVPN_PLUGIN_ENABLE_PF))
     {
@@ -568,6 +1063,9 @@ pf_init_context (struct context *c)
             event_timeout_init (&c->c2.pf.reload, 1, now);
             c->c2.pf.filename = string_alloc (pf_file, NULL);
             c->c2.pf.enabled = true;
+#ifdef HAVE_SYS_INOTIFY_H
+            pf_notify_add (&c->c2.pf);
+#endif
 #ifdef ENABLE_DEBUG
             if (check_debug_level (D_PF_DEBUG))
               pf_context_print (&c->c2.pf, "pf_init_context#1", D_PF_DEBUG);
@@ -599,12 +1097,28 @@ pf_destroy_context (struct pf_context *pfc)
 #ifdef PLUGIN_PF
   if (pfc->filename)
     {
+#ifdef HAVE_SYS_INOTIFY_H
+      pf_notify_del (pfc);
+#endif
       delete_file (pfc->filename);
       free (pfc->filename);
     }
 #endif
-  if (pfc->pfs)
-    pf_destroy (pfc->pfs);
+  pf_set_release (pfc->pfs);
+  pfc->pfs = NULL;
+  if (pfc->c2c)
+    {
+      free (pfc->c2c->known);
+      free (pfc->c2c->allow);
+      free (pfc->c2c);
+      pfc->c2c = NULL;
+    }
+  if (pfc->slot)
+    {
+      pf_slot_release (pfc->slot);
+      pfc->slot = 0;
+    }
+  ++pf_generation;
 }
 
 #ifdef ENABLE_DEBUG
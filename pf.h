@@ -45,9 +45,23 @@ struct pf_subnet {
   struct ipv4_subnet rule;
 };
 
+/*
+ * Node of the binary prefix trie that subnet rules are
+ * compiled into, see pf_subnet_compile().
+ */
+struct pf_subnet_node {
+  int child[2];                  /* index of child node, 0 if none */
+  int rule;                      /* index of first rule for this prefix, or -1 */
+};
+
 struct pf_subnet_set {
   bool default_allow;
   struct pf_subnet *list;
+
+  /* compiled form of list */
+  struct ipv4_subnet **rules;    /* rules of list, in order */
+  struct pf_subnet_node *trie;   /* root at index 0 */
+  int n_trie_nodes;
 };
 
 struct pf_cn {
@@ -67,17 +81,34 @@ struct pf_cn_set {
 };
 
 struct pf_set {
+  int refcount;                  /* interned sets are shared, see pf_set_acquire() */
+  char *key;                     /* rule text the set was parsed from */
   bool kill;
   struct pf_subnet_set sns;
   struct pf_cn_set cns;
 };
 
+/*
+ * Client-to-client decisions of one sender, cached
+ * by the slot number of the receiving client.
+ */
+struct pf_c2c_cache {
+  unsigned int generation;       /* pf_generation when bits were valid */
+  int n_slots;
+  uint8_t *known;                /* decision for slot is cached */
+  uint8_t *allow;                /* cached decision */
+};
+
 struct pf_context {
   bool enabled;
+  int slot;                      /* 1-based client slot number, 0 if none */
+  struct pf_c2c_cache *c2c;
   struct pf_set *pfs;
 #ifdef PLUGIN_PF
   char *filename;
   time_t file_last_mod;
+  bool notify;                   /* filename is watched by inotify */
+  bool notified;                 /* filename was written since last check */
   unsigned int n_check_reload;
   struct event_timeout reload;
 #endif
@@ -87,6 +118,14 @@ void pf_init_context (struct context *c);
 
 void pf_destroy_context (struct pf_context *pfc);
 
+unsigned int pf_rules_generation (void);
+
+/*
+ * Forget cached client-to-client decisions, e.g. because
+ * a client's common name has become known.
+ */
+void pf_c2c_invalidate (void);
+
 #ifdef PLUGIN_PF
 void pf_check_reload (struct context *c);
 #endif
@@ -29,6 +29,7 @@
 #include "buffer.h"
 #include "error.h"
 #include "misc.h"
+#include "fdmisc.h"
 #include "plugin.h"
 
 #include "memdbg.h"
@@ -280,7 +281,8 @@ plugin_open_item (struct plugin *p,
 		  const struct plugin_option *o,
 		  struct openvpn_plugin_string_list **retlist,
 		  const char **envp,
-		  const int init_point)
+		  const int init_point,
+		  const int auth_fd)
 {
   ASSERT (p->initialized);
 
@@ -301,7 +303,8 @@ plugin_open_item (struct plugin *p,
       if (p->open3) {
         struct openvpn_plugin_args_open_in args = { .type_mask = p->plugin_type_mask,
                                                     .argv      = o->argv,
-                                                    .envp      = envp };
+                                                    .envp      = envp,
+                                                    .auth_complete_fd = auth_fd };
         struct openvpn_plugin_args_open_return retargs;
 
         CLEAR(retargs);
@@ -309,6 +312,7 @@ plugin_open_item (struct plugin *p,
           p->plugin_type_mask = retargs.type_mask;
           p->plugin_handle = retargs.handle;
           retlist = retargs.return_list;
+          p->async_auth = (retargs.flags & OPENVPN_PLUGIN_OPEN_ASYNC_AUTH) && auth_fd >= 0;
         } else {
           p->plugin_handle = NULL;
         }
@@ -319,11 +323,12 @@ plugin_open_item (struct plugin *p,
       else
 	ASSERT (0);
 
-      msg (D_PLUGIN, "PLUGIN_INIT: POST %s '%s' intercepted=%s %s",
+      msg (D_PLUGIN, "PLUGIN_INIT: POST %s '%s' intercepted=%s %s%s",
 	   p->so_pathname,
 	   print_argv (o->argv, &gc, PA_BRACKET),
 	   plugin_mask_string (p->plugin_type_mask, &gc),
-	   (retlist && *retlist) ? "[RETLIST]" : "");
+	   (retlist && *retlist) ? "[RETLIST]" : "",
+	   p->async_auth ? "[ASYNC-AUTH]" : "");
       
       if ((p->plugin_type_mask | plugin_supported_types()) != plugin_supported_types())
 	msg (M_FATAL, "PLUGIN_INIT: plugin %s expressed interest in unsupported plugin types: [want=0x%08x, have=0x%08x]",
@@ -345,12 +350,12 @@ plugin_call_item (const struct plugin *p,
 		  const int type,
 		  const struct argv *av,
 		  struct openvpn_plugin_string_list **retlist,
-		  const char **envp
+		  const char **envp,
 #ifdef USE_SSL
-		  , int certdepth,
-		  x509_cert_t *current_cert
+		  int certdepth,
+		  x509_cert_t *current_cert,
 #endif
-		 )
+		  const unsigned int auth_handle)
 {
   int status = OPENVPN_PLUGIN_FUNC_SUCCESS;
 
@@ -377,11 +382,12 @@ plugin_call_item (const struct plugin *p,
 						    .per_client_context = per_client_context,
 #ifdef USE_SSL
 						    .current_cert_depth = (current_cert ? certdepth : -1),
-						    .current_cert = current_cert
+						    .current_cert = current_cert,
 #else
 						    .__current_cert_depth_disabled = -1,
-						    .__current_cert_disabled = NULL
+						    .__current_cert_disabled = NULL,
 #endif
+						    .auth_handle = p->async_auth ? auth_handle : 0
 						  };
         struct openvpn_plugin_args_func_return retargs;
 
@@ -493,6 +499,258 @@ plugin_list_inherit (const struct plugin_list *src)
   return pl;
 }
 
+#ifdef PLUGIN_DEF_AUTH
+
+/*
+ * Deferred auth results reported on the auth completion pipe.
+ */
+
+static uint32_t
+auth_handle_hash_function (const void *key, uint32_t iv)
+{
+  return *(const unsigned int *)key;
+}
+
+static bool
+auth_handle_compare_function (const void *key1, const void *key2)
+{
+  return *(const unsigned int *)key1 == *(const unsigned int *)key2;
+}
+
+static void
+plugin_auth_init (struct plugin_auth *pa)
+{
+#ifndef WIN32
+  if (pa->fd[0] < 0)
+    {
+      if (pipe (pa->fd) == 0)
+	{
+	  set_nonblock (pa->fd[0]);
+	  set_cloexec (pa->fd[0]);
+	  set_cloexec (pa->fd[1]);
+	  pa->pending = hash_init (256,
+				   0,
+				   auth_handle_hash_function,
+				   auth_handle_compare_function);
+	}
+      else
+	{
+	  msg (M_WARN|M_ERRNO, "PLUGIN: cannot create auth completion pipe, plugins must use auth_control_file");
+	  pa->fd[0] = pa->fd[1] = -1;
+	}
+    }
+#endif
+}
+
+static void
+plugin_auth_free (struct plugin_auth *pa)
+{
+  if (pa->pending)
+    {
+      struct hash_iterator hi;
+      struct hash_element *he;
+
+      hash_iterator_init (pa->pending, &hi);
+      while ((he = hash_iterator_next (&hi)))
+	free (he->value);
+      hash_iterator_free (&hi);
+      hash_free (pa->pending);
+      pa->pending = NULL;
+    }
+  if (pa->fd[0] >= 0)
+    {
+      close (pa->fd[0]);
+      close (pa->fd[1]);
+      pa->fd[0] = pa->fd[1] = -1;
+    }
+}
+
+static void
+plugin_auth_finish (struct plugin_auth *pa, struct plugin_auth_request *req)
+{
+  ASSERT (hash_remove (pa->pending, &req->handle));
+  --pa->stats.n_inflight;
+  free (req);
+}
+
+/*
+ * True if a plugin which handles OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY
+ * still reports deferred results through auth_control_file.
+ */
+bool
+plugin_auth_legacy_defined (const struct plugin_list *pl)
+{
+  if (pl && pl->common)
+    {
+      const struct plugin_common *pc = pl->common;
+      const unsigned int mask = OPENVPN_PLUGIN_MASK (OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY);
+      int i;
+
+      for (i = 0; i < pc->n; ++i)
+	{
+	  if ((pc->plugins[i].plugin_type_mask & mask) && !pc->plugins[i].async_auth)
+	    return true;
+	}
+    }
+  return false;
+}
+
+/*
+ * Return a handle not used by any pending request, or 0 if
+ * the auth completion pipe is not available.
+ */
+unsigned int
+plugin_auth_new_handle (const struct plugin_list *pl)
+{
+  struct plugin_auth *pa;
+
+  if (!pl || !pl->common)
+    return 0;
+  pa = &pl->common->auth;
+  if (!pa->pending)
+    return 0;
+
+  do {
+    if (!++pa->handle_seq)
+      ++pa->handle_seq;
+  } while (hash_lookup (pa->pending, &pa->handle_seq));
+  return pa->handle_seq;
+}
+
+/*
+ * Wait for n_pending results for handle.  arg is returned
+ * by plugin_auth_read once the request completes.
+ */
+void
+plugin_auth_begin (const struct plugin_list *pl,
+		   const unsigned int handle,
+		   const int n_pending,
+		   void *arg)
+{
+  struct plugin_auth *pa = &pl->common->auth;
+  struct plugin_auth_request *req;
+
+  ASSERT (pa->pending && handle && n_pending > 0);
+  ALLOC_OBJ_CLEAR (req, struct plugin_auth_request);
+  req->handle = handle;
+  req->n_pending = n_pending;
+  req->arg = arg;
+  ASSERT (hash_add (pa->pending, &req->handle, req, false));
+  ++pa->stats.n_inflight;
+  ++pa->stats.n_started;
+}
+
+/*
+ * Forget a pending request, because its key has gone away
+ * or its deferred auth window expired.  A result which
+ * arrives later is counted as stale.
+ */
+void
+plugin_auth_cancel (const struct plugin_list *pl,
+		    const unsigned int handle,
+		    const bool timed_out)
+{
+  if (pl && pl->common && pl->common->auth.pending && handle)
+    {
+      struct plugin_auth *pa = &pl->common->auth;
+      struct plugin_auth_request *req = (struct plugin_auth_request *) hash_lookup (pa->pending, &handle);
+
+      if (req)
+	{
+	  if (timed_out)
+	    ++pa->stats.n_timed_out;
+	  plugin_auth_finish (pa, req);
+	}
+    }
+}
+
+void
+plugin_auth_event_set (const struct plugin_list *pl,
+		       struct event_set *es,
+		       void *arg,
+		       unsigned int *persistent)
+{
+  if (pl && pl->common && pl->common->auth.pending)
+    {
+      if (!persistent || !*persistent)
+	{
+	  event_ctl (es, pl->common->auth.fd[0], EVENT_READ, arg);
+	  if (persistent)
+	    *persistent = EVENT_READ;
+	}
+    }
+}
+
+/*
+ * Read results from the auth completion pipe.  Fills dest with
+ * up to n requests which are now complete, a request completes
+ * on its first failure or once every deferring plugin succeeded.
+ * Returns the number of completed requests.
+ */
+int
+plugin_auth_read (const struct plugin_list *pl,
+		  struct plugin_auth_completion *dest,
+		  const int n)
+{
+  struct openvpn_plugin_auth_result rec[16];
+  struct plugin_auth *pa;
+  ssize_t len;
+  int count = 0;
+  int i;
+
+  if (!pl || !pl->common || !pl->common->auth.pending)
+    return 0;
+  pa = &pl->common->auth;
+
+  len = read (pa->fd[0], rec, min_int (n, SIZE (rec)) * sizeof (rec[0]));
+  if (len < 0)
+    {
+      if (errno != EAGAIN && errno != EINTR)
+	msg (D_PLUGIN|M_ERRNO, "PLUGIN: read from auth completion pipe failed");
+      return 0;
+    }
+  if (len % sizeof (rec[0]))
+    msg (D_PLUGIN, "PLUGIN: truncated record on auth completion pipe");
+
+  for (i = 0; i < len / (ssize_t) sizeof (rec[0]); ++i)
+    {
+      const bool success = (rec[i].status == OPENVPN_PLUGIN_FUNC_SUCCESS);
+      struct plugin_auth_request *req = (struct plugin_auth_request *) hash_lookup (pa->pending, &rec[i].auth_handle);
+
+      if (!req)
+	{
+	  dmsg (D_PLUGIN_DEBUG, "PLUGIN: result for unknown auth handle %u", rec[i].auth_handle);
+	  ++pa->stats.n_stale;
+	  continue;
+	}
+
+      if (success && --req->n_pending > 0)
+	continue;
+
+      dest[count].handle = req->handle;
+      dest[count].success = success;
+      dest[count].arg = req->arg;
+      ++count;
+
+      if (success)
+	++pa->stats.n_succeeded;
+      else
+	++pa->stats.n_failed;
+      plugin_auth_finish (pa, req);
+    }
+  return count;
+}
+
+const struct plugin_auth_stats *
+plugin_auth_stats (const struct plugin_list *pl)
+{
+  if (pl && pl->common && pl->common->auth.pending)
+    return &pl->common->auth.stats;
+  return NULL;
+}
+
+#endif
+
 static struct plugin_common *
 plugin_common_init (const struct plugin_option_list *list)
 {
@@ -500,6 +758,9 @@ plugin_common_init (const struct plugin_option_list *list)
   struct plugin_common *pc;
 
   ALLOC_OBJ_CLEAR (pc, struct plugin_common);
+#ifdef PLUGIN_DEF_AUTH
+  pc->auth.fd[0] = pc->auth.fd[1] = -1;
+#endif
 
   for (i = 0; i < list->n; ++i)
     {
@@ -528,13 +789,26 @@ plugin_common_open (struct plugin_common *pc,
   if (pr)
     plugin_return_init (pr);
 
+#ifdef PLUGIN_DEF_AUTH
+  /* must exist before the first plugin is opened, so that helpers
+     which the plugin forks inherit the write end; it is close-on-exec,
+     so a plugin which execs a helper has to pass it on explicitly */
+  plugin_auth_init (&pc->auth);
+#endif
+
   for (i = 0; i < pc->n; ++i)
     {
       plugin_open_item (&pc->plugins[i],
 			&list->plugins[i],
 			pr ? &pr->list[i] : NULL,
 			envp,
-			init_point);
+			init_point,
+#ifdef PLUGIN_DEF_AUTH
+			pc->auth.fd[1]
+#else
+			-1
+#endif
+			);
     }
 
   if (pr)
@@ -553,6 +827,9 @@ plugin_common_close (struct plugin_common *pc)
 
       for (i = 0; i < pc->n; ++i)
 	plugin_close_item (&pc->plugins[i]);
+#ifdef PLUGIN_DEF_AUTH
+      plugin_auth_free (&pc->auth);
+#endif
       free (pc);
     }
 }
@@ -578,17 +855,19 @@ plugin_list_open (struct plugin_list *pl,
   plugin_per_client_init (pl->common, &pl->per_client, init_point);
 }
 
-int
-plugin_call_ssl (const struct plugin_list *pl,
-	     const int type,
-	     const struct argv *av,
-	     struct plugin_return *pr,
-	     struct env_set *es
+static int
+plugin_call_list (const struct plugin_list *pl,
+		  const int type,
+		  const struct argv *av,
+		  struct plugin_return *pr,
+		  struct env_set *es,
 #ifdef USE_SSL
-             , int certdepth,
-	     x509_cert_t *current_cert
+		  int certdepth,
+		  x509_cert_t *current_cert,
 #endif
-	    )
+		  const unsigned int auth_handle,
+		  int *n_async,
+		  int *n_legacy)
 {
   if (pr)
     plugin_return_init (pr);
@@ -608,17 +887,18 @@ plugin_call_ssl (const struct plugin_list *pl,
 
       for (i = 0; i < n; ++i)
 	{
-	  const int status = plugin_call_item (&pl->common->plugins[i],
+	  const struct plugin *p = &pl->common->plugins[i];
+	  const int status = plugin_call_item (p,
 					       pl->per_client.per_client_context[i],
 					       type,
 					       av,
 					       pr ? &pr->list[i] : NULL,
-					       envp
+					       envp,
 #ifdef USE_SSL
-					       ,certdepth,
-					       current_cert
+					       certdepth,
+					       current_cert,
 #endif
-					      );
+					       auth_handle);
 	  switch (status)
 	    {
 	    case OPENVPN_PLUGIN_FUNC_SUCCESS:
@@ -626,6 +906,13 @@ plugin_call_ssl (const struct plugin_list *pl,
 	      break;
 	    case OPENVPN_PLUGIN_FUNC_DEFERRED:
 	      deferred = true;
+	      if (p->async_auth && auth_handle)
+		{
+		  if (n_async)
+		    ++*n_async;
+		}
+	      else if (n_legacy)
+		++*n_legacy;
 	      break;
 	    default:
 	      error = true;
@@ -649,6 +936,54 @@ plugin_call_ssl (const struct plugin_list *pl,
   return OPENVPN_PLUGIN_FUNC_SUCCESS;
 }
 
+int
+plugin_call_ssl (const struct plugin_list *pl,
+	     const int type,
+	     const struct argv *av,
+	     struct plugin_return *pr,
+	     struct env_set *es
+#ifdef USE_SSL
+             , int certdepth,
+	     x509_cert_t *current_cert
+#endif
+	    )
+{
+  return plugin_call_list (pl, type, av, pr, es,
+#ifdef USE_SSL
+			   certdepth, current_cert,
+#endif
+			   0, NULL, NULL);
+}
+
+#ifdef PLUGIN_DEF_AUTH
+
+/*
+ * Call the plugins for type, which may be
+ * OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY or
+ * OPENVPN_PLUGIN_CLIENT_CONNECT_V2.  Of those returning
+ * OPENVPN_PLUGIN_FUNC_DEFERRED, n_async will report on the
+ * auth completion pipe under handle and n_legacy through
+ * auth_control_file.
+ */
+int
+plugin_call_deferred (const struct plugin_list *pl,
+		      const int type,
+		      struct plugin_return *pr,
+		      struct env_set *es,
+		      const unsigned int handle,
+		      int *n_async,
+		      int *n_legacy)
+{
+  *n_async = *n_legacy = 0;
+  return plugin_call_list (pl, type, NULL, pr, es,
+#ifdef USE_SSL
+			   -1, NULL,
+#endif
+			   handle, n_async, n_legacy);
+}
+
+#endif
+
 void
 plugin_list_close (struct plugin_list *pl)
 {
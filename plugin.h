@@ -40,6 +40,11 @@
 #ifdef ENABLE_PLUGIN
 
 #include "misc.h"
+#include "event.h"
+
+#ifdef PLUGIN_DEF_AUTH
+#include "list.h"
+#endif
 
 #define MAX_PLUGINS 16
 
@@ -79,6 +84,9 @@ struct plugin {
   openvpn_plugin_select_initialization_point_v1 initialization_point;
 
   openvpn_plugin_handle_t plugin_handle;
+
+  /* reports deferred auth results on the auth completion pipe */
+  bool async_auth;
 };
 
 struct plugin_per_client
@@ -86,10 +94,57 @@ struct plugin_per_client
   void *per_client_context[MAX_PLUGINS];
 };
 
+#ifdef PLUGIN_DEF_AUTH
+
+/*
+ * A deferred OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY call waiting
+ * for n_pending plugins to write their result to the
+ * auth completion pipe.
+ */
+struct plugin_auth_request
+{
+  unsigned int handle;
+  int n_pending;
+  void *arg;                /* owner, handed back on completion */
+};
+
+struct plugin_auth_stats
+{
+  int n_inflight;
+  counter_type n_started;
+  counter_type n_succeeded;
+  counter_type n_failed;
+  counter_type n_timed_out;
+  counter_type n_stale;     /* results for unknown or cancelled handles */
+};
+
+/*
+ * A completed request, as returned by plugin_auth_read.
+ */
+struct plugin_auth_completion
+{
+  unsigned int handle;
+  bool success;
+  void *arg;
+};
+
+struct plugin_auth
+{
+  int fd[2];                /* [0] watched by the event loop, [1] written by plugins */
+  unsigned int handle_seq;
+  struct hash *pending;     /* handle -> struct plugin_auth_request */
+  struct plugin_auth_stats stats;
+};
+
+#endif
+
 struct plugin_common
 {
   int n;
   struct plugin plugins[MAX_PLUGINS];
+#ifdef PLUGIN_DEF_AUTH
+  struct plugin_auth auth;
+#endif
 };
 
 struct plugin_list
@@ -151,6 +206,52 @@ int plugin_call_ssl (const struct plugin_list *pl,
 void plugin_list_close (struct plugin_list *pl);
 bool plugin_defined (const struct plugin_list *pl, const int type);
 
+#ifdef PLUGIN_DEF_AUTH
+
+/*
+ * Deferred OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY and
+ * OPENVPN_PLUGIN_CLIENT_CONNECT_V2 support.
+ *
+ * Plugins which set OPENVPN_PLUGIN_OPEN_ASYNC_AUTH report their
+ * result by writing a struct openvpn_plugin_auth_result to a pipe
+ * which the event loop waits on, instead of through an
+ * auth_control_file which has to be polled.
+ */
+
+int plugin_call_deferred (const struct plugin_list *pl,
+			  const int type,
+			  struct plugin_return *pr,
+			  struct env_set *es,
+			  const unsigned int handle,
+			  int *n_async,
+			  int *n_legacy);
+
+bool plugin_auth_legacy_defined (const struct plugin_list *pl);
+
+unsigned int plugin_auth_new_handle (const struct plugin_list *pl);
+
+void plugin_auth_begin (const struct plugin_list *pl,
+			const unsigned int handle,
+			const int n_pending,
+			void *arg);
+
+void plugin_auth_cancel (const struct plugin_list *pl,
+			 const unsigned int handle,
+			 const bool timed_out);
+
+void plugin_auth_event_set (const struct plugin_list *pl,
+			    struct event_set *es,
+			    void *arg,
+			    unsigned int *persistent);
+
+int plugin_auth_read (const struct plugin_list *pl,
+		      struct plugin_auth_completion *dest,
+		      const int n);
+
+const struct plugin_auth_stats *plugin_auth_stats (const struct plugin_list *pl);
+
+#endif
+
 void plugin_return_get_column (const struct plugin_return *src,
 			       struct plugin_return *dest,
 			       const char *colname);
@@ -29,78 +29,226 @@
 #include "error.h"
 #include "socket.h"
 #include "otime.h"
+#include "misc.h"
 
 #include "memdbg.h"
 
 #if P2MP
 
+static void ifconfig_pool_journal (struct ifconfig_pool_persist *persist,
+				   const struct ifconfig_pool *pool, const int i);
+
+/*
+ * Two-level bitmap of entry indices
+ */
+
+static inline int
+ifconfig_pool_lowest_bit (uint32_t w)
+{
+#ifdef __GNUC__
+  return __builtin_ctz (w);
+#else
+  int i = 0;
+  while (!(w & 1))
+    {
+      w >>= 1;
+      ++i;
+    }
+  return i;
+#endif
+}
+
+static inline void
+ifconfig_pool_map_add (struct ifconfig_pool_map *map, const int i)
+{
+  map->words[i >> 5] |= (1u << (i & 31));
+  map->summary[i >> 10] |= (1u << ((i >> 5) & 31));
+}
+
+static inline void
+ifconfig_pool_map_del (struct ifconfig_pool_map *map, const int i)
+{
+  map->words[i >> 5] &= ~(1u << (i & 31));
+  if (!map->words[i >> 5])
+    map->summary[i >> 10] &= ~(1u << ((i >> 5) & 31));
+}
+
+static int
+ifconfig_pool_map_first (const struct ifconfig_pool_map *map)
+{
+  int s;
+  for (s = 0; s < (int) SIZE (map->summary); ++s)
+    {
+      if (map->summary[s])
+	{
+	  const int w = (s << 5) + ifconfig_pool_lowest_bit (map->summary[s]);
+	  return (w << 5) + ifconfig_pool_lowest_bit (map->words[w]);
+	}
+    }
+  return -1;
+}
+
+/*
+ * Common name index
+ */
+
+static inline int
+ifconfig_pool_cn_bucket (const struct ifconfig_pool *pool, const char *cn)
+{
+  /* FNV-1a */
+  uint32_t h = 2166136261u;
+  while (*cn)
+    {
+      h ^= (uint8_t) *cn++;
+      h *= 16777619u;
+    }
+  return h & pool->cn_mask;
+}
+
 static void
-ifconfig_pool_entry_free (struct ifconfig_pool_entry *ipe, bool hard)
+ifconfig_pool_set_cn (struct ifconfig_pool *pool, const int i, const char *cn)
 {
-  ipe->in_use = false;
-  if (hard && ipe->common_name)
+  struct ifconfig_pool_entry *ipe = &pool->list[i];
+
+  /* unchanged, e.g. a client reconnecting to its old address */
+  if (cn ? ipe->common_name && !strcmp (ipe->common_name, cn) : !ipe->common_name)
+    return;
+
+  if (ipe->common_name)
     {
+      int *p = &pool->cn_buckets[ifconfig_pool_cn_bucket (pool, ipe->common_name)];
+      while (*p != i)
+	p = &pool->list[*p].cn_next;
+      *p = ipe->cn_next;
+      ipe->cn_next = -1;
       free (ipe->common_name);
       ipe->common_name = NULL;
     }
+  if (cn)
+    {
+      int *p = &pool->cn_buckets[ifconfig_pool_cn_bucket (pool, cn)];
+      ipe->common_name = string_alloc (cn, NULL);
+      ipe->cn_next = *p;
+      *p = i;
+    }
+  if (pool->persist)
+    ifconfig_pool_journal (pool->persist, pool, i);
+}
+
+/*
+ * Add entry i to, or remove it from, the free entry indexes
+ * according to its current state.  Every change of in_use, fixed
+ * or last_release must be bracketed by these two calls.
+ */
+static void
+ifconfig_pool_unindex (struct ifconfig_pool *pool, const int i)
+{
+  struct ifconfig_pool_entry *ipe = &pool->list[i];
+
+  if (ipe->in_use)
+    return;
+  ifconfig_pool_map_del (&pool->free_map, i);
+  if (ipe->fixed)
+    return;
+  if (!ipe->last_release)
+    ifconfig_pool_map_del (&pool->unused_map, i);
+  else
+    {
+      if (ipe->released_prev >= 0)
+	pool->list[ipe->released_prev].released_next = ipe->released_next;
+      else
+	pool->released_head = ipe->released_next;
+      if (ipe->released_next >= 0)
+	pool->list[ipe->released_next].released_prev = ipe->released_prev;
+      else
+	pool->released_tail = ipe->released_prev;
+      ipe->released_prev = ipe->released_next = -1;
+    }
+}
+
+static void
+ifconfig_pool_index (struct ifconfig_pool *pool, const int i)
+{
+  struct ifconfig_pool_entry *ipe = &pool->list[i];
+
+  if (ipe->in_use)
+    return;
+  ifconfig_pool_map_add (&pool->free_map, i);
+  if (ipe->fixed)
+    return;
+  if (!ipe->last_release)
+    ifconfig_pool_map_add (&pool->unused_map, i);
+  else
+    {
+      /* releases happen in time order, so append */
+      ipe->released_prev = pool->released_tail;
+      ipe->released_next = -1;
+      if (pool->released_tail >= 0)
+	pool->list[pool->released_tail].released_next = i;
+      else
+	pool->released_head = i;
+      pool->released_tail = i;
+    }
+}
+
+static void
+ifconfig_pool_entry_free (struct ifconfig_pool *pool, const int i, bool hard)
+{
+  struct ifconfig_pool_entry *ipe = &pool->list[i];
+
+  ifconfig_pool_unindex (pool, i);
+  ipe->in_use = false;
+  if (hard && ipe->common_name)
+    ifconfig_pool_set_cn (pool, i, NULL);
   if (hard)
     ipe->last_release = 0;
   else
     ipe->last_release = now;
+  ifconfig_pool_index (pool, i);
 }
 
 static int
 ifconfig_pool_find (struct ifconfig_pool *pool, const char *common_name)
 {
   int i;
-  time_t earliest_release = 0;
-  int previous_usage = -1;
-  int new_usage = -1;
 
-  for (i = 0; i < pool->size; ++i)
+  /*
+   * If duplicate_cn mode, take first available IP address
+   */
+  if (pool->duplicate_cn)
+    return ifconfig_pool_map_first (&pool->free_map);
+
+  /*
+   * Prefer a possible allocation to us from an earlier
+   * session, the lowest such address if there are several.
+   */
+  if (common_name)
     {
-      struct ifconfig_pool_entry *ipe = &pool->list[i];
-      if (!ipe->in_use)
-	{
-	  /*
-	   * If duplicate_cn mode, take first available IP address
-	   */
-	  if (pool->duplicate_cn)
-	    {
-	      new_usage = i;
-	      break;
-	    }
-
-	  /*
-	   * Keep track of the unused IP address entry which
-	   * was released earliest.
-	   */
-	  if ((new_usage == -1 || ipe->last_release < earliest_release) && !ipe->fixed)
-	    {
-	      earliest_release = ipe->last_release;
-	      new_usage = i;
-	    }
+      int previous_usage = -1;
 
-	  /*
-	   * Keep track of a possible allocation to us
-	   * from an earlier session.
-	   */
-	  if (previous_usage < 0
-	      && common_name
-	      && ipe->common_name
+      for (i = pool->cn_buckets[ifconfig_pool_cn_bucket (pool, common_name)];
+	   i >= 0;
+	   i = pool->list[i].cn_next)
+	{
+	  const struct ifconfig_pool_entry *ipe = &pool->list[i];
+	  if (!ipe->in_use
+	      && (previous_usage < 0 || i < previous_usage)
 	      && !strcmp (common_name, ipe->common_name))
 	    previous_usage = i;
-
 	}
+      if (previous_usage >= 0)
+	return previous_usage;
     }
 
-  if (previous_usage >= 0)
-    return previous_usage;
-
-  if (new_usage >= 0)
-    return new_usage;
+  /*
+   * Otherwise take the unused IP address entry which
+   * was released earliest.
+   */
+  i = ifconfig_pool_map_first (&pool->unused_map);
+  if (i >= 0)
+    return i;
 
-  return -1;
+  return pool->released_head;
 }
 
 /*
@@ -182,6 +330,27 @@ ifconfig_pool_init (int type, in_addr_t start, in_addr_t end,
 
   ALLOC_ARRAY_CLEAR (pool->list, struct ifconfig_pool_entry, pool->size);
 
+  /* index all entries as unused */
+  {
+    int n_buckets = 16;
+    int i;
+
+    while (n_buckets < pool->size)
+      n_buckets <<= 1;
+    ALLOC_ARRAY (pool->cn_buckets, int, n_buckets);
+    pool->cn_mask = n_buckets - 1;
+    for (i = 0; i < n_buckets; ++i)
+      pool->cn_buckets[i] = -1;
+
+    pool->released_head = pool->released_tail = -1;
+    for (i = 0; i < pool->size; ++i)
+      {
+	struct ifconfig_pool_entry *ipe = &pool->list[i];
+	ipe->cn_next = ipe->released_prev = ipe->released_next = -1;
+	ifconfig_pool_index (pool, i);
+      }
+  }
+
   msg (D_IFCONFIG_POOL, "IFCONFIG POOL: base=%s size=%d, ipv6=%d",
        print_in_addr_t (pool->base, 0, &gc),
        pool->size, pool->ipv6 );
@@ -196,8 +365,10 @@ ifconfig_pool_free (struct ifconfig_pool *pool)
   if (pool)
     {
       int i;
+      pool->persist = NULL;
       for (i = 0; i < pool->size; ++i)
-	ifconfig_pool_entry_free (&pool->list[i], true);
+	ifconfig_pool_entry_free (pool, i, true);
+      free (pool->cn_buckets);
       free (pool->list);
       free (pool);
     }
@@ -213,10 +384,13 @@ ifconfig_pool_acquire (struct ifconfig_pool *pool, in_addr_t *local, in_addr_t *
     {
       struct ifconfig_pool_entry *ipe = &pool->list[i];
       ASSERT (!ipe->in_use);
-      ifconfig_pool_entry_free (ipe, true);
+      ifconfig_pool_unindex (pool, i);
       ipe->in_use = true;
-      if (common_name)
-	ipe->common_name = string_alloc (common_name, NULL);
+      ipe->last_release = 0;
+      ifconfig_pool_index (pool, i);
+
+      /* replaces any previous name with a single journal record */
+      ifconfig_pool_set_cn (pool, i, common_name);
 
       switch (pool->type)
 	{
@@ -253,7 +427,7 @@ ifconfig_pool_release (struct ifconfig_pool* pool, ifconfig_pool_handle hand, co
   bool ret = false;
   if (pool && hand >= 0 && hand < pool->size)
     {
-      ifconfig_pool_entry_free (&pool->list[hand], hard);
+      ifconfig_pool_entry_free (pool, hand, hard);
       ret = true;
     }
   return ret;
@@ -337,14 +511,39 @@ ifconfig_pool_set (struct ifconfig_pool* pool, const char *cn, const in_addr_t a
   if (h >= 0)
     {
       struct ifconfig_pool_entry *e = &pool->list[h];
-      ifconfig_pool_entry_free (e, true);
+      ifconfig_pool_entry_free (pool, h, true);
+      ifconfig_pool_unindex (pool, h);
       e->in_use = false;
-      e->common_name = string_alloc (cn, NULL);
+      ifconfig_pool_set_cn (pool, h, cn);
       e->last_release = now;
       e->fixed = fixed;
+      ifconfig_pool_index (pool, h);
     }
 }
 
+/*
+ * Return the persist file line for entry i, or NULL if it has
+ * no common name.
+ */
+static const char *
+ifconfig_pool_entry_print (const struct ifconfig_pool* pool, const int i, struct gc_arena *gc)
+{
+  const struct ifconfig_pool_entry *e = &pool->list[i];
+  struct buffer out;
+
+  if (!e->common_name)
+    return NULL;
+
+  out = alloc_buf_gc (256, gc);
+  buf_printf (&out, "%s,%s",
+	      e->common_name,
+	      print_in_addr_t (ifconfig_pool_handle_to_ip_base (pool, i), 0, gc));
+  if (pool->ipv6)
+    buf_printf (&out, ",%s",
+		print_in6_addr (ifconfig_pool_handle_to_ipv6_base (pool, i), 0, gc));
+  return BSTR (&out);
+}
+
 static void
 ifconfig_pool_list (const struct ifconfig_pool* pool, struct status_output *out)
 {
@@ -355,25 +554,9 @@ ifconfig_pool_list (const struct ifconfig_pool* pool, struct status_output *out)
 
       for (i = 0; i < pool->size; ++i)
 	{
-	  const struct ifconfig_pool_entry *e = &pool->list[i];
-	  if (e->common_name)
-	    {
-	      const in_addr_t ip = ifconfig_pool_handle_to_ip_base (pool, i);
-	      if ( pool->ipv6 )
-		{
-		  struct in6_addr ip6 = ifconfig_pool_handle_to_ipv6_base (pool, i);
-		  status_printf (out, "%s,%s,%s",
-				 e->common_name,
-				 print_in_addr_t (ip, 0, &gc),
-				 print_in6_addr (ip6, 0, &gc));
-		}
-	      else
-		{
-		  status_printf (out, "%s,%s",
-				 e->common_name,
-				 print_in_addr_t (ip, 0, &gc));
-		}
-	    }
+	  const char *line = ifconfig_pool_entry_print (pool, i, &gc);
+	  if (line)
+	    status_printf (out, "%s", line);
 	}
       gc_free (&gc);
     }
@@ -390,9 +573,201 @@ ifconfig_pool_msg (const struct ifconfig_pool* pool, int msglevel)
 }
 
 /*
- * Deal with reading/writing the ifconfig pool database to a file
+ * Deal with reading/writing the ifconfig pool database to a file.
+ *
+ * Every common name change is appended to the journal, which is
+ * written out at the refresh interval.  Once the journal outgrows
+ * the pool, a new snapshot is written to file.tmp a slice at a time
+ * and renamed over file.  Records journaled meanwhile are kept in
+ * memory, and become the new journal once the snapshot is in place.
+ * Journal records are absolute, so replaying the snapshot and then
+ * the journal always yields the latest state, even if we stopped
+ * between the rename and the journal truncation.
  */
 
+static const char *
+ifconfig_pool_persist_name (const struct ifconfig_pool_persist *persist, const char *suffix, struct gc_arena *gc)
+{
+  struct buffer out = alloc_buf_gc (strlen (persist->filename) + strlen (suffix) + 1, gc);
+  buf_printf (&out, "%s%s", persist->filename, suffix);
+  return BSTR (&out);
+}
+
+static bool
+ifconfig_pool_persist_output (const int fd, struct buffer *buf)
+{
+  const int len = BLEN (buf);
+  bool ret = true;
+
+  if (len)
+    ret = (write (fd, BPTR (buf), len) == len);
+  buf_reset_len (buf);
+  return ret;
+}
+
+static void
+ifconfig_pool_journal_flush (struct ifconfig_pool_persist *persist)
+{
+  if (!ifconfig_pool_persist_output (persist->journal_fd, &persist->journal)
+      && !persist->journal_errors)
+    {
+      struct gc_arena gc = gc_new ();
+      msg (M_WARN | M_ERRNO, "Note: cannot write %s",
+	   ifconfig_pool_persist_name (persist, ".journal", &gc));
+      persist->journal_errors = true;
+      gc_free (&gc);
+    }
+}
+
+static void
+ifconfig_pool_journal_record (struct ifconfig_pool_persist *persist, const char *record)
+{
+  if ((int)strlen (record) + 2 > BCAP (&persist->journal))
+    ifconfig_pool_journal_flush (persist);
+  buf_printf (&persist->journal, "%s\n", record);
+  ++persist->journal_records;
+}
+
+static void
+ifconfig_pool_journal (struct ifconfig_pool_persist *persist,
+		       const struct ifconfig_pool *pool, const int i)
+{
+  struct gc_arena gc = gc_new ();
+  struct buffer out = alloc_buf_gc (256, &gc);
+  const char *cn = pool->list[i].common_name;
+  const char *ip = print_in_addr_t (ifconfig_pool_handle_to_ip_base (pool, i), 0, &gc);
+
+  if (cn)
+    buf_printf (&out, "+%s,%s", cn, ip);
+  else
+    buf_printf (&out, "-%s", ip);
+  ifconfig_pool_journal_record (persist, BSTR (&out));
+  if (persist->replay)
+    buffer_list_push (persist->replay, BPTR (&out));
+  gc_free (&gc);
+}
+
+static void
+ifconfig_pool_journal_truncate (struct ifconfig_pool_persist *persist)
+{
+#if defined(HAVE_FTRUNCATE)
+  if (ftruncate (persist->journal_fd, 0) != 0)
+    msg (M_WARN | M_ERRNO, "Note: cannot truncate ifconfig pool journal");
+#elif defined(HAVE_CHSIZE)
+  chsize (persist->journal_fd, 0);
+#endif
+  persist->journal_records = 0;
+}
+
+static void
+ifconfig_pool_snapshot_begin (struct ifconfig_pool_persist *persist)
+{
+  struct gc_arena gc = gc_new ();
+  const char *tmp = ifconfig_pool_persist_name (persist, ".tmp", &gc);
+
+  persist->snapshot_fd = open (tmp, O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+  if (persist->snapshot_fd >= 0)
+    {
+      persist->snapshot_next = 0;
+      persist->replay = buffer_list_new (0);
+    }
+  else
+    msg (M_WARN | M_ERRNO, "Note: cannot open %s for writing, %s not updated", tmp, persist->filename);
+  gc_free (&gc);
+}
+
+static void
+ifconfig_pool_snapshot_abort (struct ifconfig_pool_persist *persist)
+{
+  if (persist->snapshot_fd >= 0)
+    {
+      struct gc_arena gc = gc_new ();
+      close (persist->snapshot_fd);
+      persist->snapshot_fd = -1;
+      delete_file (ifconfig_pool_persist_name (persist, ".tmp", &gc));
+      buffer_list_free (persist->replay);
+      persist->replay = NULL;
+      gc_free (&gc);
+    }
+}
+
+static void
+ifconfig_pool_snapshot_end (struct ifconfig_pool_persist *persist)
+{
+  struct gc_arena gc = gc_new ();
+  const char *tmp = ifconfig_pool_persist_name (persist, ".tmp", &gc);
+  struct buffer_entry *e;
+
+  close (persist->snapshot_fd);
+  persist->snapshot_fd = -1;
+#ifdef WIN32
+  delete_file (persist->filename);
+#endif
+  if (rename (tmp, persist->filename) != 0)
+    {
+      msg (M_WARN | M_ERRNO, "Note: cannot rename %s to %s", tmp, persist->filename);
+      delete_file (tmp);
+    }
+  else if (persist->journal_fd < 0)
+    {
+      /* stale records would override the snapshot when replayed */
+      delete_file (ifconfig_pool_persist_name (persist, ".journal", &gc));
+      msg (D_IFCONFIG_POOL, "IFCONFIG POOL: wrote %s", persist->filename);
+    }
+  else
+    {
+      /* the pending journal buffer holds only records in replay */
+      buf_reset_len (&persist->journal);
+      ifconfig_pool_journal_truncate (persist);
+      for (e = persist->replay->head; e; e = e->next)
+	ifconfig_pool_journal_record (persist, BSTR (&e->buf));
+      ifconfig_pool_journal_flush (persist);
+      msg (D_IFCONFIG_POOL, "IFCONFIG POOL: wrote snapshot %s, %d journal records kept",
+	   persist->filename, persist->journal_records);
+    }
+  buffer_list_free (persist->replay);
+  persist->replay = NULL;
+  gc_free (&gc);
+}
+
+/*
+ * Write up to n more entries of the snapshot in progress.
+ */
+static void
+ifconfig_pool_snapshot_step (struct ifconfig_pool_persist *persist, const struct ifconfig_pool *pool, const int n)
+{
+  struct gc_arena gc = gc_new ();
+  struct buffer out = alloc_buf_gc (IFCONFIG_POOL_JOURNAL_BUF, &gc);
+  const int end = min_int (persist->snapshot_next + n, pool->size);
+  bool ok = true;
+  int i;
+
+  for (i = persist->snapshot_next; i < end && ok; ++i)
+    {
+      struct gc_arena entry_gc = gc_new ();
+      const char *line = ifconfig_pool_entry_print (pool, i, &entry_gc);
+      if (line)
+	{
+	  if ((int)strlen (line) + 2 > BCAP (&out))
+	    ok = ifconfig_pool_persist_output (persist->snapshot_fd, &out);
+	  buf_printf (&out, "%s\n", line);
+	}
+      gc_free (&entry_gc);
+    }
+  if (ok)
+    ok = ifconfig_pool_persist_output (persist->snapshot_fd, &out);
+  persist->snapshot_next = end;
+
+  if (!ok)
+    {
+      msg (M_WARN | M_ERRNO, "Note: cannot write ifconfig pool snapshot for %s", persist->filename);
+      ifconfig_pool_snapshot_abort (persist);
+    }
+  else if (end == pool->size)
+    ifconfig_pool_snapshot_end (persist);
+  gc_free (&gc);
+}
+
 struct ifconfig_pool_persist *
 ifconfig_pool_persist_init (const char *filename, int refresh_freq)
 {
@@ -401,16 +776,26 @@ ifconfig_pool_persist_init (const char *filename, int refresh_freq)
   ASSERT (filename);
 
   ALLOC_OBJ_CLEAR (ret, struct ifconfig_pool_persist);
+  ret->filename = string_alloc (filename, NULL);
+  ret->journal_fd = -1;
+  ret->snapshot_fd = -1;
   if (refresh_freq > 0)
     {
+      struct gc_arena gc = gc_new ();
+      const char *journal = ifconfig_pool_persist_name (ret, ".journal", &gc);
+
+      /* open the journal now, in case we drop privileges later */
       ret->fixed = false;
-      ret->file = status_open (filename, refresh_freq, -1, NULL, STATUS_OUTPUT_READ|STATUS_OUTPUT_WRITE);
+      ret->journal_fd = open (journal, O_CREAT | O_WRONLY | O_APPEND, S_IRUSR | S_IWUSR);
+      if (ret->journal_fd < 0)
+	msg (M_WARN | M_ERRNO, "Note: cannot open %s for writing, %s will be rewritten in full instead",
+	     journal, filename);
+      ret->journal = alloc_buf (IFCONFIG_POOL_JOURNAL_BUF);
+      event_timeout_init (&ret->et, refresh_freq, 0);
+      gc_free (&gc);
     }
   else
-    {
-      ret->fixed = true;
-      ret->file = status_open (filename, 0, -1, NULL, STATUS_OUTPUT_READ);
-    }
+    ret->fixed = true;
   return ret;
 }
 
@@ -419,80 +804,169 @@ ifconfig_pool_persist_close (struct ifconfig_pool_persist *persist)
 {
   if (persist)
     {
-      if (persist->file)
-	status_close (persist->file);
+      ifconfig_pool_snapshot_abort (persist);
+      if (persist->journal_fd >= 0)
+	{
+	  ifconfig_pool_journal_flush (persist);
+	  close (persist->journal_fd);
+	}
+      free_buf (&persist->journal);
+      free (persist->filename);
       free (persist);
     }
 }
 
-bool
-ifconfig_pool_write_trigger (struct ifconfig_pool_persist *persist)
-{
-  if (persist->file)
-    return status_trigger (persist->file);
-  else
-    return false;
-}
-
-void
-ifconfig_pool_read (struct ifconfig_pool_persist *persist, struct ifconfig_pool *pool)
+/*
+ * Replay a snapshot or journal file into pool.  Returns the number
+ * of records replayed.
+ */
+static int
+ifconfig_pool_read_file (struct ifconfig_pool_persist *persist, struct ifconfig_pool *pool,
+			 const char *filename, const bool journal)
 {
   const int buf_size = 128;
+  struct buffer_list *bl = buffer_list_file (filename, 256);
+  int n = 0;
 
-  update_time ();
-  if (persist && persist->file && pool)
+  if (bl)
     {
       struct gc_arena gc = gc_new ();
-      struct buffer in = alloc_buf_gc (256, &gc);
+      struct buffer_entry *e;
       char *cn_buf;
       char *ip_buf;
-      int line = 0;
 
       ALLOC_ARRAY_CLEAR_GC (cn_buf, char, buf_size, &gc);
       ALLOC_ARRAY_CLEAR_GC (ip_buf, char, buf_size, &gc);
 
-      while (true)
+      for (e = bl->head; e; e = e->next)
 	{
-	  ASSERT (buf_init (&in, 0));
-	  if (!status_read (persist->file, &in))
-	    break;
-	  ++line;
-	  if (BLEN (&in))
+	  struct buffer in = e->buf;
+	  int c;
+
+	  buf_chomp (&in);
+	  if (!BLEN (&in))
+	    continue;
+	  c = *BSTR(&in);
+	  if (c == '#' || c == ';')
+	    continue;
+
+	  if (journal)
 	    {
-	      int c = *BSTR(&in);
-	      if (c == '#' || c == ';')
+	      bool succeeded;
+	      in_addr_t addr;
+
+	      buf_advance (&in, 1);
+	      if (c == '+')
+		{
+		  if (!buf_parse (&in, ',', cn_buf, buf_size)
+		      || !buf_parse (&in, ',', ip_buf, buf_size))
+		    continue;
+		}
+	      else if (c != '-' || !buf_parse (&in, ',', ip_buf, buf_size))
 		continue;
-	      msg( M_INFO, "ifconfig_pool_read(), in='%s', TODO: IPv6",
-				BSTR(&in) );
 
-	      if (buf_parse (&in, ',', cn_buf, buf_size)
-		  && buf_parse (&in, ',', ip_buf, buf_size))
+	      addr = getaddr (GETADDR_HOST_ORDER, ip_buf, 0, &succeeded, NULL);
+	      if (succeeded)
+		{
+		  ifconfig_pool_set (pool, c == '+' ? cn_buf : NULL, addr, persist->fixed);
+		  ++n;
+		}
+	      continue;
+	    }
+
+	  msg( M_INFO, "ifconfig_pool_read(), in='%s', TODO: IPv6",
+	       BSTR(&in) );
+
+	  if (buf_parse (&in, ',', cn_buf, buf_size)
+	      && buf_parse (&in, ',', ip_buf, buf_size))
+	    {
+	      bool succeeded;
+	      const in_addr_t addr = getaddr (GETADDR_HOST_ORDER, ip_buf, 0, &succeeded, NULL);
+	      if (succeeded)
 		{
-		  bool succeeded;
-		  const in_addr_t addr = getaddr (GETADDR_HOST_ORDER, ip_buf, 0, &succeeded, NULL);
-		  if (succeeded)
-		    {
-		      msg( M_INFO, "succeeded -> ifconfig_pool_set()");
-		      ifconfig_pool_set (pool, cn_buf, addr, persist->fixed);
-		    }
+		  msg( M_INFO, "succeeded -> ifconfig_pool_set()");
+		  ifconfig_pool_set (pool, cn_buf, addr, persist->fixed);
+		  ++n;
 		}
 	    }
 	}
 
+      buffer_list_free (bl);
+      gc_free (&gc);
+    }
+  return n;
+}
+
+void
+ifconfig_pool_read (struct ifconfig_pool_persist *persist, struct ifconfig_pool *pool)
+{
+  update_time ();
+  if (persist && pool)
+    {
+      struct gc_arena gc = gc_new ();
+
+      /* a snapshot of a previous pool is of no use any more */
+      ifconfig_pool_snapshot_abort (persist);
+
+      ifconfig_pool_read_file (persist, pool, persist->filename, false);
+      /*
+       * Replayed journal records count towards compaction, or a
+       * server which keeps restarting would never compact.
+       */
+      if (!persist->fixed)
+	persist->journal_records +=
+	  ifconfig_pool_read_file (persist, pool, ifconfig_pool_persist_name (persist, ".journal", &gc), true);
+      if (persist->journal_fd >= 0)
+	pool->persist = persist;
+
       ifconfig_pool_msg (pool, D_IFCONFIG_POOL);
   
       gc_free (&gc);
     }
 }
 
+/*
+ * Called once per second.  Never writes more than the records
+ * journaled since the last call plus IFCONFIG_POOL_SNAPSHOT_STEP
+ * snapshot entries, unless force is set, in which case the
+ * journal is compacted before we return.  Without a journal,
+ * the whole file is rewritten at the refresh interval instead.
+ */
 void
-ifconfig_pool_write (struct ifconfig_pool_persist *persist, const struct ifconfig_pool *pool)
+ifconfig_pool_write (struct ifconfig_pool_persist *persist, const struct ifconfig_pool *pool, const bool force)
 {
-  if (persist && persist->file && (status_rw_flags (persist->file) & STATUS_OUTPUT_WRITE) && pool)
+  if (persist && !persist->fixed && persist->journal_fd < 0 && pool)
+    {
+      struct timeval null;
+      CLEAR (null);
+
+      if (force || event_timeout_trigger (&persist->et, &null, ETT_DEFAULT))
+	{
+	  ifconfig_pool_snapshot_begin (persist);
+	  if (persist->snapshot_fd >= 0)
+	    ifconfig_pool_snapshot_step (persist, pool, pool->size);
+	}
+    }
+  else if (persist && persist->journal_fd >= 0 && pool)
     {
-      status_reset (persist->file);
-      ifconfig_pool_list (pool, persist->file);
-      status_flush (persist->file);
+      struct timeval null;
+      CLEAR (null);
+
+      if (persist->snapshot_fd >= 0)
+	ifconfig_pool_snapshot_step (persist, pool, force ? pool->size : IFCONFIG_POOL_SNAPSHOT_STEP);
+
+      if (force || event_timeout_trigger (&persist->et, &null, ETT_DEFAULT))
+	{
+	  ifconfig_pool_journal_flush (persist);
+	  if (persist->snapshot_fd < 0
+	      && (persist->journal_records >= max_int (pool->size, IFCONFIG_POOL_JOURNAL_MIN)
+		  || (force && persist->journal_records)))
+	    {
+	      ifconfig_pool_snapshot_begin (persist);
+	      if (force && persist->snapshot_fd >= 0)
+		ifconfig_pool_snapshot_step (persist, pool, pool->size);
+	    }
+	}
     }
 }
 
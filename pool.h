@@ -44,6 +44,23 @@ struct ifconfig_pool_entry
   char *common_name;
   time_t last_release;
   bool fixed;
+
+  /* links of the pool indexes, -1 terminated */
+  int cn_next;             /* next entry in the same common name bucket */
+  int released_prev;       /* neighbours on the released list */
+  int released_next;
+};
+
+#define IFCONFIG_POOL_MAP_WORDS (IFCONFIG_POOL_MAX / 32)
+
+/*
+ * Set of entry indices with constant time insert, delete and
+ * lowest-index lookup, kept as a two-level bitmap.
+ */
+struct ifconfig_pool_map
+{
+  uint32_t summary[IFCONFIG_POOL_MAP_WORDS / 32]; /* bit n set if words[n] != 0 */
+  uint32_t words[IFCONFIG_POOL_MAP_WORDS];
 };
 
 struct ifconfig_pool
@@ -56,12 +73,54 @@ struct ifconfig_pool
   struct in6_addr base_ipv6;
   unsigned int size_ipv6;
   struct ifconfig_pool_entry *list;
+
+  /*
+   * Indexes over list, so that ifconfig_pool_find() need not
+   * scan it.  A free entry which is not fixed is either unused
+   * (never allocated, or released hard) or on the released list,
+   * which is ordered from earliest to latest release.
+   */
+  struct ifconfig_pool_map free_map;     /* all entries not in use */
+  struct ifconfig_pool_map unused_map;
+  int released_head;
+  int released_tail;
+  int *cn_buckets;                       /* entries by hash of common name */
+  int cn_mask;
+
+  struct ifconfig_pool_persist *persist; /* journals common name changes */
 };
 
+/*
+ * Flush the journal buffer when it fills up, and compact the journal
+ * into a new snapshot once it holds more records than the pool has
+ * entries.  A snapshot is written IFCONFIG_POOL_SNAPSHOT_STEP entries
+ * per second.
+ */
+#define IFCONFIG_POOL_JOURNAL_BUF      4096
+#define IFCONFIG_POOL_JOURNAL_MIN      256
+#define IFCONFIG_POOL_SNAPSHOT_STEP    1024
+
+/*
+ * The persist file is a snapshot of common name to address
+ * associations, plus an append-only journal (file.journal) of the
+ * changes made since.  "+cn,ip" associates cn with ip and "-ip"
+ * drops the association.
+ */
 struct ifconfig_pool_persist
 {
-  struct status_output *file;
+  char *filename;
   bool fixed;
+  struct event_timeout et;           /* journal flush interval */
+
+  int journal_fd;
+  struct buffer journal;             /* records not yet written */
+  int journal_records;               /* records in journal_fd */
+  bool journal_errors;
+
+  /* snapshot being written to file.tmp */
+  int snapshot_fd;                   /* -1 if none */
+  int snapshot_next;                 /* next pool entry to write */
+  struct buffer_list *replay;        /* records journaled since it began */
 };
 
 typedef int ifconfig_pool_handle;
@@ -78,10 +137,9 @@ bool ifconfig_pool_release (struct ifconfig_pool* pool, ifconfig_pool_handle han
 
 struct ifconfig_pool_persist *ifconfig_pool_persist_init (const char *filename, int refresh_freq);
 void ifconfig_pool_persist_close (struct ifconfig_pool_persist *persist);
-bool ifconfig_pool_write_trigger (struct ifconfig_pool_persist *persist);
 
 void ifconfig_pool_read (struct ifconfig_pool_persist *persist, struct ifconfig_pool *pool);
-void ifconfig_pool_write (struct ifconfig_pool_persist *persist, const struct ifconfig_pool *pool);
+void ifconfig_pool_write (struct ifconfig_pool_persist *persist, const struct ifconfig_pool *pool, const bool force);
 
 #ifdef IFCONFIG_POOL_TEST
 void ifconfig_pool_test (in_addr_t start, in_addr_t end);
@@ -90,28 +90,6 @@ close_socket_if_defined (const socket_descriptor_t sd)
     openvpn_close_socket (sd);
 }
 
-/*
- * Close most of parent's fds.
- * Keep stdin/stdout/stderr, plus one
- * other fd which is presumed to be
- * our pipe back to parent.
- * Admittedly, a bit of a kludge,
- * but posix doesn't give us a kind
- * of FD_CLOEXEC which will stop
- * fds from crossing a fork().
- */
-static void
-close_fds_except (int keep)
-{
-  socket_descriptor_t i;
-  closelog ();
-  for (i = 3; i <= 100; ++i)
-    {
-      if (i != keep)
-	openvpn_close_socket (i);
-    }
-}
-
 /*
  * Usually we ignore signals, because our parent will
  * deal with them.
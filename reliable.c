@@ -35,6 +35,7 @@
 #include "error.h"
 #include "common.h"
 #include "reliable.h"
+#include "otime.h"
 
 #include "memdbg.h"
 
@@ -125,7 +126,7 @@ reliable_ack_read_packet_id (struct buffer *buf, packet_id_type *pid)
 bool
 reliable_ack_acknowledge_packet_id (struct reliable_ack *ack, packet_id_type pid)
 {
-  if (!reliable_ack_packet_id_present (ack, pid) && ack->len < RELIABLE_ACK_SIZE)
+  if (!reliable_ack_packet_id_present (ack, pid) && ack->len < RELIABLE_CAPACITY)
     {
       ack->packet_id[ack->len++] = pid;
       dmsg (D_REL_DEBUG, "ACK acknowledge ID " packet_id_format " (ack->len=%d)",
@@ -156,7 +157,7 @@ reliable_ack_read (struct reliable_ack * ack,
     {
       if (!buf_read (buf, &net_pid, sizeof (net_pid)))
 	goto error;
-      if (ack->len >= RELIABLE_ACK_SIZE)
+      if (ack->len >= RELIABLE_CAPACITY)
 	goto error;
       pid = ntohpid (net_pid);
       ack->packet_id[ack->len++] = pid;
@@ -269,34 +270,59 @@ reliable_ack_print (struct buffer *buf, bool verbose, struct gc_arena *gc)
  */
 
 void
-reliable_init (struct reliable *rel, int buf_size, int offset, int array_size, bool hold)
+reliable_init (struct reliable *rel, struct buffer_pool *pool, int offset, int array_size, bool hold)
 {
-  int i;
-
   CLEAR (*rel);
+  ASSERT (pool);
   ASSERT (array_size > 0 && array_size <= RELIABLE_CAPACITY);
   rel->hold = hold;
   rel->size = array_size;
   rel->offset = offset;
+  rel->pool = pool;
+  ALLOC_ARRAY_CLEAR (rel->array, struct reliable_entry, array_size);
+}
+
+void
+reliable_free (struct reliable *rel)
+{
+  int i;
   for (i = 0; i < rel->size; ++i)
     {
       struct reliable_entry *e = &rel->array[i];
-      e->buf = alloc_buf (buf_size);
-      ASSERT (buf_init (&e->buf, offset));
+      buffer_pool_put (rel->pool, &e->buf);
     }
+  free (rel->array);
+  rel->array = NULL;
 }
 
+/* give buffers of unused entries back to the pool */
 void
-reliable_free (struct reliable *rel)
+reliable_release_idle_buffers (struct reliable *rel)
 {
   int i;
   for (i = 0; i < rel->size; ++i)
     {
       struct reliable_entry *e = &rel->array[i];
-      free_buf (&e->buf);
+      if (!e->active && e->buf.data)
+	buffer_pool_put (rel->pool, &e->buf);
     }
 }
 
+/* bytes of buffer memory currently borrowed from the pool */
+size_t
+reliable_buffer_size (const struct reliable *rel)
+{
+  size_t ret = 0;
+  int i;
+  for (i = 0; i < rel->size; ++i)
+    {
+      const struct reliable_entry *e = &rel->array[i];
+      if (e->buf.data)
+	ret += e->buf.capacity;
+    }
+  return ret;
+}
+
 /* no active buffers? */
 bool
 reliable_empty (const struct reliable *rel)
@@ -311,6 +337,58 @@ reliable_empty (const struct reliable *rel)
   return true;
 }
 
+/*
+ * Fold the round trip time of a packet sent at *sent into
+ * rel->srtt and rel->rttvar and derive the retransmit timeout
+ * from them as in RFC 6298.  Timers run in whole seconds, so
+ * the clock granularity G is one second and the timeout is
+ * rounded up.
+ */
+static void
+reliable_rtt_sample (struct reliable *rel, const struct timeval *sent)
+{
+  struct timeval tv, delta;
+  int sample, rto;
+
+  openvpn_gettimeofday (&tv, NULL);
+  tv_delta (&delta, sent, &tv);
+  sample = max_int (delta.tv_sec * 1000 + delta.tv_usec / 1000, 1);
+  if (rel->srtt)
+    {
+      rel->rttvar += (abs (rel->srtt - sample) - rel->rttvar) / 4;
+      rel->srtt += (sample - rel->srtt) / 8;
+    }
+  else
+    {
+      rel->srtt = sample;
+      rel->rttvar = sample / 2;
+    }
+  rto = rel->srtt + max_int (RELIABLE_RTO_GRANULARITY, 4 * rel->rttvar);
+  rel->rto = constrain_int ((rto + 999) / 1000, 1, RELIABLE_RTO_MAX);
+}
+
+/*
+ * Each acknowledgment names the packets it covers, so a packet
+ * still outstanding after several later ones were acknowledged
+ * was most likely lost.  Resend it now rather than at its timeout.
+ */
+static void
+reliable_sack (struct reliable *rel, const packet_id_type acked)
+{
+  int i;
+  for (i = 0; i < rel->size; ++i)
+    {
+      struct reliable_entry *e = &rel->array[i];
+      if (e->active && e->n_sent && reliable_pid_min (e->packet_id, acked)
+	  && ++e->n_sacked == RELIABLE_FAST_RETRANSMIT)
+	{
+	  dmsg (D_REL_LOW, "ACK fast retransmit ID " packet_id_format,
+		(packet_id_print_type)e->packet_id);
+	  e->next_try = now;
+	}
+    }
+}
+
 /* del acknowledged items from send buf */
 void
 reliable_send_purge (struct reliable *rel, struct reliable_ack *ack)
@@ -337,7 +415,11 @@ reliable_send_purge (struct reliable *rel, struct reliable_ack *ack)
 		  }
 	      }
 #endif
+	      /* retransmitted packets give ambiguous samples (Karn) */
+	      if (e->n_sent == 1)
+		reliable_rtt_sample (rel, &e->sent);
 	      e->active = false;
+	      reliable_sack (rel, pid);
 	      break;
 	    }
 	}
@@ -431,6 +513,8 @@ reliable_get_buf (struct reliable *rel)
       struct reliable_entry *e = &rel->array[i];
       if (!e->active)
 	{
+	  if (!e->buf.data)
+	    e->buf = buffer_pool_get (rel->pool);
 	  ASSERT (buf_init (&e->buf, rel->offset));
 	  return &e->buf;
 	}
@@ -474,6 +558,24 @@ reliable_get_buf_output_sequenced (struct reliable *rel)
   return ret;
 }
 
+/* get the last queued outgoing buffer if it was never sent */
+struct buffer *
+reliable_get_buf_output_unsent (struct reliable *rel, int opcode)
+{
+  int i;
+  for (i = 0; i < rel->size; ++i)
+    {
+      struct reliable_entry *e = &rel->array[i];
+      if (e->active && e->packet_id == rel->packet_id - 1)
+	{
+	  if (!e->n_sent && e->opcode == opcode)
+	    return &e->buf;
+	  break;
+	}
+    }
+  return NULL;
+}
+
 /* get active buffer for next sequentially increasing key ID */
 struct buffer *
 reliable_get_buf_sequenced (struct reliable *rel)
@@ -565,6 +667,9 @@ reliable_send (struct reliable *rel, int *opcode)
       /* constant timeout, no backoff */
       best->next_try = local_now + best->timeout;
 #endif
+      if (!best->n_sent++)
+	openvpn_gettimeofday (&best->sent, NULL);
+      best->n_sacked = 0;
       *opcode = best->opcode;
       dmsg (D_REL_DEBUG, "ACK reliable_send ID " packet_id_format " (size=%d to=%d)",
 	   (packet_id_print_type)best->packet_id, best->buf.len,
@@ -587,7 +692,7 @@ reliable_schedule_now (struct reliable *rel)
       if (e->active)
 	{
 	  e->next_try = now;
-	  e->timeout = rel->initial_timeout;
+	  e->timeout = reliable_rto (rel);
 	}
     }
 }
@@ -681,7 +786,9 @@ reliable_mark_active_outgoing (struct reliable *rel, struct buffer *buf, int opc
 	  e->active = true;
 	  e->opcode = opcode;
 	  e->next_try = 0;
-	  e->timeout = rel->initial_timeout;
+	  e->timeout = reliable_rto (rel);
+	  e->n_sent = 0;
+	  e->n_sacked = 0;
 	  dmsg (D_REL_DEBUG, "ACK mark active outgoing ID " packet_id_format, (packet_id_print_type)e->packet_id);
 	  return;
 	}
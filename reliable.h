@@ -47,13 +47,25 @@
 #define EXPONENTIAL_BACKOFF
 
 #define RELIABLE_ACK_SIZE 8     /**< The maximum number of packet IDs
-                                 *   waiting to be acknowledged which can
-                                 *   be stored in one \c reliable_ack
-                                 *   structure. */
+                                 *   written into one acknowledgment
+                                 *   record on the wire, which older
+                                 *   peers refuse to exceed. */
 
-#define RELIABLE_CAPACITY 8	/**< The maximum number of packets that
+#define RELIABLE_CAPACITY 64	/**< The maximum number of packets that
                                  *   the reliability layer for one VPN
-                                 *   tunnel in one direction can store. */
+                                 *   tunnel in one direction can store,
+                                 *   see \c --tls-window. */
+
+#define RELIABLE_FAST_RETRANSMIT 3 /**< Number of later packets which,
+                                 *   once acknowledged, make an
+                                 *   unacknowledged packet be resent
+                                 *   without waiting for its timeout. */
+
+#define RELIABLE_RTO_GRANULARITY 1000 /**< Timer granularity in ms, the
+                                 *   G of RFC 6298. */
+
+#define RELIABLE_RTO_MAX 60	/**< Upper bound of the retransmit
+                                 *   timeout in seconds. */
 
 /**
  * The acknowledgment structure in which packet IDs are stored for later
@@ -62,7 +74,7 @@
 struct reliable_ack
 {
   int len;
-  packet_id_type packet_id[RELIABLE_ACK_SIZE];
+  packet_id_type packet_id[RELIABLE_CAPACITY];
 };
 
 /**
@@ -76,6 +88,9 @@ struct reliable_entry
   time_t next_try;
   packet_id_type packet_id;
   int opcode;
+  int n_sent;                   /* times sent, for round trip sampling */
+  int n_sacked;                 /* later packets acknowledged since last sent */
+  struct timeval sent;          /* time of first send */
   struct buffer buf;
 };
 
@@ -90,7 +105,11 @@ struct reliable
   packet_id_type packet_id;
   int offset;
   bool hold; /* don't xmit until reliable_schedule_now is called */
-  struct reliable_entry array[RELIABLE_CAPACITY];
+  int srtt;  /* smoothed round trip time in ms of packets ACKed on first send, 0 if unknown */
+  int rttvar; /* round trip time variation in ms */
+  interval_t rto; /* retransmit timeout derived from srtt and rttvar, valid if srtt */
+  struct buffer_pool *pool; /* entry buffers are borrowed from here on demand */
+  struct reliable_entry *array; /* size entries */
 };
 
 
@@ -183,16 +202,21 @@ bool reliable_ack_write (struct reliable_ack *ack,
 /**
  * Initialize a reliable structure.
  * 
+ * No packet buffers are allocated by this function.  An entry borrows a
+ * buffer from \a pool the first time it is used, and keeps it until it
+ * is returned by \c reliable_release_idle_buffers() or \c
+ * reliable_free().
+ * 
  * @param rel The reliable structure to initialize.
- * @param buf_size The size of the buffers in which packets will be
- *     stored.
+ * @param pool The pool from which the buffers in which packets will be
+ *     stored are taken.
  * @param offset The size of reserved space at the beginning of the
  *     buffers to allow efficient header prepending.
  * @param array_size The number of packets that this reliable
  *     structure can store simultaneously.
  * @param hold description
  */
-void reliable_init (struct reliable *rel, int buf_size, int offset, int array_size, bool hold);
+void reliable_init (struct reliable *rel, struct buffer_pool *pool, int offset, int array_size, bool hold);
 
 /**
  * Free allocated memory associated with a reliable structure.
@@ -201,6 +225,24 @@ void reliable_init (struct reliable *rel, int buf_size, int offset, int array_si
  */
 void reliable_free (struct reliable *rel);
 
+/**
+ * Return the buffers of all inactive entries to the pool.
+ * 
+ * Entries which still hold a packet, i.e. unacknowledged outgoing
+ * packets or out-of-order incoming packets, keep their buffers.
+ * 
+ * @param rel The reliable structure whose idle buffers to release.
+ */
+void reliable_release_idle_buffers (struct reliable *rel);
+
+/**
+ * Return the number of bytes of buffer memory currently held by a
+ * reliable structure.
+ * 
+ * @param rel The reliable structure to inspect.
+ */
+size_t reliable_buffer_size (const struct reliable *rel);
+
 /* add to extra_frame the maximum number of bytes we will need for reliable_ack_write */
 void reliable_ack_adjust_frame_parameters (struct frame* frame, int max);
 
@@ -362,6 +404,20 @@ void reliable_mark_deleted (struct reliable *rel, struct buffer *buf, bool inc_p
  */
 struct buffer *reliable_get_buf_output_sequenced (struct reliable *rel);
 
+/**
+ * Get the buffer of the most recently queued outgoing packet if it
+ *     has not been sent yet, so that more payload can be appended to it.
+ * 
+ * @param rel The reliable structure for handling this VPN tunnel's
+ *     outgoing packets.
+ * @param opcode The opcode the packet must have been queued with.
+ * 
+ * @return A pointer to the buffer of that packet, which starts with its
+ *     packet ID, or NULL if there is no such packet or it was already
+ *     sent at least once.
+ */
+struct buffer *reliable_get_buf_output_unsent (struct reliable *rel, int opcode);
+
 /**
  * Mark the reliable entry associated with the given buffer as
  *     active outgoing.
@@ -465,6 +521,13 @@ reliable_set_timeout (struct reliable *rel, interval_t timeout)
   rel->initial_timeout = timeout;
 }
 
+/* timeout for the first retransmission of a packet */
+static inline interval_t
+reliable_rto (const struct reliable *rel)
+{
+  return rel->srtt ? rel->rto : rel->initial_timeout;
+}
+
 /* print a reliable ACK record coming off the wire */
 const char *reliable_ack_print (struct buffer *buf, bool verbose, struct gc_arena *gc);
 
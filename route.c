@@ -36,6 +36,7 @@
 #include "manage.h"
 #include "win32.h"
 #include "options.h"
+#include "fdmisc.h"
 
 #include "memdbg.h"
 
@@ -890,9 +891,22 @@ void
 add_routes (struct route_list *rl, struct route_ipv6_list *rl6,
 	    const struct tuntap *tt, unsigned int flags, const struct env_set *es)
 {
+#ifdef ENABLE_RTNETLINK
+  bool batch;
+#endif
+
   if (rl) 
       redirect_default_route_to_vpn (rl, tt, flags, es);
 
+#ifdef ENABLE_RTNETLINK
+  /*
+   * Queue the whole route list and hand it to the kernel in one go.
+   * The redirect routes above are kept out of the batch since they
+   * are built on the stack of redirect_default_route_to_vpn.
+   */
+  batch = rtnl_batch_begin (flags);
+#endif
+
   if (rl && !rl->routes_added)
     {
       int i;
@@ -932,6 +946,11 @@ add_routes (struct route_list *rl, struct route_ipv6_list *rl6,
 	}
       rl6->routes_added = true;
     }
+
+#ifdef ENABLE_RTNETLINK
+  if (batch)
+    rtnl_batch_end ();
+#endif
 }
 
 void
@@ -941,11 +960,18 @@ delete_routes (struct route_list *rl, struct route_ipv6_list *rl6,
   if (rl && rl->routes_added)
     {
       int i;
+#ifdef ENABLE_RTNETLINK
+      const bool batch = rtnl_batch_begin (flags);
+#endif
       for (i = rl->n - 1; i >= 0; --i)
 	{
 	  const struct route *r = &rl->routes[i];
 	  delete_route (r, tt, flags, es);
 	}
+#ifdef ENABLE_RTNETLINK
+      if (batch)
+	rtnl_batch_end ();
+#endif
       rl->routes_added = false;
     }
 
@@ -958,11 +984,18 @@ delete_routes (struct route_list *rl, struct route_ipv6_list *rl6,
   if ( rl6 && rl6->routes_added )
     {
       int i;
+#ifdef ENABLE_RTNETLINK
+      const bool batch = rtnl_batch_begin (flags);
+#endif
       for (i = rl6->n - 1; i >= 0; --i)
 	{
 	  const struct route_ipv6 *r6 = &rl6->routes_ipv6[i];
 	  delete_route_ipv6 (r6, tt, flags, es);
 	}
+#ifdef ENABLE_RTNETLINK
+      if (batch)
+	rtnl_batch_end ();
+#endif
       rl6->routes_added = false;
     }
 
@@ -1080,6 +1113,312 @@ setenv_routes_ipv6 (struct env_set *es, const struct route_ipv6_list *rl6)
     setenv_route_ipv6 (es, &rl6->routes_ipv6[i], i + 1);
 }
 
+#ifdef ENABLE_RTNETLINK
+
+/*
+ * rtnetlink batching.  Each queued request carries NLM_F_ACK and a
+ * sequence number, so once the batch has been sent we read back one
+ * ack per request and can attribute failures to the right route.
+ */
+
+#define RTNL_BATCH_MAX     256    /* max requests in flight */
+#define RTNL_BATCH_BYTES   16384  /* send buffer */
+#define RTNL_MSG_MAX       128    /* max size of a single request */
+
+struct rtnl_request
+{
+  const char *what;
+  bool *status;
+  bool acked;
+};
+
+struct rtnl_batch
+{
+  int fd;
+  int depth;
+  unsigned int seq; /* sequence number of req[0] */
+  int n;
+  int len;
+  struct gc_arena gc;
+  struct rtnl_request req[RTNL_BATCH_MAX];
+  uint8_t buf[RTNL_BATCH_BYTES];
+};
+
+static struct rtnl_batch *rtnl_batch; /* GLOBAL */
+
+static void
+rtnl_request_done (struct rtnl_request *r, const int err)
+{
+  r->acked = true;
+  if (err)
+    {
+      msg (M_WARN, "ERROR: %s failed: %s", r->what, strerror_ts (err, &rtnl_batch->gc));
+      if (r->status)
+	*r->status = false;
+    }
+}
+
+/*
+ * Send the queued requests and collect their acks.
+ */
+static void
+rtnl_batch_flush (void)
+{
+  struct rtnl_batch *b = rtnl_batch;
+  struct sockaddr_nl snl;
+  int n_acked = 0;
+  int i;
+
+  if (!b->n)
+    return;
+
+  CLEAR (snl);
+  snl.nl_family = AF_NETLINK;
+  if (sendto (b->fd, b->buf, b->len, 0, (struct sockaddr *) &snl, sizeof (snl)) != b->len)
+    msg (M_WARN | M_ERRNO, "ROUTE: rtnetlink send failed");
+  else
+    {
+      while (n_acked < b->n)
+	{
+	  uint8_t rbuf[8192];
+	  struct nlmsghdr *h;
+	  int len = recv (b->fd, rbuf, sizeof (rbuf), 0);
+
+	  if (len < 0)
+	    {
+	      if (errno == EINTR)
+		continue;
+	      msg (M_WARN | M_ERRNO, "ROUTE: rtnetlink receive failed");
+	      break;
+	    }
+	  for (h = (struct nlmsghdr *) rbuf; NLMSG_OK (h, len); h = NLMSG_NEXT (h, len))
+	    {
+	      const unsigned int k = h->nlmsg_seq - b->seq;
+	      if (h->nlmsg_type == NLMSG_ERROR && k < (unsigned int) b->n && !b->req[k].acked)
+		{
+		  const struct nlmsgerr *e = (const struct nlmsgerr *) NLMSG_DATA (h);
+		  rtnl_request_done (&b->req[k], -e->error);
+		  ++n_acked;
+		}
+	    }
+	}
+    }
+
+  /* anything left unacked is a failure */
+  for (i = 0; i < b->n; ++i)
+    if (!b->req[i].acked)
+      rtnl_request_done (&b->req[i], EIO);
+
+  b->seq += b->n;
+  b->n = 0;
+  b->len = 0;
+  gc_free (&b->gc);
+}
+
+bool
+rtnl_batch_begin (const unsigned int flags)
+{
+  const int method = flags & ROUTE_METHOD_MASK;
+
+  if (method == ROUTE_METHOD_EXE)
+    return false;
+
+  if (!rtnl_batch)
+    {
+      struct sockaddr_nl snl;
+      const int fd = socket (AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+
+      CLEAR (snl);
+      snl.nl_family = AF_NETLINK;
+      if (fd < 0 || bind (fd, (struct sockaddr *) &snl, sizeof (snl)) < 0)
+	{
+	  msg ((method == ROUTE_METHOD_NETLINK ? M_FATAL : D_ROUTE) | M_ERRNO,
+	       "ROUTE: cannot open rtnetlink socket");
+	  if (fd >= 0)
+	    close (fd);
+	  return false;
+	}
+      set_cloexec (fd);
+
+      ALLOC_OBJ_CLEAR (rtnl_batch, struct rtnl_batch);
+      rtnl_batch->fd = fd;
+      rtnl_batch->seq = (unsigned int) now;
+      rtnl_batch->gc = gc_new ();
+    }
+  ++rtnl_batch->depth;
+  return true;
+}
+
+void
+rtnl_batch_end (void)
+{
+  ASSERT (rtnl_batch && rtnl_batch->depth > 0);
+  if (!--rtnl_batch->depth)
+    {
+      rtnl_batch_flush ();
+      close (rtnl_batch->fd);
+      free (rtnl_batch);
+      rtnl_batch = NULL;
+    }
+}
+
+static struct nlmsghdr *
+rtnl_msg_new (const int type, const int flags, const void *body, const int body_len,
+	      const char *what, bool *status)
+{
+  struct rtnl_batch *b = rtnl_batch;
+  struct rtnl_request *r;
+  struct nlmsghdr *h;
+
+  ASSERT (b && b->depth > 0);
+  if (b->n == RTNL_BATCH_MAX || b->len + RTNL_MSG_MAX > RTNL_BATCH_BYTES)
+    rtnl_batch_flush ();
+
+  msg (D_ROUTE, "%s", what);
+
+  h = (struct nlmsghdr *) (b->buf + b->len);
+  memset (h, 0, RTNL_MSG_MAX);
+  h->nlmsg_len = NLMSG_LENGTH (body_len);
+  h->nlmsg_type = type;
+  h->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+  h->nlmsg_seq = b->seq + b->n;
+  memcpy (NLMSG_DATA (h), body, body_len);
+
+  r = &b->req[b->n++];
+  r->what = string_alloc (what, &b->gc);
+  r->status = status;
+  r->acked = false;
+  return h;
+}
+
+static void
+rtnl_msg_attr (struct nlmsghdr *h, const int type, const void *data, const int len)
+{
+  struct rtattr *rta = (struct rtattr *) ((uint8_t *) h + NLMSG_ALIGN (h->nlmsg_len));
+
+  ASSERT (NLMSG_ALIGN (h->nlmsg_len) + RTA_LENGTH (len) <= RTNL_MSG_MAX);
+  rta->rta_type = type;
+  rta->rta_len = RTA_LENGTH (len);
+  memcpy (RTA_DATA (rta), data, len);
+  h->nlmsg_len = NLMSG_ALIGN (h->nlmsg_len) + RTA_ALIGN (rta->rta_len);
+}
+
+static void
+rtnl_msg_end (struct nlmsghdr *h)
+{
+  rtnl_batch->len += NLMSG_ALIGN (h->nlmsg_len);
+}
+
+static inline int
+rtnl_addr_len (const int family)
+{
+  return family == AF_INET6 ? sizeof (struct in6_addr) : sizeof (struct in_addr);
+}
+
+void
+rtnl_route (const bool add, const int family, const void *dst, const int dst_len,
+	    const void *gateway, const int ifindex, const int metric,
+	    const char *what, bool *status)
+{
+  struct rtmsg rtm;
+  struct nlmsghdr *h;
+
+  CLEAR (rtm);
+  rtm.rtm_family = family;
+  rtm.rtm_dst_len = dst_len;
+  rtm.rtm_table = RT_TABLE_MAIN;
+  if (add)
+    {
+      rtm.rtm_protocol = RTPROT_BOOT;
+      rtm.rtm_scope = RT_SCOPE_UNIVERSE;
+      rtm.rtm_type = RTN_UNICAST;
+    }
+  else
+    rtm.rtm_scope = RT_SCOPE_NOWHERE;
+
+  h = rtnl_msg_new (add ? RTM_NEWROUTE : RTM_DELROUTE,
+		    add ? NLM_F_CREATE | NLM_F_EXCL : 0,
+		    &rtm, sizeof (rtm), what, status);
+  rtnl_msg_attr (h, RTA_DST, dst, rtnl_addr_len (family));
+  if (gateway)
+    rtnl_msg_attr (h, RTA_GATEWAY, gateway, rtnl_addr_len (family));
+  if (ifindex)
+    rtnl_msg_attr (h, RTA_OIF, &ifindex, sizeof (ifindex));
+  if (metric >= 0)
+    {
+      const uint32_t priority = metric;
+      rtnl_msg_attr (h, RTA_PRIORITY, &priority, sizeof (priority));
+    }
+  rtnl_msg_end (h);
+}
+
+void
+rtnl_addr (const bool add, const int family, const int ifindex,
+	   const void *local, const void *peer, const int prefixlen,
+	   const void *broadcast, const char *what, bool *status)
+{
+  struct ifaddrmsg ifa;
+  struct nlmsghdr *h;
+
+  CLEAR (ifa);
+  ifa.ifa_family = family;
+  ifa.ifa_prefixlen = prefixlen;
+  ifa.ifa_scope = RT_SCOPE_UNIVERSE;
+  ifa.ifa_index = ifindex;
+
+  h = rtnl_msg_new (add ? RTM_NEWADDR : RTM_DELADDR,
+		    add ? NLM_F_CREATE | NLM_F_EXCL : 0,
+		    &ifa, sizeof (ifa), what, status);
+  rtnl_msg_attr (h, IFA_LOCAL, local, rtnl_addr_len (family));
+  rtnl_msg_attr (h, IFA_ADDRESS, peer ? peer : local, rtnl_addr_len (family));
+  if (broadcast)
+    rtnl_msg_attr (h, IFA_BROADCAST, broadcast, rtnl_addr_len (family));
+  rtnl_msg_end (h);
+}
+
+void
+rtnl_link_up (const int ifindex, const int mtu, const char *what, bool *status)
+{
+  struct ifinfomsg ifi;
+  struct nlmsghdr *h;
+  const uint32_t m = mtu;
+
+  CLEAR (ifi);
+  ifi.ifi_family = AF_UNSPEC;
+  ifi.ifi_index = ifindex;
+  ifi.ifi_flags = IFF_UP;
+  ifi.ifi_change = IFF_UP;
+
+  h = rtnl_msg_new (RTM_NEWLINK, 0, &ifi, sizeof (ifi), what, status);
+  rtnl_msg_attr (h, IFLA_MTU, &m, sizeof (m));
+  rtnl_msg_end (h);
+}
+
+static void
+route_ipv4_rtnl (const bool add, const struct route *r, bool *status)
+{
+  struct gc_arena gc = gc_new ();
+  struct buffer what = alloc_buf_gc (128, &gc);
+  const in_addr_t network = htonl (r->network);
+  const in_addr_t gateway = htonl (r->gateway);
+  const int netbits = count_netmask_bits (print_in_addr_t (r->netmask, 0, &gc));
+
+  buf_printf (&what, "rtnetlink: route %s %s/%d",
+	      add ? "add" : "del",
+	      print_in_addr_t (r->network, 0, &gc),
+	      netbits);
+  if (add)
+    buf_printf (&what, " via %s", print_in_addr_t (r->gateway, 0, &gc));
+  if (r->metric_defined)
+    buf_printf (&what, " metric %d", r->metric);
+
+  rtnl_route (add, AF_INET, &network, netbits, add ? &gateway : NULL, 0,
+	      r->metric_defined ? r->metric : -1, BSTR (&what), status);
+  gc_free (&gc);
+}
+
+#endif /* ENABLE_RTNETLINK */
+
 void
 add_route (struct route *r, const struct tuntap *tt, unsigned int flags, const struct env_set *es)
 {
@@ -1111,26 +1450,37 @@ add_route (struct route *r, const struct tuntap *tt, unsigned int flags, const s
     }
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNETLINK
+  if (rtnl_batch_begin (flags))
+    {
+      route_ipv4_rtnl (true, r, &r->defined);
+      rtnl_batch_end ();
+      status = r->defined;
+    }
+  else
+#endif
+    {
 #ifdef CONFIG_FEATURE_IPROUTE
-  argv_printf (&argv, "%s route add %s/%d via %s",
-  	      iproute_path,
-	      network,
-	      count_netmask_bits(netmask),
-	      gateway);
-  if (r->metric_defined)
-    argv_printf_cat (&argv, "metric %d", r->metric);
+      argv_printf (&argv, "%s route add %s/%d via %s",
+		  iproute_path,
+		  network,
+		  count_netmask_bits(netmask),
+		  gateway);
+      if (r->metric_defined)
+	argv_printf_cat (&argv, "metric %d", r->metric);
 
 #else
-  argv_printf (&argv, "%s add -net %s netmask %s gw %s",
-		ROUTE_PATH,
-	      network,
-	      netmask,
-	      gateway);
-  if (r->metric_defined)
-    argv_printf_cat (&argv, "metric %d", r->metric);
+      argv_printf (&argv, "%s add -net %s netmask %s gw %s",
+		    ROUTE_PATH,
+		  network,
+		  netmask,
+		  gateway);
+      if (r->metric_defined)
+	argv_printf_cat (&argv, "metric %d", r->metric);
 #endif  /*CONFIG_FEATURE_IPROUTE*/
-  argv_msg (D_ROUTE, &argv);
-  status = openvpn_execve_check (&argv, es, 0, "ERROR: Linux route add command failed");
+      argv_msg (D_ROUTE, &argv);
+      status = openvpn_execve_check (&argv, es, 0, "ERROR: Linux route add command failed");
+    }
 
 #elif defined (WIN32)
 
@@ -1274,9 +1624,8 @@ add_route (struct route *r, const struct tuntap *tt, unsigned int flags, const s
 }
 
 
-static const char * 
-print_in6_addr_netbits_only( struct in6_addr network_copy, int netbits, 
-                             struct gc_arena * gc)
+static struct in6_addr
+in6_addr_netbits_only( struct in6_addr network_copy, int netbits )
 {
   /* clear host bit parts of route 
    * (needed if routes are specified improperly, or if we need to 
@@ -1293,9 +1642,48 @@ print_in6_addr_netbits_only( struct in6_addr network_copy, int netbits,
 	{ network_copy.s6_addr[byte--] &= (~0 << bits_to_clear); bits_to_clear = 0; }
     }
 
-  return print_in6_addr( network_copy, 0, gc);
+  return network_copy;
+}
+
+static const char * 
+print_in6_addr_netbits_only( struct in6_addr network_copy, int netbits, 
+                             struct gc_arena * gc)
+{
+  return print_in6_addr( in6_addr_netbits_only( network_copy, netbits ), 0, gc);
+}
+
+#ifdef ENABLE_RTNETLINK
+
+static void
+route_ipv6_rtnl (const bool add, const struct route_ipv6 *r6, const struct tuntap *tt, bool *status)
+{
+  struct gc_arena gc = gc_new ();
+  struct buffer what = alloc_buf_gc (128, &gc);
+  const struct in6_addr network = in6_addr_netbits_only (r6->network, r6->netbits);
+  const int ifindex = if_nametoindex (tt->actual_name);
+
+  buf_printf (&what, "rtnetlink: -6 route %s %s/%d dev %s",
+	      add ? "add" : "del",
+	      print_in6_addr (network, 0, &gc),
+	      r6->netbits,
+	      tt->actual_name);
+  if (add && r6->metric_defined)
+    buf_printf (&what, " metric %d", r6->metric);
+
+  if (ifindex)
+    rtnl_route (add, AF_INET6, &network, r6->netbits, NULL, ifindex,
+		add && r6->metric_defined ? r6->metric : -1, BSTR (&what), status);
+  else
+    {
+      msg (M_WARN, "ERROR: %s failed: no such device", BSTR (&what));
+      if (status)
+	*status = false;
+    }
+  gc_free (&gc);
 }
 
+#endif /* ENABLE_RTNETLINK */
+
 void
 add_route_ipv6 (struct route_ipv6 *r6, const struct tuntap *tt, unsigned int flags, const struct env_set *es)
 {
@@ -1332,26 +1720,37 @@ add_route_ipv6 (struct route_ipv6 *r6, const struct tuntap *tt, unsigned int fla
    */
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNETLINK
+  if (rtnl_batch_begin (flags))
+    {
+      route_ipv6_rtnl (true, r6, tt, &r6->defined);
+      rtnl_batch_end ();
+      status = r6->defined;
+    }
+  else
+#endif
+    {
 #ifdef CONFIG_FEATURE_IPROUTE
-  argv_printf (&argv, "%s -6 route add %s/%d dev %s",
-  	      iproute_path,
-	      network,
-	      r6->netbits,
-	      device);
-  if (r6->metric_defined)
-    argv_printf_cat (&argv, " metric %d", r6->metric);
+      argv_printf (&argv, "%s -6 route add %s/%d dev %s",
+		  iproute_path,
+		  network,
+		  r6->netbits,
+		  device);
+      if (r6->metric_defined)
+	argv_printf_cat (&argv, " metric %d", r6->metric);
 
 #else
-  argv_printf (&argv, "%s -A inet6 add %s/%d dev %s",
-		ROUTE_PATH,
-	      network,
-	      r6->netbits,
-	      device);
-  if (r6->metric_defined)
-    argv_printf_cat (&argv, " metric %d", r6->metric);
+      argv_printf (&argv, "%s -A inet6 add %s/%d dev %s",
+		    ROUTE_PATH,
+		  network,
+		  r6->netbits,
+		  device);
+      if (r6->metric_defined)
+	argv_printf_cat (&argv, " metric %d", r6->metric);
 #endif  /*CONFIG_FEATURE_IPROUTE*/
-  argv_msg (D_ROUTE, &argv);
-  status = openvpn_execve_check (&argv, es, 0, "ERROR: Linux route -6/-A inet6 add command failed");
+      argv_msg (D_ROUTE, &argv);
+      status = openvpn_execve_check (&argv, es, 0, "ERROR: Linux route -6/-A inet6 add command failed");
+    }
 
 #elif defined (WIN32)
 
@@ -1474,22 +1873,32 @@ delete_route (const struct route *r, const struct tuntap *tt, unsigned int flags
   gateway = print_in_addr_t (r->gateway, 0, &gc);
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNETLINK
+  if (rtnl_batch_begin (flags))
+    {
+      route_ipv4_rtnl (false, r, NULL);
+      rtnl_batch_end ();
+    }
+  else
+#endif
+    {
 #ifdef CONFIG_FEATURE_IPROUTE
-  argv_printf (&argv, "%s route del %s/%d",
-  	      iproute_path,
-	      network,
-	      count_netmask_bits(netmask));
+      argv_printf (&argv, "%s route del %s/%d",
+		  iproute_path,
+		  network,
+		  count_netmask_bits(netmask));
 #else
 
-  argv_printf (&argv, "%s del -net %s netmask %s",
-		ROUTE_PATH,
-	      network,
-	      netmask);
+      argv_printf (&argv, "%s del -net %s netmask %s",
+		    ROUTE_PATH,
+		  network,
+		  netmask);
 #endif /*CONFIG_FEATURE_IPROUTE*/
-  if (r->metric_defined)
-    argv_printf_cat (&argv, "metric %d", r->metric);
-  argv_msg (D_ROUTE, &argv);
-  openvpn_execve_check (&argv, es, 0, "ERROR: Linux route delete command failed");
+      if (r->metric_defined)
+	argv_printf_cat (&argv, "metric %d", r->metric);
+      argv_msg (D_ROUTE, &argv);
+      openvpn_execve_check (&argv, es, 0, "ERROR: Linux route delete command failed");
+    }
 
 #elif defined (WIN32)
   
@@ -1621,21 +2030,31 @@ delete_route_ipv6 (const struct route_ipv6 *r6, const struct tuntap *tt, unsigne
   msg( M_INFO, "delete_route_ipv6(%s/%d)", network, r6->netbits );
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNETLINK
+  if (rtnl_batch_begin (flags))
+    {
+      route_ipv6_rtnl (false, r6, tt, NULL);
+      rtnl_batch_end ();
+    }
+  else
+#endif
+    {
 #ifdef CONFIG_FEATURE_IPROUTE
-  argv_printf (&argv, "%s -6 route del %s/%d dev %s",
-  	      iproute_path,
-	      network,
-	      r6->netbits,
-	      device);
+      argv_printf (&argv, "%s -6 route del %s/%d dev %s",
+		  iproute_path,
+		  network,
+		  r6->netbits,
+		  device);
 #else
-  argv_printf (&argv, "%s -A inet6 del %s/%d dev %s",
-		ROUTE_PATH,
-	      network,
-	      r6->netbits,
-	      device);
+      argv_printf (&argv, "%s -A inet6 del %s/%d dev %s",
+		    ROUTE_PATH,
+		  network,
+		  r6->netbits,
+		  device);
 #endif  /*CONFIG_FEATURE_IPROUTE*/
-  argv_msg (D_ROUTE, &argv);
-  openvpn_execve_check (&argv, es, 0, "ERROR: Linux route -6/-A inet6 del command failed");
+      argv_msg (D_ROUTE, &argv);
+      openvpn_execve_check (&argv, es, 0, "ERROR: Linux route -6/-A inet6 del command failed");
+    }
 
 #elif defined (WIN32)
 
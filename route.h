@@ -42,6 +42,17 @@
 #define ROUTE_METHOD_IPAPI     1  /* use IP helper API */
 #define ROUTE_METHOD_EXE       2  /* use route.exe */
 #define ROUTE_METHOD_MASK      3
+#elif defined(TARGET_LINUX)
+/*
+ * Linux route methods
+ */
+#define ROUTE_METHOD_ADAPTIVE  0  /* try rtnetlink first then ip/route */
+#define ROUTE_METHOD_NETLINK   1  /* use rtnetlink */
+#define ROUTE_METHOD_EXE       2  /* run the ip/route command */
+#define ROUTE_METHOD_MASK      3
+#if defined(HAVE_LINUX_NETLINK_H) && defined(HAVE_LINUX_RTNETLINK_H)
+#define ENABLE_RTNETLINK
+#endif
 #endif
 
 /*
@@ -258,6 +269,30 @@ bool del_route_ipapi (const struct route *r, const struct tuntap *tt);
 static inline bool test_routes (const struct route_list *rl, const struct tuntap *tt) { return true; }
 #endif
 
+#ifdef ENABLE_RTNETLINK
+
+/*
+ * Route, address and link changes sent over an rtnetlink socket.
+ * Requests made between rtnl_batch_begin and rtnl_batch_end are
+ * queued and sent to the kernel together, so that installing a
+ * long route list costs a few system calls rather than a fork and
+ * exec per route.  Batches nest; the outermost rtnl_batch_end
+ * flushes.  If status is non-NULL, *status is cleared when the
+ * request fails.
+ */
+bool rtnl_batch_begin (const unsigned int flags);
+void rtnl_batch_end (void);
+
+void rtnl_route (const bool add, const int family, const void *dst, const int dst_len,
+		 const void *gateway, const int ifindex, const int metric,
+		 const char *what, bool *status);
+void rtnl_addr (const bool add, const int family, const int ifindex,
+		const void *local, const void *peer, const int prefixlen,
+		const void *broadcast, const char *what, bool *status);
+void rtnl_link_up (const int ifindex, const int mtu, const char *what, bool *status);
+
+#endif
+
 bool netmask_to_netbits (const in_addr_t network, const in_addr_t netmask, int *netbits);
 
 static inline in_addr_t
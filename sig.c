@@ -259,6 +259,20 @@ print_status (const struct context *c, struct status_output *so)
   if (lzo_defined (&c->c2.lzo_compwork))
     lzo_print_stats (&c->c2.lzo_compwork, so);
 #endif
+#if defined(USE_CRYPTO) && defined(USE_SSL)
+  if (c->c2.tls_multi)
+    status_printf (so, "Control channel buffer bytes,%u",
+		   (unsigned int) tls_multi_buffer_size (c->c2.tls_multi));
+#endif
+#ifdef ENABLE_FRAGMENT
+  if (c->c2.fragment)
+    {
+      status_printf (so, "Fragment buffer bytes,%u",
+		     (unsigned int) fragment_buffer_size (c->c2.fragment));
+      status_printf (so, "Fragment buffer pool drops," counter_format,
+		     c->c2.fragment->n_pool_drops);
+    }
+#endif
 #ifdef PACKET_TRUNCATION_CHECK
   status_printf (so, "TUN read truncations," counter_format, c->c2.n_trunc_tun_read);
   status_printf (so, "TUN write truncations," counter_format, c->c2.n_trunc_tun_write);
@@ -111,6 +111,32 @@ show_tls_performance_stats(void)
 #endif
 
 
+/*
+ * Control channel buffers are only needed while a key_state is
+ * negotiating or has control channel messages in flight.  Rather than
+ * keeping a full set per key_state for the lifetime of the client, they
+ * are borrowed from these pools on demand and returned once the key_state
+ * has gone quiet.
+ */
+static struct buffer_pool tls_packet_buf_pool;    /* GLOBAL */
+static struct buffer_pool tls_plaintext_buf_pool; /* GLOBAL */
+
+static struct buffer_pool *
+tls_buf_pool (struct buffer_pool *pool, int buf_size)
+{
+  if (!pool->buf_size)
+    buffer_pool_init (pool, buf_size, TLS_BUF_POOL_MAX_FREE, 0);
+  else if (pool->buf_size < buf_size)
+    {
+      /*
+       * Frame grew.  Only grow, so that buffers fit every frame
+       * still in use; smaller ones still out are freed when returned.
+       */
+      buffer_pool_resize (pool, buf_size);
+    }
+  return pool;
+}
+
 /*
  * Max number of bytes we will add
  * for data structures common to both
@@ -163,6 +189,9 @@ free_ssl_lib ()
   crypto_uninit_lib ();
 
   tls_free_lib();
+
+  buffer_pool_free (&tls_packet_buf_pool);
+  buffer_pool_free (&tls_plaintext_buf_pool);
 }
 
 /*
@@ -552,15 +581,14 @@ key_state_init (struct tls_session *session, struct key_state *ks)
   ALLOC_OBJ_CLEAR (ks->rec_reliable, struct reliable);
   ALLOC_OBJ_CLEAR (ks->rec_ack, struct reliable_ack);
 
-  /* allocate buffers */
-  ks->plaintext_read_buf = alloc_buf (TLS_CHANNEL_BUF_SIZE);
-  ks->plaintext_write_buf = alloc_buf (TLS_CHANNEL_BUF_SIZE);
-  ks->ack_write_buf = alloc_buf (BUF_SIZE (&session->opt->frame));
-  reliable_init (ks->send_reliable, BUF_SIZE (&session->opt->frame),
-		 FRAME_HEADROOM (&session->opt->frame), TLS_RELIABLE_N_SEND_BUFFERS,
+  /* buffers are taken from the pools on demand, see key_state_get_buffers */
+  tls_buf_pool (&tls_packet_buf_pool, BUF_SIZE (&session->opt->frame));
+  tls_buf_pool (&tls_plaintext_buf_pool, TLS_CHANNEL_BUF_SIZE);
+  reliable_init (ks->send_reliable, &tls_packet_buf_pool,
+		 FRAME_HEADROOM (&session->opt->frame), session->opt->reliable_window,
 		 ks->key_id ? false : session->opt->xmit_hold);
-  reliable_init (ks->rec_reliable, BUF_SIZE (&session->opt->frame),
-		 FRAME_HEADROOM (&session->opt->frame), TLS_RELIABLE_N_REC_BUFFERS,
+  reliable_init (ks->rec_reliable, &tls_packet_buf_pool,
+		 FRAME_HEADROOM (&session->opt->frame), 2 * session->opt->reliable_window,
 		 false);
   reliable_set_timeout (ks->send_reliable, session->opt->packet_timeout);
 
@@ -585,22 +613,24 @@ key_state_init (struct tls_session *session, struct key_state *ks)
  * associated SSL-BIO, and the structures allocated for the \link reliable
  * Reliability Layer\endlink.
  *
+ * @param session      - A pointer to the \c tls_session structure
+ *                       associated with the \a ks argument.
  * @param ks           - A pointer to the \c key_state structure to be
  *                       cleaned up.
  * @param clear        - Whether the memory allocated for the \a ks object
  *                       should be overwritten with 0s.
  */
 static void
-key_state_free (struct key_state *ks, bool clear)
+key_state_free (struct tls_session *session, struct key_state *ks, bool clear)
 {
   ks->state = S_UNDEF;
 
   key_state_ssl_free(&ks->ks_ssl);
 
   free_key_ctx_bi (&ks->key);
-  free_buf (&ks->plaintext_read_buf);
-  free_buf (&ks->plaintext_write_buf);
-  free_buf (&ks->ack_write_buf);
+  buffer_pool_put (&tls_plaintext_buf_pool, &ks->plaintext_read_buf);
+  buffer_pool_put (&tls_plaintext_buf_pool, &ks->plaintext_write_buf);
+  buffer_pool_put (&tls_packet_buf_pool, &ks->ack_write_buf);
   buffer_list_free(ks->paybuf);
 
   if (ks->send_reliable)
@@ -625,12 +655,85 @@ key_state_free (struct key_state *ks, bool clear)
 
 #ifdef PLUGIN_DEF_AUTH
   key_state_rm_auth_control_file (ks);
+  key_state_rm_plugin_auth (ks, session->opt->plugins);
 #endif
 
   if (clear)
     CLEAR (*ks);
 }
 
+/**
+ * Borrow the plaintext and ACK buffers of a \c key_state structure from
+ * the control channel buffer pools, if it does not hold them already.
+ * The buffers of the \link reliable Reliability Layer\endlink are
+ * borrowed by the reliability layer itself when they are first used.
+ *
+ * @param ks           - A pointer to the \c key_state structure.
+ */
+static void
+key_state_get_buffers (struct key_state *ks)
+{
+  if (!ks->plaintext_read_buf.data)
+    ks->plaintext_read_buf = buffer_pool_get (&tls_plaintext_buf_pool);
+  if (!ks->plaintext_write_buf.data)
+    ks->plaintext_write_buf = buffer_pool_get (&tls_plaintext_buf_pool);
+  if (!ks->ack_write_buf.data)
+    ks->ack_write_buf = buffer_pool_get (&tls_packet_buf_pool);
+}
+
+/**
+ * Return the control channel buffers of an idle \c key_state structure to
+ * the pools.
+ *
+ * A \c key_state is idle once it has reached \c S_ACTIVE, all its
+ * outgoing packets have been acknowledged, it has no ACKs left to send
+ * and no plaintext waiting to be processed.  Buffers holding
+ * out-of-order incoming packets are kept.
+ *
+ * @param ks           - A pointer to the \c key_state structure.
+ */
+static void
+key_state_release_idle_buffers (struct key_state *ks)
+{
+  if (ks->state >= S_ACTIVE
+      && reliable_empty (ks->send_reliable)
+      && reliable_ack_empty (ks->rec_ack)
+      && !BLEN (&ks->plaintext_read_buf)
+      && !BLEN (&ks->plaintext_write_buf)
+      && !buffer_list_defined (ks->paybuf))
+    {
+      buffer_pool_put (&tls_plaintext_buf_pool, &ks->plaintext_read_buf);
+      buffer_pool_put (&tls_plaintext_buf_pool, &ks->plaintext_write_buf);
+      buffer_pool_put (&tls_packet_buf_pool, &ks->ack_write_buf);
+      reliable_release_idle_buffers (ks->send_reliable);
+      reliable_release_idle_buffers (ks->rec_reliable);
+    }
+}
+
+/**
+ * Return the number of bytes of control channel buffer memory currently
+ * held by a \c key_state structure.
+ *
+ * @param ks           - A pointer to the \c key_state structure.
+ */
+static size_t
+key_state_buffer_size (const struct key_state *ks)
+{
+  size_t ret = 0;
+
+  if (ks->state == S_UNDEF)
+    return 0;
+
+  ret += ks->plaintext_read_buf.data ? ks->plaintext_read_buf.capacity : 0;
+  ret += ks->plaintext_write_buf.data ? ks->plaintext_write_buf.capacity : 0;
+  ret += ks->ack_write_buf.data ? ks->ack_write_buf.capacity : 0;
+  if (ks->send_reliable)
+    ret += reliable_buffer_size (ks->send_reliable);
+  if (ks->rec_reliable)
+    ret += reliable_buffer_size (ks->rec_reliable);
+  return ret;
+}
+
 /** @} name Functions for initialization and cleanup of key_state structures */
 
 /** @} addtogroup control_processor */
@@ -738,7 +841,7 @@ tls_session_free (struct tls_session *session, bool clear)
     packet_id_free (session->tls_auth.packet_id);
 
   for (i = 0; i < KS_SIZE; ++i)
-    key_state_free (&session->key[i], false);
+    key_state_free (session, &session->key[i], false);
 
   if (session->common_name)
     free (session->common_name);
@@ -952,6 +1055,59 @@ tls_multi_free (struct tls_multi *multi, bool clear)
   free(multi);
 }
 
+/*
+ * Control channel buffer memory held by a tls_multi object.
+ */
+size_t
+tls_multi_buffer_size (const struct tls_multi *multi)
+{
+  size_t ret = 0;
+  int i, j;
+
+  if (multi)
+    {
+      for (i = 0; i < TM_SIZE; ++i)
+	for (j = 0; j < KS_SIZE; ++j)
+	  ret += key_state_buffer_size (&multi->session[i].key[j]);
+    }
+  return ret;
+}
+
+/*
+ * Smoothed control channel round trip time in ms of the
+ * active key, or 0 if not measured yet.
+ */
+int
+tls_multi_rtt (const struct tls_multi *multi)
+{
+  if (multi)
+    {
+      const struct key_state *ks = &multi->session[TM_ACTIVE].key[KS_PRIMARY];
+      if (ks->send_reliable)
+	return ks->send_reliable->srtt;
+    }
+  return 0;
+}
+
+int
+tls_multi_key_negotiations (const struct tls_multi *multi)
+{
+  return multi ? multi->n_key_negotiations : 0;
+}
+
+/*
+ * Control channel buffer memory owned by the pools, including buffers
+ * currently lent out.
+ */
+void
+tls_buffer_pool_stats (size_t *in_use, size_t *pooled)
+{
+  *in_use = (size_t) tls_packet_buf_pool.n_out * tls_packet_buf_pool.buf_size
+    + (size_t) tls_plaintext_buf_pool.n_out * tls_plaintext_buf_pool.buf_size;
+  *pooled = (size_t) tls_packet_buf_pool.n_free * tls_packet_buf_pool.buf_size
+    + (size_t) tls_plaintext_buf_pool.n_free * tls_plaintext_buf_pool.buf_size;
+}
+
 
 /*
  * Move a packet authentication HMAC + related fields to or from the front
@@ -1477,7 +1633,7 @@ key_state_soft_reset (struct tls_session *session)
   struct key_state *ks_lame = &session->key[KS_LAME_DUCK]; /* retiring key */
 
   ks->must_die = now + session->opt->transition_window; /* remaining lifetime of old key */
-  key_state_free (ks_lame, false);
+  key_state_free (session, ks_lame, false);
   *ks_lame = *ks;
 
   key_state_init (session, ks);
@@ -2013,10 +2169,12 @@ tls_process (struct tls_multi *multi,
 
   /* Kill lame duck key transition_window seconds after primary key negotiation */
   if (lame_duck_must_die (session, wakeup)) {
-	key_state_free (ks_lame, true);
+	key_state_free (session, ks_lame, true);
 	msg (D_TLS_DEBUG_LOW, "TLS: tls_process: killed expiring key");
   }
 
+  key_state_get_buffers (ks);
+
   do
     {
       update_time ();
@@ -2108,6 +2266,7 @@ tls_process (struct tls_multi *multi,
 		    print_details (&ks->ks_ssl, "Control Channel:");
 		  state_change = true;
 		  ks->state = S_ACTIVE;
+		  ++multi->n_key_negotiations;
 		  INCR_SUCCESS;
 
 		  /* Set outgoing address for data channel packets */
@@ -2122,27 +2281,6 @@ tls_process (struct tls_multi *multi,
 		}
 	    }
 
-	  /* Reliable buffer to outgoing TCP/UDP (send up to CONTROL_SEND_ACK_MAX ACKs
-	     for previously received packets) */
-	  if (!to_link->len && reliable_can_send (ks->send_reliable))
-	    {
-	      int opcode;
-	      struct buffer b;
-
-	      buf = reliable_send (ks->send_reliable, &opcode);
-	      ASSERT (buf);
-	      b = *buf;
-	      INCR_SENT;
-
-	      write_control_auth (session, ks, &b, to_link_addr, opcode,
-				  CONTROL_SEND_ACK_MAX, true);
-	      *to_link = b;
-	      active = true;
-	      state_change = true;
-	      dmsg (D_TLS_DEBUG, "Reliable -> TCP/UDP");
-	      break;
-	    }
-
 #ifndef TLS_AGGREGATE_ACK
 	  /* Send 1 or more ACKs (each received control packet gets one ACK) */
 	  if (!to_link->len && !reliable_ack_empty (ks->rec_ack))
@@ -2283,10 +2421,37 @@ tls_process (struct tls_multi *multi,
 	  /* Outgoing Ciphertext to reliable buffer */
 	  if (ks->state >= S_START)
 	    {
+	      const int max_len = PAYLOAD_SIZE_DYNAMIC (&multi->opt.frame);
+
+	      /* First fill up the last queued packet if it has not left yet */
+	      buf = reliable_get_buf_output_unsent (ks->send_reliable, P_CONTROL_V1);
+	      if (buf && BLEN (buf) - (int) sizeof (packet_id_type) < max_len)
+		{
+		  struct buffer tail = *buf;
+		  int status;
+
+		  tail.offset += tail.len;
+		  tail.len = 0;
+		  status = key_state_read_ciphertext (&ks->ks_ssl, &tail,
+						      max_len - (BLEN (buf) - (int) sizeof (packet_id_type)));
+		  if (status == -1)
+		    {
+		      msg (D_TLS_ERRORS,
+			   "TLS Error: Ciphertext -> reliable TCP/UDP transport read error");
+		      goto error;
+		    }
+		  if (status == 1)
+		    {
+		      buf->len += tail.len;
+		      state_change = true;
+		      dmsg (D_TLS_DEBUG, "Outgoing Ciphertext -> Reliable (appended)");
+		    }
+		}
+
 	      buf = reliable_get_buf_output_sequenced (ks->send_reliable);
 	      if (buf)
 		{
-		  int status = key_state_read_ciphertext (&ks->ks_ssl, buf, PAYLOAD_SIZE_DYNAMIC (&multi->opt.frame));
+		  int status = key_state_read_ciphertext (&ks->ks_ssl, buf, max_len);
 		  if (status == -1)
 		    {
 		      msg (D_TLS_ERRORS,
@@ -2308,6 +2473,30 @@ tls_process (struct tls_multi *multi,
 
   update_time ();
 
+  /*
+   * Reliable buffer to outgoing TCP/UDP (send up to CONTROL_SEND_ACK_MAX
+   * ACKs for previously received packets).  This waits until the loop
+   * above has nothing left to do, so that everything the TLS object
+   * produced in this pass is packed into as few packets as possible,
+   * and the ACKs of everything received ride along.
+   */
+  if (!to_link->len && reliable_can_send (ks->send_reliable))
+    {
+      int opcode;
+      struct buffer b;
+
+      buf = reliable_send (ks->send_reliable, &opcode);
+      ASSERT (buf);
+      b = *buf;
+      INCR_SENT;
+
+      write_control_auth (session, ks, &b, to_link_addr, opcode,
+			  CONTROL_SEND_ACK_MAX, true);
+      *to_link = b;
+      active = true;
+      dmsg (D_TLS_DEBUG, "Reliable -> TCP/UDP");
+    }
+
 #ifdef TLS_AGGREGATE_ACK
   /* Send 1 or more ACKs (each received control packet gets one ACK) */
   if (!to_link->len && !reliable_ack_empty (ks->rec_ack))
@@ -2323,6 +2512,14 @@ tls_process (struct tls_multi *multi,
     }
 #endif
 
+  /* Return buffers of quiet key states to the pool, unless to_link
+     still refers to one of them */
+  if (!to_link->len)
+    {
+      key_state_release_idle_buffers (ks);
+      key_state_release_idle_buffers (ks_lame);
+    }
+
   /* When should we wake up again? */
   {
     if (ks->state >= S_INITIAL)
@@ -3010,7 +3207,8 @@ tls_pre_decrypt (struct tls_multi *multi,
 bool
 tls_pre_decrypt_lite (const struct tls_auth_standalone *tas,
 		      const struct link_socket_actual *from,
-		      const struct buffer *buf)
+		      const struct buffer *buf,
+		      bool *hmac_failed)
 
 {
   struct gc_arena gc = gc_new ();
@@ -3078,7 +3276,10 @@ tls_pre_decrypt_lite (const struct tls_auth_standalone *tas,
 	status = read_control_auth (&newbuf, &co, from);
 	free_buf (&newbuf);
 	if (!status)
-	  goto error;
+	  {
+	    *hmac_failed = true;
+	    goto error;
+	  }
 
 	/*
 	 * At this point, if --tls-auth is being used, we know that
@@ -81,13 +81,21 @@
  * can "hitch a ride" on an outgoing
  * non-P_ACK_V1 control packet.
  */
-#define CONTROL_SEND_ACK_MAX 4
+#define CONTROL_SEND_ACK_MAX RELIABLE_ACK_SIZE
 
 /*
  * Define number of buffers for send and receive in the reliability layer.
+ * --tls-window sets the send buffers, which are also the window size,
+ * and twice as many receive buffers.
  */
-#define TLS_RELIABLE_N_SEND_BUFFERS  4 /* also window size for reliablity layer */
-#define TLS_RELIABLE_N_REC_BUFFERS   8
+#define TLS_RELIABLE_N_SEND_BUFFERS  4 /* default --tls-window */
+#define TLS_RELIABLE_MAX_WINDOW      (RELIABLE_CAPACITY / 2)
+
+/*
+ * Maximum number of idle buffers kept in each of the control channel
+ * buffer pools, beyond which returned buffers are freed.
+ */
+#define TLS_BUF_POOL_MAX_FREE 1024
 
 /*
  * Various timeouts
@@ -231,6 +239,43 @@ void tls_multi_init_set_options(struct tls_multi* multi,
  */
 void tls_multi_free (struct tls_multi *multi, bool clear);
 
+/**
+ * Return the number of bytes of control channel buffer memory currently
+ * held by a \c tls_multi structure.
+ *
+ * Control channel buffers are borrowed from process-wide pools while a
+ * handshake is in progress or control channel messages are in flight,
+ * so this is zero for an idle client.
+ *
+ * @param multi        - The \c tls_multi structure to inspect.
+ */
+size_t tls_multi_buffer_size (const struct tls_multi *multi);
+
+/**
+ * Return the smoothed round trip time, in milliseconds, of control
+ * channel packets of the active key, or zero if none was measured.
+ *
+ * @param multi        - The \c tls_multi structure to inspect.
+ */
+int tls_multi_rtt (const struct tls_multi *multi);
+
+/**
+ * Return the number of data channel keys negotiated so far,
+ * counting the initial negotiation and every renegotiation.
+ *
+ * @param multi        - The \c tls_multi structure to inspect.
+ */
+int tls_multi_key_negotiations (const struct tls_multi *multi);
+
+/**
+ * Report the memory owned by the control channel buffer pools.
+ *
+ * @param in_use       - Set to the number of bytes lent out to \c
+ *                       key_state structures.
+ * @param pooled       - Set to the number of bytes kept for reuse.
+ */
+void tls_buffer_pool_stats (size_t *in_use, size_t *pooled);
+
 /** @} name Functions for initialization and cleanup of tls_multi structures */
 
 /** @} addtogroup control_processor */
@@ -337,6 +382,8 @@ bool tls_pre_decrypt (struct tls_multi *multi,
  *     this process.
  * @param from - The source address of the packet.
  * @param buf - A buffer structure containing the incoming packet.
+ * @param hmac_failed - Set to true if the packet was rejected because
+ *     it did not pass the HMAC firewall test.
  * 
  * @return
  * @li True if the packet is valid and a new VPN tunnel should be created
@@ -346,7 +393,8 @@ bool tls_pre_decrypt (struct tls_multi *multi,
  */
 bool tls_pre_decrypt_lite (const struct tls_auth_standalone *tas,
 			   const struct link_socket_actual *from,
-			   const struct buffer *buf);
+			   const struct buffer *buf,
+			   bool *hmac_failed);
 
 
 /**
@@ -196,6 +196,10 @@ struct key_state
   unsigned int auth_control_status;
   time_t acf_last_mod;
   char *auth_control_file;
+
+  /* deferred auth reported on the plugin auth completion pipe */
+  unsigned int plugin_auth_handle;
+  unsigned int plugin_auth_status;
 #endif
 #endif
 };
@@ -238,6 +242,7 @@ struct tls_options
   int transition_window;
   int handshake_window;
   interval_t packet_timeout;
+  int reliable_window;          /* --tls-window */
   int renegotiate_bytes;
   int renegotiate_packets;
   interval_t renegotiate_seconds;
@@ -297,6 +302,11 @@ struct tls_options
   struct man_def_auth_context *mda_context;
 #endif
 
+#ifdef PLUGIN_DEF_AUTH
+  /* handed back by plugin_auth_read when a deferred auth completes */
+  void *plugin_auth_context;
+#endif
+
 #ifdef ENABLE_X509_TRACK
   const struct x509_track *x509_track;
 #endif
@@ -452,6 +462,9 @@ struct tls_multi
 
   int n_sessions;               /**< Number of sessions negotiated thus
                                  *   far. */
+  int n_key_negotiations;       /**< Number of data channel keys
+                                 *   negotiated, including
+                                 *   renegotiations. */
 
   /*
    * Number of errors.
@@ -127,6 +127,18 @@ tls_common_name (const struct tls_multi *multi, const bool null)
     return "UNDEF";
 }
 
+/*
+ * Retrieve the username locked in by the first successful
+ * --auth-user-pass-verify of the given tunnel, or NULL.
+ */
+const char *
+tls_username (const struct tls_multi *multi)
+{
+  if (multi && multi->locked_username && strlen (multi->locked_username))
+    return multi->locked_username;
+  return NULL;
+}
+
 /*
  * Lock the common name for the given tunnel.
  */
@@ -526,28 +538,197 @@ verify_cert_call_command(const char *verify_command, struct env_set *es,
   return FAILURE;		/* Reject connection */
 }
 
+void
+serial_index_add (struct serial_index *si, const uint8_t *serial, size_t len)
+{
+  ASSERT (len <= 0xFFFF);
+  if (si->len + len + 2 > si->capacity)
+    {
+      si->capacity = max_int (4096, (si->len + len + 2) * 2);
+      si->data = (uint8_t *) realloc (si->data, si->capacity);
+      check_malloc_return (si->data);
+    }
+  if (si->n == si->n_alloc)
+    {
+      si->n_alloc = max_int (256, si->n_alloc * 2);
+      si->offsets = (size_t *) realloc (si->offsets, si->n_alloc * sizeof (size_t));
+      check_malloc_return (si->offsets);
+    }
+  si->offsets[si->n++] = si->len;
+  si->data[si->len++] = (uint8_t) (len >> 8);
+  si->data[si->len++] = (uint8_t) len;
+  memcpy (si->data + si->len, serial, len);
+  si->len += len;
+}
+
+static int
+serial_cmp (const uint8_t *a, const uint8_t *b, size_t b_len)
+{
+  const size_t a_len = (a[0] << 8) | a[1];
+  if (a_len != b_len)
+    return a_len < b_len ? -1 : 1;
+  return memcmp (a + 2, b, b_len);
+}
+
+static const uint8_t *serial_index_sort_data; /* GLOBAL, only set while sorting */
+
+static int
+serial_index_sort_cmp (const void *a, const void *b)
+{
+  const uint8_t *kb = serial_index_sort_data + *(const size_t *) b;
+  return serial_cmp (serial_index_sort_data + *(const size_t *) a, kb + 2, (kb[0] << 8) | kb[1]);
+}
+
+void
+serial_index_sort (struct serial_index *si)
+{
+  if (si->n)
+    {
+      serial_index_sort_data = si->data;
+      qsort (si->offsets, si->n, sizeof (size_t), serial_index_sort_cmp);
+      serial_index_sort_data = NULL;
+    }
+}
+
+bool
+serial_index_find (const struct serial_index *si, const uint8_t *serial, size_t len)
+{
+  int lo = 0;
+  int hi = si->n - 1;
+
+  while (lo <= hi)
+    {
+      const int mid = lo + (hi - lo) / 2;
+      const int c = serial_cmp (si->data + si->offsets[mid], serial, len);
+      if (c == 0)
+	return true;
+      else if (c < 0)
+	lo = mid + 1;
+      else
+	hi = mid - 1;
+    }
+  return false;
+}
+
+void
+serial_index_free (struct serial_index *si)
+{
+  free (si->data);
+  free (si->offsets);
+  CLEAR (*si);
+}
+
+bool
+crl_file_changed (const char *file, time_t *mtime, off_t *size, time_t loaded)
+{
+  struct stat s;
+
+  if (stat (file, &s))
+    return true;
+  if (s.st_mtime != *mtime || s.st_size != *size)
+    {
+      if (s.st_mtime > now)
+	msg (M_WARN, "WARNING: %s has a modification time in the future", file);
+      *mtime = s.st_mtime;
+      *size = s.st_size;
+      return true;
+    }
+
+  /*
+   * A change within the second we loaded it in would not show in
+   * mtime, so load once more, at most once per second.  This also
+   * bounds the cost when the mtime is in the future.
+   */
+  return *mtime >= loaded && now > loaded;
+}
+
+#if defined(HAVE_DIRENT_H) && !defined(WIN32)
+#define CRL_DIR_CACHE
+
+/*
+ * Names of the files in the --crl-verify directory, reloaded when
+ * the directory changes.
+ */
+static struct {
+  char *dir;
+  time_t mtime;
+  off_t size;
+  time_t loaded;
+  struct serial_index serials;
+} crl_dir_cache; /* GLOBAL */
+
+static void
+crl_dir_load (const char *crl_dir)
+{
+  DIR *d;
+  struct dirent *e;
+
+  serial_index_free (&crl_dir_cache.serials);
+  crl_dir_cache.loaded = now;
+
+  d = opendir (crl_dir);
+  if (!d)
+    {
+      msg (M_WARN | M_ERRNO, "VERIFY CRL: cannot read directory %s", crl_dir);
+      return;
+    }
+  while ((e = readdir (d)))
+    {
+      if (e->d_name[0] != '.')
+	serial_index_add (&crl_dir_cache.serials, (const uint8_t *) e->d_name, strlen (e->d_name));
+    }
+  closedir (d);
+
+  serial_index_sort (&crl_dir_cache.serials);
+  msg (D_TLS_DEBUG_LOW, "VERIFY CRL: loaded %d serial numbers from %s",
+       crl_dir_cache.serials.n, crl_dir);
+}
+
+#endif
+
 /*
  * check peer cert against CRL directory
  */
 static result_t
 verify_check_crl_dir(const char *crl_dir, x509_cert_t *cert)
 {
-  char fn[256];
-  int fd;
   char *serial = x509_get_serial(cert);
+  bool revoked;
 
-  if (!openvpn_snprintf(fn, sizeof(fn), "%s%c%s", crl_dir, OS_SPECIFIC_DIRSEP, serial))
+#ifdef CRL_DIR_CACHE
+  if (!crl_dir_cache.dir || strcmp (crl_dir_cache.dir, crl_dir))
     {
-      msg (D_HANDSHAKE, "VERIFY CRL: filename overflow");
-      x509_free_serial(serial);
-      return FAILURE;
+      free (crl_dir_cache.dir);
+      crl_dir_cache.dir = string_alloc (crl_dir, NULL);
+      crl_dir_cache.mtime = 0;
+      crl_dir_cache.size = 0;
     }
-  fd = open (fn, O_RDONLY);
-  if (fd >= 0)
+  if (crl_file_changed (crl_dir, &crl_dir_cache.mtime, &crl_dir_cache.size, crl_dir_cache.loaded))
+    crl_dir_load (crl_dir);
+
+  revoked = serial && serial_index_find (&crl_dir_cache.serials, (const uint8_t *) serial, strlen (serial));
+#else
+  {
+    char fn[256];
+    int fd;
+
+    if (!openvpn_snprintf(fn, sizeof(fn), "%s%c%s", crl_dir, OS_SPECIFIC_DIRSEP, serial))
+      {
+	msg (D_HANDSHAKE, "VERIFY CRL: filename overflow");
+	x509_free_serial(serial);
+	return FAILURE;
+      }
+    fd = open (fn, O_RDONLY);
+    revoked = (fd >= 0);
+    if (fd >= 0)
+      close(fd);
+  }
+#endif
+
+  if (revoked)
     {
       msg (D_HANDSHAKE, "VERIFY CRL: certificate serial number %s is revoked", serial);
       x509_free_serial(serial);
-      close(fd);
       return FAILURE;
     }
 
@@ -772,6 +953,37 @@ key_state_test_auth_control_file (struct key_state *ks)
   return ACF_DISABLED;
 }
 
+/*
+ * plugin auth completion pipe functions
+ */
+
+void
+key_state_rm_plugin_auth (struct key_state *ks, const struct plugin_list *plugins)
+{
+  if (ks && ks->plugin_auth_handle)
+    {
+      if (ks->plugin_auth_status == ACF_UNDEFINED)
+	plugin_auth_cancel (plugins, ks->plugin_auth_handle, false);
+      ks->plugin_auth_handle = 0;
+    }
+}
+
+static unsigned int
+key_state_test_plugin_auth (struct key_state *ks, const struct plugin_list *plugins)
+{
+  if (ks && ks->plugin_auth_handle)
+    {
+      if (ks->plugin_auth_status == ACF_UNDEFINED && now >= ks->auth_deferred_expire)
+	{
+	  msg (D_TLS_ERRORS, "TLS Auth Error: deferred plugin authentication timed out");
+	  plugin_auth_cancel (plugins, ks->plugin_auth_handle, true);
+	  ks->plugin_auth_status = ACF_FAILED;
+	}
+      return ks->plugin_auth_status;
+    }
+  return ACF_DISABLED;
+}
+
 #endif
 
 /*
@@ -830,7 +1042,8 @@ tls_authentication_status (struct tls_multi *multi, const int latency)
 		  unsigned int s1 = ACF_DISABLED;
 		  unsigned int s2 = ACF_DISABLED;
 #ifdef PLUGIN_DEF_AUTH
-		  s1 = key_state_test_auth_control_file (ks);
+		  s1 = acf_merge[(key_state_test_auth_control_file (ks)<<2)
+				 + key_state_test_plugin_auth (ks, multi->opt.plugins)];
 #endif /* PLUGIN_DEF_AUTH */
 #ifdef MANAGEMENT_DEF_AUTH
 		  s2 = man_def_auth_test (ks);
@@ -900,6 +1113,36 @@ tls_authenticate_key (struct tls_multi *multi, const unsigned int mda_key_id, co
 }
 #endif
 
+#ifdef PLUGIN_DEF_AUTH
+/*
+ * For deferred auth, this is where the event loop delivers (on server)
+ * results read from the plugin auth completion pipe.
+ */
+bool
+tls_authenticate_plugin_key (struct tls_multi *multi, const unsigned int handle, const bool auth)
+{
+  bool ret = false;
+  if (multi && handle)
+    {
+      int i;
+      for (i = 0; i < KEY_SCAN_SIZE; ++i)
+	{
+	  struct key_state *ks = multi->key_scan[i];
+	  if (ks->plugin_auth_handle == handle && ks->plugin_auth_status == ACF_UNDEFINED)
+	    {
+	      ks->plugin_auth_status = auth ? ACF_SUCCEEDED : ACF_FAILED;
+	      ret = true;
+	    }
+	}
+
+      /* don't let TLS_MULTI_AUTH_STATUS_INTERVAL delay the result */
+      if (ret)
+	multi->tas_last = 0;
+    }
+  return ret;
+}
+#endif
+
 
 /* ****************************************************************************
  * Functions to verify username and password
@@ -996,6 +1239,11 @@ verify_user_pass_plugin (struct tls_session *session, const struct user_pass *up
   /* Is username defined? */
   if ((session->opt->ssl_flags & SSLF_AUTH_USER_PASS_OPTIONAL) || strlen (up->username))
     {
+#ifdef PLUGIN_DEF_AUTH
+      unsigned int handle;
+      int n_async, n_legacy;
+#endif
+
       /* set username/password in private env space */
       setenv_str (session->opt->es, "username", raw_username);
       setenv_str (session->opt->es, "password", up->password);
@@ -1007,17 +1255,32 @@ verify_user_pass_plugin (struct tls_session *session, const struct user_pass *up
       setenv_untrusted (session);
 
 #ifdef PLUGIN_DEF_AUTH
-      /* generate filename for deferred auth control file */
-      key_state_gen_auth_control_file (ks, session->opt);
-#endif
+      /* generate filename for deferred auth control file, unless
+	 every plugin reports on the auth completion pipe */
+      if (plugin_auth_legacy_defined (session->opt->plugins))
+	key_state_gen_auth_control_file (ks, session->opt);
+
+      key_state_rm_plugin_auth (ks, session->opt->plugins);
+      handle = plugin_auth_new_handle (session->opt->plugins);
 
       /* call command */
-      retval = plugin_call (session->opt->plugins, OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY, NULL, NULL, session->opt->es);
+      retval = plugin_call_deferred (session->opt->plugins, OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY, NULL,
+				     session->opt->es, handle, &n_async, &n_legacy);
 
-#ifdef PLUGIN_DEF_AUTH
-      /* purge auth control filename (and file itself) for non-deferred returns */
-      if (retval != OPENVPN_PLUGIN_FUNC_DEFERRED)
+      /* purge auth control filename (and file itself) unless a plugin deferred to it */
+      if (retval != OPENVPN_PLUGIN_FUNC_DEFERRED || !n_legacy)
 	key_state_rm_auth_control_file (ks);
+
+      /* wait for the plugins which deferred to the auth completion pipe */
+      if (retval == OPENVPN_PLUGIN_FUNC_DEFERRED && n_async)
+	{
+	  ks->plugin_auth_handle = handle;
+	  ks->plugin_auth_status = ACF_UNDEFINED;
+	  plugin_auth_begin (session->opt->plugins, handle, n_async, session->opt->plugin_auth_context);
+	}
+#else
+      /* call command */
+      retval = plugin_call (session->opt->plugins, OPENVPN_PLUGIN_AUTH_USER_PASS_VERIFY, NULL, NULL, session->opt->es);
 #endif
 
       setenv_del (session->opt->es, "password");
@@ -93,6 +93,28 @@ int tls_authentication_status (struct tls_multi *multi, const int latency);
  */
 void key_state_rm_auth_control_file (struct key_state *ks);
 
+#ifdef PLUGIN_DEF_AUTH
+/**
+ * Cancel the given key state's pending plugin auth request, if any.
+ *
+ * @param ks	The key state to cancel the request for
+ * @param plugins	The plugins the request was made to
+ */
+void key_state_rm_plugin_auth (struct key_state *ks, const struct plugin_list *plugins);
+
+/**
+ * Apply the result of a deferred plugin auth request which was
+ * reported on the auth completion pipe.
+ *
+ * @param multi	The tunnel the request was made for
+ * @param handle	The request's auth handle
+ * @param auth	Whether the plugins accepted the credentials
+ *
+ * @return true if a key state of \a multi was waiting for \a handle
+ */
+bool tls_authenticate_plugin_key (struct tls_multi *multi, const unsigned int handle, const bool auth);
+#endif
+
 /**
  * Frees the given set of certificate hashes.
  *
@@ -122,6 +144,15 @@ void tls_lock_common_name (struct tls_multi *multi);
  */
 const char *tls_common_name (const struct tls_multi* multi, const bool null);
 
+/**
+ * Returns the username locked in for the given tunnel
+ *
+ * @param multi	The tunnel to return the username for
+ *
+ * @return the username, or NULL if none was verified.
+ */
+const char *tls_username (const struct tls_multi *multi);
+
 #ifdef ENABLE_PF
 
 /**
@@ -219,6 +250,50 @@ void x509_track_add (const struct x509_track **ll_head, const char *name, int ms
 /** Do not perform Netscape certificate type verification */
 #define NS_CERT_CHECK_CLIENT (1<<1)
 
+/*
+ * Revoked serial numbers of a CRL file or CRL directory, loaded once
+ * and kept sorted so that checking a certificate is a binary search.
+ */
+
+/** A set of serial numbers, each an opaque byte string */
+struct serial_index {
+  uint8_t *data;		/**< Length-prefixed serials, back to back */
+  size_t len;			/**< Bytes used in \c data */
+  size_t capacity;		/**< Bytes allocated for \c data */
+  size_t *offsets;		/**< Offset of each serial in \c data */
+  int n;			/**< Number of serials */
+  int n_alloc;			/**< Entries allocated for \c offsets */
+};
+
+/**
+ * Add a serial number to the index.  \c serial_index_sort must be
+ * called before the index is searched.
+ */
+void serial_index_add (struct serial_index *si, const uint8_t *serial, size_t len);
+
+/** Sort the index after the last \c serial_index_add */
+void serial_index_sort (struct serial_index *si);
+
+/** Return true if \c serial is in the index */
+bool serial_index_find (const struct serial_index *si, const uint8_t *serial, size_t len);
+
+/** Free the serials and reset the index to empty */
+void serial_index_free (struct serial_index *si);
+
+/**
+ * Check whether a cached copy of \c file must be reloaded.
+ *
+ * @param file		File or directory to check
+ * @param mtime		Modification time of the cached copy, updated
+ * @param size		Size of the cached copy, updated
+ * @param loaded	Time the cached copy was loaded
+ *
+ * @return		\c true if the file changed since it was loaded, or
+ * 			was modified in or after the second it was loaded
+ * 			in and was last loaded more than a second ago.
+ */
+bool crl_file_changed (const char *file, time_t *mtime, off_t *size, time_t loaded);
+
 /*
  * TODO: document
  */
@@ -256,7 +256,9 @@ result_t x509_verify_cert_eku (x509_cert_t *x509, const char * const expected_oi
 result_t x509_write_pem(FILE *peercert_file, x509_cert_t *peercert);
 
 /*
- * Check the certificate against a CRL file.
+ * Check the certificate against a CRL file.  The CRL is parsed once,
+ * with its revoked serial numbers put in a \c serial_index, and only
+ * parsed again when \c crl_file_changed reports a new version.
  *
  * @param crl_file	File name of the CRL file
  * @param cert		Certificate to verify
@@ -531,16 +531,46 @@ x509_write_pem(FILE *peercert_file, X509 *peercert)
 #endif /* OPENSSL_VERSION_NUMBER */
 
 /*
- * check peer cert against CRL
+ * The --crl-verify file, parsed once and kept until it changes.
  */
-result_t
-x509_verify_crl(const char *crl_file, X509 *peer_cert, const char *subject)
+static struct {
+  char *file;
+  time_t mtime;
+  off_t size;
+  time_t loaded;
+  X509_NAME *issuer;
+  struct serial_index revoked;
+} crl_cache; /* GLOBAL */
+
+/*
+ * Index a serial number by its DER encoding, so that serials which
+ * differ only in sign do not compare equal.
+ */
+static void
+crl_serial_der (ASN1_INTEGER *serial, uint8_t *buf, size_t *len)
+{
+  const int n = i2d_ASN1_INTEGER (serial, NULL);
+  uint8_t *p = buf;
+
+  *len = 0;
+  if (n > 0 && n <= 256)
+    *len = i2d_ASN1_INTEGER (serial, &p);
+}
+
+static void
+crl_load (const char *crl_file)
 {
   X509_CRL *crl=NULL;
-  X509_REVOKED *revoked;
   BIO *in=NULL;
   int n,i;
-  result_t retval = FAILURE;
+
+  serial_index_free (&crl_cache.revoked);
+  if (crl_cache.issuer)
+    {
+      X509_NAME_free (crl_cache.issuer);
+      crl_cache.issuer = NULL;
+    }
+  crl_cache.loaded = now;
 
   in=BIO_new(BIO_s_file());
 
@@ -558,29 +588,66 @@ x509_verify_crl(const char *crl_file, X509 *peer_cert, const char *subject)
     goto end;
   }
 
-  if (X509_NAME_cmp(X509_CRL_get_issuer(crl), X509_get_issuer_name(peer_cert)) != 0) {
-    msg (M_WARN, "CRL: CRL %s is from a different issuer than the issuer of "
-	"certificate %s", crl_file, subject);
-    retval = SUCCESS;
-    goto end;
-  }
+  crl_cache.issuer = X509_NAME_dup (X509_CRL_get_issuer(crl));
 
   n = sk_X509_REVOKED_num(X509_CRL_get_REVOKED(crl));
   for (i = 0; i < n; i++) {
-    revoked = (X509_REVOKED *)sk_X509_REVOKED_value(X509_CRL_get_REVOKED(crl), i);
-    if (ASN1_INTEGER_cmp(revoked->serialNumber, X509_get_serialNumber(peer_cert)) == 0) {
-      msg (D_HANDSHAKE, "CRL CHECK FAILED: %s is REVOKED",subject);
-      goto end;
-    }
-  }
+    X509_REVOKED *revoked = (X509_REVOKED *)sk_X509_REVOKED_value(X509_CRL_get_REVOKED(crl), i);
+    uint8_t der[256];
+    size_t len;
 
-  retval = SUCCESS;
-  msg (D_HANDSHAKE, "CRL CHECK OK: %s",subject);
+    crl_serial_der (revoked->serialNumber, der, &len);
+    if (len)
+      serial_index_add (&crl_cache.revoked, der, len);
+  }
+  serial_index_sort (&crl_cache.revoked);
+  msg (D_TLS_DEBUG_LOW, "CRL: loaded %d revoked serial numbers from %s",
+       crl_cache.revoked.n, crl_file);
 
 end:
   BIO_free(in);
   if (crl)
     X509_CRL_free (crl);
+}
 
-  return retval;
+/*
+ * check peer cert against CRL
+ */
+result_t
+x509_verify_crl(const char *crl_file, X509 *peer_cert, const char *subject)
+{
+  uint8_t der[256];
+  size_t len;
+
+  if (!crl_cache.file || strcmp (crl_cache.file, crl_file))
+    {
+      free (crl_cache.file);
+      crl_cache.file = string_alloc (crl_file, NULL);
+      crl_cache.mtime = 0;
+      crl_cache.size = 0;
+    }
+  if (crl_file_changed (crl_file, &crl_cache.mtime, &crl_cache.size, crl_cache.loaded))
+    crl_load (crl_file);
+
+  if (!crl_cache.issuer)
+    return FAILURE;
+
+  if (X509_NAME_cmp(crl_cache.issuer, X509_get_issuer_name(peer_cert)) != 0) {
+    msg (M_WARN, "CRL: CRL %s is from a different issuer than the issuer of "
+	"certificate %s", crl_file, subject);
+    return SUCCESS;
+  }
+
+  crl_serial_der (X509_get_serialNumber(peer_cert), der, &len);
+  if (!len) {
+    msg (D_HANDSHAKE, "CRL CHECK FAILED: cannot encode serial number of %s", subject);
+    return FAILURE;
+  }
+  if (serial_index_find (&crl_cache.revoked, der, len)) {
+    msg (D_HANDSHAKE, "CRL CHECK FAILED: %s is REVOKED",subject);
+    return FAILURE;
+  }
+
+  msg (D_HANDSHAKE, "CRL CHECK OK: %s",subject);
+  return SUCCESS;
 }
@@ -380,40 +380,86 @@ x509_write_pem(FILE *peercert_file, x509_cert *peercert)
     return FAILURE;
 }
 
+/*
+ * The --crl-verify file, parsed once and kept until it changes.
+ */
+static struct {
+  char *file;
+  time_t mtime;
+  off_t size;
+  time_t loaded;
+  bool valid;
+  x509_crl crl;
+  struct serial_index revoked;
+} crl_cache; /* GLOBAL */
+
+static void
+crl_load (const char *crl_file)
+{
+  x509_crl_entry *cur;
+
+  serial_index_free (&crl_cache.revoked);
+  x509_crl_free (&crl_cache.crl);
+  CLEAR (crl_cache.crl);
+  crl_cache.valid = false;
+  crl_cache.loaded = now;
+
+  if (x509parse_crlfile(&crl_cache.crl, crl_file) != 0)
+    {
+      msg (M_ERR, "CRL: cannot read CRL from file %s", crl_file);
+      return;
+    }
+  crl_cache.valid = true;
+
+  /* same entries as x509parse_revoked looks at */
+  for (cur = &crl_cache.crl.entry; cur != NULL && cur->serial.len != 0; cur = cur->next)
+    serial_index_add (&crl_cache.revoked, cur->serial.p, cur->serial.len);
+  serial_index_sort (&crl_cache.revoked);
+  msg (D_TLS_DEBUG_LOW, "CRL: loaded %d revoked serial numbers from %s",
+       crl_cache.revoked.n, crl_file);
+}
+
 /*
  * check peer cert against CRL
  */
 result_t
 x509_verify_crl(const char *crl_file, x509_cert *cert, const char *subject)
 {
-  result_t retval = FAILURE;
-  x509_crl crl = {0};
+  x509_crl *crl = &crl_cache.crl;
 
-  if (x509parse_crlfile(&crl, crl_file) != 0)
+  if (!crl_cache.file || strcmp (crl_cache.file, crl_file))
     {
-      msg (M_ERR, "CRL: cannot read CRL from file %s", crl_file);
-      goto end;
+      free (crl_cache.file);
+      crl_cache.file = string_alloc (crl_file, NULL);
+      crl_cache.mtime = 0;
+      crl_cache.size = 0;
     }
+  if (crl_file_changed (crl_file, &crl_cache.mtime, &crl_cache.size, crl_cache.loaded))
+    crl_load (crl_file);
 
-  if(cert->issuer_raw.len != crl.issuer_raw.len ||
-      memcmp(crl.issuer_raw.p, cert->issuer_raw.p, crl.issuer_raw.len) != 0)
+  if (!crl_cache.valid)
+    return FAILURE;
+
+  if(cert->issuer_raw.len != crl->issuer_raw.len ||
+      memcmp(crl->issuer_raw.p, cert->issuer_raw.p, crl->issuer_raw.len) != 0)
     {
       msg (M_WARN, "CRL: CRL %s is from a different issuer than the issuer of "
 	  "certificate %s", crl_file, subject);
-      retval = SUCCESS;
-      goto end;
+      return SUCCESS;
     }
 
-  if (0 != x509parse_revoked(cert, &crl))
+  /*
+   * The index only says whether the serial is listed; let
+   * x509parse_revoked decide, since it also checks the
+   * revocation date.
+   */
+  if (serial_index_find (&crl_cache.revoked, cert->serial.p, cert->serial.len)
+      && 0 != x509parse_revoked(cert, crl))
     {
       msg (D_HANDSHAKE, "CRL CHECK FAILED: %s is REVOKED", subject);
-      goto end;
+      return FAILURE;
     }
 
-  retval = SUCCESS;
   msg (D_HANDSHAKE, "CRL CHECK OK: %s",subject);
-
-end:
-  x509_crl_free(&crl);
-  return retval;
+  return SUCCESS;
 }
@@ -64,6 +64,7 @@ status_open (const char *filename,
       so->msglevel = msglevel;
       so->vout = vout;
       so->fd = -1;
+      so->new_fd = -1;
       buf_reset (&so->read_buf);
       event_timeout_clear (&so->et);
       if (filename)
@@ -113,6 +114,21 @@ status_open (const char *filename,
 	      /* allocate read buffer */
 	      if (so->flags & STATUS_OUTPUT_READ)
 		so->read_buf = alloc_buf (512);
+
+	      /* allocate write buffer */
+	      if (so->flags & STATUS_OUTPUT_WRITE)
+		so->write_buf = alloc_buf (STATUS_WRITE_BUF_SIZE);
+
+#ifndef WIN32
+	      if (so->flags == STATUS_OUTPUT_WRITE)
+		{
+		  struct gc_arena gc = gc_new ();
+		  struct buffer name = alloc_buf_gc (strlen (filename) + 5, &gc);
+		  buf_printf (&name, "%s.tmp", filename);
+		  so->new_filename = string_alloc (BSTR (&name), NULL);
+		  gc_free (&gc);
+		}
+#endif
 	    }
 	  else
 	    {
@@ -153,11 +169,61 @@ status_trigger_tv (struct status_output *so, struct timeval *tv)
     return false;
 }
 
+/*
+ * Write out lines buffered by status_printf.
+ */
+static void
+status_write (struct status_output *so)
+{
+  if (buf_defined (&so->write_buf) && BLEN (&so->write_buf))
+    {
+      const int len = BLEN (&so->write_buf);
+      if (so->new_fd >= 0)
+	{
+	  if (!so->new_errors && write (so->new_fd, BPTR (&so->write_buf), len) != len)
+	    so->new_errors = true;
+	}
+      else if (!so->errors && write (so->fd, BPTR (&so->write_buf), len) != len)
+	so->errors = true;
+      buf_reset_len (&so->write_buf);
+    }
+}
+
+/*
+ * Abandon a partly written next version of the file.
+ */
+static void
+status_discard_new (struct status_output *so)
+{
+  if (so->new_fd >= 0)
+    {
+      close (so->new_fd);
+      so->new_fd = -1;
+      unlink (so->new_filename);
+    }
+}
+
 void
 status_reset (struct status_output *so)
 {
   if (so && so->fd >= 0)
-    lseek (so->fd, (off_t)0, SEEK_SET);
+    {
+      if (buf_defined (&so->write_buf))
+	buf_reset_len (&so->write_buf);
+      if (so->new_filename)
+	{
+	  status_discard_new (so);
+	  so->new_fd = open (so->new_filename,
+			     O_CREAT | O_TRUNC | O_WRONLY,
+			     S_IRUSR | S_IWUSR);
+	  so->new_errors = false;
+	  if (so->new_fd >= 0)
+	    return;
+	  msg (M_WARN|M_ERRNO, "Note: cannot open %s, updating %s in place",
+	       so->new_filename, so->filename);
+	}
+      lseek (so->fd, (off_t)0, SEEK_SET);
+    }
 }
 
 void
@@ -165,21 +231,40 @@ status_flush (struct status_output *so)
 {
   if (so && so->fd >= 0 && (so->flags & STATUS_OUTPUT_WRITE))
     {
-#if defined(HAVE_FTRUNCATE)
-      {
-	const off_t off = lseek (so->fd, (off_t)0, SEEK_CUR);
-	if (ftruncate (so->fd, off) != 0) {
-	  msg (M_WARN, "Failed to truncate status file: %s", strerror(errno));
+      status_write (so);
+
+      if (so->new_fd >= 0)
+	{
+	  if (so->new_errors)
+	    msg (M_WARN, "Note: cannot write %s, %s not updated", so->new_filename, so->filename);
+	  else if (rename (so->new_filename, so->filename) != 0)
+	    msg (M_WARN|M_ERRNO, "Note: cannot rename %s to %s", so->new_filename, so->filename);
+	  else
+	    {
+	      close (so->fd);
+	      so->fd = so->new_fd;
+	      so->new_fd = -1;
+	    }
+	  status_discard_new (so);
 	}
-      }
+      else
+	{
+#if defined(HAVE_FTRUNCATE)
+	  {
+	    const off_t off = lseek (so->fd, (off_t)0, SEEK_CUR);
+	    if (ftruncate (so->fd, off) != 0) {
+	      msg (M_WARN, "Failed to truncate status file: %s", strerror(errno));
+	    }
+	  }
 #elif defined(HAVE_CHSIZE)
-      {
-	const long off = (long) lseek (so->fd, (off_t)0, SEEK_CUR);
-	chsize (so->fd, off);
-      }
+	  {
+	    const long off = (long) lseek (so->fd, (off_t)0, SEEK_CUR);
+	    chsize (so->fd, off);
+	  }
 #else
 #warning both ftruncate and chsize functions appear to be missing from this OS
 #endif
+	}
 
       /* clear read buffer */
       if (buf_defined (&so->read_buf))
@@ -200,13 +285,21 @@ status_close (struct status_output *so)
 	ret = false;
       if (so->fd >= 0)
 	{
+	  status_write (so);
+	  if (so->errors)
+	    ret = false;
 	  if (close (so->fd) < 0)
 	    ret = false;
 	}
+      status_discard_new (so);
       if (so->filename)
 	free (so->filename);
+      if (so->new_filename)
+	free (so->new_filename);
       if (buf_defined (&so->read_buf))
 	free_buf (&so->read_buf);
+      if (buf_defined (&so->write_buf))
+	free_buf (&so->write_buf);
       free (so);
     }
   else
@@ -241,11 +334,10 @@ status_printf (struct status_output *so, const char *format, ...)
 	  int len;
 	  strcat (buf, "\n");
 	  len = strlen (buf);
-	  if (len > 0)
-	    {
-	      if (write (so->fd, buf, len) != len)
-		so->errors = true;
-	    }
+	  if (len > BCAP (&so->write_buf))
+	    status_write (so);
+	  if (!buf_write (&so->write_buf, buf, len))
+	    so->errors = true;
 	}
 
       if (so->vout && !so->errors)
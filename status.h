@@ -46,6 +46,9 @@ virtual_output_print (const struct virtual_output *vo, const unsigned int flags,
  * printf-style interface for inputting/outputting status info
  */
 
+/* status_printf output is written to the file in chunks of this size */
+#define STATUS_WRITE_BUF_SIZE 16384
+
 struct status_output
 {
 # define STATUS_OUTPUT_READ  (1<<0)
@@ -55,9 +58,16 @@ struct status_output
   char *filename;
   int fd;
   int msglevel;
+
+  /* next version of a write-only file, renamed over it by status_flush */
+  char *new_filename;
+  int new_fd;
+  bool new_errors;
+
   const struct virtual_output *vout;
 
   struct buffer read_buf;
+  struct buffer write_buf;  /* lines not yet written to fd */
 
   struct event_timeout et;
 
@@ -72,6 +82,13 @@ struct status_output *status_open (const char *filename,
 
 bool status_trigger_tv (struct status_output *so, struct timeval *tv);
 bool status_trigger (struct status_output *so);
+
+/*
+ * Output between status_reset and status_flush replaces the
+ * contents of the file.  A write-only file is replaced atomically
+ * where rename() allows it, so that readers never see a partly
+ * written version.
+ */
 void status_reset (struct status_output *so);
 void status_flush (struct status_output *so);
 bool status_close (struct status_output *so);
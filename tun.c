@@ -606,6 +606,128 @@ void delete_route_connected_v6_net(struct tuntap * tt,
 #endif
 
 
+#if defined(TARGET_LINUX) && defined(ENABLE_RTNETLINK)
+
+/*
+ * Bring the device up and assign its addresses over rtnetlink, in
+ * one batch, instead of running ip/ifconfig.  Returns false if
+ * rtnetlink is not in use, so the caller should run the commands.
+ */
+static bool
+do_ifconfig_rtnl (struct tuntap *tt, const char *actual, int tun_mtu, bool tun, bool do_ipv6)
+{
+  struct gc_arena gc;
+  struct buffer what;
+  const int ifindex = if_nametoindex (actual);
+  const in_addr_t local = htonl (tt->local);
+  const in_addr_t remote_netmask = htonl (tt->remote_netmask);
+  const in_addr_t broadcast = htonl (tt->broadcast);
+  bool status = true;
+
+  if (!rtnl_batch_begin (tt->options.route_method))
+    return false;
+  if (!ifindex)
+    msg (M_FATAL, "Linux rtnetlink ifconfig failed: no such device %s", actual);
+
+  gc_init (&gc);
+  what = alloc_buf_gc (256, &gc);
+
+  buf_printf (&what, "rtnetlink: link set dev %s up mtu %d", actual, tun_mtu);
+  msg (M_INFO, "%s", BSTR (&what));
+  rtnl_link_up (ifindex, tun_mtu, BSTR (&what), &status);
+
+  buf_reset_len (&what);
+  if (tun)
+    {
+      buf_printf (&what, "rtnetlink: addr add dev %s local %s peer %s",
+		  actual,
+		  print_in_addr_t (tt->local, 0, &gc),
+		  print_in_addr_t (tt->remote_netmask, 0, &gc));
+      msg (M_INFO, "%s", BSTR (&what));
+      rtnl_addr (true, AF_INET, ifindex, &local, &remote_netmask, 32, NULL,
+		 BSTR (&what), &status);
+    }
+  else
+    {
+      const int netbits = count_netmask_bits (print_in_addr_t (tt->remote_netmask, 0, &gc));
+      buf_printf (&what, "rtnetlink: addr add dev %s %s/%d broadcast %s",
+		  actual,
+		  print_in_addr_t (tt->local, 0, &gc),
+		  netbits,
+		  print_in_addr_t (tt->broadcast, 0, &gc));
+      msg (M_INFO, "%s", BSTR (&what));
+      rtnl_addr (true, AF_INET, ifindex, &local, NULL, netbits, &broadcast,
+		 BSTR (&what), &status);
+    }
+
+  if (do_ipv6)
+    {
+      buf_reset_len (&what);
+      buf_printf (&what, "rtnetlink: -6 addr add %s/%d dev %s",
+		  print_in6_addr (tt->local_ipv6, 0, &gc),
+		  tt->netbits_ipv6,
+		  actual);
+      msg (M_INFO, "%s", BSTR (&what));
+      rtnl_addr (true, AF_INET6, ifindex, &tt->local_ipv6, NULL, tt->netbits_ipv6, NULL,
+		 BSTR (&what), &status);
+    }
+
+  rtnl_batch_end ();
+  if (!status)
+    msg (M_FATAL, "Linux rtnetlink ifconfig failed");
+
+  gc_free (&gc);
+  return true;
+}
+
+/*
+ * Remove the IPv4 address assigned by do_ifconfig_rtnl.  Returns
+ * false if rtnetlink is not in use.
+ */
+static bool
+undo_ifconfig_rtnl (struct tuntap *tt)
+{
+  struct gc_arena gc;
+  struct buffer what;
+  const int ifindex = if_nametoindex (tt->actual_name);
+  const in_addr_t local = htonl (tt->local);
+  const in_addr_t remote_netmask = htonl (tt->remote_netmask);
+
+  if (!ifindex || !rtnl_batch_begin (tt->options.route_method))
+    return false;
+
+  gc_init (&gc);
+  what = alloc_buf_gc (256, &gc);
+
+  if (is_tun_p2p (tt))
+    {
+      buf_printf (&what, "rtnetlink: addr del dev %s local %s peer %s",
+		  tt->actual_name,
+		  print_in_addr_t (tt->local, 0, &gc),
+		  print_in_addr_t (tt->remote_netmask, 0, &gc));
+      msg (M_INFO, "%s", BSTR (&what));
+      rtnl_addr (false, AF_INET, ifindex, &local, &remote_netmask, 32, NULL,
+		 BSTR (&what), NULL);
+    }
+  else
+    {
+      const int netbits = count_netmask_bits (print_in_addr_t (tt->remote_netmask, 0, &gc));
+      buf_printf (&what, "rtnetlink: addr del dev %s %s/%d",
+		  tt->actual_name,
+		  print_in_addr_t (tt->local, 0, &gc),
+		  netbits);
+      msg (M_INFO, "%s", BSTR (&what));
+      rtnl_addr (false, AF_INET, ifindex, &local, NULL, netbits, NULL,
+		 BSTR (&what), NULL);
+    }
+
+  rtnl_batch_end ();
+  gc_free (&gc);
+  return true;
+}
+
+#endif
+
 /* execute the ifconfig command through the shell */
 void
 do_ifconfig (struct tuntap *tt,
@@ -668,6 +790,12 @@ do_ifconfig (struct tuntap *tt,
 
 
 #if defined(TARGET_LINUX)
+#ifdef ENABLE_RTNETLINK
+      if (do_ifconfig_rtnl (tt, actual, tun_mtu, tun, do_ipv6))
+	tt->did_ifconfig = true;
+      else
+#endif
+      {
 #ifdef CONFIG_FEATURE_IPROUTE
 	/*
 	 * Set the MTU for the device
@@ -757,6 +885,7 @@ do_ifconfig (struct tuntap *tt,
       tt->did_ifconfig = true;
 
 #endif /*CONFIG_FEATURE_IPROUTE*/
+      }
 #elif defined(TARGET_SOLARIS)
 
       /* Solaris 2.6 (and 7?) cannot set all parameters in one go...
@@ -1528,7 +1657,11 @@ close_tun (struct tuntap *tt)
 {
   if (tt)
     {
-	if (tt->type != DEV_TYPE_NULL && tt->did_ifconfig)
+	if (tt->type != DEV_TYPE_NULL && tt->did_ifconfig
+#ifdef ENABLE_RTNETLINK
+	    && !undo_ifconfig_rtnl (tt)
+#endif
+	    )
 	  {
 	    struct argv argv;
 	    struct gc_arena gc = gc_new ();
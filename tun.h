@@ -107,6 +107,7 @@ struct tuntap_options {
 
 struct tuntap_options {
   int txqueuelen;
+  int route_method; /* ROUTE_METHOD_x, also used for ifconfig */
 };
 
 #else